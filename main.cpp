@@ -1,48 +1,44 @@
 #include "wintoastlib.h"
+#include "wintoastrequest.h"
+#include "wintoastbench.h"
+#include <fstream>
 #include <string>
 
 using namespace WinToastLib;
 
 
-//callback handlers
-class CustomHandler : public IWinToastHandler {
-public:
-    void toastActivated() const {
+// Prints how the toast ended and returns the matching exit code.
+int reportOutcome(_In_ const WinToastResult& result) {
+    switch (result.kind) {
+    case WinToastResult::Activated:
         std::wcout << L"Toast activated: The user clicked in this toast" << std::endl;
-        exit(0);
-    }
-
-    void toastActivated(int actionIndex) const {
-        std::wcout << L"Toast activated: The user clicked on action #" << actionIndex << std::endl;
-        exit(16 + actionIndex);
-    }
-
-    void toastDismissed(WinToastDismissalReason state) const {
-        switch (state) {
-        case UserCanceled:
+        return 0;
+    case WinToastResult::ActionActivated:
+        std::wcout << L"Toast activated: The user clicked on action #" << result.actionIndex << std::endl;
+        return 16 + result.actionIndex;
+    case WinToastResult::Dismissed:
+        switch (result.reason) {
+        case IWinToastHandler::UserCanceled:
             std::wcout << L"Toast was dismissed by the user" << std::endl;
-            exit(1);
-            break;
-        case TimedOut:
+            return 1;
+        case IWinToastHandler::TimedOut:
             std::wcout << L"Toast timed out (was not clicked)" << std::endl;
-            exit(2);
-            break;
-        case ApplicationHidden:
+            return 2;
+        case IWinToastHandler::ApplicationHidden:
             std::wcout << L"Toast was hidden by calling ToastNotifier.hide()" << std::endl;
-            exit(3);
-            break;
+            return 3;
         default:
             std::wcout << L"Toast was not activated (not clicked)" << std::endl;
-            exit(4);
-            break;
+            return 4;
         }
-    }
-
-    void toastFailed() const {
+    case WinToastResult::TimedOut:
+        // Nothing happened within the 10 seconds the tool waits.
+        return 2;
+    default:
         std::wcout << L"Error showing toast" << std::endl;
-        exit(5);
+        return 5;
     }
-};
+}
 
 
 enum Results {
@@ -70,6 +66,17 @@ enum Results {
 #define COMMAND_IMAGE		L"--image"
 #define COMMAND_SHORTCUT	L"--only-create-shortcut"
 #define COMMAND_AUDIOSTATE  L"--audio-state"
+#define COMMAND_TAG			L"--tag"
+#define COMMAND_GROUP		L"--group"
+#define COMMAND_SERVE		L"--serve"
+#define COMMAND_BATCH		L"--batch"
+#define COMMAND_BENCHMARK	L"--benchmark"
+#define COMMAND_STATS		L"--stats"
+#define COMMAND_TRACE		L"--trace"
+#define COMMAND_SPOOL		L"--spool"
+#define COMMAND_HISTORY		L"--history"
+#define COMMAND_IMAGECACHE	L"--image-cache"
+#define COMMAND_HISTORYQUERY L"--history-query"
 
 void print_help() 
 {
@@ -84,10 +91,24 @@ void print_help()
 	std::wcout << "\t" << COMMAND_IMAGE << L"\t\t(optional) : sets the image absolute path" << std::endl;
     std::wcout << "\t" << COMMAND_SHORTCUT << L"\t(optional) : creates the shortcut for the app" << std::endl;
     std::wcout << "\t" << COMMAND_AUDIOSTATE << L"\t(optional) : sets the audio state: Default = 0, Silent = 1, Loop = 2" << std::endl;
+    std::wcout << "\t" << COMMAND_TAG << L"\t\t(optional) : replaces the toast shown earlier with the same tag (and group) instead of adding one" << std::endl;
+    std::wcout << "\t" << COMMAND_GROUP << L"\t\t(optional) : sets the group the tag belongs to" << std::endl;
+    std::wcout << "\t" << COMMAND_SERVE << L"\t\t(optional) : keeps running and reads one toast per line from stdin" << std::endl;
+    std::wcout << "\t" << COMMAND_BATCH << L"\t\t(optional) : sends every record of a JSON-lines or CSV file (- for stdin) and reports each one" << std::endl;
+    std::wcout << "\t" << COMMAND_STATS << L"\t\t(optional) : prints send latency per stage and outcome counts to stderr on exit" << std::endl;
+    std::wcout << "\t" << COMMAND_TRACE << L"\t\t(optional) : writes a trace-event JSON file (chrome://tracing, Perfetto) of every send and outcome" << std::endl;
+    std::wcout << "\t" << COMMAND_SPOOL << L"\t\t(optional) : queues toasts in a crash-safe spool file first; toasts left in it by an earlier run are shown again" << std::endl;
+    std::wcout << "\t" << COMMAND_IMAGECACHE << L"\t(optional) : shows local downscaled copies of images, kept in the given directory" << std::endl;
+    std::wcout << "\t" << COMMAND_HISTORY << L"\t(optional) : appends every toast's outcome to the history at the given path prefix" << std::endl;
+    std::wcout << "\t" << COMMAND_HISTORYQUERY << L"\t(optional) : must come first; summarizes a history: --history-query prefix [--since hours] [--text headline] [--outcome name] [--list]" << std::endl;
+    std::wcout << "\t" << COMMAND_BENCHMARK << L"\t(optional) : must come first; runs the micro-benchmarks and prints JSON: --benchmark [--samples n] [--sample-us n] [filter]" << std::endl;
     std::wcout << "\t" << COMMAND_HELP << L"\t\t(optional) : prints this help" << std::endl << std::endl;
     std::wcout << "  Examples: " << std::endl;
     std::wcout << "\t WinToast.exe --text \"Pizza tonight?\" --attribute \"Napoletana\" --action Yes --action No" << std::endl;
     std::wcout << "\t WinToast.exe --image \"C:\\Temp\\189122.png\"" << std::endl;
+    std::wcout << "\t WinToast.exe --serve < requests.txt" << std::endl;
+    std::wcout << "\t   where each line is: --id 42 --text \"Build failed\" --action Retry" << std::endl;
+    std::wcout << "\t   and each outcome is printed as: 42 activated | 42 action 0 | 42 dismissed <reason> | 42 failed" << std::endl;
     std::wcout << "\n" << std::endl;
 }
 
@@ -157,8 +178,53 @@ void CheckUserState()
 
 }
 
+// Handlers end the process with exit(), so the stats are printed from atexit.
+void print_stats()
+{
+    std::wcerr << L"\nWinToast stats:" << std::endl;
+    WinToast::instance()->stats().write(std::wcerr);
+}
+
+// Outlives the tracer: statics are destroyed after the atexit handlers run.
+std::ofstream traceFile;
+
+void close_trace()
+{
+    WinToast::instance()->tracer()->close();
+}
+
+// Writes the outcomes still queued; handlers end the process with exit().
+void close_history()
+{
+    WinToast::instance()->history()->close();
+}
+
 int wmain(int argc, LPWSTR *argv)
 {
+    // The benchmarks only exercise the portable pipeline; skip every system check
+    // so nothing but JSON reaches stdout.
+    if (argc > 1 && !wcscmp(COMMAND_BENCHMARK, argv[1])) {
+        std::vector<std::string> benchArgs;
+        for (int arg = 2; arg < argc; arg++) {
+            const std::wstring value(argv[arg]);
+            benchArgs.push_back(std::string(value.begin(), value.end()));
+        }
+        const int status = WinToastBenchmark::main(benchArgs, std::cout);
+        if (status != 0) {
+            std::wcerr << L"Usage: WinToast.exe --benchmark [--samples n] [--sample-us n] [filter]" << std::endl;
+        }
+        return status;
+    }
+
+    // Reading a history needs neither the notifier nor a shortcut either.
+    if (argc > 1 && !wcscmp(COMMAND_HISTORYQUERY, argv[1])) {
+        const int status = WinToastHistory::queryMain(std::vector<std::wstring>(argv + 2, argv + argc), std::wcout);
+        if (status == 1) {
+            std::wcerr << L"Usage: WinToast.exe --history-query prefix [--since hours] [--text headline] [--outcome name] [--list]" << std::endl;
+        }
+        return status;
+    }
+
     CheckUserState();
 
     if (!WinToast::isCompatible()) {
@@ -166,46 +232,74 @@ int wmain(int argc, LPWSTR *argv)
         return Results::SystemNotSupported;
     }
 
-    LPWSTR text = NULL;
-    LPWSTR attribute = NULL;
-    LPWSTR imagePath = NULL;
-    LPWSTR appName = NULL;
-    LPWSTR appUserModelID = NULL;
-    std::vector<std::wstring> actions;
-    INT64 expiration = 0;
+    LPCWSTR appName = NULL;
+    LPCWSTR appUserModelID = NULL;
     bool onlyCreateShortcut = false;
-    WinToastTemplate::AudioOption audioOption = WinToastTemplate::Default;
-
-    int i;
-	for (i = 1; i < argc; i++)
-        if (!wcscmp(COMMAND_IMAGE, argv[i]))
-            imagePath = argv[++i];
-        else if (!wcscmp(COMMAND_ACTION, argv[i]))
-            actions.push_back(argv[++i]);
-        else if (!wcscmp(COMMAND_EXPIRES, argv[i]))
-            expiration = wcstol(argv[++i], NULL, 10);
-        else if (!wcscmp(COMMAND_APPNAME, argv[i]))
-            appName = argv[++i];
-        else if (!wcscmp(COMMAND_APPID, argv[i]))
-            appUserModelID = argv[++i];
-		else if (!wcscmp(COMMAND_TEXT, argv[i]))
-			text = argv[++i];
-        else if (!wcscmp(COMMAND_ATTRIBUTE, argv[i]))
-            attribute = argv[++i];
-		else if (!wcscmp(COMMAND_SHORTCUT, argv[i]))
+    bool serve = false;
+    LPWSTR batchPath = NULL;
+    bool stats = false;
+    LPWSTR tracePath = NULL;
+    LPWSTR spoolPath = NULL;
+    LPWSTR historyPath = NULL;
+    LPWSTR imageCachePath = NULL;
+    WinToastRequest request;
+
+    std::vector<std::wstring> args(argv + 1, argv + argc);
+    std::size_t i = 0;
+    while (i < args.size()) {
+        const std::size_t option = i;
+        WinToastRequest::SwitchResult result = request.parseSwitch(args, i);
+        if (result == WinToastRequest::Consumed)
+            continue;
+        if (result != WinToastRequest::NotAToastSwitch) {
+            std::wcerr << L"Missing or invalid value for: " << args[option] << std::endl;
+            return Results::UnhandledOption;
+        }
+        if (!wcscmp(COMMAND_APPNAME, args[i].c_str()) && i + 1 < args.size())
+            appName = argv[1 + ++i];
+        else if (!wcscmp(COMMAND_APPID, args[i].c_str()) && i + 1 < args.size())
+            appUserModelID = argv[1 + ++i];
+		else if (!wcscmp(COMMAND_SHORTCUT, args[i].c_str()))
 			onlyCreateShortcut = true;
-        else if (!wcscmp(COMMAND_AUDIOSTATE, argv[i]))
-            audioOption = static_cast<WinToastTemplate::AudioOption>(std::stoi(argv[++i]));
-		else if (!wcscmp(COMMAND_HELP, argv[i])) {
+        else if (!wcscmp(COMMAND_SERVE, args[i].c_str()))
+            serve = true;
+        else if (!wcscmp(COMMAND_BATCH, args[i].c_str()) && i + 1 < args.size())
+            batchPath = argv[1 + ++i];
+        else if (!wcscmp(COMMAND_STATS, args[i].c_str()))
+            stats = true;
+        else if (!wcscmp(COMMAND_TRACE, args[i].c_str()) && i + 1 < args.size())
+            tracePath = argv[1 + ++i];
+        else if (!wcscmp(COMMAND_SPOOL, args[i].c_str()) && i + 1 < args.size())
+            spoolPath = argv[1 + ++i];
+        else if (!wcscmp(COMMAND_IMAGECACHE, args[i].c_str()) && i + 1 < args.size())
+            imageCachePath = argv[1 + ++i];
+        else if (!wcscmp(COMMAND_HISTORY, args[i].c_str()) && i + 1 < args.size())
+            historyPath = argv[1 + ++i];
+		else if (!wcscmp(COMMAND_HELP, args[i].c_str())) {
 			print_help();
 			return 0;
 		} else {
-            std::wcerr << L"Option not recognized: " << argv[i]  << std::endl;
+            std::wcerr << L"Option not recognized: " << args[i]  << std::endl;
 			return Results::UnhandledOption;
         }
+        i++;
+    }
+
+    if (stats) {
+        atexit(print_stats);
+    }
+    if (tracePath) {
+        traceFile.open(tracePath, std::ios::out | std::ios::trunc);
+        if (!traceFile) {
+            std::wcerr << L"Could not open trace file: " << tracePath << std::endl;
+            return Results::UnhandledOption;
+        }
+        WinToast::instance()->setTracer(std::make_shared<WinToastTracer>(traceFile));
+        atexit(close_trace);
+    }
 
     if (onlyCreateShortcut) {
-        if (imagePath || text || actions.size() > 0 || expiration) {
+        if (!request.imagePath.empty() || request.hasText || request.actions.size() > 0 || request.expiration || serve || batchPath) {
             std::wcerr << L"--only-create-shortcut does not accept images/text/actions/expiration" << std::endl;
             return 9;
         }
@@ -213,13 +307,17 @@ int wmain(int argc, LPWSTR *argv)
         return result ? 16 + result : 0;
     }
 
-    if (!text) {
-        text = L"Very Important Reminder";
-        std::wcout << L"Text not specified, using: " << text << std::endl;
+    if (serve && batchPath) {
+        std::wcerr << L"--serve and --batch do not go together" << std::endl;
+        return Results::UnhandledOption;
     }
-    if (!attribute) {
-        attribute = L"Don't worry, be happy!";
-        std::wcout << L"Attribute not specified, using: "<< attribute << std::endl;
+    if (!serve && !batchPath) {
+        if (!request.hasText) {
+            std::wcout << L"Text not specified, using: " << WinToastRequest::DefaultText << std::endl;
+        }
+        if (!request.hasAttribute) {
+            std::wcout << L"Attribute not specified, using: " << WinToastRequest::DefaultAttribute << std::endl;
+        }
     }
     if (!appName) {
         appName = L"WinToast";
@@ -229,7 +327,7 @@ int wmain(int argc, LPWSTR *argv)
         appUserModelID = L"WinToast.ID";
         std::wcout << L"App User Model ID (AUMI) not specified, using: " << appUserModelID << std::endl;
     }
-    if (!imagePath) {
+    if (!serve && !batchPath && request.imagePath.empty()) {
         std::wcout << L"Image not specified, using no image." << std::endl;
     }
 
@@ -244,25 +342,85 @@ int wmain(int argc, LPWSTR *argv)
         return Results::InitializationFailure;
     }
 
-    bool withImage = (imagePath != NULL);
-	WinToastTemplate templ( withImage ? WinToastTemplate::ImageAndText02 : WinToastTemplate::Text02);
-	templ.setTextField(text, WinToastTemplate::FirstLine);
-    templ.setAudioOption(audioOption);
-    templ.setAttributionText(attribute);
-
-	for (auto const &action : actions)
-        templ.addAction(action);
-    if (expiration){
-        std::wcout << L"Setting Expiration to: " << expiration << L" seconds" << std::endl;
-        expiration = expiration * 1000;
+    if (imageCachePath) {
+        std::shared_ptr<WinToastImageCache> cache = std::make_shared<WinToastImageCache>();
+        if (!cache->open(imageCachePath)) {
+            std::wcerr << L"Could not open image cache: " << imageCachePath << std::endl;
+            return Results::UnhandledOption;
+        }
+        WinToast::instance()->setImageCache(cache);
+    }
+
+    if (historyPath) {
+        std::shared_ptr<WinToastHistory> history = std::make_shared<WinToastHistory>();
+        if (!history->open(historyPath)) {
+            std::wcerr << L"Could not open history: " << historyPath << std::endl;
+            return Results::UnhandledOption;
+        }
+        WinToast::instance()->setHistory(history);
+        atexit(close_history);
+    }
+
+    if (spoolPath) {
+        std::shared_ptr<WinToastSpool> spool = std::make_shared<WinToastSpool>();
+        if (!spool->open(spoolPath)) {
+            std::wcerr << L"Could not open spool file: " << spoolPath << std::endl;
+            return Results::UnhandledOption;
+        }
+        const WinToastSpool::Counters counters = spool->counters();
+        if (counters.replayed) {
+            std::wcout << L"Replaying " << counters.replayed << L" toast(s) left in the spool" << std::endl;
+        }
+        WinToast::instance()->setSpool(spool);
+    }
+
+    if (batchPath) {
+        // One process, one session for the whole file, instead of a run per toast.
+        std::ifstream batchFile;
+        const bool fromStdin = !wcscmp(batchPath, L"-");
+        if (!fromStdin) {
+            batchFile.open(batchPath, std::ios::in | std::ios::binary);
+            if (!batchFile) {
+                std::wcerr << L"Could not open batch file: " << batchPath << std::endl;
+                return Results::UnhandledOption;
+            }
+        }
+        WinToastRequestServer server([](WinToastTemplate&& toast, IWinToastHandler* handler) {
+            return WinToast::instance()->showToast(std::move(toast), handler);
+        }, std::wcout);
+        const std::size_t failures = server.serveBatch(fromStdin ? std::cin : batchFile);
+        std::wcerr << server.sent() << L" sent, " << failures << L" failed" << std::endl;
+
+        server.waitIdle(10000);
+        if (!failures) {
+            return 0;
+        }
+        return server.sent() ? Results::ToastFailed : Results::ToastNotLaunched;
+    }
+
+    if (serve) {
+        // Everything above (user state, compatibility, shortcut, AUMI) is paid once;
+        // every line read from now on is just a send.
+        WinToastRequestServer server([](WinToastTemplate&& toast, IWinToastHandler* handler) {
+            return WinToast::instance()->showToast(std::move(toast), handler);
+        }, std::wcout);
+        const std::size_t failures = server.serve(std::wcin);
+
+        // Give the toasts still on screen the same 10 seconds a single toast gets.
+        server.waitIdle(10000);
+        return failures ? Results::ToastFailed : 0;
     }
 
-        templ.setExpiration(expiration);
-    if (withImage)
-        templ.setImagePath(imagePath);
+    if (request.expiration){
+        std::wcout << L"Setting Expiration to: " << request.expiration << L" seconds" << std::endl;
+    }
+    WinToastTemplate templ = request.toTemplate();
 
 
-    if (WinToast::instance()->showToast(templ, new CustomHandler()) < 0)
+    WinToastAsync::Options wait;
+    wait.timeoutMilliseconds = 10000;
+    WinToastOperation toast = WinToast::instance()->showToastAsync(std::move(templ), wait);
+    if (toast.toastId() < 0)
     {
         std::wcerr << L"Could not launch your toast notification!";
         return Results::ToastFailed;
@@ -272,8 +430,6 @@ int wmain(int argc, LPWSTR *argv)
         std::wcout << L"Toast notification successfully sent!" << std::endl;
     }
 
-    // Sleeping for 10 seconds, while the handler either activate/dismiss
-    Sleep(10000);
-
-    exit(2);
+    // Waits up to 10 seconds for the user to activate or dismiss it.
+    exit(reportOutcome(toast.get()));
 }
@@ -0,0 +1,298 @@
+#include "wintoastasync.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace WinToastLib;
+
+namespace {
+    typedef std::chrono::steady_clock AsyncClock;
+}
+
+std::shared_ptr<IWinToastExecutor> WinToastInlineExecutor::instance() {
+    static std::shared_ptr<IWinToastExecutor> executor = std::make_shared<WinToastInlineExecutor>();
+    return executor;
+}
+
+void WinToastQueuedExecutor::execute(_In_ std::coroutine_handle<> continuation) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(continuation);
+    }
+    _ready.notify_one();
+}
+
+std::size_t WinToastQueuedExecutor::run(_In_ std::size_t maxContinuations) {
+    std::size_t resumed = 0;
+    while (resumed < maxContinuations) {
+        std::coroutine_handle<> continuation;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_queue.empty()) {
+                break;
+            }
+            continuation = _queue.front();
+            _queue.pop_front();
+        }
+        continuation.resume();
+        resumed++;
+    }
+    return resumed;
+}
+
+std::size_t WinToastQueuedExecutor::runFor(_In_ std::int64_t timeoutMilliseconds) {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _ready.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [this] { return !_queue.empty(); });
+    }
+    return run();
+}
+
+std::size_t WinToastQueuedExecutor::pending() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _queue.size();
+}
+
+// Everything the toasts of one WinToastAsync share: the send and hide
+// functions and the timeout thread.
+struct WinToastAsync::Shared {
+    struct Timer {
+        AsyncClock::time_point                  deadline;
+        std::weak_ptr<WinToastOperation::State> state;
+        bool                                    hide;
+    };
+
+    SendFunction                                send;
+    HideFunction                                hide;
+    mutable std::mutex                          mutex;
+    std::condition_variable                     wakeup;
+    std::vector<Timer>                          timers;     // min-heap on deadline
+    std::thread                                 thread;
+    bool                                        stopping = false;
+
+    static bool later(_In_ const Timer& a, _In_ const Timer& b) { return a.deadline > b.deadline; }
+    void                                        timerLoop();
+};
+
+// A toast's outcome, whoever delivers it first: the handler, the timeout, or a
+// cancellation. claim() picks the winner; publish() stores its result and
+// resumes the awaiting coroutine, if one is suspended already.
+struct WinToastOperation::State {
+    static const std::uintptr_t                 Completed = 1;
+
+    // Stop requests cancel through a weak reference, so the callback does not
+    // keep the toast alive.
+    struct StopRequest {
+        std::weak_ptr<State>                    state;
+        void operator()() const noexcept {
+            if (std::shared_ptr<State> live = state.lock()) {
+                WinToastOperation(live).cancel();
+            }
+        }
+    };
+
+    // 0, Completed, or the address of the suspended coroutine.
+    std::atomic<std::uintptr_t>                 continuation{ 0 };
+    std::atomic<bool>                           claimed{ false };
+    std::atomic<std::int64_t>                   toastId{ -1 };
+    WinToastResult                              result;
+    std::shared_ptr<IWinToastExecutor>          executor;
+    std::weak_ptr<WinToastAsync::Shared>        owner;
+    std::optional<std::stop_callback<StopRequest>> stopCallback;
+
+    inline bool claim() { return !claimed.exchange(true, std::memory_order_acq_rel); }
+
+    void publish(_In_ const WinToastResult& outcome) {
+        result = outcome;
+        const std::uintptr_t waiting = continuation.exchange(Completed, std::memory_order_acq_rel);
+        continuation.notify_all();
+        if (waiting != 0) {
+            executor->execute(std::coroutine_handle<>::from_address(reinterpret_cast<void*>(waiting)));
+        }
+    }
+
+    void hide() {
+        const std::int64_t id = toastId.load(std::memory_order_acquire);
+        std::shared_ptr<WinToastAsync::Shared> shared = owner.lock();
+        if (id >= 0 && shared) {
+            shared->hide(id);
+        }
+    }
+
+    static WinToastResult make(_In_ WinToastResult::Kind kind, _In_ int actionIndex = -1,
+                               _In_ IWinToastHandler::WinToastDismissalReason reason = IWinToastHandler::UserCanceled) {
+        WinToastResult outcome;
+        outcome.kind = kind;
+        outcome.actionIndex = actionIndex;
+        outcome.reason = reason;
+        return outcome;
+    }
+};
+
+// Handed to the send function in place of a caller's handler.
+class WinToastAsync::Handler : public IWinToastHandler {
+public:
+    explicit Handler(_In_ std::shared_ptr<WinToastOperation::State> state) : _state(std::move(state)) {}
+
+    void toastActivated() const override { complete(WinToastOperation::State::make(WinToastResult::Activated)); }
+    void toastActivated(int actionIndex) const override { complete(WinToastOperation::State::make(WinToastResult::ActionActivated, actionIndex)); }
+    void toastDismissed(WinToastDismissalReason state) const override { complete(WinToastOperation::State::make(WinToastResult::Dismissed, -1, state)); }
+    void toastFailed() const override { complete(WinToastOperation::State::make(WinToastResult::Failed)); }
+
+private:
+    void complete(_In_ const WinToastResult& outcome) const {
+        if (_state->claim()) {
+            _state->publish(outcome);
+        }
+    }
+
+    std::shared_ptr<WinToastOperation::State> _state;
+};
+
+bool WinToastOperation::await_ready() const noexcept {
+    return done();
+}
+
+bool WinToastOperation::await_suspend(_In_ std::coroutine_handle<> continuation) noexcept {
+    std::uintptr_t expected = 0;
+    // Fails only when the toast ended in the meantime: resume right away.
+    return _state->continuation.compare_exchange_strong(expected, reinterpret_cast<std::uintptr_t>(continuation.address()),
+                                                        std::memory_order_acq_rel);
+}
+
+WinToastResult WinToastOperation::await_resume() const noexcept {
+    WinToastResult outcome = _state ? _state->result : WinToastResult();
+    outcome.toastId = toastId();
+    return outcome;
+}
+
+bool WinToastOperation::cancel() {
+    // Held here: resuming the awaiting coroutine may destroy this object.
+    std::shared_ptr<State> state = _state;
+    if (!state || !state->claim()) {
+        return false;
+    }
+    state->hide();
+    state->publish(State::make(WinToastResult::Cancelled));
+    return true;
+}
+
+bool WinToastOperation::done() const noexcept {
+    return !_state || _state->continuation.load(std::memory_order_acquire) == State::Completed;
+}
+
+WinToastResult WinToastOperation::get() const {
+    if (_state) {
+        std::uintptr_t seen;
+        while ((seen = _state->continuation.load(std::memory_order_acquire)) != State::Completed) {
+            _state->continuation.wait(seen, std::memory_order_acquire);
+        }
+    }
+    return await_resume();
+}
+
+std::int64_t WinToastOperation::toastId() const noexcept {
+    return _state ? _state->toastId.load(std::memory_order_acquire) : -1;
+}
+
+WinToastAsync::WinToastAsync(_In_ SendFunction send, _In_ HideFunction hide) : _shared(std::make_shared<Shared>()) {
+    _shared->send = std::move(send);
+    _shared->hide = std::move(hide);
+}
+
+WinToastAsync::~WinToastAsync() {
+    std::vector<Shared::Timer> timers;
+    {
+        std::lock_guard<std::mutex> lock(_shared->mutex);
+        _shared->stopping = true;
+        timers.swap(_shared->timers);
+    }
+    _shared->wakeup.notify_all();
+    if (_shared->thread.joinable()) {
+        _shared->thread.join();
+    }
+    for (const Shared::Timer& timer : timers) {
+        std::shared_ptr<WinToastOperation::State> state = timer.state.lock();
+        if (state && state->claim()) {
+            state->publish(WinToastOperation::State::make(WinToastResult::TimedOut));
+        }
+    }
+}
+
+WinToastOperation WinToastAsync::show(_In_ WinToastTemplate toast) {
+    return show(std::move(toast), Options());
+}
+
+WinToastOperation WinToastAsync::show(_In_ WinToastTemplate toast, _In_ const Options& options) {
+    std::shared_ptr<WinToastOperation::State> state = std::make_shared<WinToastOperation::State>();
+    state->executor = options.executor ? options.executor : WinToastInlineExecutor::instance();
+    state->owner = _shared;
+    std::unique_ptr<Handler> handler(new Handler(state));
+    const std::int64_t id = _shared->send(std::move(toast), handler.get());
+    state->toastId.store(id, std::memory_order_release);
+    if (id < 0) {
+        // Not sent: the handler is still ours.
+        if (state->claim()) {
+            state->publish(WinToastOperation::State::make(WinToastResult::Failed));
+        }
+        return WinToastOperation(state);
+    }
+    handler.release();
+    if (options.timeoutMilliseconds > 0) {
+        Shared::Timer timer;
+        timer.deadline = AsyncClock::now() + std::chrono::milliseconds(options.timeoutMilliseconds);
+        timer.state = state;
+        timer.hide = options.hideOnTimeout;
+        std::lock_guard<std::mutex> lock(_shared->mutex);
+        if (!_shared->thread.joinable()) {
+            _shared->thread = std::thread(&Shared::timerLoop, _shared.get());
+        }
+        _shared->timers.push_back(std::move(timer));
+        std::push_heap(_shared->timers.begin(), _shared->timers.end(), &Shared::later);
+        // Only a new earliest deadline moves the thread's wake-up time.
+        if (_shared->timers.front().state.lock() == state) {
+            _shared->wakeup.notify_one();
+        }
+    }
+    if (options.stop.stop_possible()) {
+        // Runs the cancellation right here if the stop was already requested.
+        state->stopCallback.emplace(options.stop, WinToastOperation::State::StopRequest{ state });
+    }
+    return WinToastOperation(state);
+}
+
+std::size_t WinToastAsync::pendingTimeouts() const {
+    std::lock_guard<std::mutex> lock(_shared->mutex);
+    return static_cast<std::size_t>(std::count_if(_shared->timers.begin(), _shared->timers.end(), [](const Shared::Timer& timer) {
+        std::shared_ptr<WinToastOperation::State> state = timer.state.lock();
+        return state && !state->claimed.load(std::memory_order_acquire);
+    }));
+}
+
+void WinToastAsync::Shared::timerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        if (timers.empty()) {
+            wakeup.wait(lock);
+            continue;
+        }
+        const AsyncClock::time_point deadline = timers.front().deadline;
+        if (AsyncClock::now() < deadline) {
+            wakeup.wait_until(lock, deadline);
+            continue;
+        }
+        std::pop_heap(timers.begin(), timers.end(), &Shared::later);
+        Timer timer = std::move(timers.back());
+        timers.pop_back();
+        lock.unlock();
+        // Toasts that ended before their deadline are skipped here.
+        std::shared_ptr<WinToastOperation::State> state = timer.state.lock();
+        if (state && state->claim()) {
+            if (timer.hide) {
+                state->hide();
+            }
+            state->publish(WinToastOperation::State::make(WinToastResult::TimedOut));
+        }
+        state.reset();
+        lock.lock();
+    }
+}
@@ -0,0 +1,141 @@
+#ifndef WINTOASTASYNC_H
+#define WINTOASTASYNC_H
+#include "wintoasttemplate.h"
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+// C++20: coroutines and std::stop_token. The portable sources (see
+// wintoastbench_main.cpp and wintoasttest_main.cpp) still build as C++14.
+namespace WinToastLib {
+
+    // How an awaited toast ended.
+    struct WinToastResult {
+        enum Kind {
+            Activated = 0,      // clicked
+            ActionActivated,    // one of its buttons clicked; see actionIndex
+            Dismissed,          // see reason
+            Failed,             // not shown, or the platform reported a failure
+            TimedOut,           // the await's timeout passed first
+            Cancelled           // cancel() or a stop request came first; the toast was hidden, or withdrawn if not shown yet
+        };
+
+        Kind                                        kind = Failed;
+        int                                         actionIndex = -1;
+        IWinToastHandler::WinToastDismissalReason   reason = IWinToastHandler::UserCanceled;
+        // The id showToast returned: negative (TOAST_DROPPED, ...) when the toast
+        // never went out.
+        std::int64_t                                toastId = -1;
+    };
+
+    // Where a coroutine awaiting a toast resumes.
+    class IWinToastExecutor {
+    public:
+        virtual ~IWinToastExecutor() {}
+        virtual void            execute(_In_ std::coroutine_handle<> continuation) = 0;
+    };
+
+    // Resumes on the thread that completed the toast: a platform callback
+    // thread, the timeout thread, or the thread that cancelled.
+    class WinToastInlineExecutor : public IWinToastExecutor {
+    public:
+        void                    execute(_In_ std::coroutine_handle<> continuation) override { continuation.resume(); }
+        static std::shared_ptr<IWinToastExecutor> instance();
+    };
+
+    // Holds continuations until the owner runs them, e.g. from a UI thread's
+    // message loop.
+    class WinToastQueuedExecutor : public IWinToastExecutor {
+    public:
+        void                    execute(_In_ std::coroutine_handle<> continuation) override;
+        // Resumes up to maxContinuations queued coroutines on the calling thread.
+        std::size_t             run(_In_ std::size_t maxContinuations = static_cast<std::size_t>(-1));
+        // Waits up to timeoutMilliseconds for something to run, then runs what is queued.
+        std::size_t             runFor(_In_ std::int64_t timeoutMilliseconds);
+        std::size_t             pending() const;
+
+    private:
+        mutable std::mutex                      _mutex;
+        std::condition_variable                 _ready;
+        std::deque<std::coroutine_handle<>>     _queue;
+    };
+
+    class WinToastAsync;
+
+    // One toast in flight, returned by WinToastAsync::show and
+    // WinToast::showToastAsync. The toast is already sent; co_await (once)
+    // resumes with its WinToastResult on the executor chosen at send time, and
+    // right away if it has already ended. get() blocks for the same result
+    // outside a coroutine. Copies refer to the same toast.
+    class WinToastOperation {
+    public:
+        WinToastOperation() = default;
+
+        bool                    await_ready() const noexcept;
+        bool                    await_suspend(_In_ std::coroutine_handle<> continuation) noexcept;
+        WinToastResult          await_resume() const noexcept;
+
+        // Hides the toast (or withdraws it from the rate limiter or spool when it
+        // is not shown yet, see WinToast::hideToast) and ends the await with
+        // Cancelled, unless it has ended already. Returns whether this call ended it.
+        bool                    cancel();
+        bool                    done() const noexcept;
+        WinToastResult          get() const;
+        std::int64_t            toastId() const noexcept;
+
+    private:
+        friend class WinToastAsync;
+        struct State;
+
+        explicit WinToastOperation(_In_ std::shared_ptr<State> state) : _state(std::move(state)) {}
+
+        std::shared_ptr<State>  _state;
+    };
+
+    // Turns a handler-based send into an awaitable one. Each toast costs one
+    // small shared state (the result, the continuation and the toast id), the
+    // handler object pointing at it, and a timer entry when it has a timeout;
+    // the awaiting coroutine keeps only a WinToastOperation in its frame.
+    // Timeouts are served by one thread, started with the first of them.
+    class WinToastAsync {
+    public:
+        // Same contract as WinToast::showToast and WinToast::hideToast.
+        typedef std::function<std::int64_t(WinToastTemplate&& toast, IWinToastHandler* handler)> SendFunction;
+        typedef std::function<bool(std::int64_t toastId)> HideFunction;
+
+        struct Options {
+            std::int64_t                        timeoutMilliseconds = 0;   // 0 waits for as long as the toast lives
+            bool                                hideOnTimeout = false;     // otherwise it stays in Action Center
+            std::shared_ptr<IWinToastExecutor>  executor;                  // null: WinToastInlineExecutor
+            std::stop_token                     stop;                      // a stop request cancels the toast
+        };
+
+        WinToastAsync(_In_ SendFunction send, _In_ HideFunction hide);
+        // Stops the timeout thread. Toasts still waiting for a timeout end
+        // with TimedOut right away.
+        ~WinToastAsync();
+        WinToastAsync(const WinToastAsync&) = delete;
+        WinToastAsync& operator=(const WinToastAsync&) = delete;
+
+        WinToastOperation       show(_In_ WinToastTemplate toast);
+        WinToastOperation       show(_In_ WinToastTemplate toast, _In_ const Options& options);
+        // Toasts with a timeout that have not ended yet.
+        std::size_t             pendingTimeouts() const;
+
+    private:
+        friend class WinToastOperation;
+        class Handler;
+        struct Shared;
+
+        std::shared_ptr<Shared> _shared;
+    };
+}
+#endif // WINTOASTASYNC_H
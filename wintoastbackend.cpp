@@ -0,0 +1,265 @@
+#include "wintoastbackend.h"
+
+using namespace WinToastLib;
+
+namespace {
+    // Through int32 so they stay negative where long is 64-bit.
+    const long BackendOk = 0;                                                           // S_OK
+    const long BackendNoSession = static_cast<long>(static_cast<std::int32_t>(0x8000FFFFu));   // E_UNEXPECTED
+    const long BackendInvalidArg = static_cast<long>(static_cast<std::int32_t>(0x80070057u));  // E_INVALIDARG
+}
+
+std::wstring IWinToastBackend::tagKey(_In_ const std::wstring& tag, _In_ const std::wstring& group) {
+    std::wstring key;
+    key.reserve(group.length() + 1 + tag.length());
+    key.append(group);
+    // Group names cannot contain a NUL, so the pair maps to one key only.
+    key.push_back(L'\0');
+    key.append(tag);
+    return key;
+}
+
+long WinToastMemoryBackend::openSession(_In_ const std::wstring& aumi) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    WINTOAST_STAGE_TIMER(timer, _stats, _tracer, -1);
+    // Mirrors the platform backend: ToastNotificationManager and ToastNotification
+    // factories, then one notifier for the AUMI.
+    _counters.factoryLookups += 2;
+    WINTOAST_STAGE_LAP(timer, FactoryLookup);
+    _counters.notifiersCreated++;
+    WINTOAST_STAGE_LAP(timer, NotifierCreation);
+    _counters.sessionsOpened++;
+    _aumi = aumi;
+    _session = true;
+    return BackendOk;
+}
+
+void WinToastMemoryBackend::closeSession() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _session = false;
+}
+
+bool WinToastMemoryBackend::hasSession() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _session;
+}
+
+bool WinToastMemoryBackend::consumeFailure(_Out_ long& hr) {
+    if (_failCount == 0) {
+        return false;
+    }
+    _failCount--;
+    _counters.failures++;
+    _session = false;
+    hr = _failHr;
+    return true;
+}
+
+long WinToastMemoryBackend::show(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+                                 _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                 _Out_ WinToastNotificationHandle& notification) {
+    return present(xml, expiration, nullptr, nullptr, nullptr, handler, notification);
+}
+
+long WinToastMemoryBackend::showTagged(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+                                       _In_ const std::wstring& tag, _In_ const std::wstring& group,
+                                       _In_ const WinToastNotificationData& data,
+                                       _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                       _Out_ WinToastNotificationHandle& notification) {
+    return present(xml, expiration, &tag, &group, &data, handler, notification);
+}
+
+long WinToastMemoryBackend::present(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+                                    _In_opt_ const std::wstring* tag, _In_opt_ const std::wstring* group,
+                                    _In_opt_ const WinToastNotificationData* data,
+                                    _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                    _Out_ WinToastNotificationHandle& notification) {
+    WINTOAST_STAGE_TIMER(timer, _stats, _tracer, -1);
+    // Built before taking the lock, so concurrent senders only serialize on the
+    // bookkeeping below.
+    auto record = std::make_shared<Notification>();
+    record->xml = xml;
+    record->expiration = expiration;
+    if (tag) {
+        record->tag = *tag;
+        record->group = *group;
+        record->data = *data;
+    }
+    WINTOAST_STAGE_LAP(timer, NotificationCreation);
+    record->handler = handler;
+    WINTOAST_STAGE_LAP(timer, HandlerWiring);
+    record->visible = true;
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_session) {
+        return BackendNoSession;
+    }
+    long hr = BackendOk;
+    if (consumeFailure(hr)) {
+        return hr;
+    }
+    record->sequence = ++_sequence;
+    _counters.shows++;
+    WINTOAST_STAGE_LAP(timer, Show);
+    _visible++;
+    if (tag) {
+        // The platform takes the old notification out of Action Center without
+        // raising any of its events.
+        std::shared_ptr<Notification>& slot = _tagged[tagKey(*tag, *group)];
+        if (slot && slot->visible) {
+            slot->visible = false;
+            _visible--;
+            _counters.replaced++;
+        }
+        slot = record;
+    }
+    _lastShown = record;
+    notification = record;
+    return BackendOk;
+}
+
+long WinToastMemoryBackend::update(_In_ const std::wstring& tag, _In_ const std::wstring& group,
+                                   _In_ const WinToastNotificationData& data) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_session) {
+        return BackendNoSession;
+    }
+    long hr = BackendOk;
+    if (consumeFailure(hr)) {
+        return hr;
+    }
+    auto found = _tagged.find(tagKey(tag, group));
+    if (found == _tagged.end()) {
+        return UpdateNotFound;
+    }
+    if (!found->second->visible) {
+        _tagged.erase(found);
+        return UpdateNotFound;
+    }
+    Notification& record = *found->second;
+    if (data.sequence != 0 && data.sequence <= record.data.sequence) {
+        return BackendOk;
+    }
+    // Keys not in the update keep their values.
+    for (const auto& value : data.values) {
+        auto current = record.data.values.begin();
+        while (current != record.data.values.end() && current->first != value.first) {
+            ++current;
+        }
+        if (current == record.data.values.end()) {
+            record.data.values.push_back(value);
+        } else {
+            current->second = value.second;
+        }
+    }
+    record.data.sequence = data.sequence;
+    _counters.updates++;
+    return BackendOk;
+}
+
+long WinToastMemoryBackend::hide(_In_ const WinToastNotificationHandle& notification) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_session) {
+        return BackendNoSession;
+    }
+    if (!notification) {
+        return BackendInvalidArg;
+    }
+    long hr = BackendOk;
+    if (consumeFailure(hr)) {
+        return hr;
+    }
+    Notification* record = static_cast<Notification*>(notification.get());
+    if (record->visible) {
+        record->visible = false;
+        _visible--;
+    }
+    untag(*record);
+    _counters.hides++;
+    return BackendOk;
+}
+
+void WinToastMemoryBackend::failNext(_In_ long hr, _In_ std::size_t count) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _failHr = hr;
+    _failCount = count;
+}
+
+bool WinToastMemoryBackend::activate(_In_ const WinToastNotificationHandle& notification, _In_ int actionIndex) {
+    const Notification* record = get(notification);
+    if (!record || !record->handler) {
+        return false;
+    }
+    if (actionIndex < 0) {
+        record->handler->toastActivated();
+    } else {
+        record->handler->toastActivated(actionIndex);
+    }
+    return true;
+}
+
+bool WinToastMemoryBackend::dismiss(_In_ const WinToastNotificationHandle& notification, _In_ IWinToastHandler::WinToastDismissalReason reason) {
+    const Notification* record = get(notification);
+    if (!record || !record->handler) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Notification* mutableRecord = static_cast<Notification*>(notification.get());
+        if (mutableRecord->visible) {
+            mutableRecord->visible = false;
+            _visible--;
+        }
+        untag(*mutableRecord);
+    }
+    record->handler->toastDismissed(reason);
+    return true;
+}
+
+bool WinToastMemoryBackend::fail(_In_ const WinToastNotificationHandle& notification) {
+    const Notification* record = get(notification);
+    if (!record || !record->handler) {
+        return false;
+    }
+    record->handler->toastFailed();
+    return true;
+}
+
+WinToastMemoryBackend::Counters WinToastMemoryBackend::counters() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _counters;
+}
+
+std::wstring WinToastMemoryBackend::aumi() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _aumi;
+}
+
+std::size_t WinToastMemoryBackend::visibleCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _visible;
+}
+
+WinToastNotificationHandle WinToastMemoryBackend::lastShown() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _lastShown;
+}
+
+WinToastNotificationHandle WinToastMemoryBackend::findTagged(_In_ const std::wstring& tag, _In_ const std::wstring& group) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _tagged.find(tagKey(tag, group));
+    return found != _tagged.end() && found->second->visible ? found->second : nullptr;
+}
+
+void WinToastMemoryBackend::untag(_In_ const Notification& record) {
+    if (record.tag.empty()) {
+        return;
+    }
+    auto found = _tagged.find(tagKey(record.tag, record.group));
+    if (found != _tagged.end() && found->second.get() == &record) {
+        _tagged.erase(found);
+    }
+}
+
+const WinToastMemoryBackend::Notification* WinToastMemoryBackend::get(_In_ const WinToastNotificationHandle& notification) {
+    return static_cast<const Notification*>(notification.get());
+}
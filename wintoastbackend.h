@@ -0,0 +1,158 @@
+#ifndef WINTOASTBACKEND_H
+#define WINTOASTBACKEND_H
+#include "wintoaststats.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace WinToastLib {
+
+    // Platform notification object as seen by WinToast: opaque, kept alive for as
+    // long as the toast is tracked, and handed back to the backend to hide it.
+    typedef std::shared_ptr<void> WinToastNotificationHandle;
+
+    // Values for the {key} placeholders of a notification's payload. They can be
+    // replaced while the notification is shown; the platform ignores an update
+    // whose sequence is not above the last one it applied (0 always applies).
+    struct WinToastNotificationData {
+        std::uint32_t                                       sequence = 0;
+        std::vector<std::pair<std::wstring, std::wstring>>  values;
+    };
+
+    // Everything WinToast needs from the notification platform. Return values are
+    // HRESULTs; they are spelled as long here to keep this header portable.
+    //
+    // A backend owns a notifier session for one AUMI. WinToast opens it lazily
+    // on the first show/hide/clear, reuses it for every later call and only opens
+    // a new one after the backend has dropped it (hasSession() == false), which it
+    // does when a notifier call fails or when closeSession() is called.
+    //
+    // WinToast calls show and hide from whichever threads send and hide toasts,
+    // concurrently, and opens sessions one at a time; a backend must tolerate
+    // a failing call dropping the session while other threads are showing.
+    class IWinToastBackend {
+    public:
+        virtual ~IWinToastBackend() {}
+        virtual long            openSession(_In_ const std::wstring& aumi) = 0;
+        virtual void            closeSession() = 0;
+        virtual bool            hasSession() const = 0;
+        // Creates a notification from the compiled payload, wires handler to its
+        // events and shows it. expiration is relative, in milliseconds; 0 means none.
+        virtual long            show(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+                                     _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                     _Out_ WinToastNotificationHandle& notification) = 0;
+        virtual long            hide(_In_ const WinToastNotificationHandle& notification) = 0;
+        // Same as show, under a tag and group that identify the notification (a
+        // shown one with the same pair is replaced) and with its initial data.
+        virtual long            showTagged(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+                                           _In_ const std::wstring& tag, _In_ const std::wstring& group,
+                                           _In_ const WinToastNotificationData& data,
+                                           _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                           _Out_ WinToastNotificationHandle& notification) = 0;
+        // Replaces the data of the notification shown under tag and group in
+        // place, without showing it again. UpdateNotFound once it is gone.
+        virtual long            update(_In_ const std::wstring& tag, _In_ const std::wstring& group,
+                                       _In_ const WinToastNotificationData& data) = 0;
+
+        // HRESULT_FROM_WIN32(ERROR_NOT_FOUND), negative where long is 64-bit too.
+        static const long       UpdateNotFound = static_cast<long>(static_cast<std::int32_t>(0x80070490u));
+        // One string naming a tag and group pair, for indexing notifications by it.
+        static std::wstring     tagKey(_In_ const std::wstring& tag, _In_ const std::wstring& group);
+
+        // Where the backend records its stage timings (factory lookup, notifier
+        // creation, payload load, notification creation, handler wiring, Show).
+        // Null turns recording off.
+        void                    setStats(_In_opt_ std::shared_ptr<WinToastStats> stats) { _stats = std::move(stats); }
+        // Where the same stages are emitted as trace spans. Null turns tracing off.
+        void                    setTracer(_In_opt_ std::shared_ptr<WinToastTracer> tracer) { _tracer = std::move(tracer); }
+
+    protected:
+        std::shared_ptr<WinToastStats> _stats;
+        std::shared_ptr<WinToastTracer> _tracer;
+    };
+
+    // In-memory stand-in for the platform. It keeps every notification it was
+    // asked to show, lets the caller complete them programmatically and counts
+    // how often the expensive platform steps would have run.
+    class WinToastMemoryBackend : public IWinToastBackend {
+    public:
+        struct Notification {
+            std::uint64_t                       sequence;
+            std::wstring                        xml;
+            std::int64_t                        expiration;
+            std::shared_ptr<IWinToastHandler>   handler;
+            bool                                visible;
+            std::wstring                        tag;
+            std::wstring                        group;
+            // Current values, as the placeholders would show them.
+            WinToastNotificationData            data;
+        };
+
+        struct Counters {
+            std::size_t                         sessionsOpened;
+            std::size_t                         factoryLookups;
+            std::size_t                         notifiersCreated;
+            std::size_t                         shows;
+            std::size_t                         hides;
+            std::size_t                         updates;        // applied in place
+            std::size_t                         replaced;       // shown over a visible one with the same tag and group
+            std::size_t                         failures;
+        };
+
+        long                    openSession(_In_ const std::wstring& aumi) override;
+        void                    closeSession() override;
+        bool                    hasSession() const override;
+        long                    show(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+                                     _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                     _Out_ WinToastNotificationHandle& notification) override;
+        long                    hide(_In_ const WinToastNotificationHandle& notification) override;
+        long                    showTagged(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+                                           _In_ const std::wstring& tag, _In_ const std::wstring& group,
+                                           _In_ const WinToastNotificationData& data,
+                                           _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                           _Out_ WinToastNotificationHandle& notification) override;
+        long                    update(_In_ const std::wstring& tag, _In_ const std::wstring& group,
+                                       _In_ const WinToastNotificationData& data) override;
+
+        // Makes the next count notifier calls fail with hr, dropping the session
+        // the way the platform backend does.
+        void                    failNext(_In_ long hr, _In_ std::size_t count = 1);
+        // Delivers an outcome to a shown notification's handler, as the platform
+        // would from one of its callback threads. actionIndex < 0 is a plain click.
+        bool                    activate(_In_ const WinToastNotificationHandle& notification, _In_ int actionIndex = -1);
+        bool                    dismiss(_In_ const WinToastNotificationHandle& notification, _In_ IWinToastHandler::WinToastDismissalReason reason);
+        bool                    fail(_In_ const WinToastNotificationHandle& notification);
+
+        Counters                counters() const;
+        std::wstring            aumi() const;
+        std::size_t             visibleCount() const;
+        WinToastNotificationHandle lastShown() const;
+        // The visible notification shown under tag and group, if any.
+        WinToastNotificationHandle findTagged(_In_ const std::wstring& tag, _In_ const std::wstring& group) const;
+        static const Notification* get(_In_ const WinToastNotificationHandle& notification);
+
+    private:
+        bool                    consumeFailure(_Out_ long& hr);
+        long                    present(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+                                        _In_opt_ const std::wstring* tag, _In_opt_ const std::wstring* group,
+                                        _In_opt_ const WinToastNotificationData* data,
+                                        _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                        _Out_ WinToastNotificationHandle& notification);
+        // Drops record from _tagged once it has left Action Center.
+        void                    untag(_In_ const Notification& record);
+
+        mutable std::mutex      _mutex;
+        std::wstring            _aumi;
+        bool                    _session = false;
+        std::uint64_t           _sequence = 0;
+        long                    _failHr = 0;
+        std::size_t             _failCount = 0;
+        std::size_t             _visible = 0;
+        Counters                _counters = {};
+        WinToastNotificationHandle _lastShown;
+        // Visible tagged notifications by group and tag.
+        std::unordered_map<std::wstring, std::shared_ptr<Notification>> _tagged;
+    };
+}
+#endif // WINTOASTBACKEND_H
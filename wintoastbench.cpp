@@ -0,0 +1,811 @@
+#include "wintoastbench.h"
+#include "wintoastpayload.h"
+#include "wintoastfrozen.h"
+#include "wintoastbackend.h"
+#include "wintoastdispatch.h"
+#include "wintoastregistry.h"
+#include "wintoastratelimit.h"
+#include "wintoastdedup.h"
+#include "wintoastpool.h"
+#include "wintoastprogress.h"
+#include "wintoastshortcut.h"
+#include "wintoaststats.h"
+#include "wintoasttrace.h"
+#include "wintoastimage.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+using namespace WinToastLib;
+
+namespace {
+    typedef std::chrono::steady_clock BenchClock;
+
+    // Written to after every case body so the work cannot be optimized away.
+    volatile std::size_t Sink = 0;
+
+    const std::atomic<std::uint64_t>* AllocationCounter = nullptr;
+
+    inline void keep(_In_ std::size_t value) {
+        Sink = Sink + value;
+    }
+
+    class NullHandler : public IWinToastHandler {
+    public:
+        void toastActivated() const override {}
+        void toastActivated(int) const override {}
+        void toastDismissed(WinToastDismissalReason) const override {}
+        void toastFailed() const override {}
+    };
+
+    const wchar_t* const TypeNames[] = {
+        L"ImageAndText01", L"ImageAndText02", L"ImageAndText03", L"ImageAndText04",
+        L"Text01", L"Text02", L"Text03", L"Text04"
+    };
+
+    // A photo-sized picture: smooth gradients with a soft alpha edge.
+    WinToastImage sampleImage(_In_ int width, _In_ int height) {
+        WinToastImage image;
+        image.width = width;
+        image.height = height;
+        image.pixels.resize(static_cast<std::size_t>(width) * height * 4);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                std::uint8_t* pixel = &image.pixels[(static_cast<std::size_t>(y) * width + x) * 4];
+                pixel[0] = static_cast<std::uint8_t>(x * 255 / width);
+                pixel[1] = static_cast<std::uint8_t>(y * 255 / height);
+                pixel[2] = static_cast<std::uint8_t>((x ^ y) & 0xff);
+                pixel[3] = static_cast<std::uint8_t>(std::min(255, std::min(x, width - 1 - x) * 8));
+            }
+        }
+        return image;
+    }
+
+    // The same picture as a 24-bit bottom-up BMP file.
+    std::vector<std::uint8_t> sampleBmp(_In_ const WinToastImage& image) {
+        const std::size_t stride = (static_cast<std::size_t>(image.width) * 3 + 3) & ~static_cast<std::size_t>(3);
+        std::vector<std::uint8_t> file(54 + stride * image.height, 0);
+        auto put32 = [&file](std::size_t offset, std::uint32_t value) {
+            for (int i = 0; i < 4; i++) {
+                file[offset + i] = static_cast<std::uint8_t>(value >> (8 * i));
+            }
+        };
+        file[0] = 'B';
+        file[1] = 'M';
+        put32(2, static_cast<std::uint32_t>(file.size()));
+        put32(10, 54);
+        put32(14, 40);
+        put32(18, image.width);
+        put32(22, image.height);
+        file[26] = 1;
+        file[28] = 24;
+        for (int y = 0; y < image.height; y++) {
+            std::uint8_t* row = &file[54 + stride * (image.height - 1 - y)];
+            for (int x = 0; x < image.width; x++) {
+                const std::uint8_t* pixel = &image.pixels[(static_cast<std::size_t>(y) * image.width + x) * 4];
+                row[x * 3] = pixel[2];
+                row[x * 3 + 1] = pixel[1];
+                row[x * 3 + 2] = pixel[0];
+            }
+        }
+        return file;
+    }
+
+    WinToastTemplate sampleToast(_In_ WinToastTemplate::WinToastTemplateType type, _In_ std::size_t actions = 0, _In_ bool attribution = false) {
+        WinToastTemplate toast(type);
+        static const wchar_t* const Lines[] = {
+            L"Build 4711 failed on host-07",
+            L"3 tests failed in the notification pipeline",
+            L"Click to open the log & retry <now>"
+        };
+        for (int i = 0; i < toast.textFieldsCount(); i++) {
+            toast.setTextField(Lines[i], static_cast<WinToastTemplate::TextField>(i));
+        }
+        if (toast.hasImage()) {
+            toast.setImagePath(L"C:\\Users\\builder\\AppData\\Local\\CI\\icons\\failed.png");
+        }
+        for (std::size_t i = 0; i < actions; i++) {
+            toast.addAction(L"Action " + std::to_wstring(i));
+        }
+        if (attribution) {
+            toast.setAttributionText(L"via CI");
+        }
+        return toast;
+    }
+
+    std::string narrow(_In_ const std::wstring& text) {
+        return std::string(text.begin(), text.end());
+    }
+
+    // What WinToast does per toast, minus the Windows parts: compile the payload,
+    // register the id, hand it to the (in-memory) notifier, attach the handle.
+    struct Pipeline {
+        WinToastPrototypeCache                      prototypes;
+        std::shared_ptr<WinToastRegistry>           registry = std::make_shared<WinToastRegistry>();
+        std::shared_ptr<WinToastMemoryBackend>      backend = std::make_shared<WinToastMemoryBackend>();
+        std::shared_ptr<WinToastDispatcher>         dispatcher = std::make_shared<WinToastDispatcher>();
+        std::shared_ptr<IWinToastHandler>           handler = std::make_shared<NullHandler>();
+        std::wstring                                xml;
+
+        std::shared_ptr<IWinToastHandler> forwarder(_In_ std::int64_t id) {
+            std::weak_ptr<WinToastRegistry> weak = registry;
+            return std::make_shared<WinToastDispatchingHandler>(dispatcher, handler, id,
+                [weak](const WinToastOutcome& outcome) {
+                    if (auto live = weak.lock()) {
+                        live->erase(outcome.toastId);
+                    }
+                });
+        }
+
+        // xml is the payload buffer of the calling thread; everything else here
+        // may be shared by several sending threads.
+        bool send(_In_ const WinToastTemplate& toast, _In_ std::int64_t id, _Inout_ std::wstring& xml, _Out_ WinToastNotificationHandle& notification) {
+            WinToastPayload::compile(*prototypes.get(toast.type(), true), toast, xml);
+            if (!backend->hasSession()) {
+                backend->openSession(L"WinToast.Benchmark");
+            }
+            registry->reserve(id);
+            if (backend->show(xml, toast.expiration(), forwarder(id), notification) < 0) {
+                registry->erase(id);
+                return false;
+            }
+            return true;
+        }
+
+        // A toast with a tag, the way WinToast sends one: shown under its tag,
+        // bound to it in the registry, and the toast it supersedes told and
+        // released.
+        bool sendTagged(_In_ const WinToastTemplate& toast, _In_ std::int64_t id, _Inout_ std::wstring& xml, _Out_ WinToastNotificationHandle& notification) {
+            WinToastPayload::compile(*prototypes.get(toast.type(), true), toast, xml);
+            if (!backend->hasSession()) {
+                backend->openSession(L"WinToast.Benchmark");
+            }
+            registry->reserve(id);
+            std::shared_ptr<IWinToastHandler> handler = forwarder(id);
+            if (backend->showTagged(xml, toast.expiration(), toast.tag(), toast.group(), WinToastNotificationData(), handler, notification) < 0) {
+                registry->erase(id);
+                return false;
+            }
+            WinToastRegistry::Superseded superseded;
+            if (registry->bindTag(id, IWinToastBackend::tagKey(toast.tag(), toast.group()), handler, superseded)) {
+                superseded.handler->toastDismissed(IWinToastHandler::ApplicationHidden);
+            }
+            return true;
+        }
+
+        WinToastNotificationHandle showTagged(_In_ const WinToastTemplate& toast, _Inout_ std::wstring& xml) {
+            WinToastNotificationHandle notification;
+            const std::int64_t id = registry->nextId();
+            if (sendTagged(toast, id, xml, notification)) {
+                registry->attach(id, notification);
+            }
+            return notification;
+        }
+
+        WinToastNotificationHandle showOne(_In_ const WinToastTemplate& toast, _Inout_ std::wstring& xml) {
+            WinToastNotificationHandle notification;
+            const std::int64_t id = registry->nextId();
+            if (send(toast, id, xml, notification)) {
+                registry->attach(id, notification);
+            }
+            return notification;
+        }
+
+        // Mirrors the loop of WinToast::showToasts (which needs Windows to run):
+        // the first count toasts sent one after the other, their ids attached
+        // under one registry lock at the end.
+        std::vector<WinToastNotificationHandle> showBatch(_In_ const std::vector<WinToastTemplate>& toasts, _In_ std::size_t count) {
+            std::vector<std::pair<std::int64_t, WinToastNotificationHandle>> shown;
+            shown.reserve(count);
+            for (std::size_t i = 0; i < count; i++) {
+                WinToastNotificationHandle notification;
+                const std::int64_t id = registry->nextId();
+                if (send(toasts[i], id, xml, notification)) {
+                    shown.emplace_back(id, notification);
+                }
+            }
+            std::vector<WinToastNotificationHandle> notifications;
+            notifications.reserve(shown.size());
+            for (const auto& entry : shown) {
+                notifications.push_back(entry.second);
+            }
+            registry->attach(shown);
+            return notifications;
+        }
+    };
+
+    // Threads kept for the life of a case, started on its first sample, so a
+    // concurrent case times the sends and not thread start-up. run() splits the
+    // iterations evenly over the threads and returns when all of them are done.
+    class WorkerGang {
+    public:
+        explicit WorkerGang(_In_ std::size_t threads) : _count(threads) {}
+
+        ~WorkerGang() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _wake.notify_all();
+            for (std::thread& thread : _threads) {
+                thread.join();
+            }
+        }
+
+        void run(_In_ std::size_t iterations, _In_ const std::function<void(std::size_t)>& work) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (_threads.size() < _count) {
+                const std::size_t index = _threads.size();
+                _threads.emplace_back([this, index] { loop(index); });
+            }
+            _work = &work;
+            _iterations = iterations;
+            _pending = _count;
+            _generation++;
+            _wake.notify_all();
+            _done.wait(lock, [this] { return _pending == 0; });
+        }
+
+    private:
+        void loop(_In_ std::size_t index) {
+            std::uint64_t seen = 0;
+            std::unique_lock<std::mutex> lock(_mutex);
+            for (;;) {
+                _wake.wait(lock, [this, &seen] { return _stopping || _generation != seen; });
+                if (_stopping) {
+                    return;
+                }
+                seen = _generation;
+                const std::size_t share = _iterations / _count + (index < _iterations % _count ? 1 : 0);
+                const std::function<void(std::size_t)>* work = _work;
+                lock.unlock();
+                (*work)(share);
+                lock.lock();
+                if (--_pending == 0) {
+                    _done.notify_one();
+                }
+            }
+        }
+
+        const std::size_t                       _count;
+        std::vector<std::thread>                _threads;
+        std::mutex                              _mutex;
+        std::condition_variable                 _wake;
+        std::condition_variable                 _done;
+        const std::function<void(std::size_t)>* _work = nullptr;
+        std::size_t                             _iterations = 0;
+        std::size_t                             _pending = 0;
+        std::uint64_t                           _generation = 0;
+        bool                                    _stopping = false;
+    };
+
+    double percentile(_In_ const std::vector<double>& sorted, _In_ double fraction) {
+        const double rank = fraction * static_cast<double>(sorted.size() - 1);
+        const std::size_t low = static_cast<std::size_t>(std::floor(rank));
+        const std::size_t high = std::min(low + 1, sorted.size() - 1);
+        return sorted[low] + (sorted[high] - sorted[low]) * (rank - static_cast<double>(low));
+    }
+
+    std::string jsonString(_In_ const std::string& value) {
+        std::string out = "\"";
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += c;
+        }
+        return out + "\"";
+    }
+}
+
+void WinToastBenchmark::add(_In_ const std::string& name, _In_ Body body) {
+    _cases.emplace_back(name, std::move(body));
+}
+
+void WinToastBenchmark::addStandardCases() {
+    // Templates
+    add("template.construct", [](std::size_t n) {
+        for (std::size_t i = 0; i < n; i++) {
+            WinToastTemplate toast(WinToastTemplate::ImageAndText02);
+            toast.setTextField(L"Build 4711 failed on host-07", WinToastTemplate::FirstLine);
+            toast.setTextField(L"3 tests failed", WinToastTemplate::SecondLine);
+            toast.setImagePath(L"C:\\Temp\\failed.png");
+            keep(toast.textFieldsCount());
+        }
+    });
+    auto rich = std::make_shared<WinToastTemplate>(sampleToast(WinToastTemplate::ImageAndText04, 3, true));
+    add("template.copy", [rich](std::size_t n) {
+        for (std::size_t i = 0; i < n; i++) {
+            WinToastTemplate copy(*rich);
+            keep(copy.actionsCount());
+        }
+    });
+    add("template.contentHash", [rich](std::size_t n) {
+        for (std::size_t i = 0; i < n; i++) {
+            keep(static_cast<std::size_t>(rich->contentHash()));
+        }
+    });
+    add("frozen.freeze", [rich](std::size_t n) {
+        for (std::size_t i = 0; i < n; i++) {
+            WinToastFrozenToast frozen(*rich);
+            keep(frozen.payloadSize());
+        }
+    });
+    auto frozenRich = std::make_shared<WinToastFrozenToast>(*rich);
+    add("frozen.copy", [frozenRich](std::size_t n) {
+        for (std::size_t i = 0; i < n; i++) {
+            WinToastFrozenToast copy(*frozenRich);
+            keep(copy.byteSize());
+        }
+    });
+
+    // Parking toasts the way a delay queue does: the old per-template copy
+    // against freezing once.
+    const std::size_t QueueDepth = 1024;
+    add("queue.enqueue.template", [rich, QueueDepth](std::size_t n) {
+        std::deque<WinToastTemplate> queue;
+        for (std::size_t i = 0; i < n; i++) {
+            queue.push_back(*rich);
+            if (queue.size() == QueueDepth) {
+                queue.clear();
+            }
+        }
+        keep(queue.size());
+    });
+    add("queue.enqueue.frozen", [rich, QueueDepth](std::size_t n) {
+        std::deque<WinToastFrozenToast> queue;
+        for (std::size_t i = 0; i < n; i++) {
+            queue.emplace_back(*rich);
+            if (queue.size() == QueueDepth) {
+                queue.clear();
+            }
+        }
+        keep(queue.size());
+    });
+
+    // Payloads, one case per template type, plus actions/attribution handling.
+    for (int type = 0; type < WinToastTemplate::WinToastTemplateTypeCount; type++) {
+        auto toast = std::make_shared<WinToastTemplate>(sampleToast(static_cast<WinToastTemplate::WinToastTemplateType>(type)));
+        auto prototypes = std::make_shared<WinToastPrototypeCache>();
+        add("payload.compile." + narrow(TypeNames[type]), [toast, prototypes](std::size_t n) {
+            std::wstring xml;
+            for (std::size_t i = 0; i < n; i++) {
+                WinToastPayload::compile(*prototypes->get(toast->type(), true), *toast, xml);
+                keep(xml.size());
+            }
+        });
+    }
+    auto actions = std::make_shared<WinToastTemplate>(sampleToast(WinToastTemplate::Text02, 5, true));
+    add("payload.compile.actionsAndAttribution", [actions](std::size_t n) {
+        WinToastPrototypeCache prototypes;
+        std::wstring xml;
+        for (std::size_t i = 0; i < n; i++) {
+            WinToastPayload::compile(*prototypes.get(actions->type(), true), *actions, xml);
+            keep(xml.size());
+        }
+    });
+    auto frozenActions = std::make_shared<WinToastFrozenToast>(*actions);
+    add("payload.compile.frozen", [frozenActions](std::size_t n) {
+        WinToastPrototypeCache prototypes;
+        std::wstring xml;
+        for (std::size_t i = 0; i < n; i++) {
+            WinToastPayload::compile(*prototypes.get(frozenActions->type(), true), *frozenActions, xml);
+            keep(xml.size());
+        }
+    });
+    add("payload.compile.legacyFeatures", [actions](std::size_t n) {
+        WinToastPrototypeCache prototypes;
+        std::wstring xml;
+        for (std::size_t i = 0; i < n; i++) {
+            WinToastPayload::compile(*prototypes.get(actions->type(), false), *actions, xml);
+            keep(xml.size());
+        }
+    });
+
+    // Ids and registry
+    add("registry.nextId", [](std::size_t n) {
+        WinToastRegistry registry;
+        for (std::size_t i = 0; i < n; i++) {
+            keep(static_cast<std::size_t>(registry.nextId()));
+        }
+    });
+    // Steady state with 1000 live toasts: one in, the oldest out.
+    auto registry = std::make_shared<WinToastRegistry>();
+    auto oldest = std::make_shared<std::int64_t>(1);
+    for (int i = 0; i < 1000; i++) {
+        registry->reserve(registry->nextId());
+    }
+    add("registry.insertErase", [registry, oldest](std::size_t n) {
+        for (std::size_t i = 0; i < n; i++) {
+            registry->reserve(registry->nextId(), 0);
+            keep(registry->erase((*oldest)++));
+        }
+    });
+    add("registry.reserveExpire", [](std::size_t n) {
+        WinToastRegistry registry;
+        for (std::size_t i = 0; i < n; i++) {
+            registry.reserve(registry.nextId(), static_cast<std::int64_t>(i + 1));
+        }
+        keep(registry.expire(static_cast<std::int64_t>(n)));
+    });
+
+    // End to end against the in-memory notifier, including the outcome coming
+    // back and the registry entry going away.
+    auto pipeline = std::make_shared<Pipeline>();
+    auto single = std::make_shared<WinToastTemplate>(sampleToast(WinToastTemplate::ImageAndText02, 2, true));
+    add("send.single", [pipeline, single](std::size_t n) {
+        for (std::size_t i = 0; i < n; i++) {
+            WinToastNotificationHandle notification = pipeline->showOne(*single, pipeline->xml);
+            keep(pipeline->backend->activate(notification));
+        }
+    });
+    // Same work through a model of the batch path (shared setup, one registry
+    // lock per batch), not WinToast::showToasts itself. Exactly n toasts go out,
+    // the last batch short if need be, so the time per toast compares directly
+    // with send.single.
+    const std::size_t BatchSize = 16;
+    auto batch = std::make_shared<std::vector<WinToastTemplate>>(BatchSize, *single);
+    add("send.batch16", [pipeline, batch, BatchSize](std::size_t n) {
+        for (std::size_t sent = 0; sent < n; sent += BatchSize) {
+            for (auto& notification : pipeline->showBatch(*batch, std::min(BatchSize, n - sent))) {
+                keep(pipeline->backend->activate(notification));
+            }
+        }
+    });
+
+    // Replace-by-tag with 100k live tagged toasts (one per host, say): finding
+    // the toast of a tag, rebinding a tag in the registry alone, and the whole
+    // send to the in-memory notifier, the superseded toast reported and
+    // released. Each replacement keeps the count at 100k.
+    const std::size_t LiveTags = 100000;
+    auto tagged = std::make_shared<Pipeline>();
+    auto tags = std::make_shared<std::vector<std::wstring>>();
+    auto taggedToast = std::make_shared<WinToastTemplate>(sampleToast(WinToastTemplate::Text01, 0, false));
+    tags->reserve(LiveTags);
+    for (std::size_t i = 0; i < LiveTags; i++) {
+        tags->push_back(L"host-" + std::to_wstring(i));
+        taggedToast->setTag((*tags)[i]);
+        tagged->showTagged(*taggedToast, tagged->xml);
+    }
+    add("tag.lookup.100k", [tagged, tags](std::size_t n) {
+        static const std::wstring NoGroup;
+        for (std::size_t i = 0; i < n; i++) {
+            keep(static_cast<std::size_t>(tagged->registry->findTag(IWinToastBackend::tagKey((*tags)[(i * 7919) % tags->size()], NoGroup))));
+        }
+    });
+    add("tag.replace.registry.100k", [tagged, tags](std::size_t n) {
+        static const std::wstring NoGroup;
+        for (std::size_t i = 0; i < n; i++) {
+            const std::int64_t id = tagged->registry->nextId();
+            tagged->registry->reserve(id);
+            WinToastRegistry::Superseded superseded;
+            if (tagged->registry->bindTag(id, IWinToastBackend::tagKey((*tags)[(i * 7919) % tags->size()], NoGroup), tagged->forwarder(id), superseded)) {
+                superseded.handler->toastDismissed(IWinToastHandler::ApplicationHidden);
+            }
+            keep(static_cast<std::size_t>(superseded.id));
+        }
+    });
+    add("tag.replace.send.100k", [tagged, tags, taggedToast](std::size_t n) {
+        for (std::size_t i = 0; i < n; i++) {
+            taggedToast->setTag((*tags)[(i * 7919) % tags->size()]);
+            keep(tagged->showTagged(*taggedToast, tagged->xml) != nullptr);
+        }
+    });
+
+    // The same end-to-end send from several threads at once, sharing one
+    // registry, prototype cache, dispatcher and notifier. Times are wall-clock
+    // per toast across all threads, so 1e9 / p50 is sends per second; with the
+    // sharded registry it should keep falling as threads are added, up to the
+    // core count.
+    for (std::size_t threads : { 1, 2, 4, 8 }) {
+        auto shared = std::make_shared<Pipeline>();
+        shared->backend->openSession(L"WinToast.Benchmark");
+        auto gang = std::make_shared<WorkerGang>(threads);
+        add("send.concurrent." + std::to_string(threads) + "threads", [shared, single, gang](std::size_t n) {
+            std::atomic<std::size_t> activated{ 0 };
+            gang->run(n, [shared, single, &activated](std::size_t share) {
+                std::wstring xml;
+                std::size_t done = 0;
+                for (std::size_t i = 0; i < share; i++) {
+                    WinToastNotificationHandle notification = shared->showOne(*single, xml);
+                    done += shared->backend->activate(notification);
+                }
+                activated.fetch_add(done, std::memory_order_relaxed);
+            });
+            keep(activated.load(std::memory_order_relaxed));
+        });
+    }
+
+    // Instrumentation: one stage lap with stats enabled.
+    add("stats.lap", [](std::size_t n) {
+        auto stats = std::make_shared<WinToastStats>();
+        WinToastStageTimer timer(stats.get());
+        for (std::size_t i = 0; i < n; i++) {
+            timer.lap(WinToastStats::Show);
+        }
+        keep(static_cast<std::size_t>(stats->snapshot().stages[WinToastStats::Show].count));
+    });
+    // The same lap emitting a trace span; the flusher writes into a stream that
+    // discards everything, so this is the cost paid on the sending thread.
+    static std::ostream traceSink(nullptr);
+    auto tracer = std::make_shared<WinToastTracer>(traceSink);
+    add("trace.lap", [tracer](std::size_t n) {
+        WinToastStageTimer timer(nullptr, tracer.get(), 1);
+        for (std::size_t i = 0; i < n; i++) {
+            timer.lap(WinToastStats::Show);
+        }
+        keep(static_cast<std::size_t>(tracer->counters().recorded));
+    });
+
+    // Optional stages
+    add("ratelimit.admit", [](std::size_t n) {
+        auto clock = std::make_shared<WinToastManualClock>();
+        WinToastRateLimiter limiter(clock);
+        WinToastRateLimiter::BucketConfig config;
+        config.ratePerSecond = 1000000;
+        config.burst = 1;
+        limiter.setDefaultSource(config);
+        for (std::size_t i = 0; i < n; i++) {
+            clock->advance(1);
+            keep(limiter.admit(L"bench"));
+        }
+    });
+    // Hash plus table lookup per template, with 1000 distinct toasts in rotation.
+    auto variants = std::make_shared<std::vector<WinToastTemplate>>();
+    for (int i = 0; i < 1000; i++) {
+        variants->push_back(sampleToast(WinToastTemplate::Text02, 2, true));
+        variants->back().setTextField(L"Alert " + std::to_wstring(i), WinToastTemplate::SecondLine);
+    }
+    add("dedup.check", [variants](std::size_t n) {
+        auto clock = std::make_shared<WinToastManualClock>();
+        WinToastDeduplicator::Options options;
+        options.windowMicroseconds = 1000;
+        WinToastDeduplicator deduplicator(options, clock);
+        for (std::size_t i = 0; i < n; i++) {
+            clock->advance(1);
+            keep(deduplicator.check((*variants)[i % variants->size()].contentHash()).suppress);
+        }
+    });
+    // Pool scheduling: freeze, queue and weighted fair pick per toast, across 8
+    // tenants of different weights. The tenants only count, so this is the
+    // pool's own overhead on top of a send.
+    add("pool.submitDispatch.8tenants", [rich](std::size_t n) {
+        class CountingTenant : public IWinToastTenant {
+        public:
+            bool            initialize() override { return true; }
+            std::int64_t    show(_In_ const WinToastFrozenToast&, _In_ const std::shared_ptr<IWinToastHandler>&) override { return _shown++; }
+        private:
+            std::int64_t    _shown = 0;
+        };
+        const std::size_t Tenants = 8;
+        WinToastPool::Options options;
+        options.queueCapacity = 64;
+        WinToastPool pool([](const std::wstring&, const std::wstring&) { return std::make_shared<CountingTenant>(); }, options);
+        std::vector<std::wstring> aumis;
+        for (std::size_t i = 0; i < Tenants; i++) {
+            aumis.push_back(L"Bench.Tenant" + std::to_wstring(i));
+            pool.addTenant(aumis.back(), aumis.back(), static_cast<double>(i + 1));
+        }
+        for (std::size_t i = 0; i < n; i++) {
+            pool.submit(aumis[i % Tenants], *rich, new NullHandler());
+            if (i % 64 == 63) {
+                keep(pool.dispatch());
+            }
+        }
+        keep(pool.dispatch());
+    });
+    // Progress updates from a producer reporting every 100 us (simulated clock),
+    // coalesced to 4 platform updates a second, against sending every one of
+    // them to the in-memory notifier.
+    auto progressCase = [](double maxUpdatesPerSecond) {
+        return [maxUpdatesPerSecond](std::size_t n) {
+            std::shared_ptr<WinToastMemoryBackend> backend = std::make_shared<WinToastMemoryBackend>();
+            backend->openSession(L"Bench.Progress");
+            WinToastNotificationData shown;
+            shown.sequence = 1;
+            WinToastNotificationHandle notification;
+            backend->showTagged(L"<toast/>", 0, L"1", L"Bench", shown, std::make_shared<NullHandler>(), notification);
+            std::shared_ptr<WinToastManualClock> clock = std::make_shared<WinToastManualClock>();
+            WinToastUpdateCoalescer::Options options;
+            options.maxUpdatesPerSecond = maxUpdatesPerSecond;
+            WinToastUpdateCoalescer coalescer([backend](const std::wstring& tag, const std::wstring& group, const WinToastNotificationData& data) {
+                return backend->update(tag, group, data);
+            }, options, clock);
+            coalescer.track(1, L"1", L"Bench");
+            WinToastProgressBar bar;
+            bar.title = L"Building";
+            for (std::size_t i = 0; i < n; i++) {
+                bar.value = static_cast<double>(i % 1000) / 1000;
+                keep(coalescer.update(1, bar.data()));
+                clock->advance(100);
+                if (i % 64 == 63) {
+                    keep(coalescer.flush());
+                }
+            }
+        };
+    };
+    add("progress.update.coalesced", progressCase(4.0));
+    add("progress.update.direct", progressCase(0));
+    // Image cache preprocessing: what a cache worker does per new source image
+    // (decode, downscale to the toast size, encode), one 1024x1024 picture at a time.
+    const auto photo = std::make_shared<WinToastImage>(sampleImage(1024, 1024));
+    const auto photoBmp = std::make_shared<std::vector<std::uint8_t>>(sampleBmp(*photo));
+    const auto thumbnail = std::make_shared<WinToastImage>(WinToastImage::downscale(*photo, 256));
+    add("image.decodeBmp.1024", [photoBmp](std::size_t n) {
+        WinToastPortableImageCodec codec;
+        WinToastImage image;
+        for (std::size_t i = 0; i < n; i++) {
+            keep(codec.decode(photoBmp->data(), photoBmp->size(), image));
+        }
+    });
+    add("image.downscale.1024to256", [photo](std::size_t n) {
+        for (std::size_t i = 0; i < n; i++) {
+            keep(WinToastImage::downscale(*photo, 256).pixels.size());
+        }
+    });
+    add("image.encodePng.256", [thumbnail](std::size_t n) {
+        WinToastPortableImageCodec codec;
+        std::vector<std::uint8_t> png;
+        for (std::size_t i = 0; i < n; i++) {
+            keep(codec.encodePng(*thumbnail, png));
+        }
+    });
+    add("payload.compile.longImagePath", [](std::size_t n) {
+        WinToastTemplate toast = sampleToast(WinToastTemplate::ImageAndText02);
+        toast.setImagePath(L"\\\\fileserver\\builds\\" + std::wstring(300, L'x') + L"\\status #1.png");
+        WinToastPrototypeCache prototypes;
+        auto prototype = prototypes.get(toast.type(), true);
+        std::wstring xml;
+        for (std::size_t i = 0; i < n; i++) {
+            WinToastPayload::compile(*prototype, toast, xml);
+            keep(xml.size());
+        }
+    });
+
+    // The in-memory links make a full validation nearly free; on Windows it is a
+    // CoCreateInstance plus a .lnk load. What these cases track is the cost of
+    // the stamp check itself.
+    add("shortcut.ensure.stampHit", [](std::size_t n) {
+        WinToastShortcutCache cache(std::make_shared<WinToastMemoryShellLinks>());
+        long hr = 0;
+        cache.ensure(L"WinToast.lnk", L"WinToast.lnkstamp", L"WinToast.ID", hr);
+        for (std::size_t i = 0; i < n; i++) {
+            keep(cache.ensure(L"WinToast.lnk", L"WinToast.lnkstamp", L"WinToast.ID", hr));
+        }
+    });
+    add("shortcut.ensure.fullValidation", [](std::size_t n) {
+        auto links = std::make_shared<WinToastMemoryShellLinks>();
+        WinToastShortcutCache cache(links);
+        long hr = 0;
+        cache.ensure(L"WinToast.lnk", L"WinToast.lnkstamp", L"WinToast.ID", hr);
+        for (std::size_t i = 0; i < n; i++) {
+            links->remove(L"WinToast.lnkstamp");
+            keep(cache.ensure(L"WinToast.lnk", L"WinToast.lnkstamp", L"WinToast.ID", hr));
+        }
+    });
+}
+
+std::vector<WinToastBenchmark::Result> WinToastBenchmark::run(_In_ const Options& options) const {
+    std::vector<Result> results;
+    for (const auto& benchCase : _cases) {
+        if (!options.filter.empty() && benchCase.first.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        const Body& body = benchCase.second;
+        auto timeRun = [&body](std::size_t iterations) {
+            const BenchClock::time_point start = BenchClock::now();
+            body(iterations);
+            return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+        };
+
+        // Calibrate: double the iteration count until one run fills a sample.
+        const double target = static_cast<double>(options.sampleMicroseconds) * 1000.0;
+        std::size_t iterations = 1;
+        while (timeRun(iterations) < target && iterations < (std::size_t(1) << 30)) {
+            iterations *= 2;
+        }
+
+        std::vector<double> perOperation;
+        perOperation.reserve(options.samples);
+        for (std::size_t sample = 0; sample < options.samples; sample++) {
+            perOperation.push_back(timeRun(iterations) / static_cast<double>(iterations));
+        }
+        std::sort(perOperation.begin(), perOperation.end());
+
+        Result result;
+        result.name = benchCase.first;
+        result.samples = perOperation.size();
+        result.iterationsPerSample = iterations;
+        result.min = perOperation.front();
+        result.p50 = percentile(perOperation, 0.50);
+        result.p90 = percentile(perOperation, 0.90);
+        result.p99 = percentile(perOperation, 0.99);
+        result.max = perOperation.back();
+        double total = 0;
+        for (double value : perOperation) {
+            total += value;
+        }
+        result.mean = total / static_cast<double>(perOperation.size());
+        // One more run, untimed, so counting never skews the samples.
+        result.allocations = -1;
+        if (AllocationCounter) {
+            const std::uint64_t before = AllocationCounter->load(std::memory_order_relaxed);
+            body(iterations);
+            const std::uint64_t after = AllocationCounter->load(std::memory_order_relaxed);
+            result.allocations = static_cast<double>(after - before) / static_cast<double>(iterations);
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+
+void WinToastBenchmark::setAllocationCounter(_In_opt_ const std::atomic<std::uint64_t>* counter) {
+    AllocationCounter = counter;
+}
+
+void WinToastBenchmark::writeJson(_In_ const std::vector<Result>& results, _In_ const Options& options, _Inout_ std::ostream& out) {
+    std::ostringstream json;
+    json.precision(1);
+    json << std::fixed;
+    json << "{\n  \"schema\": \"wintoast-bench/1\",\n"
+         << "  \"unit\": \"ns/op\",\n"
+         << "  \"samples\": " << options.samples << ",\n"
+         << "  \"sampleMicroseconds\": " << options.sampleMicroseconds << ",\n"
+         << "  \"cases\": [";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        json << (i ? ",\n" : "\n")
+             << "    {\"name\": " << jsonString(r.name)
+             << ", \"samples\": " << r.samples
+             << ", \"iterations\": " << r.iterationsPerSample
+             << ", \"min\": " << r.min
+             << ", \"p50\": " << r.p50
+             << ", \"p90\": " << r.p90
+             << ", \"p99\": " << r.p99
+             << ", \"max\": " << r.max
+             << ", \"mean\": " << r.mean;
+        if (r.allocations >= 0) {
+            json << std::setprecision(2) << ", \"allocsPerOp\": " << r.allocations << std::setprecision(1);
+        }
+        json << "}";
+    }
+    json << "\n  ]\n}\n";
+    out << json.str();
+}
+
+bool WinToastBenchmark::parseArguments(_In_ const std::vector<std::string>& args, _Out_ Options& options) {
+    options = Options();
+    for (std::size_t i = 0; i < args.size(); i++) {
+        const bool hasValue = i + 1 < args.size();
+        try {
+            if (args[i] == "--samples" && hasValue) {
+                options.samples = static_cast<std::size_t>(std::stoul(args[++i]));
+            } else if (args[i] == "--sample-us" && hasValue) {
+                options.sampleMicroseconds = std::stoll(args[++i]);
+            } else if (args[i].compare(0, 2, "--") != 0 && options.filter.empty()) {
+                options.filter = args[i];
+            } else {
+                return false;
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    return options.samples > 0 && options.sampleMicroseconds > 0;
+}
+
+int WinToastBenchmark::main(_In_ const std::vector<std::string>& args, _Inout_ std::ostream& out) {
+    Options options;
+    if (!parseArguments(args, options)) {
+        return 2;
+    }
+    WinToastBenchmark benchmark;
+    benchmark.addStandardCases();
+    writeJson(benchmark.run(options), options, out);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef WINTOASTBENCH_H
+#define WINTOASTBENCH_H
+#include "wintoasttemplate.h"
+#include <atomic>
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace WinToastLib {
+
+    // Micro-benchmarks for the portable parts of the pipeline. Each case is timed
+    // over a number of samples; a sample runs the case body enough iterations to
+    // last about sampleMicroseconds, and the per-operation times of all samples
+    // are reported as percentiles. Nothing here touches Windows, so the suite
+    // runs wherever the portable sources build (see wintoastbench_main.cpp).
+    class WinToastBenchmark {
+    public:
+        // Runs the operation under test iterations times.
+        typedef std::function<void(std::size_t iterations)> Body;
+
+        struct Options {
+            std::size_t         samples = 100;
+            std::int64_t        sampleMicroseconds = 2000;
+            std::string         filter;                 // only cases whose name contains this
+        };
+
+        struct Result {
+            std::string         name;
+            std::size_t         samples;
+            std::uint64_t       iterationsPerSample;
+            double              min;                    // all times in nanoseconds per operation
+            double              p50;
+            double              p90;
+            double              p99;
+            double              max;
+            double              mean;
+            double              allocations;            // heap allocations per operation; negative when not counted
+        };
+
+        void                    add(_In_ const std::string& name, _In_ Body body);
+        // The standard suite: templates, payloads, registry, end-to-end sends and
+        // the optional stages (rate limiter, dedup, shortcut stamp).
+        void                    addStandardCases();
+        std::vector<Result>     run(_In_ const Options& options) const;
+
+        // Process-wide count of heap allocations, kept by the host binary (the
+        // standalone runner replaces operator new for it). When set, every case
+        // also reports allocations per operation.
+        static void             setAllocationCounter(_In_opt_ const std::atomic<std::uint64_t>* counter);
+        static void             writeJson(_In_ const std::vector<Result>& results, _In_ const Options& options, _Inout_ std::ostream& out);
+        // Parses [--samples n] [--sample-us n] [filter]; false on a bad argument.
+        static bool             parseArguments(_In_ const std::vector<std::string>& args, _Out_ Options& options);
+        // Builds the standard suite, runs it and writes JSON to out. Returns a process exit code.
+        static int              main(_In_ const std::vector<std::string>& args, _Inout_ std::ostream& out);
+
+    private:
+        std::vector<std::pair<std::string, Body>> _cases;
+    };
+}
+#endif // WINTOASTBENCH_H
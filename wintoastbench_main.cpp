@@ -0,0 +1,69 @@
+// Standalone entry point for the benchmark suite, for builds without the
+// Windows parts of WinToast. On Linux, compile this file together with
+// wintoastbench.cpp, wintoasttemplate.cpp, wintoastpayload.cpp,
+// wintoastbackend.cpp, wintoastdispatch.cpp, wintoastregistry.cpp, wintoaststats.cpp,
+// wintoastratelimit.cpp, wintoastdedup.cpp, wintoastshortcut.cpp, wintoasttrace.cpp,
+// wintoastfrozen.cpp, wintoastimage.cpp, wintoastpool.cpp and wintoastprogress.cpp, e.g.
+//
+//   g++ -std=c++14 -O2 -pthread -o wintoastbench wintoastbench_main.cpp <the files above>
+//   ./wintoastbench [--samples n] [--sample-us n] [filter] > results.json
+//
+// WinToast.exe --benchmark runs the same suite. Only this runner counts heap
+// allocations (allocsPerOp in the output), by replacing the global operator new.
+#include "wintoastbench.h"
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+namespace {
+    std::atomic<std::uint64_t> Allocations{ 0 };
+
+    void* countedAllocation(std::size_t size) {
+        Allocations.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size ? size : 1);
+    }
+}
+
+void* operator new(std::size_t size) {
+    if (void* p = countedAllocation(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocation(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocation(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char** argv) {
+    WinToastLib::WinToastBenchmark::setAllocationCounter(&Allocations);
+    const int status = WinToastLib::WinToastBenchmark::main(std::vector<std::string>(argv + 1, argv + argc), std::cout);
+    if (status != 0) {
+        std::cerr << "Usage: wintoastbench [--samples n] [--sample-us n] [filter]" << std::endl;
+    }
+    return status;
+}
@@ -0,0 +1,52 @@
+#include "wintoastcapabilities.h"
+#include <atomic>
+#include <mutex>
+
+using namespace WinToastLib;
+
+namespace {
+    struct SnapshotState {
+        std::mutex                                      mutex;
+        std::shared_ptr<IWinToastCapabilityProbe>       probe;
+        std::atomic<const WinToastCapabilities*>        current{ nullptr };
+        // Snapshots are never freed: callers hold plain references to them. A new
+        // one is only made after install(), so this stays tiny.
+        std::vector<std::unique_ptr<WinToastCapabilities>> snapshots;
+        std::atomic<std::size_t>                        probes{ 0 };
+    };
+
+    SnapshotState& state() {
+        static SnapshotState instance;
+        return instance;
+    }
+}
+
+const WinToastCapabilities& WinToastCapabilitySnapshot::get(_In_ IWinToastCapabilityProbe& fallback) {
+    SnapshotState& snapshot = state();
+    const WinToastCapabilities* current = snapshot.current.load(std::memory_order_acquire);
+    if (current) {
+        return *current;
+    }
+
+    std::lock_guard<std::mutex> lock(snapshot.mutex);
+    current = snapshot.current.load(std::memory_order_relaxed);
+    if (!current) {
+        IWinToastCapabilityProbe& probe = snapshot.probe ? *snapshot.probe : fallback;
+        snapshot.snapshots.emplace_back(new WinToastCapabilities(probe.probe()));
+        snapshot.probes.fetch_add(1, std::memory_order_relaxed);
+        current = snapshot.snapshots.back().get();
+        snapshot.current.store(current, std::memory_order_release);
+    }
+    return *current;
+}
+
+void WinToastCapabilitySnapshot::install(_In_opt_ std::shared_ptr<IWinToastCapabilityProbe> probe) {
+    SnapshotState& snapshot = state();
+    std::lock_guard<std::mutex> lock(snapshot.mutex);
+    snapshot.probe = std::move(probe);
+    snapshot.current.store(nullptr, std::memory_order_release);
+}
+
+std::size_t WinToastCapabilitySnapshot::probeCount() {
+    return state().probes.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,54 @@
+#ifndef WINTOASTCAPABILITIES_H
+#define WINTOASTCAPABILITIES_H
+#include "wintoasttemplate.h"
+#include <bitset>
+#include <memory>
+
+namespace WinToastLib {
+
+    // What the running system offers, as far as WinToast is concerned.
+    struct WinToastCapabilities {
+        enum Feature {
+            AppUserModelId = 0,         // SetCurrentProcessExplicitAppUserModelID resolved
+            ShellLinkProperties,        // PropVariantToString resolved
+            WinRTActivation,            // RoGetActivationFactory and the HSTRING functions resolved
+            Actions,                    // toast <actions>
+            Audio,                      // toast <audio>
+            Attribution,                // <text placement="attribution">
+            FeatureCount
+        };
+
+        std::bitset<FeatureCount>   features;
+        std::uint32_t               majorVersion = 0;
+        std::uint32_t               minorVersion = 0;
+        std::uint32_t               buildNumber = 0;
+
+        inline bool                 has(_In_ Feature feature) const { return features.test(feature); }
+        inline void                 set(_In_ Feature feature, _In_ bool supported = true) { features.set(feature, supported); }
+        // Every entry point WinToast needs was found.
+        inline bool                 compatible() const { return has(AppUserModelId) && has(ShellLinkProperties) && has(WinRTActivation); }
+        // Actions, audio and attribution: what the payload compiler calls modern features.
+        inline bool                 modern() const { return has(Actions) && has(Audio) && has(Attribution); }
+    };
+
+    // Looks at the system once and reports what it found.
+    class IWinToastCapabilityProbe {
+    public:
+        virtual ~IWinToastCapabilityProbe() {}
+        virtual WinToastCapabilities    probe() = 0;
+    };
+
+    // Process-wide capability snapshot. The first get() runs the probe; every later
+    // call, from any thread, returns the same snapshot without probing again.
+    class WinToastCapabilitySnapshot {
+    public:
+        // fallback is used when no probe was installed.
+        static const WinToastCapabilities&  get(_In_ IWinToastCapabilityProbe& fallback);
+        // Installs probe (nullptr restores the fallback) and drops the snapshot, so
+        // the next get() probes again. References from earlier get() calls stay valid.
+        static void                         install(_In_opt_ std::shared_ptr<IWinToastCapabilityProbe> probe);
+        // How many times a probe has run in this process.
+        static std::size_t                  probeCount();
+    };
+}
+#endif // WINTOASTCAPABILITIES_H
@@ -0,0 +1,44 @@
+#ifndef WINTOASTCLOCK_H
+#define WINTOASTCLOCK_H
+#include "wintoasttemplate.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+namespace WinToastLib {
+
+    // Monotonic time source for anything that schedules by elapsed time (rate
+    // limiting, dedup windows, update coalescing). Injecting a manual clock makes
+    // those stages deterministic.
+    class IWinToastClock {
+    public:
+        virtual ~IWinToastClock() {}
+        virtual std::int64_t        nowMicroseconds() const = 0;
+    };
+
+    class WinToastSteadyClock : public IWinToastClock {
+    public:
+        std::int64_t nowMicroseconds() const override {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static std::shared_ptr<IWinToastClock> instance() {
+            static std::shared_ptr<IWinToastClock> clock = std::make_shared<WinToastSteadyClock>();
+            return clock;
+        }
+    };
+
+    // Clock that only moves when told to.
+    class WinToastManualClock : public IWinToastClock {
+    public:
+        explicit WinToastManualClock(_In_ std::int64_t startMicroseconds = 0) : _now(startMicroseconds) {}
+
+        std::int64_t nowMicroseconds() const override { return _now.load(); }
+        inline void                 set(_In_ std::int64_t microseconds) { _now.store(microseconds); }
+        inline void                 advance(_In_ std::int64_t microseconds) { _now.fetch_add(microseconds); }
+
+    private:
+        std::atomic<std::int64_t>   _now;
+    };
+}
+#endif // WINTOASTCLOCK_H
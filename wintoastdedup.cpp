@@ -0,0 +1,109 @@
+#include "wintoastdedup.h"
+#include <algorithm>
+
+using namespace WinToastLib;
+
+namespace {
+    inline std::size_t roundUpToPowerOfTwo(std::size_t value) {
+        std::size_t size = 1;
+        while (size < value) {
+            size <<= 1;
+        }
+        return size;
+    }
+}
+
+WinToastDeduplicator::WinToastDeduplicator() : WinToastDeduplicator(Options()) {}
+
+WinToastDeduplicator::WinToastDeduplicator(_In_ const Options& options, _In_opt_ std::shared_ptr<IWinToastClock> clock) :
+    _options(options),
+    _clock(clock ? std::move(clock) : WinToastSteadyClock::instance())
+{
+    _options.sets = roundUpToPowerOfTwo(std::max<std::size_t>(options.sets, 1));
+    _options.ways = std::max<std::size_t>(options.ways, 1);
+    _setMask = _options.sets - 1;
+    _entries.resize(_options.sets * _options.ways);
+}
+
+WinToastDeduplicator::Verdict WinToastDeduplicator::lookup(_In_ std::uint64_t hash) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return lookupLocked(hash, _clock->nowMicroseconds());
+}
+
+void WinToastDeduplicator::commit(_In_ std::uint64_t hash) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    commitLocked(hash, _clock->nowMicroseconds());
+}
+
+WinToastDeduplicator::Verdict WinToastDeduplicator::check(_In_ std::uint64_t hash) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::int64_t now = _clock->nowMicroseconds();
+    const Verdict verdict = lookupLocked(hash, now);
+    if (!verdict.suppress) {
+        commitLocked(hash, now);
+    }
+    return verdict;
+}
+
+WinToastDeduplicator::Entry* WinToastDeduplicator::find(_In_ std::uint64_t hash, _Out_ bool& found) {
+    // FNV's low bits are its weakest; fold the high half in before picking a set.
+    Entry* set = &_entries[(static_cast<std::size_t>(hash ^ (hash >> 32)) & _setMask) * _options.ways];
+    Entry* victim = set;
+    for (std::size_t way = 0; way < _options.ways; way++) {
+        Entry& entry = set[way];
+        if (entry.used && entry.hash == hash) {
+            found = true;
+            return &entry;
+        }
+        if (victim->used && (!entry.used || entry.shownAt < victim->shownAt)) {
+            victim = &entry;
+        }
+    }
+    found = false;
+    return victim;
+}
+
+WinToastDeduplicator::Verdict WinToastDeduplicator::lookupLocked(_In_ std::uint64_t hash, _In_ std::int64_t now) {
+    _counters.checked++;
+    bool found = false;
+    Entry* entry = find(hash, found);
+    if (!found) {
+        return Verdict{ false, 0 };
+    }
+    if (now - entry->shownAt < _options.windowMicroseconds) {
+        entry->repeats++;
+        _counters.suppressed++;
+        return Verdict{ true, entry->repeats };
+    }
+    return Verdict{ false, entry->repeats };
+}
+
+void WinToastDeduplicator::commitLocked(_In_ std::uint64_t hash, _In_ std::int64_t now) {
+    bool found = false;
+    Entry* entry = find(hash, found);
+    if (!found) {
+        if (entry->used && now - entry->shownAt < _options.windowMicroseconds) {
+            _counters.evictions++;
+        }
+        entry->hash = hash;
+        entry->used = true;
+    }
+    // The repeats it reported went out with this copy.
+    entry->shownAt = now;
+    entry->repeats = 0;
+}
+
+void WinToastDeduplicator::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::fill(_entries.begin(), _entries.end(), Entry());
+}
+
+WinToastDeduplicator::Counters WinToastDeduplicator::counters() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _counters;
+}
+
+std::wstring WinToastDeduplicator::repeatAttribution(_In_ const std::wstring& attribution, _In_ std::uint32_t repeats) {
+    std::wstring count = L"(" + std::to_wstring(repeats) + (repeats == 1 ? L" repeat)" : L" repeats)");
+    return attribution.empty() ? count : attribution + L" " + count;
+}
@@ -0,0 +1,76 @@
+#ifndef WINTOASTDEDUP_H
+#define WINTOASTDEDUP_H
+#include "wintoastclock.h"
+#include <mutex>
+
+namespace WinToastLib {
+
+    // Suppresses toasts whose content (WinToastTemplate::contentHash) was already
+    // shown less than a window ago. Hashes live in a fixed set-associative table
+    // (sets x ways entries, allocated once), so memory is constant and a lookup
+    // touches one set. When a set is full the entry shown longest ago is evicted,
+    // which can let a repeat through early but never suppresses a new toast.
+    class WinToastDeduplicator {
+    public:
+        struct Options {
+            std::int64_t        windowMicroseconds = 60 * 1000000LL;
+            std::size_t         sets = 256;             // rounded up to a power of two
+            std::size_t         ways = 4;
+            // Append the number of suppressed copies to the attribution text of
+            // the next copy that does go out.
+            bool                countRepeats = false;
+        };
+
+        struct Verdict {
+            bool                suppress;
+            // Copies suppressed since this content was last shown. For a toast
+            // that goes out, that is the count from the window that just ended.
+            std::uint32_t       repeats;
+        };
+
+        struct Counters {
+            std::uint64_t       checked;
+            std::uint64_t       suppressed;
+            std::uint64_t       evictions;              // entries pushed out while their window was still open
+        };
+
+        WinToastDeduplicator();
+        explicit WinToastDeduplicator(_In_ const Options& options, _In_opt_ std::shared_ptr<IWinToastClock> clock = nullptr);
+
+        // Whether hash is a repeat within the window; a repeat is counted as
+        // suppressed. Nothing is recorded as shown until commit(hash), which the
+        // caller makes once the toast is actually shown or queued, so a toast that
+        // is turned away later can be retried.
+        Verdict                 lookup(_In_ std::uint64_t hash);
+        void                    commit(_In_ std::uint64_t hash);
+        // lookup and, unless suppressed, commit in one step.
+        Verdict                 check(_In_ std::uint64_t hash);
+        void                    clear();
+        Counters                counters() const;
+        inline const Options&   options() const { return _options; }
+
+        // attribution with the repeat count appended, e.g. L"Build bot (3 repeats)".
+        static std::wstring     repeatAttribution(_In_ const std::wstring& attribution, _In_ std::uint32_t repeats);
+
+    private:
+        struct Entry {
+            std::uint64_t       hash = 0;
+            std::int64_t        shownAt = 0;
+            std::uint32_t       repeats = 0;
+            bool                used = false;
+        };
+
+        // The entry holding hash, or else the one to evict for it.
+        Entry*                  find(_In_ std::uint64_t hash, _Out_ bool& found);
+        Verdict                 lookupLocked(_In_ std::uint64_t hash, _In_ std::int64_t now);
+        void                    commitLocked(_In_ std::uint64_t hash, _In_ std::int64_t now);
+
+        Options                 _options;
+        std::shared_ptr<IWinToastClock> _clock;
+        mutable std::mutex      _mutex;
+        std::vector<Entry>      _entries;
+        std::size_t             _setMask;
+        Counters                _counters = {};
+    };
+}
+#endif // WINTOASTDEDUP_H
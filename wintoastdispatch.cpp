@@ -0,0 +1,225 @@
+#include "wintoastdispatch.h"
+
+using namespace WinToastLib;
+
+void WinToastOutcome::deliver() const {
+    if (!handler) {
+        return;
+    }
+    switch (kind) {
+    case Activated:
+        handler->toastActivated();
+        break;
+    case ActionActivated:
+        handler->toastActivated(actionIndex);
+        break;
+    case Dismissed:
+        handler->toastDismissed(reason);
+        break;
+    default:
+        handler->toastFailed();
+        break;
+    }
+}
+
+WinToastOutcomeQueue::WinToastOutcomeQueue(_In_ std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    _cells = new Cell[size];
+    _mask = size - 1;
+    for (std::size_t i = 0; i < size; i++) {
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    _enqueuePos.store(0, std::memory_order_relaxed);
+    _dequeuePos.store(0, std::memory_order_relaxed);
+}
+
+WinToastOutcomeQueue::~WinToastOutcomeQueue() {
+    delete[] _cells;
+}
+
+bool WinToastOutcomeQueue::push(_Inout_ WinToastOutcome& outcome) {
+    Cell* cell;
+    std::size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        cell = &_cells[pos & _mask];
+        const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+            if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->outcome = std::move(outcome);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool WinToastOutcomeQueue::pop(_Out_ WinToastOutcome& outcome) {
+    Cell* cell;
+    std::size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        cell = &_cells[pos & _mask];
+        const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+        if (diff == 0) {
+            if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = _dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+    outcome = std::move(cell->outcome);
+    cell->outcome.handler.reset();
+    cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+    return true;
+}
+
+WinToastDispatcher::WinToastDispatcher() : WinToastDispatcher(Options()) {
+}
+
+WinToastDispatcher::WinToastDispatcher(_In_ const Options& options) :
+    _options(options),
+    _queue(options.capacity)
+{
+    std::size_t workers = 0;
+    if (_options.mode == DedicatedThread) {
+        workers = 1;
+    } else if (_options.mode == ThreadPool) {
+        workers = _options.threads > 0 ? _options.threads : 1;
+    }
+    for (std::size_t i = 0; i < workers; i++) {
+        _workers.emplace_back(&WinToastDispatcher::workerLoop, this);
+    }
+}
+
+WinToastDispatcher::~WinToastDispatcher() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+bool WinToastDispatcher::post(_In_ WinToastOutcome outcome) {
+    _posted.fetch_add(1, std::memory_order_relaxed);
+    if (_options.mode == Inline) {
+        outcome.deliver();
+        _delivered.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    // Counted before the push so a worker can never pop an outcome that is not
+    // yet reflected in the depth.
+    const std::size_t depth = _depth.fetch_add(1) + 1;
+    if (!_queue.push(outcome)) {
+        _depth.fetch_sub(1);
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    const std::size_t queued = depth < _queue.capacity() ? depth : _queue.capacity();
+    std::size_t highWater = _highWaterDepth.load(std::memory_order_relaxed);
+    while (queued > highWater && !_highWaterDepth.compare_exchange_weak(highWater, queued, std::memory_order_relaxed)) {
+    }
+    // Pairs with the sleeping/depth check in workerLoop: either the worker sees
+    // the new depth or we see it asleep and wake it.
+    if (_sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _wakeup.notify_one();
+    }
+    return true;
+}
+
+bool WinToastDispatcher::deliverOne() {
+    WinToastOutcome outcome;
+    if (!_queue.pop(outcome)) {
+        return false;
+    }
+    _depth.fetch_sub(1);
+    outcome.deliver();
+    _delivered.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+std::size_t WinToastDispatcher::poll(_In_ std::size_t maxOutcomes) {
+    std::size_t delivered = 0;
+    while (delivered < maxOutcomes && deliverOne()) {
+        delivered++;
+    }
+    return delivered;
+}
+
+void WinToastDispatcher::workerLoop() {
+    for (;;) {
+        if (deliverOne()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleeping.fetch_add(1);
+        _wakeup.wait(lock, [this] { return _depth.load() > 0 || _stopping.load(); });
+        _sleeping.fetch_sub(1);
+        if (_stopping.load() && _depth.load() == 0) {
+            return;
+        }
+    }
+}
+
+WinToastDispatcher::Counters WinToastDispatcher::counters() const {
+    Counters counters;
+    counters.posted = _posted.load(std::memory_order_relaxed);
+    counters.delivered = _delivered.load(std::memory_order_relaxed);
+    counters.dropped = _dropped.load(std::memory_order_relaxed);
+    counters.depth = _depth.load(std::memory_order_relaxed);
+    counters.highWaterDepth = _highWaterDepth.load(std::memory_order_relaxed);
+    return counters;
+}
+
+WinToastDispatchingHandler::WinToastDispatchingHandler(_In_ std::shared_ptr<WinToastDispatcher> dispatcher, _In_ std::shared_ptr<IWinToastHandler> handler,
+                                                       _In_ std::int64_t toastId, _In_opt_ Observer observer) :
+    _dispatcher(dispatcher),
+    _handler(handler),
+    _toastId(toastId),
+    _observer(observer)
+{
+}
+
+void WinToastDispatchingHandler::post(_In_ WinToastOutcome::Kind kind, _In_ int actionIndex, _In_ WinToastDismissalReason reason) const {
+    WinToastOutcome outcome;
+    outcome.toastId = _toastId;
+    outcome.kind = kind;
+    outcome.actionIndex = actionIndex;
+    outcome.reason = reason;
+    outcome.handler = _handler;
+    if (_observer) {
+        _observer(outcome);
+    }
+    _dispatcher->post(std::move(outcome));
+}
+
+void WinToastDispatchingHandler::toastActivated() const {
+    post(WinToastOutcome::Activated, -1, UserCanceled);
+}
+
+void WinToastDispatchingHandler::toastActivated(int actionIndex) const {
+    post(WinToastOutcome::ActionActivated, actionIndex, UserCanceled);
+}
+
+void WinToastDispatchingHandler::toastDismissed(WinToastDismissalReason state) const {
+    post(WinToastOutcome::Dismissed, -1, state);
+}
+
+void WinToastDispatchingHandler::toastFailed() const {
+    post(WinToastOutcome::Failed, -1, UserCanceled);
+}
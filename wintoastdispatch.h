@@ -0,0 +1,132 @@
+#ifndef WINTOASTDISPATCH_H
+#define WINTOASTDISPATCH_H
+#include "wintoasttemplate.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace WinToastLib {
+
+    // What happened to a toast, captured on the platform callback thread.
+    struct WinToastOutcome {
+        enum Kind { Activated = 0, ActionActivated, Dismissed, Failed, KindCount };
+
+        std::int64_t                                toastId = -1;
+        Kind                                        kind = Failed;
+        int                                         actionIndex = -1;
+        IWinToastHandler::WinToastDismissalReason   reason = IWinToastHandler::UserCanceled;
+        std::shared_ptr<IWinToastHandler>           handler;
+
+        // Calls the matching IWinToastHandler method.
+        void                                        deliver() const;
+    };
+
+    // Bounded lock-free queue (array of sequenced cells). Any number of threads
+    // may push; pops are safe from several consumers too, which the thread-pool
+    // executor relies on. Capacity is rounded up to a power of two.
+    class WinToastOutcomeQueue {
+    public:
+        explicit WinToastOutcomeQueue(_In_ std::size_t capacity);
+        ~WinToastOutcomeQueue();
+        WinToastOutcomeQueue(const WinToastOutcomeQueue&) = delete;
+        WinToastOutcomeQueue& operator=(const WinToastOutcomeQueue&) = delete;
+
+        bool                    push(_Inout_ WinToastOutcome& outcome);     // false when full
+        bool                    pop(_Out_ WinToastOutcome& outcome);        // false when empty
+        std::size_t             capacity() const { return _mask + 1; }
+
+    private:
+        struct Cell {
+            std::atomic<std::size_t>    sequence;
+            WinToastOutcome             outcome;
+        };
+
+        Cell*                           _cells;
+        std::size_t                     _mask;
+        alignas(64) std::atomic<std::size_t> _enqueuePos;
+        alignas(64) std::atomic<std::size_t> _dequeuePos;
+    };
+
+    // Moves handler calls off the platform callback threads. Outcomes are posted
+    // to a bounded queue and delivered by the configured executor:
+    //  - Inline:          delivered right away on the posting thread (the old behaviour)
+    //  - DedicatedThread: one dispatcher thread
+    //  - ThreadPool:      options.threads workers; handlers must tolerate concurrency
+    //  - Polled:          nothing runs until the owner calls poll()
+    // When the queue is full the outcome is dropped and counted.
+    class WinToastDispatcher {
+    public:
+        enum Mode { Inline = 0, DedicatedThread, ThreadPool, Polled };
+
+        struct Options {
+            Mode                mode = Inline;
+            std::size_t         capacity = 4096;
+            std::size_t         threads = 1;
+        };
+
+        struct Counters {
+            std::uint64_t       posted;
+            std::uint64_t       delivered;
+            std::uint64_t       dropped;
+            std::size_t         depth;
+            std::size_t         highWaterDepth;
+        };
+
+        WinToastDispatcher();
+        explicit WinToastDispatcher(_In_ const Options& options);
+        // Stops the workers after delivering what is already queued.
+        ~WinToastDispatcher();
+
+        bool                    post(_In_ WinToastOutcome outcome);
+        // Delivers up to maxOutcomes queued outcomes on the calling thread.
+        std::size_t             poll(_In_ std::size_t maxOutcomes = static_cast<std::size_t>(-1));
+        Counters                counters() const;
+        inline Mode             mode() const { return _options.mode; }
+
+    private:
+        void                    workerLoop();
+        bool                    deliverOne();
+
+        Options                             _options;
+        WinToastOutcomeQueue                _queue;
+        std::vector<std::thread>            _workers;
+        std::mutex                          _sleepMutex;
+        std::condition_variable             _wakeup;
+        std::atomic<std::size_t>            _sleeping{ 0 };
+        std::atomic<bool>                   _stopping{ false };
+        std::atomic<std::uint64_t>          _posted{ 0 };
+        std::atomic<std::uint64_t>          _delivered{ 0 };
+        std::atomic<std::uint64_t>          _dropped{ 0 };
+        std::atomic<std::size_t>            _depth{ 0 };
+        std::atomic<std::size_t>            _highWaterDepth{ 0 };
+    };
+
+    // IWinToastHandler handed to the backend in place of the caller's handler:
+    // it turns each callback into a WinToastOutcome and posts it. The observer, if
+    // any, sees the outcome first, still on the callback thread; it is meant for
+    // cheap bookkeeping such as dropping the toast from the registry.
+    class WinToastDispatchingHandler : public IWinToastHandler {
+    public:
+        typedef std::function<void(const WinToastOutcome&)> Observer;
+
+        WinToastDispatchingHandler(_In_ std::shared_ptr<WinToastDispatcher> dispatcher, _In_ std::shared_ptr<IWinToastHandler> handler,
+                                   _In_ std::int64_t toastId, _In_opt_ Observer observer = nullptr);
+
+        void toastActivated() const override;
+        void toastActivated(int actionIndex) const override;
+        void toastDismissed(WinToastDismissalReason state) const override;
+        void toastFailed() const override;
+
+    private:
+        void                                post(_In_ WinToastOutcome::Kind kind, _In_ int actionIndex, _In_ WinToastDismissalReason reason) const;
+
+        std::shared_ptr<WinToastDispatcher> _dispatcher;
+        std::shared_ptr<IWinToastHandler>   _handler;
+        std::int64_t                        _toastId;
+        Observer                            _observer;
+    };
+}
+#endif // WINTOASTDISPATCH_H
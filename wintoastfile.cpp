@@ -0,0 +1,186 @@
+#include "wintoastfile.h"
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace WinToastLib;
+
+std::string WinToastLib::narrowPath(_In_ const std::wstring& path) {
+    std::string utf8;
+    utf8.reserve(path.length());
+    for (std::size_t i = 0; i < path.length(); i++) {
+        std::uint32_t code = static_cast<std::uint32_t>(path[i]);
+        // UTF-16 (Windows wchar_t): join surrogate pairs.
+        if (code >= 0xd800 && code < 0xdc00 && i + 1 < path.length()) {
+            const std::uint32_t low = static_cast<std::uint32_t>(path[i + 1]);
+            if (low >= 0xdc00 && low < 0xe000) {
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                i++;
+            }
+        }
+        if (code < 0x80) {
+            utf8 += static_cast<char>(code);
+        } else if (code < 0x800) {
+            utf8 += static_cast<char>(0xc0 | (code >> 6));
+            utf8 += static_cast<char>(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            utf8 += static_cast<char>(0xe0 | (code >> 12));
+            utf8 += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            utf8 += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            utf8 += static_cast<char>(0xf0 | (code >> 18));
+            utf8 += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            utf8 += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            utf8 += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+    return utf8;
+}
+
+std::FILE* WinToastLib::openFile(_In_ const std::wstring& path, _In_ const char* mode) {
+#ifdef _WIN32
+    const std::string narrowMode(mode);
+    std::FILE* file = nullptr;
+    return _wfopen_s(&file, extendedPath(path).c_str(), std::wstring(narrowMode.begin(), narrowMode.end()).c_str()) == 0 ? file : nullptr;
+#else
+    return std::fopen(narrowPath(path).c_str(), mode);
+#endif
+}
+
+bool WinToastLib::removeFile(_In_ const std::wstring& path) {
+#ifdef _WIN32
+    return _wremove(extendedPath(path).c_str()) == 0;
+#else
+    return std::remove(narrowPath(path).c_str()) == 0;
+#endif
+}
+
+bool WinToastLib::truncateFile(_In_ const std::wstring& path, _In_ std::uint64_t size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(extendedPath(path).c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(size);
+    const bool truncated = SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+    CloseHandle(file);
+    return truncated;
+#else
+    return truncate(narrowPath(path).c_str(), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+bool WinToastLib::renameFile(_In_ const std::wstring& from, _In_ const std::wstring& to) {
+#ifdef _WIN32
+    return MoveFileExW(extendedPath(from).c_str(), extendedPath(to).c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+    return std::rename(narrowPath(from).c_str(), narrowPath(to).c_str()) == 0;
+#endif
+}
+
+bool WinToastLib::createDirectory(_In_ const std::wstring& path) {
+#ifdef _WIN32
+    const std::wstring extended = extendedPath(path);
+    if (CreateDirectoryW(extended.c_str(), nullptr)) {
+        return true;
+    }
+    const DWORD attributes = GetFileAttributesW(extended.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    const std::string narrow = narrowPath(path);
+    struct stat status;
+    return mkdir(narrow.c_str(), 0755) == 0 || (stat(narrow.c_str(), &status) == 0 && S_ISDIR(status.st_mode));
+#endif
+}
+
+bool WinToastLib::fileStatus(_In_ const std::wstring& path, _Out_ std::uint64_t& size, _Out_ std::int64_t& modified) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(extendedPath(path).c_str(), GetFileExInfoStandard, &data) || (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return false;
+    }
+    size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    // FILETIME counts 100 ns intervals since 1601-01-01.
+    const std::int64_t ticks = static_cast<std::int64_t>((static_cast<std::uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32)
+                                                         | data.ftLastWriteTime.dwLowDateTime);
+    modified = ticks / 10000000 - 11644473600LL;
+    return true;
+#else
+    struct stat status;
+    if (stat(narrowPath(path).c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+        return false;
+    }
+    size = static_cast<std::uint64_t>(status.st_size);
+    modified = static_cast<std::int64_t>(status.st_mtime);
+    return true;
+#endif
+}
+
+bool WinToastLib::listDirectory(_In_ const std::wstring& directory, _In_ const std::function<void(const std::wstring& name)>& visit) {
+#ifdef _WIN32
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileW(extendedPath(directory + L"\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            visit(data.cFileName);
+        }
+    } while (FindNextFileW(find, &data));
+    FindClose(find);
+    return true;
+#else
+    DIR* dir = opendir(narrowPath(directory).c_str());
+    if (!dir) {
+        return false;
+    }
+    while (const dirent* entry = readdir(dir)) {
+        const std::wstring name = directory + L"/" + std::wstring(entry->d_name, entry->d_name + std::strlen(entry->d_name));
+        std::uint64_t size;
+        std::int64_t modified;
+        // Names are taken as Latin-1 here; the cache only writes ASCII ones.
+        if (fileStatus(name, size, modified)) {
+            visit(std::wstring(entry->d_name, entry->d_name + std::strlen(entry->d_name)));
+        }
+    }
+    closedir(dir);
+    return true;
+#endif
+}
+
+std::wstring WinToastLib::extendedPath(_In_ const std::wstring& path) {
+#ifdef _WIN32
+    // Below MAX_PATH, or already extended: nothing to do.
+    if (path.length() < MAX_PATH || path.compare(0, 4, L"\\\\?\\") == 0) {
+        return path;
+    }
+    std::wstring extended;
+    const bool unc = path.length() > 2 && (path[0] == L'\\' || path[0] == L'/') && (path[1] == L'\\' || path[1] == L'/');
+    const bool drive = path.length() > 2 && path[1] == L':' && (path[2] == L'\\' || path[2] == L'/');
+    if (unc) {
+        extended = L"\\\\?\\UNC\\" + path.substr(2);
+    } else if (drive) {
+        extended = L"\\\\?\\" + path;
+    } else {
+        // Relative paths cannot be extended; the API gets them as they are.
+        return path;
+    }
+    // The \\?\ form is passed to the file system untouched: no / to \ mapping.
+    for (wchar_t& c : extended) {
+        if (c == L'/') {
+            c = L'\\';
+        }
+    }
+    return extended;
+#else
+    return path;
+#endif
+}
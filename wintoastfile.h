@@ -0,0 +1,30 @@
+#ifndef WINTOASTFILE_H
+#define WINTOASTFILE_H
+#include "wintoasttemplate.h"
+#include <cstdio>
+#include <functional>
+
+namespace WinToastLib {
+
+    // Wide-path file access for the portable modules: the wide CRT functions on
+    // Windows, the UTF-8 spelling of the path elsewhere.
+    std::string         narrowPath(_In_ const std::wstring& path);
+    // mode as for fopen, e.g. "rb" or "ab".
+    std::FILE*          openFile(_In_ const std::wstring& path, _In_ const char* mode);
+    bool                removeFile(_In_ const std::wstring& path);
+    // Cuts the file at path down to size bytes.
+    bool                truncateFile(_In_ const std::wstring& path, _In_ std::uint64_t size);
+    // Replaces to if it exists.
+    bool                renameFile(_In_ const std::wstring& from, _In_ const std::wstring& to);
+    // True if the directory exists afterwards.
+    bool                createDirectory(_In_ const std::wstring& path);
+    // size in bytes, modified in seconds since the Unix epoch.
+    bool                fileStatus(_In_ const std::wstring& path, _Out_ std::uint64_t& size, _Out_ std::int64_t& modified);
+    // Calls visit with the name of every regular file in directory.
+    bool                listDirectory(_In_ const std::wstring& directory, _In_ const std::function<void(const std::wstring& name)>& visit);
+    // The form of an absolute path that the wide file functions accept past
+    // MAX_PATH: \\?\ or \\?\UNC\ in front, backslashes only. Unchanged off
+    // Windows, or when short enough.
+    std::wstring        extendedPath(_In_ const std::wstring& path);
+}
+#endif // WINTOASTFILE_H
@@ -0,0 +1,314 @@
+#include "wintoastfrozen.h"
+#include "wintoastpayload.h"
+#include <cstring>
+#include <new>
+
+using namespace WinToastLib;
+
+namespace {
+    enum FixedSlot {
+        ImageSlot = 0,
+        AudioSlot,
+        AttributionSlot,
+        SourceSlot,
+        TagSlot,
+        GroupSlot,
+        FirstTextSlot,
+        FirstActionSlot = FirstTextSlot + 3,
+        FixedSlotCount = FirstActionSlot
+    };
+
+    const std::uint32_t SerializedMagic = 0x32465457;   // "WTF2"
+    // Records written before tag and group existed: same header, no tag or
+    // group slot. Still read, so a spool survives an upgrade.
+    const std::uint32_t LegacySerializedMagic = 0x5a465457;   // "WTFZ"
+    const std::size_t LegacyFixedSlotCount = FixedSlotCount - 2;
+
+    struct Slot {
+        std::uint32_t           offset;
+        std::uint32_t           length;
+    };
+
+    // Serialized header; the slots and the arena follow it.
+    struct SerializedHeader {
+        std::uint32_t           magic;
+        std::uint8_t            unitSize;
+        std::uint8_t            type;
+        std::uint8_t            audioOption;
+        std::uint8_t            textFieldsCount;
+        std::uint32_t           slotCount;
+        std::uint32_t           arenaLength;
+        std::uint32_t           payloadSize;
+        std::int64_t            expiration;
+        std::uint64_t           contentHash;
+    };
+
+    template <typename T>
+    inline void append(_Inout_ std::vector<std::uint8_t>& out, _In_ const T* data, _In_ std::size_t count) {
+        const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + count * sizeof(T));
+    }
+}
+
+struct WinToastFrozenToast::Block {
+    std::atomic<std::uint32_t>  refs;
+    std::uint32_t               slotCount;
+    std::uint32_t               arenaLength;        // in wchar_t, terminators included
+    std::uint32_t               payloadSize;
+    std::int64_t                expiration;
+    std::uint64_t               contentHash;
+    std::uint8_t                type;
+    std::uint8_t                audioOption;
+    std::uint8_t                textFieldsCount;
+
+    inline Slot*                slots() { return reinterpret_cast<Slot*>(this + 1); }
+    inline wchar_t*             arena() { return reinterpret_cast<wchar_t*>(slots() + slotCount); }
+    inline std::size_t          bytes() const { return bytesFor(slotCount, arenaLength); }
+
+    static std::size_t bytesFor(_In_ std::size_t slotCount, _In_ std::size_t arenaLength) {
+        return sizeof(Block) + slotCount * sizeof(Slot) + arenaLength * sizeof(wchar_t);
+    }
+
+    static Block* allocate(_In_ std::size_t slotCount, _In_ std::size_t arenaLength) {
+        Block* block = new (::operator new(bytesFor(slotCount, arenaLength))) Block();
+        block->refs.store(1, std::memory_order_relaxed);
+        block->slotCount = static_cast<std::uint32_t>(slotCount);
+        block->arenaLength = static_cast<std::uint32_t>(arenaLength);
+        return block;
+    }
+
+    static void release(_In_opt_ Block* block) {
+        if (block && block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            block->~Block();
+            ::operator delete(block);
+        }
+    }
+};
+
+WinToastFrozenToast::WinToastFrozenToast(_In_ const WinToastTemplate& toast) {
+    const std::size_t slotCount = FixedSlotCount + toast.actionsCount();
+    auto stringAt = [&toast](std::size_t slot) -> const std::wstring& {
+        static const std::wstring Empty;
+        switch (slot) {
+        case ImageSlot:         return toast.imagePath();
+        case AudioSlot:         return toast.audioPath();
+        case AttributionSlot:   return toast.attributionText();
+        case SourceSlot:        return toast.source();
+        case TagSlot:           return toast.tag();
+        case GroupSlot:         return toast.group();
+        default:
+            if (slot >= FirstActionSlot) {
+                return toast.actionLabel(static_cast<int>(slot - FirstActionSlot));
+            }
+            const int field = static_cast<int>(slot - FirstTextSlot);
+            return field < toast.textFieldsCount() ? toast.textField(WinToastTemplate::TextField(field)) : Empty;
+        }
+    };
+
+    std::size_t arenaLength = 0;
+    for (std::size_t slot = 0; slot < slotCount; slot++) {
+        arenaLength += stringAt(slot).length() + 1;
+    }
+    _block = Block::allocate(slotCount, arenaLength);
+    _block->expiration = toast.expiration();
+    _block->contentHash = toast.contentHash();
+    _block->payloadSize = static_cast<std::uint32_t>(WinToastPayload::measure(toast, true));
+    _block->type = static_cast<std::uint8_t>(toast.type());
+    _block->audioOption = static_cast<std::uint8_t>(toast.audioOption());
+    _block->textFieldsCount = static_cast<std::uint8_t>(toast.textFieldsCount());
+
+    Slot* slots = _block->slots();
+    wchar_t* arena = _block->arena();
+    std::uint32_t offset = 0;
+    for (std::size_t slot = 0; slot < slotCount; slot++) {
+        const std::wstring& value = stringAt(slot);
+        slots[slot].offset = offset;
+        slots[slot].length = static_cast<std::uint32_t>(value.length());
+        std::memcpy(arena + offset, value.c_str(), (value.length() + 1) * sizeof(wchar_t));
+        offset += slots[slot].length + 1;
+    }
+}
+
+WinToastFrozenToast::WinToastFrozenToast(_In_ const WinToastFrozenToast& other) : _block(other._block) {
+    if (_block) {
+        _block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+WinToastFrozenToast& WinToastFrozenToast::operator=(_In_ WinToastFrozenToast other) {
+    std::swap(_block, other._block);
+    return *this;
+}
+
+WinToastFrozenToast::~WinToastFrozenToast() {
+    Block::release(_block);
+}
+
+WinToastTemplate WinToastFrozenToast::thaw() const {
+    WinToastTemplate toast(type());
+    for (int field = 0; field < textFieldsCount(); field++) {
+        toast.setTextField(textField(WinToastTemplate::TextField(field)).str(), WinToastTemplate::TextField(field));
+    }
+    for (int action = 0; action < actionsCount(); action++) {
+        toast.addAction(actionLabel(action).str());
+    }
+    toast.setImagePath(imagePath().str())
+         .setAudioPath(audioPath().str())
+         .setAudioOption(audioOption())
+         .setAttributionText(attributionText().str())
+         .setSource(source().str())
+         .setTag(tag().str())
+         .setGroup(group().str())
+         .setExpiration(expiration());
+    return toast;
+}
+
+WinToastTemplate::WinToastTemplateType WinToastFrozenToast::type() const {
+    return static_cast<WinToastTemplate::WinToastTemplateType>(_block->type);
+}
+
+WinToastTemplate::AudioOption WinToastFrozenToast::audioOption() const {
+    return static_cast<WinToastTemplate::AudioOption>(_block->audioOption);
+}
+
+std::int64_t WinToastFrozenToast::expiration() const {
+    return _block->expiration;
+}
+
+std::uint64_t WinToastFrozenToast::contentHash() const {
+    return _block->contentHash;
+}
+
+std::size_t WinToastFrozenToast::payloadSize() const {
+    return _block->payloadSize;
+}
+
+int WinToastFrozenToast::textFieldsCount() const {
+    return _block->textFieldsCount;
+}
+
+int WinToastFrozenToast::actionsCount() const {
+    return static_cast<int>(_block->slotCount - FixedSlotCount);
+}
+
+WinToastStringRef WinToastFrozenToast::string(_In_ std::size_t slot) const {
+    const Slot& entry = _block->slots()[slot];
+    return WinToastStringRef(_block->arena() + entry.offset, entry.length);
+}
+
+WinToastStringRef WinToastFrozenToast::textField(_In_ WinToastTemplate::TextField pos) const {
+    return string(FirstTextSlot + pos);
+}
+
+WinToastStringRef WinToastFrozenToast::actionLabel(_In_ int pos) const {
+    return string(FirstActionSlot + pos);
+}
+
+WinToastStringRef WinToastFrozenToast::imagePath() const {
+    return string(ImageSlot);
+}
+
+WinToastStringRef WinToastFrozenToast::audioPath() const {
+    return string(AudioSlot);
+}
+
+WinToastStringRef WinToastFrozenToast::attributionText() const {
+    return string(AttributionSlot);
+}
+
+WinToastStringRef WinToastFrozenToast::source() const {
+    return string(SourceSlot);
+}
+
+WinToastStringRef WinToastFrozenToast::tag() const {
+    return string(TagSlot);
+}
+
+WinToastStringRef WinToastFrozenToast::group() const {
+    return string(GroupSlot);
+}
+
+std::size_t WinToastFrozenToast::byteSize() const {
+    return _block ? _block->bytes() : 0;
+}
+
+void WinToastFrozenToast::serialize(_Inout_ std::vector<std::uint8_t>& out) const {
+    if (!_block) {
+        return;
+    }
+    SerializedHeader header = {};
+    header.magic = SerializedMagic;
+    header.unitSize = sizeof(wchar_t);
+    header.type = _block->type;
+    header.audioOption = _block->audioOption;
+    header.textFieldsCount = _block->textFieldsCount;
+    header.slotCount = _block->slotCount;
+    header.arenaLength = _block->arenaLength;
+    header.payloadSize = _block->payloadSize;
+    header.expiration = _block->expiration;
+    header.contentHash = _block->contentHash;
+    out.reserve(out.size() + sizeof(header) + _block->bytes() - sizeof(Block));
+    append(out, &header, 1);
+    append(out, _block->slots(), _block->slotCount);
+    append(out, _block->arena(), _block->arenaLength);
+}
+
+bool WinToastFrozenToast::deserialize(_In_ const std::uint8_t* data, _In_ std::size_t size,
+                                      _Out_ WinToastFrozenToast& toast, _Out_ std::size_t& consumed) {
+    toast = WinToastFrozenToast();
+    consumed = 0;
+    SerializedHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    const bool legacy = header.magic == LegacySerializedMagic;
+    if ((header.magic != SerializedMagic && !legacy) || header.unitSize != sizeof(wchar_t)
+        || header.type >= WinToastTemplate::WinToastTemplateTypeCount || header.audioOption > WinToastTemplate::Loop
+        || header.textFieldsCount > 3 || header.slotCount < (legacy ? LegacyFixedSlotCount : static_cast<std::size_t>(FixedSlotCount))
+        || header.slotCount > header.arenaLength
+        || header.slotCount > size / sizeof(Slot) || header.arenaLength > size / sizeof(wchar_t)) {
+        return false;
+    }
+    const std::size_t bodySize = header.slotCount * sizeof(Slot) + static_cast<std::size_t>(header.arenaLength) * sizeof(wchar_t);
+    if (size - sizeof(header) < bodySize) {
+        return false;
+    }
+
+    const std::size_t slotCount = header.slotCount + (legacy ? FixedSlotCount - LegacyFixedSlotCount : 0);
+    Block* block = Block::allocate(slotCount, header.arenaLength);
+    WinToastFrozenToast frozen(block);
+    block->payloadSize = header.payloadSize;
+    block->expiration = header.expiration;
+    block->contentHash = header.contentHash;
+    block->type = header.type;
+    block->audioOption = header.audioOption;
+    block->textFieldsCount = header.textFieldsCount;
+    if (legacy) {
+        // Tag and group come in empty, as the image path's terminator.
+        const std::uint8_t* body = data + sizeof(header);
+        const std::size_t tailSlots = header.slotCount - TagSlot;
+        Slot* slots = block->slots();
+        std::memcpy(slots, body, TagSlot * sizeof(Slot));
+        slots[TagSlot].offset = slots[ImageSlot].offset + slots[ImageSlot].length;
+        slots[TagSlot].length = 0;
+        slots[GroupSlot] = slots[TagSlot];
+        std::memcpy(slots + FirstTextSlot, body + TagSlot * sizeof(Slot), tailSlots * sizeof(Slot));
+        std::memcpy(block->arena(), body + header.slotCount * sizeof(Slot), header.arenaLength * sizeof(wchar_t));
+    } else {
+        std::memcpy(block->slots(), data + sizeof(header), bodySize);
+    }
+
+    // Every slot must point at a terminated string inside the arena.
+    const Slot* slots = block->slots();
+    const wchar_t* arena = block->arena();
+    for (std::uint32_t slot = 0; slot < block->slotCount; slot++) {
+        const std::uint64_t end = static_cast<std::uint64_t>(slots[slot].offset) + slots[slot].length;
+        if (end >= header.arenaLength || arena[end] != L'\0') {
+            return false;
+        }
+    }
+    toast = std::move(frozen);
+    consumed = sizeof(header) + bodySize;
+    return true;
+}
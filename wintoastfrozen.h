@@ -0,0 +1,86 @@
+#ifndef WINTOASTFROZEN_H
+#define WINTOASTFROZEN_H
+#include "wintoasttemplate.h"
+#include <atomic>
+
+namespace WinToastLib {
+
+    // Non-owning view of a string inside a frozen toast's arena. data() is
+    // null-terminated.
+    class WinToastStringRef {
+    public:
+        WinToastStringRef() : _data(L""), _length(0) {}
+        WinToastStringRef(_In_ const wchar_t* data, _In_ std::size_t length) : _data(data), _length(length) {}
+
+        inline const wchar_t*       data() const { return _data; }
+        inline std::size_t          length() const { return _length; }
+        inline bool                 empty() const { return _length == 0; }
+        inline const wchar_t*       begin() const { return _data; }
+        inline const wchar_t*       end() const { return _data + _length; }
+        inline std::wstring         str() const { return std::wstring(_data, _length); }
+
+    private:
+        const wchar_t*              _data;
+        std::size_t                 _length;
+    };
+
+    // Immutable snapshot of a WinToastTemplate in a single heap block: a small
+    // header, one (offset, length) slot per string and every string back to back
+    // in one wide-character arena. The content hash and the size of the modern
+    // payload are computed once when freezing.
+    //
+    // Copies share the block through an atomic reference count, so handing a
+    // frozen toast to another thread or queue never allocates. The serialized
+    // form is the block itself in a fixed field order; it is meant for the same
+    // platform (wchar_t width is recorded and checked), e.g. spool files;
+    // records written before tags existed are read with an empty tag and group.
+    // Accessors other than empty() and byteSize() need a non-empty toast.
+    class WinToastFrozenToast {
+    public:
+        WinToastFrozenToast() : _block(nullptr) {}
+        explicit WinToastFrozenToast(_In_ const WinToastTemplate& toast);
+        WinToastFrozenToast(_In_ const WinToastFrozenToast& other);
+        WinToastFrozenToast(_Inout_ WinToastFrozenToast&& other) : _block(other._block) { other._block = nullptr; }
+        WinToastFrozenToast& operator=(_In_ WinToastFrozenToast other);
+        ~WinToastFrozenToast();
+
+        inline bool                                 empty() const { return _block == nullptr; }
+        WinToastTemplate                            thaw() const;
+
+        WinToastTemplate::WinToastTemplateType      type() const;
+        WinToastTemplate::AudioOption               audioOption() const;
+        std::int64_t                                expiration() const;
+        std::uint64_t                               contentHash() const;
+        // Characters in the payload compiled with modern features.
+        std::size_t                                 payloadSize() const;
+        int                                         textFieldsCount() const;
+        int                                         actionsCount() const;
+        inline bool                                 hasImage() const { return type() < WinToastTemplate::Text01; }
+        WinToastStringRef                           textField(_In_ WinToastTemplate::TextField pos) const;
+        WinToastStringRef                           actionLabel(_In_ int pos) const;
+        WinToastStringRef                           imagePath() const;
+        WinToastStringRef                           audioPath() const;
+        WinToastStringRef                           attributionText() const;
+        WinToastStringRef                           source() const;
+        WinToastStringRef                           tag() const;
+        WinToastStringRef                           group() const;
+        // Heap bytes held by the shared block (0 when empty).
+        std::size_t                                 byteSize() const;
+
+        // Appends the serialized toast to out.
+        void                                        serialize(_Inout_ std::vector<std::uint8_t>& out) const;
+        // Reads one toast from data; consumed receives the bytes used. False on
+        // truncated, corrupt or foreign (different wchar_t width) input.
+        static bool                                 deserialize(_In_ const std::uint8_t* data, _In_ std::size_t size,
+                                                                _Out_ WinToastFrozenToast& toast, _Out_ std::size_t& consumed);
+
+    private:
+        struct Block;
+
+        explicit WinToastFrozenToast(_In_ Block* block) : _block(block) {}
+        WinToastStringRef                           string(_In_ std::size_t slot) const;
+
+        Block*                                      _block;
+    };
+}
+#endif // WINTOASTFROZEN_H
@@ -0,0 +1,657 @@
+#include "wintoasthistory.h"
+#include "wintoastfile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <ostream>
+
+using namespace WinToastLib;
+
+namespace {
+    const std::uint32_t ManifestMagic = 0x4d485457;     // "WTHM"
+    const std::uint32_t FileVersion = 1;
+    const std::uint64_t FnvOffsetBasis = 0xcbf29ce484222325ULL;
+    const std::uint64_t FnvPrime = 0x100000001b3ULL;
+
+    struct Manifest {
+        std::uint32_t           magic;
+        std::uint32_t           version;
+        std::uint64_t           firstSegment;
+        std::uint64_t           lastSegment;
+    };
+
+    // Record layout in a .log file: this header, then per action label its length
+    // in UTF-16 units (uint16) and the units. checksum covers everything after it.
+    struct RecordHeader {
+        std::uint32_t           bytes;
+        std::uint32_t           checksum;
+        std::int64_t            toastId;
+        std::int64_t            timestamp;
+        std::uint64_t           textHash;
+        std::uint32_t           latencyMilliseconds;
+        std::uint8_t            type;
+        std::uint8_t            outcome;
+        std::int8_t             actionIndex;
+        std::uint8_t            labelCount;
+    };
+
+    std::uint32_t checksumOf(_In_ const std::uint8_t* data, _In_ std::size_t length) {
+        std::uint64_t hash = FnvOffsetBasis;
+        for (std::size_t i = 0; i < length; i++) {
+            hash = (hash ^ data[i]) * FnvPrime;
+        }
+        return static_cast<std::uint32_t>(hash ^ (hash >> 32));
+    }
+
+    template <typename T>
+    inline void append(_Inout_ std::vector<std::uint8_t>& out, _In_ const T& value) {
+        const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void encode(_In_ const WinToastHistory::Record& record, _Inout_ std::vector<std::uint8_t>& out) {
+        const std::size_t start = out.size();
+        RecordHeader header = {};
+        header.toastId = record.toastId;
+        header.timestamp = record.timestamp;
+        header.textHash = record.textHash;
+        header.latencyMilliseconds = record.latencyMilliseconds;
+        header.type = static_cast<std::uint8_t>(record.type);
+        header.outcome = static_cast<std::uint8_t>(record.outcome);
+        header.actionIndex = static_cast<std::int8_t>(std::max(-1, std::min(record.actionIndex, 127)));
+        header.labelCount = static_cast<std::uint8_t>(std::min<std::size_t>(record.actionLabels.size(), 255));
+        append(out, header);
+        for (std::size_t label = 0; label < header.labelCount; label++) {
+            const std::wstring& text = record.actionLabels[label];
+            const std::uint16_t length = static_cast<std::uint16_t>(std::min<std::size_t>(text.length(), 0xffff));
+            append(out, length);
+            for (std::size_t i = 0; i < length; i++) {
+                // Stored as UTF-16 units; outside the BMP (wchar_t is wider than
+                // 16 bits off Windows) becomes the replacement character.
+                const std::uint32_t code = static_cast<std::uint32_t>(text[i]);
+                append(out, static_cast<std::uint16_t>(code > 0xffff ? 0xfffd : code));
+            }
+        }
+        const std::uint32_t bytes = static_cast<std::uint32_t>(out.size() - start);
+        std::memcpy(out.data() + start, &bytes, sizeof(bytes));
+        const std::uint32_t checksum = checksumOf(out.data() + start + 8, bytes - 8);
+        std::memcpy(out.data() + start + 4, &checksum, sizeof(checksum));
+    }
+
+    // Reads the record at data; false when it is truncated or corrupt.
+    bool decode(_In_ const std::uint8_t* data, _In_ std::size_t size, _Out_ WinToastHistory::Record& record, _Out_ std::size_t& consumed) {
+        RecordHeader header;
+        if (size < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (header.bytes < sizeof(header) || header.bytes > size || header.checksum != checksumOf(data + 8, header.bytes - 8)
+            || header.type >= WinToastTemplate::WinToastTemplateTypeCount || header.outcome >= WinToastStats::OutcomeCount) {
+            return false;
+        }
+        record.toastId = header.toastId;
+        record.timestamp = header.timestamp;
+        record.textHash = header.textHash;
+        record.latencyMilliseconds = header.latencyMilliseconds;
+        record.type = static_cast<WinToastTemplate::WinToastTemplateType>(header.type);
+        record.outcome = static_cast<WinToastStats::Outcome>(header.outcome);
+        record.actionIndex = header.actionIndex;
+        record.actionLabels.resize(header.labelCount);
+        std::size_t offset = sizeof(header);
+        for (std::wstring& label : record.actionLabels) {
+            std::uint16_t length;
+            if (offset + sizeof(length) > header.bytes) {
+                return false;
+            }
+            std::memcpy(&length, data + offset, sizeof(length));
+            offset += sizeof(length);
+            if (offset + length * sizeof(std::uint16_t) > header.bytes) {
+                return false;
+            }
+            label.resize(length);
+            for (std::uint16_t i = 0; i < length; i++, offset += sizeof(std::uint16_t)) {
+                std::uint16_t unit;
+                std::memcpy(&unit, data + offset, sizeof(unit));
+                label[i] = static_cast<wchar_t>(unit);
+            }
+        }
+        consumed = header.bytes;
+        return true;
+    }
+
+    long fileSize(_In_ std::FILE* file) {
+        return std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1;
+    }
+
+    // Calendar date from days since 1970-01-01 (proleptic Gregorian).
+    void civilFromDays(_In_ std::int64_t days, _Out_ int& year, _Out_ int& month, _Out_ int& day) {
+        days += 719468;
+        const std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        const std::int64_t dayOfEra = days - era * 146097;
+        const std::int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        const std::int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        const std::int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+        day = static_cast<int>(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+        month = static_cast<int>(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+        year = static_cast<int>(yearOfEra + era * 400 + (month <= 2 ? 1 : 0));
+    }
+
+    void writeTimestamp(_Inout_ std::wostream& out, _In_ std::int64_t microseconds) {
+        const std::int64_t seconds = microseconds / 1000000 - (microseconds % 1000000 < 0 ? 1 : 0);
+        std::int64_t days = seconds / 86400;
+        std::int64_t secondOfDay = seconds % 86400;
+        if (secondOfDay < 0) {
+            secondOfDay += 86400;
+            days--;
+        }
+        int year, month, day;
+        civilFromDays(days, year, month, day);
+        wchar_t text[32];
+        swprintf(text, 32, L"%04d-%02d-%02dT%02d:%02d:%02dZ", year, month, day,
+                 static_cast<int>(secondOfDay / 3600), static_cast<int>(secondOfDay / 60 % 60), static_cast<int>(secondOfDay % 60));
+        out << text;
+    }
+
+    bool parseOutcomes(_In_ const std::wstring& name, _Out_ std::uint32_t& outcomes) {
+        outcomes = 0;
+        const std::string narrow(name.begin(), name.end());
+        if (narrow == "clicked") {
+            outcomes = (1u << WinToastStats::Activated) | (1u << WinToastStats::ActionActivated);
+        } else if (narrow == "dismissed") {
+            outcomes = (1u << WinToastStats::DismissedUserCanceled) | (1u << WinToastStats::DismissedApplicationHidden)
+                     | (1u << WinToastStats::DismissedTimedOut);
+        } else {
+            for (int outcome = 0; outcome < WinToastStats::OutcomeCount; outcome++) {
+                if (narrow == WinToastStats::outcomeName(static_cast<WinToastStats::Outcome>(outcome))) {
+                    outcomes = 1u << outcome;
+                }
+            }
+        }
+        return outcomes != 0;
+    }
+}
+
+WinToastHistory::WinToastHistory() : WinToastHistory(Options()) {}
+
+WinToastHistory::WinToastHistory(_In_ const Options& options) : _options(options) {
+    _options.batchRecords = std::max<std::size_t>(_options.batchRecords, 1);
+}
+
+WinToastHistory::~WinToastHistory() {
+    close();
+}
+
+std::wstring WinToastHistory::segmentPath(_In_ std::uint64_t number, _In_ const wchar_t* extension) const {
+    return _prefix + L"." + std::to_wstring(number) + extension;
+}
+
+bool WinToastHistory::open(_In_ const std::wstring& prefix) {
+    close();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _prefix = prefix;
+    _segments.clear();
+    _counters = Counters();
+
+    Manifest manifest = {};
+    if (std::FILE* file = openFile(_prefix + L".manifest", "rb")) {
+        const bool read = std::fread(&manifest, sizeof(manifest), 1, file) == 1;
+        std::fclose(file);
+        if (!read || manifest.magic != ManifestMagic || manifest.version != FileVersion || manifest.firstSegment > manifest.lastSegment) {
+            return false;
+        }
+    } else {
+        manifest.firstSegment = manifest.lastSegment = 1;
+    }
+    for (std::uint64_t number = manifest.firstSegment; number <= manifest.lastSegment; number++) {
+        Segment segment;
+        if (!loadSegment(number, segment)) {
+            return false;
+        }
+        _counters.blocks += segment.blocks.size();
+        _segments.push_back(std::move(segment));
+    }
+    if (!openForAppend(manifest.lastSegment) || !writeManifest()) {
+        return false;
+    }
+    _counters.segments = _segments.size();
+    _stopping = false;
+    _writer = std::thread(&WinToastHistory::writerLoop, this);
+    return true;
+}
+
+bool WinToastHistory::loadSegment(_In_ std::uint64_t number, _Out_ Segment& segment) {
+    segment.number = number;
+    segment.blocks.clear();
+    std::FILE* log = openFile(segmentPath(number, L".log"), "rb");
+    if (!log) {
+        // Never written to, or deleted by hand: nothing to index.
+        return true;
+    }
+    const long logSize = fileSize(log);
+    std::uint64_t indexed = 0;
+    long indexSize = 0;
+    if (std::FILE* index = openFile(segmentPath(number, L".idx"), "rb")) {
+        indexSize = fileSize(index);
+        std::fseek(index, 0, SEEK_SET);
+        BlockIndex block;
+        while (std::fread(&block, sizeof(block), 1, index) == 1 && block.offset + block.bytes <= static_cast<std::uint64_t>(logSize)) {
+            segment.blocks.push_back(block);
+            indexed = block.offset + block.bytes;
+        }
+        std::fclose(index);
+    }
+
+    // A torn entry at the end of the index, or entries past the log, would
+    // throw off every entry appended after them.
+    bool rewrite = indexSize != static_cast<long>(segment.blocks.size() * sizeof(BlockIndex));
+    // Records past the last indexed block were written just before a crash that
+    // came before their index entry; index what is intact of them.
+    if (logSize > 0 && static_cast<std::uint64_t>(logSize) > indexed) {
+        std::vector<std::uint8_t> tail(static_cast<std::size_t>(logSize - indexed));
+        std::fseek(log, static_cast<long>(indexed), SEEK_SET);
+        if (std::fread(tail.data(), 1, tail.size(), log) == tail.size()) {
+            BlockIndex block = {};
+            block.offset = indexed;
+            block.minTimestamp = INT64_MAX;
+            block.maxTimestamp = INT64_MIN;
+            Record record;
+            std::size_t offset = 0;
+            std::size_t consumed = 0;
+            while (decode(tail.data() + offset, tail.size() - offset, record, consumed)) {
+                offset += consumed;
+                block.records++;
+                block.minTimestamp = std::min(block.minTimestamp, record.timestamp);
+                block.maxTimestamp = std::max(block.maxTimestamp, record.timestamp);
+                block.types |= 1u << record.type;
+                block.outcomeCounts[record.outcome]++;
+                block.outcomeLatency[record.outcome] += record.latencyMilliseconds;
+            }
+            if (block.records) {
+                block.bytes = static_cast<std::uint32_t>(offset);
+                segment.blocks.push_back(block);
+                rewrite = true;
+            }
+        }
+    }
+    std::fclose(log);
+
+    if (rewrite) {
+        // Rewritten whole, which also drops any torn entry at its end.
+        std::FILE* index = openFile(segmentPath(number, L".idx"), "wb");
+        if (!index) {
+            return false;
+        }
+        const bool written = std::fwrite(segment.blocks.data(), sizeof(BlockIndex), segment.blocks.size(), index) == segment.blocks.size();
+        std::fclose(index);
+        return written;
+    }
+    return true;
+}
+
+bool WinToastHistory::openForAppend(_In_ std::uint64_t number) {
+    if (_log) {
+        std::fclose(_log);
+    }
+    if (_index) {
+        std::fclose(_index);
+    }
+    _log = openFile(segmentPath(number, L".log"), "ab");
+    _index = openFile(segmentPath(number, L".idx"), "ab");
+    if (!_log || !_index) {
+        return false;
+    }
+    const long size = fileSize(_log);
+    _logBytes = size > 0 ? static_cast<std::uint64_t>(size) : 0;
+    if (_segments.empty() || _segments.back().number != number) {
+        Segment segment;
+        segment.number = number;
+        _segments.push_back(std::move(segment));
+    }
+    return true;
+}
+
+bool WinToastHistory::rollBack() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::uint64_t number = _segments.back().number;
+    const std::uint64_t indexBytes = _segments.back().blocks.size() * sizeof(BlockIndex);
+    // Closed first: stdio may still buffer some of the failed write.
+    std::fclose(_log);
+    std::fclose(_index);
+    _log = nullptr;
+    _index = nullptr;
+    const bool truncated = truncateFile(segmentPath(number, L".log"), _logBytes)
+                        && truncateFile(segmentPath(number, L".idx"), indexBytes);
+    return openForAppend(number) && truncated;
+}
+
+bool WinToastHistory::writeManifest() {
+    Manifest manifest = {};
+    manifest.magic = ManifestMagic;
+    manifest.version = FileVersion;
+    manifest.firstSegment = _segments.front().number;
+    manifest.lastSegment = _segments.back().number;
+    std::FILE* file = openFile(_prefix + L".manifest", "wb");
+    if (!file) {
+        return false;
+    }
+    const bool written = std::fwrite(&manifest, sizeof(manifest), 1, file) == 1;
+    return std::fclose(file) == 0 && written;
+}
+
+void WinToastHistory::close() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        _wakeup.notify_all();
+    }
+    if (_writer.joinable()) {
+        _writer.join();
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_log) {
+        std::fclose(_log);
+        _log = nullptr;
+    }
+    if (_index) {
+        std::fclose(_index);
+        _index = nullptr;
+    }
+}
+
+void WinToastHistory::record(_In_ Record record) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _queued++;
+    if (_stopping || _queue.size() >= _options.queueCapacity) {
+        _done++;
+        _counters.dropped++;
+        return;
+    }
+    _counters.recorded++;
+    _queue.push_back(std::move(record));
+    if (_queue.size() == _options.batchRecords) {
+        _wakeup.notify_one();
+    }
+}
+
+void WinToastHistory::flush() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    const std::uint64_t target = _queued;
+    if (_done >= target) {
+        return;
+    }
+    _flushRequested = true;
+    _wakeup.notify_one();
+    _written.wait(lock, [this, target] { return _done >= target; });
+}
+
+void WinToastHistory::writerLoop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    std::vector<Record> batch;
+    for (;;) {
+        _wakeup.wait_for(lock, std::chrono::milliseconds(_options.flushIntervalMilliseconds), [this] {
+            return _stopping || _flushRequested || _queue.size() >= _options.batchRecords;
+        });
+        _flushRequested = false;
+        if (_queue.empty()) {
+            if (_stopping) {
+                break;
+            }
+            continue;
+        }
+        // The emptied vector goes back as the next queue, keeping its capacity.
+        batch.swap(_queue);
+        lock.unlock();
+        const std::size_t written = writeBatch(batch);
+        lock.lock();
+        _done += batch.size();
+        _counters.written += written;
+        _counters.dropped += batch.size() - written;
+        batch.clear();
+        _written.notify_all();
+    }
+    _written.notify_all();
+}
+
+std::size_t WinToastHistory::writeBatch(_In_ const std::vector<Record>& batch) {
+    std::size_t written = 0;
+    std::vector<std::uint8_t> bytes;
+    for (std::size_t first = 0; first < batch.size(); first += _options.batchRecords) {
+        const std::size_t last = std::min(batch.size(), first + _options.batchRecords);
+        BlockIndex block = {};
+        block.offset = _logBytes;
+        block.minTimestamp = INT64_MAX;
+        block.maxTimestamp = INT64_MIN;
+        bytes.clear();
+        for (std::size_t i = first; i < last; i++) {
+            const Record& record = batch[i];
+            encode(record, bytes);
+            block.records++;
+            block.minTimestamp = std::min(block.minTimestamp, record.timestamp);
+            block.maxTimestamp = std::max(block.maxTimestamp, record.timestamp);
+            block.types |= 1u << record.type;
+            block.outcomeCounts[record.outcome]++;
+            block.outcomeLatency[record.outcome] += record.latencyMilliseconds;
+        }
+        block.bytes = static_cast<std::uint32_t>(bytes.size());
+
+        // The block goes out before its index entry, so an entry never points
+        // past the data; a crash in between is repaired by loadSegment.
+        if (!_log || !_index) {
+            // A roll back could not reopen the segment.
+            continue;
+        }
+        if (std::fwrite(bytes.data(), 1, bytes.size(), _log) != bytes.size() || std::fflush(_log) != 0
+            || std::fwrite(&block, sizeof(block), 1, _index) != 1 || std::fflush(_index) != 0) {
+            // Part of the block (or of its entry) may be in the files already;
+            // left there, it would shift the offsets of every later block.
+            rollBack();
+            continue;
+        }
+        _logBytes += bytes.size();
+        written += last - first;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _segments.back().blocks.push_back(block);
+        _counters.blocks++;
+        if (_logBytes >= _options.segmentBytes && openForAppend(_segments.back().number + 1)) {
+            while (_options.maxSegments && _segments.size() > _options.maxSegments) {
+                removeFile(segmentPath(_segments.front().number, L".log"));
+                removeFile(segmentPath(_segments.front().number, L".idx"));
+                _segments.erase(_segments.begin());
+            }
+            writeManifest();
+            _counters.segments = _segments.size();
+        }
+    }
+    return written;
+}
+
+std::size_t WinToastHistory::query(_In_ const Query& query, _In_ const std::function<bool(const Record&)>& visit) const {
+    std::vector<Segment> segments;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        segments = _segments;
+    }
+    return scan(segments, query, visit);
+}
+
+std::size_t WinToastHistory::scan(_In_ const std::vector<Segment>& segments, _In_ const Query& query,
+                                  _In_ const std::function<bool(const Record&)>& visit) const {
+    std::size_t matched = 0;
+    std::vector<std::uint8_t> bytes;
+    Record record;
+    for (const Segment& segment : segments) {
+        std::FILE* log = nullptr;
+        for (const BlockIndex& block : segment.blocks) {
+            std::uint32_t outcomes = 0;
+            for (int outcome = 0; outcome < WinToastStats::OutcomeCount; outcome++) {
+                outcomes |= block.outcomeCounts[outcome] ? 1u << outcome : 0;
+            }
+            if (block.maxTimestamp < query.from || block.minTimestamp >= query.to || !(outcomes & query.outcomes)
+                || (query.type >= 0 && !(block.types & (1u << query.type)))) {
+                continue;
+            }
+            if (!log && !(log = openFile(segmentPath(segment.number, L".log"), "rb"))) {
+                break;
+            }
+            bytes.resize(block.bytes);
+            if (std::fseek(log, static_cast<long>(block.offset), SEEK_SET) != 0 || std::fread(bytes.data(), 1, bytes.size(), log) != bytes.size()) {
+                continue;
+            }
+            std::size_t offset = 0;
+            std::size_t consumed = 0;
+            while (offset < bytes.size() && decode(bytes.data() + offset, bytes.size() - offset, record, consumed)) {
+                offset += consumed;
+                if (record.timestamp < query.from || record.timestamp >= query.to || !(query.outcomes & (1u << record.outcome))
+                    || (query.type >= 0 && record.type != query.type) || (query.matchText && record.textHash != query.textHash)) {
+                    continue;
+                }
+                matched++;
+                if (!visit(record)) {
+                    std::fclose(log);
+                    return matched;
+                }
+            }
+        }
+        if (log) {
+            std::fclose(log);
+        }
+    }
+    return matched;
+}
+
+WinToastHistory::Summary WinToastHistory::summarize(_In_ const Query& query) const {
+    Summary summary = {};
+    std::vector<Segment> segments;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        segments = _segments;
+    }
+    // Blocks entirely inside the time range are counted from their index entry
+    // when nothing else needs the records themselves.
+    const bool indexOnly = query.type < 0 && !query.matchText;
+    for (const Segment& segment : segments) {
+        for (const BlockIndex& block : segment.blocks) {
+            std::uint32_t outcomes = 0;
+            for (int outcome = 0; outcome < WinToastStats::OutcomeCount; outcome++) {
+                outcomes |= block.outcomeCounts[outcome] ? 1u << outcome : 0;
+            }
+            if (block.maxTimestamp < query.from || block.minTimestamp >= query.to || !(outcomes & query.outcomes)
+                || (query.type >= 0 && !(block.types & (1u << query.type)))) {
+                summary.blocksSkipped++;
+            } else if (indexOnly && block.minTimestamp >= query.from && block.maxTimestamp < query.to) {
+                summary.blocksFromIndex++;
+                for (int outcome = 0; outcome < WinToastStats::OutcomeCount; outcome++) {
+                    if (query.outcomes & (1u << outcome)) {
+                        summary.count += block.outcomeCounts[outcome];
+                        summary.outcomes[outcome] += block.outcomeCounts[outcome];
+                        summary.latencyMilliseconds += block.outcomeLatency[outcome];
+                    }
+                }
+            } else {
+                summary.blocksRead++;
+            }
+        }
+    }
+    if (summary.blocksRead == 0) {
+        return summary;
+    }
+
+    // The rest are read; scan() applies the same block checks before reading.
+    if (indexOnly) {
+        for (Segment& segment : segments) {
+            segment.blocks.erase(std::remove_if(segment.blocks.begin(), segment.blocks.end(), [&query](const BlockIndex& block) {
+                return block.minTimestamp >= query.from && block.maxTimestamp < query.to;
+            }), segment.blocks.end());
+        }
+    }
+    scan(segments, query, [&summary](const Record& record) {
+        summary.count++;
+        summary.outcomes[record.outcome]++;
+        summary.latencyMilliseconds += record.latencyMilliseconds;
+        return true;
+    });
+    return summary;
+}
+
+WinToastHistory::Counters WinToastHistory::counters() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _counters;
+}
+
+std::uint64_t WinToastHistory::hashText(_In_ const wchar_t* text, _In_ std::size_t length) {
+    std::uint64_t hash = FnvOffsetBasis;
+    for (std::size_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<std::uint64_t>(text[i])) * FnvPrime;
+    }
+    return (hash ^ length) * FnvPrime;
+}
+
+std::int64_t WinToastHistory::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int WinToastHistory::queryMain(_In_ const std::vector<std::wstring>& args, _Inout_ std::wostream& out) {
+    if (args.empty()) {
+        return 1;
+    }
+    Query query;
+    bool list = false;
+    for (std::size_t i = 1; i < args.size(); i++) {
+        const bool hasValue = i + 1 < args.size();
+        if (args[i] == L"--since" && hasValue) {
+            const double hours = std::wcstod(args[++i].c_str(), nullptr);
+            if (hours <= 0) {
+                return 1;
+            }
+            query.from = now() - static_cast<std::int64_t>(hours * 3600.0 * 1000000.0);
+        } else if (args[i] == L"--text" && hasValue) {
+            query.matchText = true;
+            query.textHash = hashText(args[++i]);
+        } else if (args[i] == L"--outcome" && hasValue) {
+            if (!parseOutcomes(args[++i], query.outcomes)) {
+                return 1;
+            }
+        } else if (args[i] == L"--list") {
+            list = true;
+        } else {
+            return 1;
+        }
+    }
+
+    WinToastHistory history;
+    if (!history.open(args[0])) {
+        out << L"Could not open history: " << args[0] << std::endl;
+        return 2;
+    }
+    if (list) {
+        history.query(query, [&out](const Record& record) {
+            writeTimestamp(out, record.timestamp);
+            out << L" id=" << record.toastId << L" type=" << record.type
+                << L" outcome=" << WinToastStats::outcomeName(record.outcome) << L" latency=" << record.latencyMilliseconds << L"ms";
+            if (record.actionIndex >= 0) {
+                out << L" action=" << record.actionIndex;
+                if (record.actionIndex < static_cast<int>(record.actionLabels.size())) {
+                    out << L" (" << record.actionLabels[record.actionIndex] << L")";
+                }
+            }
+            out << std::endl;
+            return true;
+        });
+    }
+    const Summary summary = history.summarize(query);
+    out << L"toasts: " << summary.count << std::endl;
+    for (int outcome = 0; outcome < WinToastStats::OutcomeCount; outcome++) {
+        if (summary.outcomes[outcome]) {
+            out << L"  " << WinToastStats::outcomeName(static_cast<WinToastStats::Outcome>(outcome)) << L": " << summary.outcomes[outcome] << std::endl;
+        }
+    }
+    if (summary.count) {
+        out << L"mean latency: " << summary.latencyMilliseconds / summary.count << L" ms" << std::endl;
+    }
+    out << L"blocks: " << summary.blocksRead << L" read, " << summary.blocksFromIndex << L" from the index, "
+        << summary.blocksSkipped << L" skipped" << std::endl;
+    return 0;
+}
@@ -0,0 +1,177 @@
+#ifndef WINTOASTHISTORY_H
+#define WINTOASTHISTORY_H
+#include "wintoaststats.h"
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <thread>
+
+namespace WinToastLib {
+
+    // Append-only history of what happened to each toast, for questions such as
+    // "how many build-failure toasts were dismissed without a click this week".
+    //
+    // Files share a path prefix: <prefix>.manifest names the live segments,
+    // <prefix>.<n>.log holds the records of segment n and <prefix>.<n>.idx one
+    // entry per block of records, with the block's time range, template types and
+    // per-outcome counts and latency totals. Queries skip blocks outside the time
+    // range or without a wanted outcome, and summarize() takes blocks that match
+    // entirely from the index without reading them.
+    //
+    // record() only queues; a writer thread appends each batch as one block every
+    // flushIntervalMilliseconds, or sooner when batchRecords are waiting.
+    class WinToastHistory {
+    public:
+        struct Options {
+            std::size_t         segmentBytes = 4 << 20;     // a new segment starts past this size
+            std::size_t         maxSegments = 0;            // oldest segments are deleted beyond this; 0 keeps all
+            std::size_t         batchRecords = 256;         // records per block, at most
+            std::size_t         queueCapacity = 16384;      // records waiting for the writer; more are dropped
+            std::int64_t        flushIntervalMilliseconds = 1000;
+        };
+
+        struct Record {
+            std::int64_t                            toastId = -1;
+            std::int64_t                            timestamp = 0;              // when sent, microseconds since the Unix epoch
+            std::uint32_t                           latencyMilliseconds = 0;    // from send to outcome
+            WinToastTemplate::WinToastTemplateType  type = WinToastTemplate::ImageAndText02;
+            // Hash of the first text line, the headline saying what the toast is
+            // about; see hashText.
+            std::uint64_t                           textHash = 0;
+            WinToastStats::Outcome                  outcome = WinToastStats::Failed;
+            int                                     actionIndex = -1;
+            std::vector<std::wstring>               actionLabels;
+        };
+
+        struct Query {
+            std::int64_t        from = INT64_MIN;           // timestamp range, [from, to)
+            std::int64_t        to = INT64_MAX;
+            std::uint32_t       outcomes = AllOutcomes;     // bit (1 << WinToastStats::Outcome) per wanted outcome
+            int                 type = -1;                  // WinToastTemplateType, -1 for any
+            bool                matchText = false;
+            std::uint64_t       textHash = 0;
+        };
+
+        struct Summary {
+            std::uint64_t       count;
+            std::uint64_t       outcomes[WinToastStats::OutcomeCount];
+            std::uint64_t       latencyMilliseconds;        // total over count
+            std::uint64_t       blocksRead;
+            std::uint64_t       blocksFromIndex;            // answered by the index alone
+            std::uint64_t       blocksSkipped;
+        };
+
+        struct Counters {
+            std::uint64_t       recorded;
+            std::uint64_t       written;
+            std::uint64_t       dropped;                    // queue full
+            std::uint64_t       blocks;
+            std::size_t         segments;
+        };
+
+        static const std::uint32_t AllOutcomes = (1u << WinToastStats::OutcomeCount) - 1;
+
+        WinToastHistory();
+        explicit WinToastHistory(_In_ const Options& options);
+        // Same as close().
+        ~WinToastHistory();
+
+        // Opens the history at prefix, creating it if needed. Records of a block
+        // the last run wrote but did not index are indexed again.
+        bool                    open(_In_ const std::wstring& prefix);
+        // Writes what is queued and stops the writer.
+        void                    close();
+
+        // Queues a record for the writer; never blocks on I/O.
+        void                    record(_In_ Record record);
+        // Waits until everything recorded so far is written.
+        void                    flush();
+
+        // Calls visit for every matching record, oldest first, until it returns
+        // false. Returns how many records matched.
+        std::size_t             query(_In_ const Query& query, _In_ const std::function<bool(const Record&)>& visit) const;
+        Summary                 summarize(_In_ const Query& query) const;
+        Counters                counters() const;
+
+        // Static parts of a toast's record; Toast is a WinToastTemplate or a
+        // WinToastFrozenToast.
+        template <typename Toast>
+        static Record           describe(_In_ const Toast& toast, _In_ std::int64_t toastId) {
+            Record record;
+            record.toastId = toastId;
+            record.timestamp = now();
+            record.type = toast.type();
+            if (toast.textFieldsCount() > 0) {
+                const auto& headline = toast.textField(WinToastTemplate::FirstLine);
+                record.textHash = hashText(headline.data(), headline.length());
+            }
+            record.actionLabels.reserve(toast.actionsCount());
+            for (int action = 0; action < toast.actionsCount(); action++) {
+                const auto& label = toast.actionLabel(action);
+                record.actionLabels.emplace_back(label.begin(), label.end());
+            }
+            return record;
+        }
+        static std::uint64_t    hashText(_In_ const wchar_t* text, _In_ std::size_t length);
+        static inline std::uint64_t hashText(_In_ const std::wstring& text) { return hashText(text.data(), text.length()); }
+        // Microseconds since the Unix epoch.
+        static std::int64_t     now();
+
+        // Command-line query behind WinToast.exe --history-query:
+        //   <prefix> [--since hours] [--text headline] [--outcome name] [--list]
+        // Prints the summary (and with --list every record) to out. Returns 0, or
+        // non-zero on bad arguments or a history that cannot be opened.
+        static int              queryMain(_In_ const std::vector<std::wstring>& args, _Inout_ std::wostream& out);
+
+    private:
+        // One block of a segment as stored in its .idx file.
+        struct BlockIndex {
+            std::uint64_t       offset;
+            std::uint32_t       bytes;
+            std::uint32_t       records;
+            std::int64_t        minTimestamp;
+            std::int64_t        maxTimestamp;
+            std::uint32_t       types;              // bit per WinToastTemplateType
+            std::uint32_t       outcomeCounts[WinToastStats::OutcomeCount];
+            std::uint32_t       reserved;
+            std::uint64_t       outcomeLatency[WinToastStats::OutcomeCount];   // milliseconds
+        };
+
+        struct Segment {
+            std::uint64_t       number;
+            std::vector<BlockIndex> blocks;
+        };
+
+        bool                    loadSegment(_In_ std::uint64_t number, _Out_ Segment& segment);
+        bool                    openForAppend(_In_ std::uint64_t number);
+        // Cuts the open segment's files back to the blocks written so far.
+        bool                    rollBack();
+        bool                    writeManifest();
+        // Returns how many of batch reached the files.
+        std::size_t             writeBatch(_In_ const std::vector<Record>& batch);
+        void                    writerLoop();
+        std::wstring            segmentPath(_In_ std::uint64_t number, _In_ const wchar_t* extension) const;
+        std::size_t             scan(_In_ const std::vector<Segment>& segments, _In_ const Query& query,
+                                     _In_ const std::function<bool(const Record&)>& visit) const;
+
+        Options                 _options;
+        std::wstring            _prefix;
+        mutable std::mutex      _mutex;             // the queue and the segment list
+        std::condition_variable _wakeup;
+        std::condition_variable _written;
+        std::vector<Record>     _queue;
+        std::vector<Segment>    _segments;
+        std::FILE*              _log = nullptr;     // writer only
+        std::FILE*              _index = nullptr;
+        std::uint64_t           _logBytes = 0;
+        std::uint64_t           _queued = 0;        // records handed to record(), ever
+        std::uint64_t           _done = 0;          // of those, written or dropped
+        bool                    _flushRequested = false;
+        bool                    _stopping = true;   // no writer running
+        std::thread             _writer;
+        Counters                _counters = {};
+    };
+}
+#endif // WINTOASTHISTORY_H
@@ -0,0 +1,471 @@
+#include "wintoastimage.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <wincodec.h>
+#include <wrl/client.h>
+#pragma comment(lib, "windowscodecs.lib")
+#endif
+
+using namespace WinToastLib;
+
+namespace {
+    const int MaxDecodedDimension = 1 << 14;
+
+    inline std::uint32_t readLittle32(_In_ const std::uint8_t* data) {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<std::uint32_t>(data[3]) << 24);
+    }
+
+    inline std::uint16_t readLittle16(_In_ const std::uint8_t* data) {
+        return static_cast<std::uint16_t>(data[0] | (data[1] << 8));
+    }
+
+    inline void appendBig32(_Inout_ std::vector<std::uint8_t>& out, _In_ std::uint32_t value) {
+        out.push_back(static_cast<std::uint8_t>(value >> 24));
+        out.push_back(static_cast<std::uint8_t>(value >> 16));
+        out.push_back(static_cast<std::uint8_t>(value >> 8));
+        out.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    std::uint32_t crc32(_In_ const std::uint8_t* data, _In_ std::size_t size) {
+        static const struct Table {
+            std::uint32_t entries[256];
+            Table() {
+                for (std::uint32_t n = 0; n < 256; n++) {
+                    std::uint32_t c = n;
+                    for (int k = 0; k < 8; k++) {
+                        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    }
+                    entries[n] = c;
+                }
+            }
+        } table;
+        std::uint32_t crc = 0xffffffffu;
+        for (std::size_t i = 0; i < size; i++) {
+            crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return crc ^ 0xffffffffu;
+    }
+
+    // Appends a PNG chunk; its CRC covers the type and the data.
+    void appendChunk(_Inout_ std::vector<std::uint8_t>& png, _In_ const char* type, _In_ const std::vector<std::uint8_t>& data) {
+        appendBig32(png, static_cast<std::uint32_t>(data.size()));
+        const std::size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        appendBig32(png, crc32(png.data() + start, png.size() - start));
+    }
+
+    // Position and width of a BMP channel mask, for scaling it to 8 bits.
+    struct Channel {
+        int             shift = 0;
+        int             bits = 0;
+
+        explicit Channel(_In_ std::uint32_t mask) {
+            if (mask) {
+                while (!(mask & 1)) {
+                    mask >>= 1;
+                    shift++;
+                }
+                while (mask & 1) {
+                    mask >>= 1;
+                    bits++;
+                }
+            }
+        }
+
+        inline std::uint8_t extract(_In_ std::uint32_t pixel, _In_ std::uint8_t missing) const {
+            if (!bits) {
+                return missing;
+            }
+            const std::uint32_t value = (pixel >> shift) & ((1u << bits) - 1);
+            return static_cast<std::uint8_t>(bits >= 8 ? value >> (bits - 8) : value * 255 / ((1u << bits) - 1));
+        }
+    };
+}
+
+WinToastImage WinToastImage::downscale(_In_ const WinToastImage& source, _In_ int maxDimension) {
+    if (maxDimension <= 0 || (source.width <= maxDimension && source.height <= maxDimension)) {
+        return source;
+    }
+    const double scale = static_cast<double>(maxDimension) / std::max(source.width, source.height);
+    WinToastImage result;
+    result.width = std::max(1, static_cast<int>(source.width * scale + 0.5));
+    result.height = std::max(1, static_cast<int>(source.height * scale + 0.5));
+
+    // Every source column and row covers at most two destination ones; the
+    // weights are the lengths of overlap in destination pixels, so they add up
+    // to 1 over each destination pixel and the sums below are already averages.
+    struct Span {
+        int             first;
+        float           firstWeight;
+        float           secondWeight;
+    };
+    auto spans = [](int from, int to) {
+        std::vector<Span> result(from);
+        const double ratio = static_cast<double>(to) / from;
+        for (int i = 0; i < from; i++) {
+            const double start = i * ratio;
+            const double end = (i + 1) * ratio;
+            Span& span = result[i];
+            span.first = std::min(static_cast<int>(start), to - 1);
+            const double boundary = span.first + 1.0;
+            if (end > boundary && span.first + 1 < to) {
+                span.firstWeight = static_cast<float>(boundary - start);
+                span.secondWeight = static_cast<float>(end - boundary);
+            } else {
+                span.firstWeight = static_cast<float>(end - start);
+                span.secondWeight = 0.0f;
+            }
+        }
+        return result;
+    };
+    const std::vector<Span> columns = spans(source.width, result.width);
+    const std::vector<Span> rows = spans(source.height, result.height);
+
+    // Colors are premultiplied while averaging, so transparent pixels add no color.
+    std::vector<float> row(static_cast<std::size_t>(result.width) * 4);
+    std::vector<float> sums(static_cast<std::size_t>(result.width) * result.height * 4, 0.0f);
+    for (int y = 0; y < source.height; y++) {
+        std::fill(row.begin(), row.end(), 0.0f);
+        const std::uint8_t* pixel = source.pixels.data() + static_cast<std::size_t>(y) * source.width * 4;
+        for (int x = 0; x < source.width; x++, pixel += 4) {
+            const float alpha = pixel[3] * (1.0f / 255.0f);
+            const float premultiplied[4] = { pixel[0] * alpha, pixel[1] * alpha, pixel[2] * alpha, static_cast<float>(pixel[3]) };
+            const Span& span = columns[x];
+            float* target = &row[static_cast<std::size_t>(span.first) * 4];
+            for (int channel = 0; channel < 4; channel++) {
+                target[channel] += premultiplied[channel] * span.firstWeight;
+            }
+            if (span.secondWeight > 0.0f) {
+                for (int channel = 0; channel < 4; channel++) {
+                    target[4 + channel] += premultiplied[channel] * span.secondWeight;
+                }
+            }
+        }
+        const Span& span = rows[y];
+        float* first = &sums[static_cast<std::size_t>(span.first) * result.width * 4];
+        for (std::size_t i = 0; i < row.size(); i++) {
+            first[i] += row[i] * span.firstWeight;
+        }
+        if (span.secondWeight > 0.0f) {
+            float* second = first + static_cast<std::size_t>(result.width) * 4;
+            for (std::size_t i = 0; i < row.size(); i++) {
+                second[i] += row[i] * span.secondWeight;
+            }
+        }
+    }
+
+    result.pixels.resize(sums.size());
+    for (std::size_t i = 0; i < sums.size(); i += 4) {
+        const float alpha = sums[i + 3];
+        const float unpremultiply = alpha > 0.0f ? 255.0f / alpha : 0.0f;
+        for (int channel = 0; channel < 3; channel++) {
+            result.pixels[i + channel] = static_cast<std::uint8_t>(std::min(255.0f, sums[i + channel] * unpremultiply + 0.5f));
+        }
+        result.pixels[i + 3] = static_cast<std::uint8_t>(std::min(255.0f, alpha + 0.5f));
+    }
+    return result;
+}
+
+bool WinToastPortableImageCodec::decode(_In_ const std::uint8_t* data, _In_ std::size_t size, _Out_ WinToastImage& image) {
+    image = WinToastImage();
+    if (size < 54 || data[0] != 'B' || data[1] != 'M') {
+        return false;
+    }
+    const std::uint32_t pixelOffset = readLittle32(data + 10);
+    const std::uint32_t headerSize = readLittle32(data + 14);
+    if (headerSize < 40 || 14 + static_cast<std::size_t>(headerSize) > size) {
+        return false;
+    }
+    const std::int32_t width = static_cast<std::int32_t>(readLittle32(data + 18));
+    const std::int32_t signedHeight = static_cast<std::int32_t>(readLittle32(data + 22));
+    const std::uint16_t bitsPerPixel = readLittle16(data + 28);
+    const std::uint32_t compression = readLittle32(data + 30);
+    const bool topDown = signedHeight < 0;
+    const std::int32_t height = topDown ? -signedHeight : signedHeight;
+    if (width <= 0 || height <= 0 || width > MaxDecodedDimension || height > MaxDecodedDimension
+        || (bitsPerPixel != 24 && bitsPerPixel != 32)) {
+        return false;
+    }
+
+    // BI_RGB: BGR(X); BI_BITFIELDS/BI_ALPHABITFIELDS: masks after the 40-byte
+    // header (or inside a V4/V5 header, at the same place).
+    std::uint32_t masks[4] = { 0x00ff0000, 0x0000ff00, 0x000000ff, 0 };
+    if (compression == 3 || compression == 6) {
+        const std::size_t count = compression == 6 || headerSize >= 56 ? 4 : 3;
+        if (bitsPerPixel != 32 || 54 + count * 4 > size) {
+            return false;
+        }
+        for (std::size_t mask = 0; mask < count; mask++) {
+            masks[mask] = readLittle32(data + 54 + mask * 4);
+        }
+    } else if (compression != 0) {
+        return false;
+    }
+    const Channel red(masks[0]), green(masks[1]), blue(masks[2]), alpha(masks[3]);
+
+    const std::size_t stride = ((static_cast<std::size_t>(width) * bitsPerPixel + 31) / 32) * 4;
+    if (pixelOffset > size || stride * height > size - pixelOffset) {
+        return false;
+    }
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(static_cast<std::size_t>(width) * height * 4);
+    bool anyAlpha = false;
+    for (std::int32_t y = 0; y < height; y++) {
+        const std::uint8_t* in = data + pixelOffset + stride * (topDown ? y : height - 1 - y);
+        std::uint8_t* out = image.pixels.data() + static_cast<std::size_t>(y) * width * 4;
+        for (std::int32_t x = 0; x < width; x++, out += 4) {
+            if (bitsPerPixel == 24) {
+                out[0] = in[2];
+                out[1] = in[1];
+                out[2] = in[0];
+                out[3] = 255;
+                in += 3;
+            } else {
+                const std::uint32_t pixel = readLittle32(in);
+                out[0] = red.extract(pixel, 0);
+                out[1] = green.extract(pixel, 0);
+                out[2] = blue.extract(pixel, 0);
+                out[3] = alpha.extract(pixel, 255);
+                anyAlpha |= out[3] != 0;
+                in += 4;
+            }
+        }
+    }
+    // 32-bit files often leave the alpha byte at zero; treat them as opaque.
+    if (bitsPerPixel == 32 && masks[3] && !anyAlpha) {
+        for (std::size_t i = 3; i < image.pixels.size(); i += 4) {
+            image.pixels[i] = 255;
+        }
+    }
+    return true;
+}
+
+bool WinToastPortableImageCodec::encodePng(_In_ const WinToastImage& image, _Out_ std::vector<std::uint8_t>& png) {
+    png.clear();
+    if (image.width <= 0 || image.height <= 0 || image.pixels.size() != static_cast<std::size_t>(image.width) * image.height * 4) {
+        return false;
+    }
+    static const std::uint8_t Signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    png.assign(Signature, Signature + sizeof(Signature));
+
+    std::vector<std::uint8_t> header;
+    appendBig32(header, static_cast<std::uint32_t>(image.width));
+    appendBig32(header, static_cast<std::uint32_t>(image.height));
+    header.push_back(8);    // bits per channel
+    header.push_back(6);    // RGBA
+    header.push_back(0);    // deflate
+    header.push_back(0);    // adaptive filtering
+    header.push_back(0);    // not interlaced
+    appendChunk(png, "IHDR", header);
+
+    // zlib stream of stored deflate blocks over the scanlines, each led by
+    // filter type 0 (none).
+    const std::size_t rowBytes = static_cast<std::size_t>(image.width) * 4;
+    const std::size_t rawSize = (rowBytes + 1) * image.height;
+    std::vector<std::uint8_t> raw;
+    raw.reserve(rawSize);
+    for (int y = 0; y < image.height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), image.pixels.begin() + y * rowBytes, image.pixels.begin() + (y + 1) * rowBytes);
+    }
+    std::vector<std::uint8_t> zlib;
+    zlib.reserve(rawSize + rawSize / 65535 * 5 + 11);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    std::size_t offset = 0;
+    do {
+        const std::size_t length = std::min<std::size_t>(raw.size() - offset, 65535);
+        zlib.push_back(offset + length == raw.size() ? 1 : 0);
+        zlib.push_back(static_cast<std::uint8_t>(length));
+        zlib.push_back(static_cast<std::uint8_t>(length >> 8));
+        zlib.push_back(static_cast<std::uint8_t>(~length));
+        zlib.push_back(static_cast<std::uint8_t>(~length >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+        offset += length;
+    } while (offset < raw.size());
+    // Adler-32, reduced every 5552 bytes: the most that cannot overflow b.
+    std::uint32_t a = 1, b = 0;
+    for (std::size_t start = 0; start < raw.size(); start += 5552) {
+        const std::size_t end = std::min<std::size_t>(raw.size(), start + 5552);
+        for (std::size_t i = start; i < end; i++) {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    appendBig32(zlib, (b << 16) | a);
+    appendChunk(png, "IDAT", zlib);
+    appendChunk(png, "IEND", std::vector<std::uint8_t>());
+    return true;
+}
+
+const wchar_t* WinToastLib::imageExtension(_In_ const std::uint8_t* data, _In_ std::size_t size) {
+    if (size >= 8 && !std::memcmp(data, "\x89PNG\r\n\x1a\n", 8)) {
+        return L".png";
+    }
+    if (size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff) {
+        return L".jpg";
+    }
+    if (size >= 6 && (!std::memcmp(data, "GIF87a", 6) || !std::memcmp(data, "GIF89a", 6))) {
+        return L".gif";
+    }
+    return nullptr;
+}
+
+#ifdef _WIN32
+namespace {
+    using Microsoft::WRL::ComPtr;
+
+    // Cache workers are plain threads; each call brings its own apartment.
+    class ComScope {
+    public:
+        ComScope() : _hr(CoInitializeEx(nullptr, COINIT_MULTITHREADED)) {}
+        ~ComScope() {
+            if (SUCCEEDED(_hr)) {
+                CoUninitialize();
+            }
+        }
+        inline bool usable() const { return SUCCEEDED(_hr) || _hr == RPC_E_CHANGED_MODE; }
+    private:
+        HRESULT     _hr;
+    };
+
+    class WinToastWicImageCodec : public IWinToastImageCodec {
+    public:
+        bool decode(_In_ const std::uint8_t* data, _In_ std::size_t size, _Out_ WinToastImage& image) override {
+            image = WinToastImage();
+            ComScope com;
+            ComPtr<IWICImagingFactory> factory;
+            ComPtr<IWICStream> stream;
+            ComPtr<IWICBitmapDecoder> decoder;
+            ComPtr<IWICBitmapFrameDecode> frame;
+            ComPtr<IWICFormatConverter> converter;
+            UINT width = 0, height = 0;
+            HRESULT hr = com.usable() && size <= MAXDWORD ? S_OK : E_FAIL;
+            if (SUCCEEDED(hr)) {
+                hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+            }
+            if (SUCCEEDED(hr)) {
+                hr = factory->CreateStream(&stream);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = stream->InitializeFromMemory(const_cast<BYTE*>(data), static_cast<DWORD>(size));
+            }
+            if (SUCCEEDED(hr)) {
+                hr = factory->CreateDecoderFromStream(stream.Get(), nullptr, WICDecodeMetadataCacheOnDemand, &decoder);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = decoder->GetFrame(0, &frame);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = factory->CreateFormatConverter(&converter);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = converter->GetSize(&width, &height);
+            }
+            if (SUCCEEDED(hr) && (width == 0 || height == 0 || width > MaxDecodedDimension || height > MaxDecodedDimension)) {
+                hr = E_INVALIDARG;
+            }
+            if (SUCCEEDED(hr)) {
+                image.pixels.resize(static_cast<std::size_t>(width) * height * 4);
+                hr = converter->CopyPixels(nullptr, width * 4, static_cast<UINT>(image.pixels.size()), image.pixels.data());
+            }
+            if (FAILED(hr)) {
+                image = WinToastImage();
+                return false;
+            }
+            image.width = static_cast<int>(width);
+            image.height = static_cast<int>(height);
+            return true;
+        }
+
+        bool encodePng(_In_ const WinToastImage& image, _Out_ std::vector<std::uint8_t>& png) override {
+            png.clear();
+            // The PNG encoder takes BGRA on every Windows version.
+            std::vector<std::uint8_t> bgra(image.pixels);
+            for (std::size_t i = 0; i + 3 < bgra.size(); i += 4) {
+                std::swap(bgra[i], bgra[i + 2]);
+            }
+            ComScope com;
+            ComPtr<IWICImagingFactory> factory;
+            ComPtr<IStream> memory;
+            ComPtr<IWICBitmapEncoder> encoder;
+            ComPtr<IWICBitmapFrameEncode> frame;
+            ComPtr<IPropertyBag2> properties;
+            WICPixelFormatGUID format = GUID_WICPixelFormat32bppBGRA;
+            HRESULT hr = com.usable() && image.width > 0 && image.height > 0 ? S_OK : E_FAIL;
+            if (SUCCEEDED(hr)) {
+                hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+            }
+            if (SUCCEEDED(hr)) {
+                hr = CreateStreamOnHGlobal(nullptr, TRUE, &memory);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = factory->CreateEncoder(GUID_ContainerFormatPng, nullptr, &encoder);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = encoder->Initialize(memory.Get(), WICBitmapEncoderNoCache);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = encoder->CreateNewFrame(&frame, &properties);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = frame->Initialize(properties.Get());
+            }
+            if (SUCCEEDED(hr)) {
+                hr = frame->SetSize(image.width, image.height);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = frame->SetPixelFormat(&format);
+            }
+            if (SUCCEEDED(hr) && format != GUID_WICPixelFormat32bppBGRA) {
+                hr = E_UNEXPECTED;
+            }
+            if (SUCCEEDED(hr)) {
+                hr = frame->WritePixels(image.height, image.width * 4, static_cast<UINT>(bgra.size()), bgra.data());
+            }
+            if (SUCCEEDED(hr)) {
+                hr = frame->Commit();
+            }
+            if (SUCCEEDED(hr)) {
+                hr = encoder->Commit();
+            }
+            HGLOBAL global = nullptr;
+            ULARGE_INTEGER written = {};
+            if (SUCCEEDED(hr)) {
+                hr = memory->Seek(LARGE_INTEGER(), STREAM_SEEK_CUR, &written);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = GetHGlobalFromStream(memory.Get(), &global);
+            }
+            if (SUCCEEDED(hr)) {
+                const std::uint8_t* bytes = static_cast<const std::uint8_t*>(GlobalLock(global));
+                if (bytes) {
+                    png.assign(bytes, bytes + written.QuadPart);
+                    GlobalUnlock(global);
+                } else {
+                    hr = E_OUTOFMEMORY;
+                }
+            }
+            return SUCCEEDED(hr);
+        }
+    };
+}
+
+std::shared_ptr<IWinToastImageCodec> WinToastLib::defaultImageCodec() {
+    return std::make_shared<WinToastWicImageCodec>();
+}
+#else
+std::shared_ptr<IWinToastImageCodec> WinToastLib::defaultImageCodec() {
+    return std::make_shared<WinToastPortableImageCodec>();
+}
+#endif
@@ -0,0 +1,47 @@
+#ifndef WINTOASTIMAGE_H
+#define WINTOASTIMAGE_H
+#include "wintoasttemplate.h"
+#include <memory>
+
+namespace WinToastLib {
+
+    // Decoded picture: 8-bit RGBA, straight (not premultiplied) alpha, rows top
+    // down with no padding.
+    struct WinToastImage {
+        int                         width = 0;
+        int                         height = 0;
+        std::vector<std::uint8_t>   pixels;
+
+        // Fits the image inside maxDimension x maxDimension, keeping the aspect
+        // ratio, by averaging every source pixel a destination pixel covers (box
+        // filter, alpha-weighted). Images that already fit are returned as is.
+        static WinToastImage        downscale(_In_ const WinToastImage& source, _In_ int maxDimension);
+    };
+
+    // Turns file contents into pixels and pixels into a PNG file.
+    class IWinToastImageCodec {
+    public:
+        virtual ~IWinToastImageCodec() {}
+        virtual bool            decode(_In_ const std::uint8_t* data, _In_ std::size_t size, _Out_ WinToastImage& image) = 0;
+        virtual bool            encodePng(_In_ const WinToastImage& image, _Out_ std::vector<std::uint8_t>& png) = 0;
+    };
+
+    // Dependency-free codec: decodes uncompressed BMP (24 and 32 bits per pixel)
+    // and writes PNG with stored (uncompressed) deflate blocks, which any PNG
+    // reader accepts. Other formats fail to decode.
+    class WinToastPortableImageCodec : public IWinToastImageCodec {
+    public:
+        bool                    decode(_In_ const std::uint8_t* data, _In_ std::size_t size, _Out_ WinToastImage& image) override;
+        bool                    encodePng(_In_ const WinToastImage& image, _Out_ std::vector<std::uint8_t>& png) override;
+    };
+
+    // The codec the image cache uses by default: Windows Imaging Component
+    // (every installed format in, compressed PNG out) on Windows, the portable
+    // codec elsewhere.
+    std::shared_ptr<IWinToastImageCodec> defaultImageCodec();
+
+    // File types toasts display directly, told by their first bytes; for files
+    // that cannot be decoded but may still be shown as they are. nullptr if none.
+    const wchar_t*              imageExtension(_In_ const std::uint8_t* data, _In_ std::size_t size);
+}
+#endif // WINTOASTIMAGE_H
@@ -0,0 +1,417 @@
+#include "wintoastimagecache.h"
+#include "wintoastfile.h"
+#include <algorithm>
+#include <chrono>
+#include <cwchar>
+
+using namespace WinToastLib;
+
+namespace {
+    const std::uint64_t FnvOffsetBasis = 0xcbf29ce484222325ULL;
+    const std::uint64_t FnvPrime = 0x100000001b3ULL;
+#ifdef _WIN32
+    const wchar_t PathSeparator = L'\\';
+#else
+    const wchar_t PathSeparator = L'/';
+#endif
+
+    std::wstring hashName(_In_ std::uint64_t hash, _In_ const wchar_t* extension) {
+        wchar_t name[32];
+        std::swprintf(name, sizeof(name) / sizeof(*name), L"%016llx%ls", static_cast<unsigned long long>(hash), extension);
+        return name;
+    }
+
+    // Copies are named <16 hex digits><extension>; anything else is not ours.
+    bool parseName(_In_ const std::wstring& name, _Out_ std::uint64_t& hash) {
+        static const wchar_t* const Extensions[] = { L".png", L".jpg", L".gif" };
+        if (name.length() != 20 || std::find_if(std::begin(Extensions), std::end(Extensions), [&name](const wchar_t* extension) {
+                return name.compare(16, 4, extension) == 0;
+            }) == std::end(Extensions)) {
+            return false;
+        }
+        hash = 0;
+        for (int i = 0; i < 16; i++) {
+            const wchar_t c = name[i];
+            const int digit = c >= L'0' && c <= L'9' ? c - L'0' : c >= L'a' && c <= L'f' ? c - L'a' + 10 : -1;
+            if (digit < 0) {
+                return false;
+            }
+            hash = (hash << 4) | static_cast<std::uint64_t>(digit);
+        }
+        return true;
+    }
+
+    bool readFile(_In_ const std::wstring& path, _In_ std::uint64_t size, _Out_ std::vector<std::uint8_t>& contents) {
+        std::FILE* file = openFile(path, "rb");
+        if (!file) {
+            return false;
+        }
+        contents.resize(static_cast<std::size_t>(size));
+        const bool read = std::fread(contents.data(), 1, contents.size(), file) == contents.size();
+        std::fclose(file);
+        return read;
+    }
+
+    bool writeFile(_In_ const std::wstring& path, _In_ const std::vector<std::uint8_t>& contents) {
+        std::FILE* file = openFile(path, "wb");
+        if (!file) {
+            return false;
+        }
+        const bool written = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        return std::fclose(file) == 0 && written;
+    }
+}
+
+WinToastImageCache::WinToastImageCache() : WinToastImageCache(Options()) {}
+
+WinToastImageCache::WinToastImageCache(_In_ const Options& options, _In_opt_ std::shared_ptr<IWinToastImageCodec> codec) :
+    _options(options),
+    _codec(codec ? codec : defaultImageCodec())
+{
+    _options.workers = std::max<std::size_t>(_options.workers, 1);
+}
+
+WinToastImageCache::~WinToastImageCache() {
+    close();
+}
+
+bool WinToastImageCache::open(_In_ const std::wstring& directory) {
+    close();
+    if (!createDirectory(directory)) {
+        return false;
+    }
+    struct Found {
+        std::uint64_t   hash;
+        std::wstring    name;
+        std::size_t     bytes;
+        std::int64_t    modified;
+    };
+    std::vector<Found> found;
+    std::vector<std::wstring> leftovers;
+    const bool listed = listDirectory(directory, [&](const std::wstring& name) {
+        Found file;
+        std::uint64_t size;
+        if (parseName(name, file.hash) && fileStatus(directory + PathSeparator + name, size, file.modified)) {
+            file.name = name;
+            file.bytes = static_cast<std::size_t>(size);
+            found.push_back(std::move(file));
+        } else if (name.length() > 4 && name.compare(name.length() - 4, 4, L".tmp") == 0) {
+            leftovers.push_back(name);
+        }
+    });
+    if (!listed) {
+        return false;
+    }
+    // Half-written copies of a run that died.
+    for (const std::wstring& name : leftovers) {
+        removeFile(directory + PathSeparator + name);
+    }
+    // Oldest first, so the newest end up most recently used.
+    std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.modified < b.modified; });
+
+    std::vector<std::wstring> evicted;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _directory = directory;
+        _sources.clear();
+        _files.clear();
+        _recent.clear();
+        _bytes = 0;
+        _counters = Counters();
+        for (const Found& file : found) {
+            addFileLocked(file.hash, file.name, file.bytes);
+        }
+        evictLocked(nullptr, evicted);
+        _stopping = false;
+        for (std::size_t worker = 0; worker < _options.workers; worker++) {
+            _workers.emplace_back(&WinToastImageCache::workerLoop, this);
+        }
+    }
+    for (const std::wstring& name : evicted) {
+        removeFile(directory + PathSeparator + name);
+    }
+    return true;
+}
+
+void WinToastImageCache::close() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        _work.notify_all();
+    }
+    for (std::thread& worker : _workers) {
+        worker.join();
+    }
+    _workers.clear();
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const std::wstring& source : _queue) {
+        Source& entry = _sources[source];
+        entry.queued = false;
+        if (entry.state == Pending) {
+            entry.state = Missing;
+        }
+    }
+    _queue.clear();
+    _idle.notify_all();
+}
+
+std::wstring WinToastImageCache::resolve(_In_ const std::wstring& source) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return lookupLocked(source, false);
+}
+
+void WinToastImageCache::prefetch(_In_ const std::wstring& source) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    lookupLocked(source, true);
+}
+
+WinToastImageCache::State WinToastImageCache::state(_In_ const std::wstring& source) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _sources.find(source);
+    if (it == _sources.end()) {
+        return Missing;
+    }
+    // A ready source whose copy was evicted is cached again on its next use.
+    if (it->second.state == Ready && !_files.count(it->second.hash)) {
+        return Missing;
+    }
+    return it->second.state;
+}
+
+std::wstring WinToastImageCache::lookupLocked(_In_ const std::wstring& source, _In_ bool prefetchOnly) {
+    Source& entry = _sources[source];
+    const bool stale = now() - entry.checkedAt >= _options.revalidateMilliseconds;
+    if (entry.state == Ready) {
+        auto file = _files.find(entry.hash);
+        if (file != _files.end()) {
+            _recent.splice(_recent.begin(), _recent, file->second.recent);
+            if (stale) {
+                // The copy stays in use while the worker looks at the source again.
+                enqueueLocked(source, entry);
+            }
+            if (!prefetchOnly) {
+                _counters.hits++;
+            }
+            return _directory + PathSeparator + file->second.name;
+        }
+        entry.state = Missing;
+    }
+    if (entry.state == Missing || (entry.state == Failed && stale)) {
+        enqueueLocked(source, entry);
+    }
+    if (!prefetchOnly) {
+        _counters.misses++;
+    }
+    return std::wstring();
+}
+
+bool WinToastImageCache::enqueueLocked(_In_ const std::wstring& source, _Inout_ Source& entry) {
+    if (entry.queued) {
+        return true;
+    }
+    if (_stopping || _queue.size() >= _options.queueCapacity) {
+        _counters.ignored++;
+        return false;
+    }
+    _queue.push_back(source);
+    entry.queued = true;
+    if (entry.state != Ready) {
+        entry.state = Pending;
+    }
+    _work.notify_one();
+    return true;
+}
+
+bool WinToastImageCache::waitIdle(_In_ std::int64_t timeoutMilliseconds) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _idle.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [this] { return _queue.empty() && _busy == 0; });
+}
+
+WinToastImageCache::Counters WinToastImageCache::counters() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Counters counters = _counters;
+    counters.entries = _files.size();
+    counters.bytes = _bytes;
+    return counters;
+}
+
+void WinToastImageCache::workerLoop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        _work.wait(lock, [this] { return _stopping || !_queue.empty(); });
+        if (_stopping) {
+            break;
+        }
+        const std::wstring source = std::move(_queue.front());
+        _queue.pop_front();
+        _busy++;
+        lock.unlock();
+        process(source);
+        lock.lock();
+        _sources[source].queued = false;
+        _busy--;
+        if (_queue.empty() && _busy == 0) {
+            _idle.notify_all();
+        }
+    }
+}
+
+void WinToastImageCache::process(_In_ const std::wstring& source) {
+    Source known;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        known = _sources[source];
+    }
+    auto finish = [this, &source](State state, std::uint64_t hash, std::uint64_t size, std::int64_t modified) {
+        Source& entry = _sources[source];
+        entry.state = state;
+        entry.hash = hash;
+        entry.size = size;
+        entry.modified = modified;
+        entry.checkedAt = now();
+    };
+
+    std::uint64_t size = 0;
+    std::int64_t modified = 0;
+    std::vector<std::uint8_t> contents;
+    if (!fileStatus(source, size, modified) || size == 0 || size > _options.maxSourceBytes || size > SIZE_MAX) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _counters.failed++;
+        finish(Failed, 0, size, modified);
+        return;
+    }
+    {
+        // Unchanged since it was cached: nothing to read.
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (known.state == Ready && known.size == size && known.modified == modified && _files.count(known.hash)) {
+            finish(Ready, known.hash, size, modified);
+            return;
+        }
+    }
+    if (!readFile(source, size, contents)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _counters.failed++;
+        finish(Failed, 0, size, modified);
+        return;
+    }
+
+    const std::uint64_t hash = hashContents(contents);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _counters.processed++;
+        auto file = _files.find(hash);
+        if (file != _files.end()) {
+            _counters.shared++;
+            _recent.splice(_recent.begin(), _recent, file->second.recent);
+            finish(Ready, hash, size, modified);
+            return;
+        }
+    }
+
+    bool downscaled = false;
+    std::size_t bytes = 0;
+    const std::wstring name = store(hash, contents, bytes, downscaled);
+    std::vector<std::wstring> evicted;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (name.empty()) {
+            _counters.failed++;
+            finish(Failed, 0, size, modified);
+            return;
+        }
+        if (_files.count(hash)) {
+            // Another worker stored the same contents meanwhile, under the same name.
+            _counters.shared++;
+        } else {
+            (downscaled ? _counters.downscaled : _counters.copied)++;
+            addFileLocked(hash, name, bytes);
+        }
+        finish(Ready, hash, size, modified);
+        evictLocked(&hash, evicted);
+    }
+    for (const std::wstring& victim : evicted) {
+        removeFile(_directory + PathSeparator + victim);
+    }
+}
+
+std::wstring WinToastImageCache::store(_In_ std::uint64_t hash, _In_ const std::vector<std::uint8_t>& contents,
+                                       _Out_ std::size_t& bytes, _Out_ bool& downscaled) {
+    downscaled = false;
+    bytes = 0;
+    std::vector<std::uint8_t> copy;
+    const wchar_t* extension = imageExtension(contents.data(), contents.size());
+    WinToastImage image;
+    if (_codec->decode(contents.data(), contents.size(), image)) {
+        if (image.width > _options.maxDimension || image.height > _options.maxDimension) {
+            downscaled = _codec->encodePng(WinToastImage::downscale(image, _options.maxDimension), copy);
+            if (!downscaled) {
+                return std::wstring();
+            }
+            extension = L".png";
+        } else if (!extension) {
+            // Small enough, but in a format toasts do not show (e.g. BMP).
+            if (!_codec->encodePng(image, copy)) {
+                return std::wstring();
+            }
+            extension = L".png";
+        }
+    } else if (!extension) {
+        return std::wstring();
+    }
+    const std::vector<std::uint8_t>& data = copy.empty() ? contents : copy;
+
+    // Written under a private name and renamed, so the platform never sees a
+    // partial file and two workers with the same contents do not collide.
+    const std::wstring name = hashName(hash, extension);
+    std::uint64_t temporary;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        temporary = ++_temporary;
+    }
+    const std::wstring staging = _directory + PathSeparator + name + L"." + std::to_wstring(temporary) + L".tmp";
+    if (!writeFile(staging, data) || !renameFile(staging, _directory + PathSeparator + name)) {
+        removeFile(staging);
+        return std::wstring();
+    }
+    bytes = data.size();
+    return name;
+}
+
+void WinToastImageCache::addFileLocked(_In_ std::uint64_t hash, _In_ const std::wstring& name, _In_ std::size_t bytes) {
+    _recent.push_front(hash);
+    File& file = _files[hash];
+    file.name = name;
+    file.bytes = bytes;
+    file.recent = _recent.begin();
+    _bytes += bytes;
+}
+
+void WinToastImageCache::evictLocked(_In_opt_ const std::uint64_t* keep, _Inout_ std::vector<std::wstring>& evicted) {
+    while (_bytes > _options.maxBytes && !_recent.empty()) {
+        const std::uint64_t victim = _recent.back();
+        if (keep && victim == *keep) {
+            // Only the newest copy is left and it alone is over the limit.
+            break;
+        }
+        auto file = _files.find(victim);
+        _bytes -= file->second.bytes;
+        evicted.push_back(file->second.name);
+        _files.erase(file);
+        _recent.pop_back();
+        _counters.evicted++;
+    }
+}
+
+std::uint64_t WinToastImageCache::hashContents(_In_ const std::vector<std::uint8_t>& contents) const {
+    // The target size is part of the key: copies made for another size differ.
+    std::uint64_t hash = FnvOffsetBasis;
+    for (std::uint8_t byte : contents) {
+        hash = (hash ^ byte) * FnvPrime;
+    }
+    hash = (hash ^ contents.size()) * FnvPrime;
+    return (hash ^ static_cast<std::uint64_t>(_options.maxDimension)) * FnvPrime;
+}
+
+std::int64_t WinToastImageCache::now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
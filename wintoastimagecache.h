@@ -0,0 +1,123 @@
+#ifndef WINTOASTIMAGECACHE_H
+#define WINTOASTIMAGECACHE_H
+#include "wintoastimage.h"
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace WinToastLib {
+
+    // Local, content-addressed copies of toast images. The platform reads a
+    // toast's image when it shows it, every time; for big files or files on a
+    // network share that read is slow, so the cache keeps a small copy on a
+    // local disk instead.
+    //
+    // A worker pool reads each source image, hashes its contents and stores a
+    // copy named after the hash, downscaled to fit the toast (or the original
+    // bytes when the codec cannot decode them but the platform can show them).
+    // Sources with the same contents share one copy. resolve() only looks in
+    // memory: it returns the copy when it is ready and otherwise queues the
+    // source and returns nothing, so the caller shows the source this time.
+    // Copies are evicted least recently used first once their total size
+    // passes maxBytes.
+    class WinToastImageCache {
+    public:
+        struct Options {
+            std::size_t         maxBytes = 64 << 20;        // total size of the copies
+            std::size_t         maxSourceBytes = 32 << 20;  // bigger sources are never read
+            int                 maxDimension = 256;         // longer side of a copy, in pixels
+            std::size_t         workers = 2;
+            std::size_t         queueCapacity = 1024;       // sources waiting for a worker; more are ignored
+            // A ready source is checked again (size and modification time only)
+            // when resolved after this long; failed ones are retried.
+            std::int64_t        revalidateMilliseconds = 60000;
+        };
+
+        enum State { Missing = 0, Pending, Ready, Failed };
+
+        struct Counters {
+            std::uint64_t       hits;               // resolved to a ready copy
+            std::uint64_t       misses;             // not ready; the source was shown
+            std::uint64_t       processed;          // sources read and hashed by a worker
+            std::uint64_t       shared;             // of those, contents that already had a copy
+            std::uint64_t       downscaled;
+            std::uint64_t       copied;             // kept as is: fits already, or not decodable
+            std::uint64_t       failed;
+            std::uint64_t       evicted;
+            std::uint64_t       ignored;            // queue full
+            std::size_t         entries;
+            std::size_t         bytes;
+        };
+
+        WinToastImageCache();
+        explicit WinToastImageCache(_In_ const Options& options, _In_opt_ std::shared_ptr<IWinToastImageCodec> codec = nullptr);
+        // Stops the workers; the files stay for the next run.
+        ~WinToastImageCache();
+
+        // Uses directory for the copies, creating it if needed, takes over the
+        // copies an earlier run left there and starts the workers.
+        bool                    open(_In_ const std::wstring& directory);
+        void                    close();
+
+        // Path of the ready copy of source, or empty. Never touches the disk.
+        std::wstring            resolve(_In_ const std::wstring& source);
+        // Queues source ahead of the first toast that shows it.
+        void                    prefetch(_In_ const std::wstring& source);
+        State                   state(_In_ const std::wstring& source) const;
+        // Waits until no source is queued or being processed.
+        bool                    waitIdle(_In_ std::int64_t timeoutMilliseconds);
+        Counters                counters() const;
+        inline const Options&   options() const { return _options; }
+
+    private:
+        struct File {
+            std::wstring        name;
+            std::size_t         bytes;
+            std::list<std::uint64_t>::iterator recent;
+        };
+
+        struct Source {
+            State               state = Missing;
+            std::uint64_t       hash = 0;
+            std::uint64_t       size = 0;
+            std::int64_t        modified = 0;
+            std::int64_t        checkedAt = 0;      // steady clock, milliseconds
+            bool                queued = false;
+        };
+
+        std::wstring            lookupLocked(_In_ const std::wstring& source, _In_ bool prefetchOnly);
+        bool                    enqueueLocked(_In_ const std::wstring& source, _Inout_ Source& entry);
+        void                    workerLoop();
+        void                    process(_In_ const std::wstring& source);
+        // Writes the copy of contents; returns its file name, or empty.
+        std::wstring            store(_In_ std::uint64_t hash, _In_ const std::vector<std::uint8_t>& contents,
+                                      _Out_ std::size_t& bytes, _Out_ bool& downscaled);
+        void                    addFileLocked(_In_ std::uint64_t hash, _In_ const std::wstring& name, _In_ std::size_t bytes);
+        // Drops least recently used copies, never keep, until the total fits;
+        // the caller deletes the evicted files outside the lock.
+        void                    evictLocked(_In_opt_ const std::uint64_t* keep, _Inout_ std::vector<std::wstring>& evicted);
+        std::uint64_t           hashContents(_In_ const std::vector<std::uint8_t>& contents) const;
+        static std::int64_t     now();
+
+        Options                 _options;
+        std::shared_ptr<IWinToastImageCodec> _codec;
+        std::wstring            _directory;
+        mutable std::mutex      _mutex;
+        std::condition_variable _work;
+        std::condition_variable _idle;
+        std::deque<std::wstring> _queue;
+        std::size_t             _busy = 0;          // sources being processed
+        std::unordered_map<std::wstring, Source> _sources;
+        std::unordered_map<std::uint64_t, File> _files;
+        std::list<std::uint64_t> _recent;           // hashes, most recently used first
+        std::size_t             _bytes = 0;
+        std::uint64_t           _temporary = 0;     // numbers the files being written
+        bool                    _stopping = true;
+        std::vector<std::thread> _workers;
+        Counters                _counters = {};
+    };
+}
+#endif // WINTOASTIMAGECACHE_H
@@ -1,5 +1,13 @@
 #include "wintoastlib.h"
 
+static_assert(static_cast<int>(WinToastLib::WinToastTemplate::ImageAndText01) == ToastTemplateType_ToastImageAndText01
+           && static_cast<int>(WinToastLib::WinToastTemplate::Text04) == ToastTemplateType_ToastText04,
+              "WinToastTemplateType must mirror ToastTemplateType");
+static_assert(static_cast<int>(WinToastLib::IWinToastHandler::UserCanceled) == ToastDismissalReason_UserCanceled
+           && static_cast<int>(WinToastLib::IWinToastHandler::ApplicationHidden) == ToastDismissalReason_ApplicationHidden
+           && static_cast<int>(WinToastLib::IWinToastHandler::TimedOut) == ToastDismissalReason_TimedOut,
+              "WinToastDismissalReason must mirror ToastDismissalReason");
+
 typedef LONG NTSTATUS, *PNTSTATUS;
 typedef NTSTATUS(WINAPI* RtlGetVersionPtr)(PRTL_OSVERSIONINFOW);
 #define STATUS_SUCCESS (0x00000000)
@@ -76,8 +84,41 @@ namespace DllImporter {
         }
         return hr;
     }
+
+    // Libraries are loaded and entry points resolved once per process.
+    inline HRESULT ensureLoaded() {
+        static std::once_flag once;
+        static HRESULT result = E_FAIL;
+        std::call_once(once, [] { result = initialize(); });
+        return result;
+    }
 }
 
+class WinToastWin32CapabilityProbe : public IWinToastCapabilityProbe {
+public:
+    WinToastCapabilities probe() override {
+        DllImporter::ensureLoaded();
+        WinToastCapabilities capabilities;
+        capabilities.set(WinToastCapabilities::AppUserModelId, DllImporter::SetCurrentProcessExplicitAppUserModelID != nullptr);
+        capabilities.set(WinToastCapabilities::ShellLinkProperties, DllImporter::PropVariantToString != nullptr);
+        capabilities.set(WinToastCapabilities::WinRTActivation, DllImporter::RoGetActivationFactory != nullptr
+                                                                && DllImporter::WindowsCreateStringReference != nullptr
+                                                                && DllImporter::WindowsGetStringRawBuffer != nullptr
+                                                                && DllImporter::WindowsDeleteString != nullptr);
+
+        RTL_OSVERSIONINFOW version = GetRealOSVersion();
+        capabilities.majorVersion = version.dwMajorVersion;
+        capabilities.minorVersion = version.dwMinorVersion;
+        capabilities.buildNumber = version.dwBuildNumber;
+        // Modern features (actions, audio, attribution) need Windows 10.
+        const bool modern = version.dwMajorVersion > 6;
+        capabilities.set(WinToastCapabilities::Actions, modern);
+        capabilities.set(WinToastCapabilities::Audio, modern);
+        capabilities.set(WinToastCapabilities::Attribution, modern);
+        return capabilities;
+    }
+};
+
 class WinToastStringWrapper {
 public:
     WinToastStringWrapper(_In_reads_(length) PCWSTR stringRef, _In_ UINT32 length) throw() {
@@ -162,6 +203,29 @@ public:
 };
 
 namespace Util {
+    // COM is initialized per thread, not per WinToast. Each thread that talks to
+    // the shell or the notification platform joins the multithreaded apartment
+    // the first time it needs to and leaves it when the thread ends. A thread
+    // already in a single-threaded apartment (a UI thread) keeps it.
+    class ComApartment {
+    public:
+        ComApartment() : _hr(CoInitializeEx(NULL, COINIT::COINIT_MULTITHREADED)) {}
+        ~ComApartment() {
+            if (SUCCEEDED(_hr)) {
+                CoUninitialize();
+            }
+        }
+        inline HRESULT result() const { return (SUCCEEDED(_hr) || _hr == RPC_E_CHANGED_MODE) ? S_OK : _hr; }
+
+    private:
+        HRESULT _hr;
+    };
+
+    inline HRESULT ensureComApartment() {
+        thread_local ComApartment apartment;
+        return apartment.result();
+    }
+
     inline HRESULT defaultExecutablePath(_In_ WCHAR* path, _In_ DWORD nSize = MAX_PATH) {
         DWORD written = GetModuleFileNameExW(GetCurrentProcess(), nullptr, path, nSize);
         //std::wcout << L"Default executable path: " << path << std::endl;
@@ -201,6 +265,18 @@ namespace Util {
     }
 
 
+    // Validation stamp for the shortcut: %LOCALAPPDATA%\<appname>.lnkstamp
+    inline HRESULT defaultShortcutStampPath(const std::wstring& appname, _In_ WCHAR* path, _In_ DWORD nSize = MAX_PATH) {
+        DWORD written = GetEnvironmentVariableW(L"LOCALAPPDATA", path, nSize);
+        HRESULT hr = written > 0 ? S_OK : E_INVALIDARG;
+        if (SUCCEEDED(hr)) {
+            const std::wstring stamp(L"\\" + appname + DEFAULT_STAMP_FORMAT);
+            errno_t result = wcscat_s(path, nSize, stamp.c_str());
+            hr = (result == 0) ? S_OK : E_INVALIDARG;
+        }
+        return hr;
+    }
+
     inline PCWSTR AsString(ComPtr<IXmlDocument> &xmlDocument) {
         HSTRING xml;
         ComPtr<IXmlNodeSerializer> ser;
@@ -215,20 +291,6 @@ namespace Util {
 		return DllImporter::WindowsGetStringRawBuffer(hstring, NULL);
     }
 
-    inline HRESULT setNodeStringValue(const std::wstring& string, IXmlNode *node, IXmlDocument *xml) {
-        ComPtr<IXmlText> textNode;
-        HRESULT hr = xml->CreateTextNode( WinToastStringWrapper(string).Get(), &textNode);
-        if (SUCCEEDED(hr)) {
-            ComPtr<IXmlNode> stringNode;
-            hr = textNode.As(&stringNode);
-            if (SUCCEEDED(hr)) {
-                ComPtr<IXmlNode> appendedChild;
-                hr = node->AppendChild(stringNode.Get(), &appendedChild);
-            }
-        }
-        return hr;
-    }
-
     inline HRESULT setEventHandlers(_In_ IToastNotification* notification, _In_ std::shared_ptr<IWinToastHandler> eventHandler, _In_ INT64 expirationTime) {
         EventRegistrationToken activatedToken, dismissedToken, failedToken;
         HRESULT hr = notification->add_Activated(
@@ -277,42 +339,383 @@ namespace Util {
         return hr;
     }
 
-    inline HRESULT addAttribute(_In_ IXmlDocument *xml, const std::wstring &name, IXmlNamedNodeMap *attributeMap) {
-        ComPtr<ABI::Windows::Data::Xml::Dom::IXmlAttribute> srcAttribute;
-        HRESULT hr = xml->CreateAttribute(WinToastStringWrapper(name).Get(), &srcAttribute);
+    inline HRESULT loadXmlDocument(_In_ const std::wstring& xml, _Out_ ComPtr<IXmlDocument>& xmlDocument) {
+        ComPtr<IActivationFactory> documentFactory;
+        HRESULT hr = DllImporter::Wrap_GetActivationFactory(WinToastStringWrapper(RuntimeClass_Windows_Data_Xml_Dom_XmlDocument).Get(), &documentFactory);
+        if (SUCCEEDED(hr)) {
+            ComPtr<IInspectable> inspectable;
+            hr = documentFactory->ActivateInstance(&inspectable);
+            if (SUCCEEDED(hr)) {
+                hr = inspectable.As(&xmlDocument);
+                if (SUCCEEDED(hr)) {
+                    ComPtr<IXmlDocumentIO> documentIO;
+                    hr = xmlDocument.As(&documentIO);
+                    if (SUCCEEDED(hr)) {
+                        hr = documentIO->LoadXml(WinToastStringWrapper(xml).Get());
+                    }
+                }
+            }
+        }
+        return hr;
+    }
+}
+
+// Notifier session on top of the WinRT toast APIs. Both activation factories and
+// the notifier are resolved once in openSession() and kept until a notifier call
+// fails, at which point the session is dropped and WinToast opens a new one.
+class WinToastWinRTBackend : public IWinToastBackend {
+public:
+    long openSession(_In_ const std::wstring& aumi) override {
+        WINTOAST_STAGE_TIMER(timer, _stats, _tracer, -1);
+        std::shared_ptr<Session> session = std::make_shared<Session>();
+        HRESULT hr = DllImporter::Wrap_GetActivationFactory(WinToastStringWrapper(RuntimeClass_Windows_UI_Notifications_ToastNotificationManager).Get(), &session->notificationManager);
+        if (SUCCEEDED(hr)) {
+            hr = DllImporter::Wrap_GetActivationFactory(WinToastStringWrapper(RuntimeClass_Windows_UI_Notifications_ToastNotification).Get(), &session->notificationFactory);
+            WINTOAST_STAGE_LAP(timer, FactoryLookup);
+            if (SUCCEEDED(hr)) {
+                hr = session->notificationManager->CreateToastNotifierWithId(WinToastStringWrapper(aumi).Get(), &session->notifier);
+                WINTOAST_STAGE_LAP(timer, NotifierCreation);
+            }
+            if (SUCCEEDED(hr)) {
+                // Missing before Windows 10 1607; only tagged toasts need it.
+                DllImporter::Wrap_GetActivationFactory(WinToastStringWrapper(RuntimeClass_Windows_UI_Notifications_NotificationData).Get(), &session->dataFactory);
+            }
+        }
+        if (FAILED(hr)) {
+            session.reset();
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _session.swap(session);
+        return hr;
+    }
+
+    void closeSession() override {
+        std::shared_ptr<Session> session;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _session.swap(session);
+    }
+
+    bool hasSession() const override {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _session != nullptr;
+    }
+
+    long show(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+              _In_ const std::shared_ptr<IWinToastHandler>& handler,
+              _Out_ WinToastNotificationHandle& handle) override {
+        return present(xml, expiration, nullptr, nullptr, nullptr, handler, handle);
+    }
+
+    long showTagged(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+                    _In_ const std::wstring& tag, _In_ const std::wstring& group,
+                    _In_ const WinToastNotificationData& data,
+                    _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                    _Out_ WinToastNotificationHandle& handle) override {
+        return present(xml, expiration, &tag, &group, &data, handler, handle);
+    }
+
+    long update(_In_ const std::wstring& tag, _In_ const std::wstring& group,
+                _In_ const WinToastNotificationData& data) override {
+        const std::shared_ptr<Session> session = current();
+        if (!session) {
+            return E_UNEXPECTED;
+        }
+        ComPtr<IToastNotifier2> notifier;
+        HRESULT hr = session->notifier.As(&notifier);
+        if (SUCCEEDED(hr)) {
+            ComPtr<INotificationData> notificationData;
+            hr = createData(*session, data, notificationData);
+            if (SUCCEEDED(hr)) {
+                NotificationUpdateResult result = NotificationUpdateResult_Failed;
+                hr = notifier->UpdateWithTagAndGroup(notificationData.Get(), WinToastStringWrapper(tag).Get(),
+                                                     WinToastStringWrapper(group).Get(), &result);
+                if (FAILED(hr)) {
+                    dropSession(session);
+                } else if (result == NotificationUpdateResult_NotificationNotFound) {
+                    hr = UpdateNotFound;
+                } else if (result != NotificationUpdateResult_Succeeded) {
+                    hr = E_FAIL;
+                }
+            }
+        }
+        return hr;
+    }
+
+    long hide(_In_ const WinToastNotificationHandle& handle) override {
+        const std::shared_ptr<Session> session = current();
+        if (!session) {
+            return E_UNEXPECTED;
+        }
+        if (!handle) {
+            return E_INVALIDARG;
+        }
+        HRESULT hr = session->notifier->Hide(static_cast<IToastNotification*>(handle.get()));
+        if (FAILED(hr)) {
+            dropSession(session);
+        }
+        return hr;
+    }
+
+private:
+    struct Session {
+        ComPtr<IToastNotificationManagerStatics>    notificationManager;
+        ComPtr<IToastNotifier>                      notifier;
+        ComPtr<IToastNotificationFactory>           notificationFactory;
+        ComPtr<IActivationFactory>                  dataFactory;        // NotificationData, for tagged toasts
+    };
+
+    long present(_In_ const std::wstring& xml, _In_ std::int64_t expiration,
+                 _In_opt_ const std::wstring* tag, _In_opt_ const std::wstring* group,
+                 _In_opt_ const WinToastNotificationData* data,
+                 _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                 _Out_ WinToastNotificationHandle& handle) {
+        // Threads showing at the same time each work on their own reference to
+        // the session, so one of them dropping it cannot pull it from under another.
+        const std::shared_ptr<Session> session = current();
+        if (!session) {
+            return E_UNEXPECTED;
+        }
+        WINTOAST_STAGE_TIMER(timer, _stats, _tracer, -1);
+        ComPtr<IXmlDocument> xmlDocument;
+        HRESULT hr = Util::loadXmlDocument(xml, xmlDocument);
+        WINTOAST_STAGE_LAP(timer, PayloadLoad);
+        if (SUCCEEDED(hr)) {
+            ComPtr<IToastNotification> notification;
+            hr = session->notificationFactory->CreateToastNotification(xmlDocument.Get(), &notification);
+            if (SUCCEEDED(hr)) {
+                INT64 absoluteExpiration = 0;
+                if (expiration > 0) {
+                    MyDateTime expirationDateTime(expiration);
+                    absoluteExpiration = expirationDateTime;
+                    hr = notification->put_ExpirationTime(&expirationDateTime);
+                }
+                if (SUCCEEDED(hr) && tag) {
+                    hr = setIdentity(*session, notification.Get(), *tag, *group, *data);
+                }
+                WINTOAST_STAGE_LAP(timer, NotificationCreation);
+                if (SUCCEEDED(hr)) {
+                    hr = Util::setEventHandlers(notification.Get(), handler, absoluteExpiration);
+                    WINTOAST_STAGE_LAP(timer, HandlerWiring);
+                }
+                if (SUCCEEDED(hr)) {
+                    hr = session->notifier->Show(notification.Get());
+                    WINTOAST_STAGE_LAP(timer, Show);
+                    if (FAILED(hr)) {
+                        dropSession(session);
+                    }
+                }
+                if (SUCCEEDED(hr)) {
+                    handle = WinToastNotificationHandle(notification.Detach(), [](void* p) {
+                        static_cast<IToastNotification*>(p)->Release();
+                    });
+                }
+            }
+        }
+        return hr;
+    }
+
+    // Tag, group and initial data of a tagged toast (Windows 10 1607 and later).
+    static HRESULT setIdentity(_In_ const Session& session, _In_ IToastNotification* notification,
+                               _In_ const std::wstring& tag, _In_ const std::wstring& group,
+                               _In_ const WinToastNotificationData& data) {
+        ComPtr<IToastNotification2> tagged;
+        HRESULT hr = notification->QueryInterface(IID_PPV_ARGS(&tagged));
+        if (SUCCEEDED(hr)) {
+            hr = tagged->put_Tag(WinToastStringWrapper(tag).Get());
+            if (SUCCEEDED(hr)) {
+                hr = tagged->put_Group(WinToastStringWrapper(group).Get());
+            }
+        }
+        if (SUCCEEDED(hr) && !data.values.empty()) {
+            ComPtr<IToastNotification4> bound;
+            hr = notification->QueryInterface(IID_PPV_ARGS(&bound));
+            if (SUCCEEDED(hr)) {
+                ComPtr<INotificationData> notificationData;
+                hr = createData(session, data, notificationData);
+                if (SUCCEEDED(hr)) {
+                    hr = bound->put_Data(notificationData.Get());
+                }
+            }
+        }
+        return hr;
+    }
+
+    static HRESULT createData(_In_ const Session& session, _In_ const WinToastNotificationData& data,
+                              _Out_ ComPtr<INotificationData>& notificationData) {
+        if (!session.dataFactory) {
+            return E_NOTIMPL;
+        }
+        ComPtr<IInspectable> inspectable;
+        HRESULT hr = session.dataFactory->ActivateInstance(&inspectable);
+        if (SUCCEEDED(hr)) {
+            hr = inspectable.As(&notificationData);
+            if (SUCCEEDED(hr)) {
+                ComPtr<ABI::Windows::Foundation::Collections::IMap<HSTRING, HSTRING>> values;
+                hr = notificationData->get_Values(&values);
+                for (std::size_t i = 0; SUCCEEDED(hr) && i < data.values.size(); i++) {
+                    boolean replaced = false;
+                    hr = values->Insert(WinToastStringWrapper(data.values[i].first).Get(),
+                                        WinToastStringWrapper(data.values[i].second).Get(), &replaced);
+                }
+                if (SUCCEEDED(hr)) {
+                    hr = notificationData->put_SequenceNumber(data.sequence);
+                }
+            }
+        }
+        return hr;
+    }
+
+    std::shared_ptr<Session> current() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _session;
+    }
+
+    // Drops session after a failing call, unless another thread already
+    // replaced it with a new one.
+    void dropSession(_In_ const std::shared_ptr<Session>& session) {
+        std::shared_ptr<Session> dropped;
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_session == session) {
+            _session.swap(dropped);
+        }
+    }
+
+    mutable std::mutex                              _mutex;
+    std::shared_ptr<Session>                        _session;
+};
+
+// Shell-link and file access on top of the Win32 shell APIs.
+class WinToastWin32ShellLinks : public IWinToastShellLinks {
+public:
+    bool stat(_In_ const std::wstring& path, _Out_ WinToastFileStamp& stamp) override {
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+            return false;
+        }
+        stamp.size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        stamp.lastWriteTime = (static_cast<std::int64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+        return true;
+    }
+
+    bool readText(_In_ const std::wstring& path, _Out_ std::wstring& text) override {
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        // The stamp is a few hundred bytes; anything much larger is not ours.
+        WCHAR buffer[1024];
+        DWORD read = 0;
+        const bool ok = ReadFile(file, buffer, sizeof(buffer), &read, nullptr) && read < sizeof(buffer);
+        CloseHandle(file);
+        if (ok) {
+            text.assign(buffer, read / sizeof(WCHAR));
+        }
+        return ok;
+    }
+
+    bool writeText(_In_ const std::wstring& path, _In_ const std::wstring& text) override {
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        const DWORD size = static_cast<DWORD>(text.length() * sizeof(WCHAR));
+        DWORD written = 0;
+        const bool ok = WriteFile(file, text.c_str(), size, &written, nullptr) && written == size;
+        CloseHandle(file);
+        return ok;
+    }
+
+    long validateLink(_In_ const std::wstring& linkPath, _In_ const std::wstring& aumi, _Out_ bool& wasChanged) override {
+        wasChanged = false;
+        std::wcout << L"Shortcut found at: " << linkPath << std::endl;
+
+        // Let's load the file as shell link to validate.
+        // - Create a shell link
+        // - Create a persistant file
+        // - Load the path as data for the persistant file
+        // - Read the property AUMI and validate with the current
+        // - Review if AUMI is equal.
+        ComPtr<IShellLink> shellLink;
+        HRESULT hr = CoCreateInstance(CLSID_ShellLink, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&shellLink));
         if (SUCCEEDED(hr)) {
-            ComPtr<IXmlNode> node;
-            hr = srcAttribute.As(&node);
+            ComPtr<IPersistFile> persistFile;
+            hr = shellLink.As(&persistFile);
             if (SUCCEEDED(hr)) {
-                ComPtr<IXmlNode> pNode;
-                hr = attributeMap->SetNamedItem(node.Get(), &pNode);
+                hr = persistFile->Load(linkPath.c_str(), STGM_READWRITE);
+                if (SUCCEEDED(hr)) {
+                    ComPtr<IPropertyStore> propertyStore;
+                    hr = shellLink.As(&propertyStore);
+                    if (SUCCEEDED(hr)) {
+                        PROPVARIANT appIdPropVar;
+                        hr = propertyStore->GetValue(PKEY_AppUserModel_ID, &appIdPropVar);
+                        if (SUCCEEDED(hr)) {
+                            WCHAR AUMI[MAX_PATH];
+                            hr = DllImporter::PropVariantToString(appIdPropVar, AUMI, MAX_PATH);
+                            wasChanged = false;
+                            if (FAILED(hr) || aumi != AUMI) {
+                                wasChanged = true;
+                                std::wcout << L"The AUMI found in the shortcut doesn't match the one specified. Attempting to update the shortcut." << std::endl;
+                                PropVariantClear(&appIdPropVar);
+                                hr = InitPropVariantFromString(aumi.c_str(), &appIdPropVar);
+                                if (SUCCEEDED(hr)) {
+                                    hr = propertyStore->SetValue(PKEY_AppUserModel_ID, appIdPropVar);
+                                    if (SUCCEEDED(hr)) {
+                                        hr = propertyStore->Commit();
+                                        if (SUCCEEDED(hr) && SUCCEEDED(persistFile->IsDirty())) {
+                                            hr = persistFile->Save(linkPath.c_str(), TRUE);
+                                            if (SUCCEEDED(hr)) {
+                                                std::wcout << L"Success: Shortcut AUMI updated to: " << aumi << std::endl;
+                                            }
+                                        }
+                                    }
+                                }
+                            }
+                            PropVariantClear(&appIdPropVar);
+                        }
+                    }
+                }
             }
         }
         return hr;
     }
 
-    inline HRESULT createElement(_In_ IXmlDocument *xml, _In_ const std::wstring& root_node, _In_ const std::wstring& element_name, _In_ const std::vector<std::wstring>& attribute_names) {
-        ComPtr<IXmlNodeList> rootList;
-        HRESULT hr = xml->GetElementsByTagName(WinToastStringWrapper(root_node).Get(), &rootList);
+    long createLink(_In_ const std::wstring& linkPath, _In_ const std::wstring& aumi) override {
+        std::wcout << L"Error, shortcut not found. Attempting to create one at: " << linkPath << std::endl;
+        WCHAR   exePath[MAX_PATH]{ L'\0' };
+        WCHAR   exeDir[MAX_PATH]{ L'\0' };
+        Util::defaultExecutablePath(exePath);
+        Util::defaultExecutableDir(exeDir);
+
+        ComPtr<IShellLinkW> shellLink;
+        HRESULT hr = CoCreateInstance(CLSID_ShellLink, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&shellLink));
         if (SUCCEEDED(hr)) {
-            ComPtr<IXmlNode> root;
-            hr = rootList->Item(0, &root);
+            hr = shellLink->SetPath(exePath);
             if (SUCCEEDED(hr)) {
-                ComPtr<ABI::Windows::Data::Xml::Dom::IXmlElement> audioElement;
-                hr = xml->CreateElement(WinToastStringWrapper(element_name).Get(), &audioElement);
+                hr = shellLink->SetArguments(L"");
                 if (SUCCEEDED(hr)) {
-                    ComPtr<IXmlNode> audioNodeTmp;
-                    hr = audioElement.As(&audioNodeTmp);
+                    hr = shellLink->SetWorkingDirectory(exeDir);
                     if (SUCCEEDED(hr)) {
-                        ComPtr<IXmlNode> audioNode;
-                        hr = root->AppendChild(audioNodeTmp.Get(), &audioNode);
+                        ComPtr<IPropertyStore> propertyStore;
+                        hr = shellLink.As(&propertyStore);
                         if (SUCCEEDED(hr)) {
-                            ComPtr<IXmlNamedNodeMap> attributes;
-                            hr = audioNode->get_Attributes(&attributes);
+                            PROPVARIANT appIdPropVar;
+                            hr = InitPropVariantFromString(aumi.c_str(), &appIdPropVar);
                             if (SUCCEEDED(hr)) {
-                                for (auto it : attribute_names) {
-                                    hr = addAttribute(xml, it, attributes.Get());
+                                hr = propertyStore->SetValue(PKEY_AppUserModel_ID, appIdPropVar);
+                                if (SUCCEEDED(hr)) {
+                                    hr = propertyStore->Commit();
+                                    if (SUCCEEDED(hr)) {
+                                        ComPtr<IPersistFile> persistFile;
+                                        hr = shellLink.As(&persistFile);
+                                        if (SUCCEEDED(hr)) {
+                                            hr = persistFile->Save(linkPath.c_str(), TRUE);
+                                            if (SUCCEEDED(hr)) {
+
+                                            }
+                                        }
+                                    }
                                 }
+                                PropVariantClear(&appIdPropVar);
                             }
                         }
                     }
@@ -321,7 +724,46 @@ namespace Util {
         }
         return hr;
     }
-}
+};
+
+// Outcome sink for spooled toasts replayed without a replay handler.
+class WinToastSilentHandler : public IWinToastHandler {
+public:
+    void toastActivated() const override {}
+    void toastActivated(int) const override {}
+    void toastDismissed(WinToastDismissalReason) const override {}
+    void toastFailed() const override {}
+};
+
+// A caller's handler on its way through a send. The shared pointer handed to
+// the helpers deletes it only once adopt() was called, i.e. once a toast was
+// accepted; a send turned away leaves it with the caller, who may retry with it.
+class WinToastPendingHandler {
+public:
+    explicit WinToastPendingHandler(_In_ IWinToastHandler* handler) :
+        _owner(std::make_shared<Owner>(handler)),
+        _shared(_owner, handler)
+    {
+    }
+
+    inline const std::shared_ptr<IWinToastHandler>& get() const { return _shared; }
+    inline void adopt() { _owner->adopted = true; }
+
+private:
+    struct Owner {
+        explicit Owner(_In_ IWinToastHandler* handler) : handler(handler) {}
+        ~Owner() {
+            if (adopted) {
+                delete handler;
+            }
+        }
+        IWinToastHandler*   handler;
+        bool                adopted = false;
+    };
+
+    std::shared_ptr<Owner>              _owner;
+    std::shared_ptr<IWinToastHandler>   _shared;   // aliases _owner
+};
 
 WinToast* WinToast::instance() {
     static WinToast instance;
@@ -330,8 +772,22 @@ WinToast* WinToast::instance() {
 
 WinToast::WinToast() :
     _isInitialized(false),
-    _hasCoInitialized(false)
+    _registry(std::make_shared<WinToastRegistry>()),
+    _backend(std::make_shared<WinToastWinRTBackend>()),
+#ifndef WINTOAST_NO_STATS
+    _stats(std::make_shared<WinToastStats>()),
+#endif
+    _dispatcher(std::make_shared<WinToastDispatcher>()),
+    _shortcuts(std::make_shared<WinToastShortcutCache>(std::make_shared<WinToastWin32ShellLinks>())),
+    _progress(std::make_shared<WinToastUpdateCoalescer>([this](const std::wstring& tag, const std::wstring& group, const WinToastNotificationData& data) -> long {
+        const HRESULT hr = ensureSessionHelper();
+        return SUCCEEDED(hr) ? _backend->update(tag, group, data) : hr;
+    })),
+    _async(new WinToastAsync([this](WinToastTemplate&& toast, IWinToastHandler* handler) { return showToast(std::move(toast), handler); },
+                             [this](std::int64_t id) { return hideToast(id); }))
 {
+    _backend->setStats(_stats);
+    _backend->setTracer(_tracer);
 	if (!isCompatible()) {
         std::wcout << L"Warning: Your system is not compatible with this library " << std::endl;
 
@@ -339,9 +795,11 @@ WinToast::WinToast() :
 }
 
 WinToast::~WinToast() {
-    if (_hasCoInitialized) {
-        CoUninitialize();
+    // The sender and flusher threads call back into this object.
+    if (_spool) {
+        _spool->stop();
     }
+    _progress->stop();
 }
 
 void WinToast::setAppName(_In_ const std::wstring& appName) {
@@ -350,23 +808,69 @@ void WinToast::setAppName(_In_ const std::wstring& appName) {
 
 
 void WinToast::setAppUserModelId(_In_ const std::wstring& aumi) {
+    if (_aumi != aumi) {
+        _prototypes.invalidate();
+        // The notifier is bound to the AUMI it was created with.
+        _backend->closeSession();
+    }
     _aumi = aumi;
+}
+
+void WinToast::setBackend(_In_ std::shared_ptr<IWinToastBackend> backend) {
+    _backend = backend ? backend : std::make_shared<WinToastWinRTBackend>();
+    _backend->setStats(_stats);
+    _backend->setTracer(_tracer);
+}
 
+void WinToast::setTracer(_In_opt_ std::shared_ptr<WinToastTracer> tracer) {
+    _tracer = std::move(tracer);
+    _backend->setTracer(_tracer);
+}
+
+void WinToast::setShellLinks(_In_ std::shared_ptr<IWinToastShellLinks> links) {
+    _shortcuts = std::make_shared<WinToastShortcutCache>(links ? links : std::make_shared<WinToastWin32ShellLinks>());
+}
+
+WinToastStats::Snapshot WinToast::stats() const {
+    WinToastStats::Snapshot snapshot = {};
+    if (_stats) {
+        snapshot = _stats->snapshot();
+    }
+    return snapshot;
+}
+
+void WinToast::resetStats() {
+    if (_stats) {
+        _stats->reset();
+    }
+}
+
+void WinToast::setDispatcher(_In_ const WinToastDispatcher::Options& options) {
+    _dispatcher = std::make_shared<WinToastDispatcher>(options);
+}
+
+std::size_t WinToast::poll(_In_ std::size_t maxOutcomes) {
+    return _dispatcher->poll(maxOutcomes);
+}
+
+void WinToast::setTemplateProvider(_In_ std::shared_ptr<IWinToastTemplateProvider> provider) {
+    _prototypes.setProvider(provider);
+}
+
+const WinToastCapabilities& WinToast::capabilities() {
+    static WinToastWin32CapabilityProbe probe;
+    // The entry points are always resolved from the real libraries, even when an
+    // installed probe decides what gets reported.
+    DllImporter::ensureLoaded();
+    return WinToastCapabilitySnapshot::get(probe);
 }
 
 bool WinToast::isCompatible() {
-	DllImporter::initialize();
-	return !((DllImporter::SetCurrentProcessExplicitAppUserModelID == nullptr)
-		|| (DllImporter::PropVariantToString == nullptr)
-		|| (DllImporter::RoGetActivationFactory == nullptr)
-		|| (DllImporter::WindowsCreateStringReference == nullptr)
-		|| (DllImporter::WindowsDeleteString == nullptr));
+	return capabilities().compatible();
 }
 
 bool WinToastLib::WinToast::supportModernFeatures() {
-	RTL_OSVERSIONINFOW tmp = GetRealOSVersion();
-	return tmp.dwMajorVersion > 6;
-
+	return capabilities().modern();
 }
 std::wstring WinToast::configureAUMI(_In_ const std::wstring &companyName,
                                                _In_ const std::wstring &productName,
@@ -401,34 +905,35 @@ enum WinToast::ShortcutResult WinToast::createShortcut() {
         return SHORTCUT_INCOMPATIBLE_OS;
     }
 
-    if (!_hasCoInitialized) {
-        HRESULT initHr = CoInitializeEx(NULL, COINIT::COINIT_MULTITHREADED);
-        if (initHr != RPC_E_CHANGED_MODE) {
-            if (FAILED(initHr) && initHr != S_FALSE) {
-                std::wcout << L"Error on COM library initialization!" << std::endl;
-                return SHORTCUT_COM_INIT_FAILURE;
-            }
-            else {
-                _hasCoInitialized = true;
-            }
-        }
+    if (FAILED(Util::ensureComApartment())) {
+        std::wcout << L"Error on COM library initialization!" << std::endl;
+        return SHORTCUT_COM_INIT_FAILURE;
     }
 
-    bool wasChanged;
-    HRESULT hr = validateShellLinkHelper(wasChanged);
-    if (SUCCEEDED(hr))
-        return wasChanged ? SHORTCUT_WAS_CHANGED : SHORTCUT_UNCHANGED;
-
-    hr = createShellLinkHelper();
-    if (SUCCEEDED(hr))
-    {
+    WCHAR linkPath[MAX_PATH] = { L'\0' };
+    WCHAR stampPath[MAX_PATH] = { L'\0' };
+    if (FAILED(Util::defaultShellLinkPath(_appName, linkPath))) {
+        return SHORTCUT_CREATE_FAILED;
+    }
+    // Without a stamp location every start simply takes the full validation path.
+    Util::defaultShortcutStampPath(_appName, stampPath);
+
+    long hr = S_OK;
+    switch (_shortcuts->ensure(linkPath, stampPath, _aumi, hr)) {
+    case WinToastShortcutCache::Unchanged:
+        return SHORTCUT_UNCHANGED;
+    case WinToastShortcutCache::WasChanged:
+        return SHORTCUT_WAS_CHANGED;
+    case WinToastShortcutCache::WasCreated:
         return SHORTCUT_WAS_CREATED;
-
+    default:
+        return SHORTCUT_CREATE_FAILED;
     }
-    return SHORTCUT_CREATE_FAILED;
 }
 
 bool WinToast::initialize() {
+    // Callers racing here run one at a time; senders only read the flag.
+    std::lock_guard<std::mutex> lock(_initializeMutex);
     _isInitialized = false;
 
     if (createShortcut() < 0)
@@ -443,227 +948,478 @@ bool WinToast::initialize() {
     }
 
     _isInitialized = true;
-    return _isInitialized;
+    return true;
 }
 
-HRESULT	WinToast::validateShellLinkHelper(_Out_ bool& wasChanged) 
-{
-	WCHAR path[MAX_PATH] = { L'\0' };
-    Util::defaultShellLinkPath(_appName, path);
-    // Check if the file exist
-    DWORD attr = GetFileAttributesW(path);
-    if (attr >= 0xFFFFFFF) 
-    {
-        std::wcout << L"Error, shortcut not found. Attempting to create one at: " << path << std::endl;
+INT64 WinToast::showToast(_In_ const WinToastTemplate& toast, _In_  IWinToastHandler* handler)  {
+    return sendHelper(toast, nullptr, handler);
+}
+
+INT64 WinToast::showToast(_In_ WinToastTemplate&& toast, _In_ IWinToastHandler* handler) {
+    return sendHelper(toast, &toast, handler);
+}
+
+INT64 WinToast::sendHelper(_In_ const WinToastTemplate& toast, _Inout_opt_ WinToastTemplate* owned, _In_ IWinToastHandler* handler) {
+    INT64 id = -1;
+    if (!isInitialized()) {
+        std::wcout << L"Error when launching the toast. WinToast is not initialized" << std::endl;
 
-        return E_FAIL;
+        return id;
+    }
+    if (!handler) {
+        std::wcout << L"Error when launching the toast. handler cannot be null." << std::endl;
+        return id;
     }
-    else {
 
-        std::wcout << L"Shortcut found at: " << path << std::endl;
+    expireHelper();
+    pumpRateLimiter();
+    std::unique_ptr<WinToastTemplate> counted;
+    std::uint64_t hash = 0;
+    HRESULT hr = deduplicateHelper(toast, owned, counted, hash);
+    if (hr == WINTOAST_S_DUPLICATE) {
+        // Suppressed before the handler is taken over: it is still the caller's.
+        return TOAST_DUPLICATE;
+    }
+    // Taken over only once the toast is queued, spooled or shown.
+    WinToastPendingHandler sharedHandler(handler);
+    const WinToastTemplate& effective = counted ? *counted : toast;
+    id = _registry->nextId();
+    hr = rateLimitHelper(effective, sharedHandler.get(), id);
+    if (hr == S_FALSE) {
+        sharedHandler.adopt();
+        commitDuplicateHelper(hash);
+        return id;
+    }
+    if (hr == WINTOAST_E_RATE_REJECTED) {
+        return TOAST_REJECTED;
+    }
+    if (hr == WINTOAST_E_RATE_DROPPED) {
+        return TOAST_DROPPED;
+    }
+    if (_spool) {
+        hr = spoolHelper(WinToastFrozenToast(effective), sharedHandler.get(), id);
+        if (FAILED(hr)) {
+            return TOAST_DROPPED;
+        }
+        sharedHandler.adopt();
+        commitDuplicateHelper(hash);
+        return id;
+    }
 
+    std::wstring xml;
+    WinToastNotificationHandle notification;
+    hr = showToastHelper(effective, sharedHandler.get(), modernFeaturesHelper(), xml, id, notification);
+    if (FAILED(hr)) {
+        return -1;
     }
+    sharedHandler.adopt();
+    commitDuplicateHelper(hash);
+    _registry->attach(id, std::move(notification));
+    return id;
+}
 
-    // Let's load the file as shell link to validate.
-    // - Create a shell link
-    // - Create a persistant file
-    // - Load the path as data for the persistant file
-    // - Read the property AUMI and validate with the current
-    // - Review if AUMI is equal.
-    ComPtr<IShellLink> shellLink;
-    HRESULT hr = CoCreateInstance(CLSID_ShellLink, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&shellLink));
-    if (SUCCEEDED(hr)) {
-        ComPtr<IPersistFile> persistFile;
-        hr = shellLink.As(&persistFile);
+std::vector<WinToastBatchResult> WinToast::showToasts(_In_ std::span<const WinToastTemplate> toasts, _In_ IWinToastHandler* handler) {
+    std::vector<WinToastBatchResult> results(toasts.size(), WinToastBatchResult{ -1, E_FAIL });
+    if (!isInitialized()) {
+        std::wcout << L"Error when launching the toasts. WinToast is not initialized" << std::endl;
+        return results;
+    }
+    if (!handler) {
+        std::wcout << L"Error when launching the toasts. handler cannot be null." << std::endl;
+        return results;
+    }
+    // One owner for the handler across the whole batch; it lives as long as any
+    // of the toasts can still call back into it, and stays with the caller when
+    // none of them was accepted.
+    WinToastPendingHandler sharedHandler(handler);
+    expireHelper();
+    pumpRateLimiter();
+    const bool modernFeatures = modernFeaturesHelper();
+    std::wstring xml;
+    std::vector<std::pair<INT64, WinToastNotificationHandle>> shown;
+    shown.reserve(toasts.size());
+    // With a spool the whole batch is appended, and flushed, at once.
+    std::shared_ptr<WinToastSpool> spool = _spool;
+    std::vector<WinToastFrozenToast> spooled;
+    std::vector<std::uint64_t> spooledIds;
+    std::vector<std::size_t> spooledItems;
+    // Content of the items waiting for the spool: recorded by the deduplicator
+    // only once appended, but repeats later in the batch are still suppressed.
+    std::vector<std::uint64_t> spooledHashes;
+
+    for (std::size_t i = 0; i < toasts.size(); i++) {
+        std::unique_ptr<WinToastTemplate> counted;
+        std::uint64_t hash = 0;
+        HRESULT hr = deduplicateHelper(toasts[i], nullptr, counted, hash);
+        if (hr == S_OK && _deduplicator && std::find(spooledHashes.begin(), spooledHashes.end(), hash) != spooledHashes.end()) {
+            hr = WINTOAST_S_DUPLICATE;
+        }
+        if (hr == WINTOAST_S_DUPLICATE) {
+            results[i] = WinToastBatchResult{ TOAST_DUPLICATE, hr };
+            continue;
+        }
+        const WinToastTemplate& effective = counted ? *counted : toasts[i];
+        WinToastNotificationHandle notification;
+        const INT64 id = _registry->nextId();
+        hr = rateLimitHelper(effective, sharedHandler.get(), id);
+        if (hr == S_FALSE) {
+            sharedHandler.adopt();
+            commitDuplicateHelper(hash);
+            results[i] = WinToastBatchResult{ id, hr };
+            continue;
+        }
+        if (SUCCEEDED(hr) && spool) {
+            spooled.emplace_back(effective);
+            spooledIds.push_back(static_cast<std::uint64_t>(id));
+            spooledItems.push_back(i);
+            spooledHashes.push_back(hash);
+            continue;
+        }
         if (SUCCEEDED(hr)) {
-            hr = persistFile->Load(path, STGM_READWRITE);
-            if (SUCCEEDED(hr)) {
-                ComPtr<IPropertyStore> propertyStore;
-                hr = shellLink.As(&propertyStore);
-                if (SUCCEEDED(hr)) {
-                    PROPVARIANT appIdPropVar;
-                    hr = propertyStore->GetValue(PKEY_AppUserModel_ID, &appIdPropVar);
-                    if (SUCCEEDED(hr)) {
-                        WCHAR AUMI[MAX_PATH];
-                        hr = DllImporter::PropVariantToString(appIdPropVar, AUMI, MAX_PATH);
-                        wasChanged = false;
-                        if (FAILED(hr) || _aumi != AUMI) {
-                            wasChanged = true;
-                            std::wcout << L"The AUMI found in the shortcut doesn't match the one specified. Attempting to update the shortcut." << std::endl;
-                            PropVariantClear(&appIdPropVar);
-                            hr = InitPropVariantFromString(_aumi.c_str(), &appIdPropVar);
-                            if (SUCCEEDED(hr)) {
-                                hr = propertyStore->SetValue(PKEY_AppUserModel_ID, appIdPropVar);
-                                if (SUCCEEDED(hr)) {
-                                    hr = propertyStore->Commit();
-                                    if (SUCCEEDED(hr) && SUCCEEDED(persistFile->IsDirty())) {
-                                        hr = persistFile->Save(path, TRUE);
-                                        if (SUCCEEDED(hr)) {
-                                            std::wcout << L"Success: Shortcut AUMI updated to: " << _aumi << std::endl;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                        PropVariantClear(&appIdPropVar);
-                    }
-                }
+            hr = showToastHelper(effective, sharedHandler.get(), modernFeatures, xml, id, notification);
+        }
+        results[i].hr = hr;
+        if (SUCCEEDED(hr)) {
+            sharedHandler.adopt();
+            commitDuplicateHelper(hash);
+            results[i].id = id;
+            shown.emplace_back(id, std::move(notification));
+        }
+    }
+
+    _registry->attach(shown);
+    if (!spooled.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(_spoolMutex);
+            for (std::uint64_t id : spooledIds) {
+                _spooled[static_cast<INT64>(id)] = sharedHandler.get();
+            }
+        }
+        const std::vector<WinToastSpool::AppendResult> appended = spool->appendBatch(spooled, &spooledIds);
+        std::lock_guard<std::mutex> lock(_spoolMutex);
+        for (std::size_t k = 0; k < appended.size(); k++) {
+            if (appended[k] == WinToastSpool::Appended) {
+                sharedHandler.adopt();
+                commitDuplicateHelper(spooledHashes[k]);
+                results[spooledItems[k]] = WinToastBatchResult{ static_cast<INT64>(spooledIds[k]), S_FALSE };
+            } else {
+                _spooled.erase(static_cast<INT64>(spooledIds[k]));
+                results[spooledItems[k]] = WinToastBatchResult{ -1, WINTOAST_E_SPOOL_FULL };
             }
         }
     }
-    return hr;
+    return results;
 }
 
-
-
-HRESULT	WinToast::createShellLinkHelper() {
-    WCHAR	slPath[MAX_PATH]{ L'\0' };
-    WCHAR   exePath[MAX_PATH]{ L'\0' };
-    WCHAR   exeDir[MAX_PATH]{ L'\0' };
-    Util::defaultShellLinkPath(_appName, slPath);
-    Util::defaultExecutablePath(exePath);
-    Util::defaultExecutableDir(exeDir);
-
-    ComPtr<IShellLinkW> shellLink;
-    HRESULT hr = CoCreateInstance(CLSID_ShellLink, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&shellLink));
+template <typename Toast>
+HRESULT WinToast::showToastHelper(_In_ const Toast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                  _In_ bool modernFeatures, _Inout_ std::wstring& xml, _In_ INT64 id, _Out_ WinToastNotificationHandle& notification,
+                                  _In_opt_ const Identity* identity) {
+    WINTOAST_STAGE_TIMER(timer, _stats, _tracer, id);
+    WINTOAST_STATS_COUNT(_stats, countSend());
+    // A tag on the toast itself means replace-by-tag, with no bound data.
+    Identity tagged;
+    if (!identity && !toast.tag().empty()) {
+        tagged.tag.assign(toast.tag().begin(), toast.tag().end());
+        tagged.group.assign(toast.group().begin(), toast.group().end());
+        tagged.progressBar = false;
+        identity = &tagged;
+    }
+    HRESULT hr = compilePayloadHelper(toast, modernFeatures, xml, identity && identity->progressBar);
     if (SUCCEEDED(hr)) {
-        hr = shellLink->SetPath(exePath);
+        hr = ensureSessionHelper();
         if (SUCCEEDED(hr)) {
-            hr = shellLink->SetArguments(L"");
-            if (SUCCEEDED(hr)) {
-                hr = shellLink->SetWorkingDirectory(exeDir);
-                if (SUCCEEDED(hr)) {
-                    ComPtr<IPropertyStore> propertyStore;
-                    hr = shellLink.As(&propertyStore);
-                    if (SUCCEEDED(hr)) {
-                        PROPVARIANT appIdPropVar;
-                        hr = InitPropVariantFromString(_aumi.c_str(), &appIdPropVar);
-                        if (SUCCEEDED(hr)) {
-                            hr = propertyStore->SetValue(PKEY_AppUserModel_ID, appIdPropVar);
-                            if (SUCCEEDED(hr)) {
-                                hr = propertyStore->Commit();
-                                if (SUCCEEDED(hr)) {
-                                    ComPtr<IPersistFile> persistFile;
-                                    hr = shellLink.As(&persistFile);
-                                    if (SUCCEEDED(hr)) {
-                                        hr = persistFile->Save(slPath, TRUE);
-                                        if (SUCCEEDED(hr)) {
-
-                                        }
-                                    }
-                                }
-                            }
-                            PropVariantClear(&appIdPropVar);
-                        }
+            INT64 expiresAt = WinToastRegistry::NoExpiration;
+            if (toast.expiration() > 0) {
+                expiresAt = MyDateTime(toast.expiration());
+            }
+            // Tracked before Show so an outcome that races with the send still
+            // removes the entry.
+            _registry->reserve(id, expiresAt);
+
+            // The platform raises events on its own threads; the forwarder only
+            // records the outcome and leaves running the handler to the dispatcher.
+            // Any outcome ends the toast's life in Action Center (activation removes
+            // it too), so it also drops the registry entry.
+            std::weak_ptr<WinToastRegistry> registry = _registry;
+            std::shared_ptr<WinToastStats> stats = _stats;
+            std::shared_ptr<WinToastTracer> tracer = _tracer;
+            std::shared_ptr<WinToastHistory> history = _history;
+            std::weak_ptr<WinToastUpdateCoalescer> progress;
+            if (identity && identity->progressBar) {
+                progress = _progress;
+            }
+            WinToastHistory::Record sent;
+            if (history) {
+                sent = WinToastHistory::describe(toast, id);
+            }
+            std::shared_ptr<IWinToastHandler> forwarder = std::make_shared<WinToastDispatchingHandler>(_dispatcher, handler, id,
+                [registry, stats, tracer, history, progress, sent](const WinToastOutcome& outcome) {
+                    // The flow from the send ends in this span, on the callback thread.
+                    const std::int64_t start = tracer ? tracer->now() : 0;
+                    WINTOAST_TRACE(tracer, flowEnd(outcome.toastId));
+                    WINTOAST_STATS_COUNT(stats, countOutcome(WinToastStats::outcomeOf(outcome)));
+                    if (auto live = registry.lock()) {
+                        live->erase(outcome.toastId);
+                    }
+                    if (auto updates = progress.lock()) {
+                        updates->untrack(outcome.toastId);
                     }
+                    if (history) {
+                        // Queued for the history's writer; no I/O on this thread.
+                        WinToastHistory::Record record = sent;
+                        record.outcome = WinToastStats::outcomeOf(outcome);
+                        record.actionIndex = outcome.actionIndex;
+                        record.latencyMilliseconds = static_cast<std::uint32_t>((WinToastHistory::now() - record.timestamp) / 1000);
+                        history->record(std::move(record));
+                    }
+                    WINTOAST_TRACE(tracer, complete(WinToastStats::outcomeName(WinToastStats::outcomeOf(outcome)), start,
+                                                    tracer->now() - start, outcome.toastId));
+                });
+            if (identity) {
+                hr = _backend->showTagged(xml, toast.expiration(), identity->tag, identity->group, identity->data, forwarder, notification);
+            } else {
+                hr = _backend->show(xml, toast.expiration(), forwarder, notification);
+            }
+            if (SUCCEEDED(hr)) {
+                WINTOAST_TRACE(_tracer, flowStart(id));
+                if (identity) {
+                    supersedeHelper(id, *identity, forwarder);
                 }
+            } else {
+                _registry->erase(id);
             }
         }
     }
+    WINTOAST_STAGE_LAP(timer, Send);
+    if (SUCCEEDED(hr)) {
+        WINTOAST_STATS_COUNT(_stats, countShown());
+    } else {
+        WINTOAST_STATS_COUNT(_stats, countFailure(hr));
+    }
     return hr;
 }
 
-INT64 WinToast::showToast(_In_ const WinToastTemplate& toast, _In_  IWinToastHandler* handler)  {
-    INT64 id = -1;
-    if (!isInitialized()) {
-        std::wcout << L"Error when launching the toast. WinToast is not initialized" << std::endl;
+void WinToast::supersedeHelper(_In_ INT64 id, _In_ const Identity& identity, _In_ const std::shared_ptr<IWinToastHandler>& forwarder) {
+    WinToastRegistry::Superseded superseded;
+    if (!_registry->bindTag(id, IWinToastBackend::tagKey(identity.tag, identity.group), forwarder, superseded)) {
+        return;
+    }
+    // The platform took the old toast out of Action Center without raising any
+    // event. Its owner hears of it as hidden by the application; then its
+    // handler and notification go with superseded.
+    WINTOAST_TRACE(_tracer, instant("tag-superseded", superseded.id));
+    superseded.handler->toastDismissed(IWinToastHandler::ApplicationHidden);
+}
 
-        return id;
+HRESULT WinToast::deduplicateHelper(_In_ const WinToastTemplate& toast, _Inout_opt_ WinToastTemplate* owned, _Out_ std::unique_ptr<WinToastTemplate>& counted,
+                                    _Out_ std::uint64_t& hash) {
+    counted.reset();
+    hash = 0;
+    if (!_deduplicator) {
+        return S_OK;
     }
-    if (!handler) {
-        std::wcout << L"Error when launching the toast. handler cannot be null." << std::endl;
-        return id;
+    // Looked up before rate limiting, so repeats never use up tokens, but only
+    // recorded once the toast goes out: one that is rejected can be retried.
+    hash = toast.contentHash();
+    const WinToastDeduplicator::Verdict verdict = _deduplicator->lookup(hash);
+    if (verdict.suppress) {
+        WINTOAST_TRACE(_tracer, instant("duplicate-suppressed"));
+        return WINTOAST_S_DUPLICATE;
+    }
+    if (verdict.repeats > 0 && _deduplicator->options().countRepeats) {
+        std::wstring attribution = WinToastDeduplicator::repeatAttribution(toast.attributionText(), verdict.repeats);
+        // A template the caller gave up is annotated in place; otherwise on a copy.
+        if (owned) {
+            owned->setAttributionText(std::move(attribution));
+        } else {
+            counted.reset(new WinToastTemplate(toast));
+            counted->setAttributionText(std::move(attribution));
+        }
     }
+    return S_OK;
+}
 
-    ComPtr<IToastNotificationManagerStatics> notificationManager;
-    HRESULT hr = DllImporter::Wrap_GetActivationFactory(WinToastStringWrapper(RuntimeClass_Windows_UI_Notifications_ToastNotificationManager).Get(), &notificationManager);
-    if (SUCCEEDED(hr)) {
-        ComPtr<IToastNotifier> notifier;
-        hr = notificationManager->CreateToastNotifierWithId(WinToastStringWrapper(_aumi).Get(), &notifier);
-        if (SUCCEEDED(hr)) {
-            ComPtr<IToastNotificationFactory> notificationFactory;
-            hr = DllImporter::Wrap_GetActivationFactory(WinToastStringWrapper(RuntimeClass_Windows_UI_Notifications_ToastNotification).Get(), &notificationFactory);
-            if (SUCCEEDED(hr)) {
-				ComPtr<IXmlDocument> xmlDocument;
-				HRESULT hr = notificationManager->GetTemplateContent(ToastTemplateType(toast.type()), &xmlDocument);
-                if (SUCCEEDED(hr)) {
-                    const int fieldsCount = toast.textFieldsCount();
-                    for (int i = 0; i < fieldsCount && SUCCEEDED(hr); i++) {
-                        hr = setTextFieldHelper(xmlDocument.Get(), toast.textField(WinToastTemplate::TextField(i)), i);
-                    }
+void WinToast::commitDuplicateHelper(_In_ std::uint64_t hash) {
+    if (_deduplicator) {
+        _deduplicator->commit(hash);
+    }
+}
 
-                    // Modern feature are supported Windows > Windows 10
-                    if (SUCCEEDED(hr) && supportModernFeatures()) {
+HRESULT WinToast::rateLimitHelper(_In_ const WinToastTemplate& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler, _In_ INT64 id) {
+    if (!_rateLimiter) {
+        return S_OK;
+    }
+    switch (_rateLimiter->admit(toast.source())) {
+    case WinToastRateLimiter::Admitted:
+        return S_OK;
+    case WinToastRateLimiter::MustQueue: {
+        // The id is handed out now; the toast is compiled and shown when released.
+        // Queued toasts are frozen: one heap block each instead of one per string.
+        WinToastFrozenToast deferred(toast);
+        std::shared_ptr<IWinToastHandler> owner(handler);
+        const bool queued = _rateLimiter->enqueue(toast.source(), [this, deferred, owner, id]() {
+            sendDeferredHelper(deferred, owner, id);
+        }, id);
+        WINTOAST_TRACE(_tracer, instant(queued ? "rate-queued" : "rate-dropped", id));
+        return queued ? S_FALSE : WINTOAST_E_RATE_DROPPED;
+    }
+    case WinToastRateLimiter::Rejected:
+        WINTOAST_TRACE(_tracer, instant("rate-rejected", id));
+        return WINTOAST_E_RATE_REJECTED;
+    default:
+        WINTOAST_TRACE(_tracer, instant("rate-dropped", id));
+        return WINTOAST_E_RATE_DROPPED;
+    }
+}
 
-                        // Note that we do this *after* using toast.textFieldsCount() to
-                        // iterate/fill the template's text fields, since we're adding yet another text field.
-                        if (SUCCEEDED(hr)
-                            && !toast.attributionText().empty()) {
-                            hr = setAttributionTextFieldHelper(xmlDocument.Get(), toast.attributionText());
-                        }
+void WinToast::sendDeferredHelper(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler, _In_ INT64 id) {
+    if (_spool && SUCCEEDED(spoolHelper(toast, handler, id))) {
+        return;
+    }
+    deliverHelper(toast, handler, id);
+}
 
-                        const int actionsCount = toast.actionsCount();
-                        WCHAR buf[12];
-                        for (int i = 0; i < actionsCount && SUCCEEDED(hr); i++) {
-                            _snwprintf_s(buf, sizeof(buf) / sizeof(*buf), _TRUNCATE, L"%d", i);
-                            hr = addActionHelper(xmlDocument.Get(), toast.actionLabel(i), buf);
-                        }
+HRESULT WinToast::deliverHelper(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler, _In_ INT64 id,
+                                _In_ bool reportFailure) {
+    std::wstring xml;
+    WinToastNotificationHandle notification;
+    HRESULT hr = showToastHelper(toast, handler, modernFeaturesHelper(), xml, id, notification);
+    if (SUCCEEDED(hr)) {
+        _registry->attach(id, std::move(notification));
+    } else if (reportFailure) {
+        failedHelper(handler, id);
+    }
+    return hr;
+}
 
-                        if (SUCCEEDED(hr)) {
-                            hr = (toast.audioPath().empty() && toast.audioOption() == WinToastTemplate::Default)
-                                ? hr : setAudioFieldHelper(xmlDocument.Get(), toast.audioPath(), toast.audioOption());
-                        }
-                    } else {
-                        std::wcout << L"Modern features (Actions/Sounds/Attributes) not supported in this os version" << std::endl;
+void WinToast::failedHelper(_In_ const std::shared_ptr<IWinToastHandler>& handler, _In_ INT64 id) {
+    // The producer already has the id, so a late failure goes through the
+    // handler like any other outcome.
+    WinToastOutcome outcome;
+    outcome.toastId = id;
+    outcome.kind = WinToastOutcome::Failed;
+    outcome.handler = handler;
+    _dispatcher->post(std::move(outcome));
+}
 
-                    }
+HRESULT WinToast::spoolHelper(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler, _In_ INT64 id) {
+    // Registered first: the sender may pick the record up before append returns.
+    {
+        std::lock_guard<std::mutex> lock(_spoolMutex);
+        _spooled[id] = handler;
+    }
+    if (_spool->append(toast, static_cast<std::uint64_t>(id)) == WinToastSpool::Appended) {
+        WINTOAST_TRACE(_tracer, instant("spooled", id));
+        return S_OK;
+    }
+    std::lock_guard<std::mutex> lock(_spoolMutex);
+    _spooled.erase(id);
+    WINTOAST_TRACE(_tracer, instant("spool-full", id));
+    return WINTOAST_E_SPOOL_FULL;
+}
 
-                    if (SUCCEEDED(hr)) {
-                        hr = toast.hasImage() ? setImageFieldHelper(xmlDocument.Get(), toast.imagePath()) : hr;
-                        if (SUCCEEDED(hr)) {
-                            ComPtr<IToastNotification> notification;
-                            hr = notificationFactory->CreateToastNotification(xmlDocument.Get(), &notification);
-                            if (SUCCEEDED(hr)) {
-                                INT64 expiration = 0;
-                                INT64 relativeExpiration = toast.expiration();
-                                if (relativeExpiration > 0) {
-                                    MyDateTime expirationDateTime(relativeExpiration);
-                                    expiration = expirationDateTime;
-                                    hr = notification->put_ExpirationTime(&expirationDateTime);
-                                }
-                                if (SUCCEEDED(hr)) {
-                                    hr = Util::setEventHandlers(notification.Get(), std::shared_ptr<IWinToastHandler>(handler), expiration);
-                                }
-                                if (SUCCEEDED(hr)) {
-                                    GUID guid;
-                                    hr = CoCreateGuid(&guid);
-                                    if (SUCCEEDED(hr)) {
-                                        id = guid.Data1;
-                                        _buffer[id] = notification;
-                                        hr = notifier->Show(notification.Get());
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+bool WinToast::spoolSendHelper(_In_ const WinToastFrozenToast& toast, _In_ const WinToastSpool::Entry& entry) {
+    // Recovered records can be replayed before initialize(); they wait for it.
+    if (!isInitialized()) {
+        return false;
+    }
+    INT64 id = -1;
+    std::shared_ptr<IWinToastHandler> handler;
+    bool known = false;
+    if (!entry.replayed) {
+        // Looked up, not taken: the entry stays until the toast is shown, so a
+        // retry still reports to its producer.
+        std::lock_guard<std::mutex> lock(_spoolMutex);
+        auto it = _spooled.find(static_cast<INT64>(entry.tag));
+        if (it != _spooled.end()) {
+            id = it->first;
+            handler = it->second;
+            known = true;
         }
     }
-    return FAILED(hr) ? -1 : id;
+    if (known && !handler) {
+        // hideToast took it back; the record is done with.
+        std::lock_guard<std::mutex> lock(_spoolMutex);
+        _spooled.erase(id);
+        return true;
+    }
+    if (!handler) {
+        // Appended by an earlier run, whose producer is gone.
+        id = _registry->nextId();
+        handler = _spoolReplayHandler;
+    }
+    const HRESULT hr = deliverHelper(toast, handler, id, false);
+    // A payload that does not compile never will; anything else is the
+    // notifier, which may well be back by the next try.
+    const bool permanent = hr == E_INVALIDARG || hr == STRSAFE_E_INSUFFICIENT_BUFFER;
+    if (FAILED(hr) && !permanent) {
+        WINTOAST_TRACE(_tracer, instant("spool-retry", id));
+        return false;
+    }
+    if (known) {
+        std::lock_guard<std::mutex> lock(_spoolMutex);
+        _spooled.erase(id);
+    }
+    if (FAILED(hr)) {
+        failedHelper(handler, id);
+    }
+    return true;
 }
 
-ComPtr<IToastNotifier> WinToast::notifier(_In_ bool* succeded) const  {
-	ComPtr<IToastNotificationManagerStatics> notificationManager;
-	ComPtr<IToastNotifier> notifier;
-	HRESULT hr = DllImporter::Wrap_GetActivationFactory(WinToastStringWrapper(RuntimeClass_Windows_UI_Notifications_ToastNotificationManager).Get(), &notificationManager);
-	if (SUCCEEDED(hr)) {
-		hr = notificationManager->CreateToastNotifierWithId(WinToastStringWrapper(_aumi).Get(), &notifier);
-	}
-	*succeded = SUCCEEDED(hr);
-	return notifier;
+void WinToast::setSpool(_In_opt_ std::shared_ptr<WinToastSpool> spool, _In_opt_ IWinToastHandler* replayHandler) {
+    if (_spool) {
+        _spool->stop();
+    }
+    _spoolReplayHandler = replayHandler ? std::shared_ptr<IWinToastHandler>(replayHandler) : std::make_shared<WinToastSilentHandler>();
+    _spool = std::move(spool);
+    if (_spool) {
+        _spool->start([this](const WinToastFrozenToast& toast, const WinToastSpool::Entry& entry) {
+            return spoolSendHelper(toast, entry);
+        });
+    }
+}
+
+void WinToast::setImageCache(_In_opt_ std::shared_ptr<WinToastImageCache> cache) {
+    _imageCache = std::move(cache);
+}
+
+void WinToast::setHistory(_In_opt_ std::shared_ptr<WinToastHistory> history) {
+    _history = std::move(history);
+}
+
+void WinToast::setRateLimiter(_In_opt_ std::shared_ptr<WinToastRateLimiter> limiter) {
+    _rateLimiter = std::move(limiter);
+}
+
+void WinToast::setDeduplicator(_In_opt_ std::shared_ptr<WinToastDeduplicator> deduplicator) {
+    _deduplicator = std::move(deduplicator);
+}
+
+std::size_t WinToast::pumpRateLimiter() {
+    std::shared_ptr<WinToastRateLimiter> limiter = _rateLimiter;
+    return limiter ? limiter->drain() : 0;
 }
 
+void WinToast::expireHelper() {
+    // Expired toasts are already gone from Action Center; only our reference is
+    // left, and the coalescer entry of a progress toast.
+    _registry->expire(MyDateTime::Now(), [this](std::int64_t id) {
+        _progress->untrack(id);
+    });
+}
+
+HRESULT WinToast::ensureSessionHelper() {
+    // The session (activation factories + notifier) is created once per AUMI and
+    // reused; the backend drops it after a failing notifier call.
+    HRESULT hr = Util::ensureComApartment();
+    if (FAILED(hr) || _backend->hasSession()) {
+        return hr;
+    }
+    // Threads finding no session queue up here, and only the first opens one.
+    std::lock_guard<std::mutex> lock(_sessionMutex);
+    return _backend->hasSession() ? S_OK : _backend->openSession(_aumi);
+}
 
 bool WinToast::hideToast(_In_ INT64 id) {
     if (!isInitialized()) {
@@ -671,242 +1427,187 @@ bool WinToast::hideToast(_In_ INT64 id) {
 
         return false;
     }
-    const bool find = _buffer.find(id) != _buffer.end();
-	if (find) {
-		bool succeded = false;
-		ComPtr<IToastNotifier> notify = notifier(&succeded);
-		if (succeded) {
-			notify->Hide(_buffer[id].Get());
+    expireHelper();
+    WinToastNotificationHandle notification;
+    const bool find = _registry->take(id, notification);
+    if (!find) {
+        return withdrawHelper(id);
+    }
+	if (notification) {
+		if (SUCCEEDED(ensureSessionHelper())) {
+			_backend->hide(notification);
 		}
-		_buffer.erase(id);
 	}
     return find;
 }
 
-void WinToast::clear() {
-	bool succeded = false;
-	ComPtr<IToastNotifier> notify = notifier(&succeded);
-	if (succeded) {
-		auto end = _buffer.end();
-		for (auto it = _buffer.begin(); it != end; ++it) {
-			notify->Hide(it->second.Get());
-		}
-	}
-    _buffer.clear();
-}
-
-HRESULT WinToast::setAttributionTextFieldHelper(_In_ IXmlDocument *xml, _In_ const std::wstring& text) {
-    Util::createElement(xml, L"binding", L"text", { L"placement" });
-    ComPtr<IXmlNodeList> nodeList;
-    HRESULT hr = xml->GetElementsByTagName(WinToastStringWrapper(L"text").Get(), &nodeList);
-    if (SUCCEEDED(hr)) {
-        UINT32 nodeListLength;
-        hr = nodeList->get_Length(&nodeListLength);
-        if (SUCCEEDED(hr)) {
-            for (UINT32 i = 0; i < nodeListLength; i++) {
-                ComPtr<IXmlNode> textNode;
-                hr = nodeList->Item(i, &textNode);
-                if (SUCCEEDED(hr)) {
-                    ComPtr<IXmlNamedNodeMap> attributes;
-                    hr = textNode->get_Attributes(&attributes);
-                    if (SUCCEEDED(hr)) {
-                        ComPtr<IXmlNode> editedNode;
-                        if (SUCCEEDED(hr)) {
-                            hr = attributes->GetNamedItem(WinToastStringWrapper(L"placement").Get(), &editedNode);
-                            if (FAILED(hr) || !editedNode) {
-                                continue;
-                            }
-                            hr = Util::setNodeStringValue(L"attribution", editedNode.Get(), xml);
-                            if (SUCCEEDED(hr)) {
-                                return setTextFieldHelper(xml, text, i);
-                            }
-                        }
-                    }
-                }
-            }
+bool WinToast::withdrawHelper(_In_ INT64 id) {
+    std::shared_ptr<WinToastRateLimiter> limiter = _rateLimiter;
+    bool withdrawn = limiter && limiter->withdraw(id);
+    std::shared_ptr<IWinToastHandler> handler;
+    if (!withdrawn && _spool) {
+        std::lock_guard<std::mutex> lock(_spoolMutex);
+        auto it = _spooled.find(id);
+        if (it != _spooled.end() && it->second) {
+            // The record stays in the spool and the sender skips it.
+            handler.swap(it->second);
+            withdrawn = true;
         }
     }
-    return hr;
+    if (withdrawn) {
+        WINTOAST_TRACE(_tracer, instant("withdrawn", id));
+    }
+    return withdrawn;
 }
 
-HRESULT WinToast::setTextFieldHelper(_In_ IXmlDocument *xml, _In_ const std::wstring& text, _In_ int pos) {
-    ComPtr<IXmlNodeList> nodeList;
-    HRESULT hr = xml->GetElementsByTagName(WinToastStringWrapper(L"text").Get(), &nodeList);
-    if (SUCCEEDED(hr)) {
-        ComPtr<IXmlNode> node;
-        hr = nodeList->Item(pos, &node);
-        if (SUCCEEDED(hr)) {
-            hr = Util::setNodeStringValue(text, node.Get(), xml);
-        }
-    }
-    return hr;
+INT64 WinToast::findTaggedToast(_In_ const std::wstring& tag, _In_ const std::wstring& group) const {
+    const INT64 id = _registry->findTag(IWinToastBackend::tagKey(tag, group));
+    return id != 0 ? id : -1;
 }
 
+INT64 WinToast::showProgressToast(_In_ const WinToastTemplate& toast, _In_ const WinToastProgressBar& progress, _In_ IWinToastHandler* handler,
+                                  _In_ const std::wstring& tag, _In_ const std::wstring& group) {
+    INT64 id = -1;
+    if (!isInitialized()) {
+        std::wcout << L"Error when launching the progress toast. WinToast is not initialized" << std::endl;
+        return id;
+    }
+    if (!handler) {
+        std::wcout << L"Error when launching the progress toast. handler cannot be null." << std::endl;
+        return id;
+    }
+    const bool modernFeatures = modernFeaturesHelper();
+    if (!modernFeatures) {
+        std::wcout << L"Error when launching the progress toast. Progress bars need modern features." << std::endl;
+        return id;
+    }
 
-HRESULT WinToast::setImageFieldHelper(_In_ IXmlDocument *xml, _In_ const std::wstring& path)  {
-    wchar_t imagePath[MAX_PATH] = L"file:///";
-    HRESULT hr = StringCchCatW(imagePath, MAX_PATH, path.c_str());
-    if (SUCCEEDED(hr)) {
-        ComPtr<IXmlNodeList> nodeList;
-        HRESULT hr = xml->GetElementsByTagName(WinToastStringWrapper(L"image").Get(), &nodeList);
-        if (SUCCEEDED(hr)) {
-            ComPtr<IXmlNode> node;
-            hr = nodeList->Item(0, &node);
-            if (SUCCEEDED(hr))  {
-                ComPtr<IXmlNamedNodeMap> attributes;
-                hr = node->get_Attributes(&attributes);
-                if (SUCCEEDED(hr)) {
-                    ComPtr<IXmlNode> editedNode;
-                    hr = attributes->GetNamedItem(WinToastStringWrapper(L"src").Get(), &editedNode);
-                    if (SUCCEEDED(hr)) {
-                        Util::setNodeStringValue(imagePath, editedNode.Get(), xml);
-                    }
-                }
-            }
-        }
+    expireHelper();
+    WinToastPendingHandler sharedHandler(handler);
+    id = _registry->nextId();
+    Identity identity;
+    identity.tag = tag.empty() ? std::to_wstring(id) : tag;
+    identity.group = group.empty() ? std::wstring(DEFAULT_PROGRESS_GROUP) : group;
+    identity.data = progress.data();
+    identity.data.sequence = 1;
+    identity.progressBar = true;
+    // Updates still coming for a toast this one replaces would land on it.
+    const INT64 previous = _registry->findTag(IWinToastBackend::tagKey(identity.tag, identity.group));
+    if (previous != 0) {
+        _progress->untrack(previous);
     }
-    return hr;
+    // Tracked before the toast is shown, so an update racing with the send is kept.
+    _progress->track(id, identity.tag, identity.group);
+    std::wstring xml;
+    WinToastNotificationHandle notification;
+    HRESULT hr = showToastHelper(toast, sharedHandler.get(), modernFeatures, xml, id, notification, &identity);
+    if (FAILED(hr)) {
+        _progress->untrack(id);
+        return -1;
+    }
+    sharedHandler.adopt();
+    _registry->attach(id, std::move(notification));
+    _progress->start();
+    return id;
 }
 
-HRESULT WinToast::setAudioFieldHelper(_In_ IXmlDocument *xml, _In_ const std::wstring& path, _In_opt_ WinToastTemplate::AudioOption option) {
-    std::vector<std::wstring> attrs;
-    if (!path.empty()) attrs.push_back(L"src");
-    if (option == WinToastTemplate::AudioOption::Loop) attrs.push_back(L"loop");
-    if (option == WinToastTemplate::AudioOption::Silent) attrs.push_back(L"silent");
-    Util::createElement(xml, L"toast", L"audio", attrs);
+bool WinToast::updateProgress(_In_ INT64 id, _In_ const WinToastProgressBar& progress) {
+    return _progress->update(id, progress.data());
+}
 
-    ComPtr<IXmlNodeList> nodeList;
-    HRESULT hr = xml->GetElementsByTagName(WinToastStringWrapper(L"audio").Get(), &nodeList);
-    if (SUCCEEDED(hr)) {
-        ComPtr<IXmlNode> node;
-        hr = nodeList->Item(0, &node);
-        if (SUCCEEDED(hr)) {
-            ComPtr<IXmlNamedNodeMap> attributes;
-            hr = node->get_Attributes(&attributes);
-            if (SUCCEEDED(hr)) {
-                ComPtr<IXmlNode> editedNode;
-                if (!path.empty()) {
-                    if (SUCCEEDED(hr)) {
-                        hr = attributes->GetNamedItem(WinToastStringWrapper(L"src").Get(), &editedNode);
-                        if (SUCCEEDED(hr)) {
-                            Util::setNodeStringValue(path, editedNode.Get(), xml);
-                        }
-                    }
-                }
-                //
-                // These options are mutually exclusive
-                //
-                switch (option) {
-                case WinToastTemplate::AudioOption::Loop:
-                    hr = attributes->GetNamedItem(WinToastStringWrapper(L"loop").Get(), &editedNode);
-                    if (SUCCEEDED(hr)) {
-                        Util::setNodeStringValue(L"true", editedNode.Get(), xml);
-                    }
-                    break;
-                case WinToastTemplate::AudioOption::Silent:
-                    hr = attributes->GetNamedItem(WinToastStringWrapper(L"silent").Get(), &editedNode);
-                    if (SUCCEEDED(hr)) {
-                        Util::setNodeStringValue(L"true", editedNode.Get(), xml);
-                    }
-                default:
-                    break;
-                }
-            }
-        }
-    }
-    return hr;
+void WinToast::setMaxProgressUpdatesPerSecond(_In_ double maxUpdatesPerSecond) {
+    _progress->setMaxUpdatesPerSecond(maxUpdatesPerSecond);
 }
 
-HRESULT WinToast::addActionHelper(_In_ IXmlDocument *xml, _In_ const std::wstring& content, _In_ const std::wstring& arguments) {
-	ComPtr<IXmlNodeList> nodeList;
-	HRESULT hr = xml->GetElementsByTagName(WinToastStringWrapper(L"actions").Get(), &nodeList);
-    if (SUCCEEDED(hr)) {
-        UINT32 length;
-        hr = nodeList->get_Length(&length);
-        if (SUCCEEDED(hr)) {
-            ComPtr<IXmlNode> actionsNode;
-            if (length > 0) {
-                hr = nodeList->Item(0, &actionsNode);
-            } else {
-                hr = xml->GetElementsByTagName(WinToastStringWrapper(L"toast").Get(), &nodeList);
-                if (SUCCEEDED(hr)) {
-                    hr = nodeList->get_Length(&length);
-                    if (SUCCEEDED(hr)) {
-                        ComPtr<IXmlNode> toastNode;
-                        hr = nodeList->Item(0, &toastNode);
-                        if (SUCCEEDED(hr)) {
-                            ComPtr<IXmlElement> toastElement;
-                            hr = toastNode.As(&toastElement);
-                            if (SUCCEEDED(hr))
-                                        hr = toastElement->SetAttribute(WinToastStringWrapper(L"template").Get(), WinToastStringWrapper(L"ToastGeneric").Get());
-                            if (SUCCEEDED(hr))
-                                        hr = toastElement->SetAttribute(WinToastStringWrapper(L"duration").Get(), WinToastStringWrapper(L"short").Get());
-                            if (SUCCEEDED(hr)) {
-                                ComPtr<IXmlElement> actionsElement;
-                                hr = xml->CreateElement(WinToastStringWrapper(L"actions").Get(), &actionsElement);
-                                if (SUCCEEDED(hr)) {
-                                    hr = actionsElement.As(&actionsNode);
-                                    if (SUCCEEDED(hr)) {
-                                        ComPtr<IXmlNode> appendedChild;
-                                        hr = toastNode->AppendChild(actionsNode.Get(), &appendedChild);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-            if (SUCCEEDED(hr)) {
-                ComPtr<IXmlElement> actionElement;
-                hr = xml->CreateElement(WinToastStringWrapper(L"action").Get(), &actionElement);
-                if (SUCCEEDED(hr))
-                    hr = actionElement->SetAttribute(WinToastStringWrapper(L"content").Get(), WinToastStringWrapper(content).Get());
-                if (SUCCEEDED(hr))
-                    hr = actionElement->SetAttribute(WinToastStringWrapper(L"arguments").Get(), WinToastStringWrapper(arguments).Get());
-                if (SUCCEEDED(hr)) {
-                    ComPtr<IXmlNode> actionNode;
-                    hr = actionElement.As(&actionNode);
-                    if (SUCCEEDED(hr)) {
-                        ComPtr<IXmlNode> appendedChild;
-                        hr = actionsNode->AppendChild(actionNode.Get(), &appendedChild);
-                    }
-                }
-            }
-        }
-    }
-    return hr;
+WinToastOperation WinToast::showToastAsync(_In_ WinToastTemplate toast, _In_ const WinToastAsync::Options& options) {
+    return _async->show(std::move(toast), options);
 }
 
-WinToastTemplate::WinToastTemplate(_In_ WinToastTemplateType type) : _type(type) {
-    static const std::size_t TextFieldsCount[] = { 1, 2, 2, 3, 1, 2, 2, 3};
-    _textFields = std::vector<std::wstring>(TextFieldsCount[_type], L"");
+void WinToast::clear() {
+	std::vector<WinToastNotificationHandle> notifications = _registry->takeAll();
+	if (!notifications.empty() && SUCCEEDED(ensureSessionHelper())) {
+		for (auto& notification : notifications) {
+			_backend->hide(notification);
+		}
+	}
 }
 
-WinToastTemplate::~WinToastTemplate() {
-    _textFields.clear();
+bool WinToast::modernFeaturesHelper() const {
+    // Modern feature are supported Windows > Windows 10
+    const bool modernFeatures = supportModernFeatures();
+    if (!modernFeatures) {
+        std::wcout << L"Modern features (Actions/Sounds/Attributes) not supported in this os version" << std::endl;
+    }
+    return modernFeatures;
 }
 
-void WinToastTemplate::setTextField(_In_ const std::wstring& txt, _In_ WinToastTemplate::TextField pos) {
-    _textFields[pos] = txt;
+template <typename Toast>
+HRESULT WinToast::compilePayloadHelper(_In_ const Toast& toast, _In_ bool modernFeatures, _Out_ std::wstring& xml, _In_ bool progressBar) {
+    // Long paths are fine (the payload writes them as URIs of any length) up to
+    // what the file system itself accepts.
+    if (toast.hasImage() && toast.imagePath().length() > WinToastPayload::MaxImagePathLength) {
+        return STRSAFE_E_INSUFFICIENT_BUFFER;
+    }
+    // A ready local copy replaces the image; otherwise the source is shown and
+    // the cache prepares the copy in the background.
+    std::wstring cachedImage;
+    if (_imageCache && toast.hasImage() && !toast.imagePath().empty()) {
+        cachedImage = _imageCache->resolve(std::wstring(toast.imagePath().begin(), toast.imagePath().end()));
+    }
+
+    // The whole document is compiled to a string up front and parsed once by the
+    // backend, instead of fetching the template DOM and editing it one node at a time.
+    WINTOAST_STAGE_TIMER(timer, _stats, _tracer, -1);
+    std::shared_ptr<const WinToastPrototype> prototype = _prototypes.get(toast.type(), modernFeatures);
+    WINTOAST_STAGE_LAP(timer, TemplateFetch);
+    if (!prototype) {
+        return E_INVALIDARG;
+    }
+    // Without the ToastGeneric binding the platform would drop the bar and show a plain toast.
+    if (progressBar && !WinToastPayload::supportsProgress(*prototype)) {
+        return E_NOTIMPL;
+    }
+    WinToastPayload::compile(*prototype, toast, xml, cachedImage.empty() ? nullptr : &cachedImage, progressBar);
+    WINTOAST_STAGE_LAP(timer, FieldPopulation);
+    return S_OK;
 }
 
-void WinToastTemplate::setImagePath(_In_ const std::wstring& imgPath) {
-    _imagePath = imgPath;
+namespace {
+    // Lends the pool's shared handler to WinToast, which takes ownership of the
+    // handler it is given once the toast is accepted.
+    class WinToastSharedHandler : public IWinToastHandler {
+    public:
+        explicit WinToastSharedHandler(_In_ std::shared_ptr<IWinToastHandler> handler) : _handler(std::move(handler)) {}
+        void toastActivated() const override { _handler->toastActivated(); }
+        void toastActivated(int actionIndex) const override { _handler->toastActivated(actionIndex); }
+        void toastDismissed(WinToastDismissalReason state) const override { _handler->toastDismissed(state); }
+        void toastFailed() const override { _handler->toastFailed(); }
+
+    private:
+        std::shared_ptr<IWinToastHandler> _handler;
+    };
 }
 
-void WinToastTemplate::setAudioPath(_In_ const std::wstring& audioPath) {
-    _audioPath = audioPath;
+WinToastTenant::WinToastTenant(_In_ const std::wstring& aumi, _In_ const std::wstring& appName) {
+    _toast.setAppUserModelId(aumi);
+    _toast.setAppName(appName);
 }
 
-void WinToastTemplate::setAudioOption(_In_ const WinToastTemplate::AudioOption & audioOption) {
-    _audioOption = audioOption;
+bool WinToastTenant::initialize() {
+    return _toast.isInitialized() || _toast.initialize();
 }
 
-void WinToastTemplate::setAttributionText(_In_ const std::wstring& attributionText) {
-    _attributionText = attributionText;
+std::int64_t WinToastTenant::show(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler) {
+    std::unique_ptr<IWinToastHandler> lent(new WinToastSharedHandler(handler));
+    const std::int64_t id = _toast.showToast(toast.thaw(), lent.get());
+    if (id >= 0) {
+        lent.release();
+    }
+    return id;
 }
 
-void WinToastTemplate::addAction(_In_ const std::wstring & label)
-{
-	_actions.push_back(label);
-}
\ No newline at end of file
+WinToastPool::TenantFactory WinToastTenant::factory() {
+    return [](const std::wstring& aumi, const std::wstring& appName) {
+        return std::make_shared<WinToastTenant>(aumi, appName);
+    };
+}
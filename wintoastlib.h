@@ -17,7 +17,26 @@
 #include <winstring.h>
 #include <string.h>
 #include <vector>
+#include <algorithm>
+#include <span>
 #include <map>
+#include <unordered_map>
+#include "wintoasttemplate.h"
+#include "wintoastpayload.h"
+#include "wintoastfrozen.h"
+#include "wintoastbackend.h"
+#include "wintoastdispatch.h"
+#include "wintoastregistry.h"
+#include "wintoastratelimit.h"
+#include "wintoastdedup.h"
+#include "wintoastspool.h"
+#include "wintoasthistory.h"
+#include "wintoastimagecache.h"
+#include "wintoastpool.h"
+#include "wintoastasync.h"
+#include "wintoastprogress.h"
+#include "wintoastshortcut.h"
+#include "wintoastcapabilities.h"
 using namespace Microsoft::WRL;
 using namespace ABI::Windows::Data::Xml::Dom;
 using namespace ABI::Windows::Foundation;
@@ -26,76 +45,43 @@ using namespace Windows::Foundation;
 
 #define DEFAULT_SHELL_LINKS_PATH	L"\\Microsoft\\Windows\\Start Menu\\Programs\\"
 #define DEFAULT_LINK_FORMAT			L".lnk"
+#define DEFAULT_STAMP_FORMAT        L".lnkstamp"
+#define DEFAULT_PROGRESS_GROUP      L"WinToast.Progress"
+// Batch item turned away by the rate limiter (WinToastRateLimiter::Reject / Drop).
+#define WINTOAST_E_RATE_REJECTED    MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x0201)
+#define WINTOAST_E_RATE_DROPPED     MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x0202)
+// Batch item suppressed as a repeat by the deduplicator.
+#define WINTOAST_S_DUPLICATE        MAKE_HRESULT(SEVERITY_SUCCESS, FACILITY_ITF, 0x0203)
+// Batch item the spool could not take (full, or too large for it).
+#define WINTOAST_E_SPOOL_FULL       MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x0204)
 namespace WinToastLib {
 
-    class IWinToastHandler {
-    public:
-        enum WinToastDismissalReason {
-            UserCanceled = ToastDismissalReason::ToastDismissalReason_UserCanceled,
-            ApplicationHidden = ToastDismissalReason::ToastDismissalReason_ApplicationHidden,
-            TimedOut = ToastDismissalReason::ToastDismissalReason_TimedOut
-        };
-        virtual void toastActivated() const = 0;
-        virtual void toastActivated(int actionIndex) const = 0;
-        virtual void toastDismissed(WinToastDismissalReason state) const = 0;
-        virtual void toastFailed() const = 0;
-    };
-
-    class WinToastTemplate {
-    public:
-        enum AudioOption { Default = 0, Silent = 1, Loop = 2 };
-        enum TextField { FirstLine = 0, SecondLine, ThirdLine };
-        enum WinToastTemplateType {
-            ImageAndText01 = ToastTemplateType::ToastTemplateType_ToastImageAndText01,
-            ImageAndText02 = ToastTemplateType::ToastTemplateType_ToastImageAndText02,
-            ImageAndText03 = ToastTemplateType::ToastTemplateType_ToastImageAndText03,
-            ImageAndText04 = ToastTemplateType::ToastTemplateType_ToastImageAndText04,
-            Text01 = ToastTemplateType::ToastTemplateType_ToastText01,
-            Text02 = ToastTemplateType::ToastTemplateType_ToastText02,
-            Text03 = ToastTemplateType::ToastTemplateType_ToastText03,
-            Text04 = ToastTemplateType::ToastTemplateType_ToastText04,
-            WinToastTemplateTypeCount
-        };
-
-        WinToastTemplate(_In_ WinToastTemplateType type = ImageAndText02);
-        ~WinToastTemplate();
-
-        void                                        setTextField(_In_ const std::wstring& txt, _In_ TextField pos);
-        void                                        setImagePath(_In_ const std::wstring& imgPath);
-        void                                        setAudioPath(_In_ const std::wstring& audioPath);
-        void                                        setAudioOption(_In_ const WinToastTemplate::AudioOption& audioOption);
-        void                                        setAttributionText(_In_ const std::wstring & attributionText);
-        void                                        addAction(_In_ const std::wstring& label);
-        inline void                                 setExpiration(_In_ INT64 millisecondsFromNow) { _expiration = millisecondsFromNow; }
-        inline int                                  textFieldsCount() const { return static_cast<int>(_textFields.size()); }
-        inline int                                  actionsCount() const { return static_cast<int>(_actions.size()); }
-        inline bool                                 hasImage() const { return _type < Text01; }
-        inline std::vector<std::wstring>            textFields() const { return _textFields; }
-        inline std::wstring                         textField(_In_ TextField pos) const { return _textFields[pos]; }
-        inline std::wstring                         actionLabel(_In_ int pos) const { return _actions[pos]; }
-        inline std::wstring                         imagePath() const { return _imagePath; }
-        inline std::wstring                         audioPath() const { return _audioPath; }
-        inline std::wstring                         attributionText() const { return _attributionText; }
-        inline INT64                                expiration() const { return _expiration; }
-        inline WinToastTemplateType                 type() const { return _type; }
-        inline WinToastTemplate::AudioOption        audioOption() const { return _audioOption; }
-
-    private:
-        std::vector<std::wstring>			_textFields;
-        std::wstring                        _imagePath;
-        std::wstring                        _audioPath;
-        std::vector<std::wstring>           _actions;
-        INT64                               _expiration;
-        WinToastTemplateType                _type;
-        WinToastTemplate::AudioOption       _audioOption = WinToastTemplate::AudioOption::Default;
-        std::wstring                        _attributionText;
+    // Outcome of one item of WinToast::showToasts: id is the toast id on success
+    // and -1 otherwise, hr says why an item failed. S_FALSE means the rate limiter
+    // queued the toast or it went to the spool; it goes out later under the id given here.
+    struct WinToastBatchResult {
+        INT64           id;
+        HRESULT         hr;
     };
 
+    // Thread safety: showToast, showToasts, hideToast, clear, poll, stats,
+    // showProgressToast, updateProgress and pumpRateLimiter may be called from any number of threads at once, as may
+    // initialize (concurrent calls run one after the other). Ids come from an
+    // atomic counter and live toasts sit in a sharded registry. Each calling
+    // thread joins the COM multithreaded apartment on first use, unless it is
+    // already in an apartment. Toasts sharing a tag and group should come from
+    // one thread: when two race, the platform and the registry may keep
+    // different ones. The setters (setAppUserModelId, setAppName,
+    // setBackend, setDispatcher, setTracer, setRateLimiter, ...) configure the
+    // instance and must not run while other threads use it.
     class WinToast {
     public:
         WinToast(void);
         virtual ~WinToast();
         static WinToast* instance();
+        // Process-wide snapshot of entry points, OS version and supported features,
+        // probed on first use. isCompatible and supportModernFeatures read it.
+        static const WinToastCapabilities& capabilities();
         static bool             isCompatible();
 		static bool				supportModernFeatures();
 		static std::wstring     configureAUMI(_In_ const std::wstring& companyName,
@@ -105,13 +91,113 @@ namespace WinToastLib {
                                                     );
         virtual bool            initialize();
         virtual bool            isInitialized() const { return _isInitialized; }
+        // Returns the toast id, and then owns handler. A negative result (-1,
+        // TOAST_REJECTED, TOAST_DROPPED, TOAST_DUPLICATE) leaves handler with the
+        // caller, who may retry with it or delete it.
         virtual INT64           showToast(_In_ const WinToastTemplate& toast, _In_ IWinToastHandler* handler);
+        // Same, taking the template over: dedup annotates its attribution in place
+        // instead of on a copy.
+        virtual INT64           showToast(_In_ WinToastTemplate&& toast, _In_ IWinToastHandler* handler);
+        // Sends a burst of toasts sharing one handler. The initialization check,
+        // notifier session, OS capability probe and payload buffer are set up once
+        // for the whole batch and the new ids are registered together at the end.
+        // Results are in the same order as toasts, which may be any contiguous
+        // range of templates (a vector, an array, part of either). handler is
+        // owned once any item is queued, spooled or shown; when none is, it stays
+        // with the caller.
+        virtual std::vector<WinToastBatchResult> showToasts(_In_ std::span<const WinToastTemplate> toasts, _In_ IWinToastHandler* handler);
+        // Hides a shown toast. One still queued by the rate limiter or waiting in
+        // the spool is withdrawn instead and never shown; it reports no outcome.
+        // Returns false when id is neither live nor pending.
         virtual bool            hideToast(_In_ INT64 id);
+        // Id of the live toast shown under tag and group (see
+        // WinToastTemplate::setTag), or -1.
+        INT64                   findTaggedToast(_In_ const std::wstring& tag, _In_ const std::wstring& group = std::wstring()) const;
         virtual void            clear();
+        // Sends toast through showToast and returns its outcome as an awaitable
+        // (see WinToastOperation): co_await it, or get() it outside a coroutine.
+        // options set a timeout, a stop token and the executor to resume on.
+        WinToastOperation       showToastAsync(_In_ WinToastTemplate toast, _In_ const WinToastAsync::Options& options = WinToastAsync::Options());
+        // Shows toast with a progress bar whose fields are bound data, so
+        // updateProgress changes them in place instead of showing a new toast.
+        // tag and group identify it to the platform (an empty tag means the toast
+        // id, an empty group DEFAULT_PROGRESS_GROUP). Progress toasts skip the
+        // deduplicator, rate limiter and spool. The bar renders in the adaptive
+        // ToastGeneric binding only, so this fails without modern features.
+        // Returns the id, owning handler from then on, or -1, leaving it with the caller.
+        INT64                   showProgressToast(_In_ const WinToastTemplate& toast, _In_ const WinToastProgressBar& progress, _In_ IWinToastHandler* handler,
+                                                  _In_ const std::wstring& tag = std::wstring(), _In_ const std::wstring& group = std::wstring());
+        // Records progress as the bar's latest state. At most
+        // setMaxProgressUpdatesPerSecond updates per toast reach the platform;
+        // the last one always does. False once the toast has ended.
+        bool                    updateProgress(_In_ INT64 id, _In_ const WinToastProgressBar& progress);
+        void                    setMaxProgressUpdatesPerSecond(_In_ double maxUpdatesPerSecond);
+        inline std::shared_ptr<WinToastUpdateCoalescer> progressUpdates() const { return _progress; }
         inline std::wstring     appName() const { return _appName; }
         inline std::wstring     appUserModelId() const { return _aumi; }
         void                    setAppUserModelId(_In_ const std::wstring& appName);
         void                    setAppName(_In_ const std::wstring& appName);
+        void                    setTemplateProvider(_In_ std::shared_ptr<IWinToastTemplateProvider> provider);
+        // Replaces the platform backend (e.g. with a WinToastMemoryBackend). Any open
+        // notifier session belongs to the old backend and is dropped with it.
+        void                    setBackend(_In_ std::shared_ptr<IWinToastBackend> backend);
+        inline std::shared_ptr<IWinToastBackend> backend() const { return _backend; }
+        inline WinToastPrototypeCache& prototypes() { return _prototypes; }
+        // Chooses where handler methods run. The default (Inline) calls them on the
+        // platform callback thread. Toasts already shown keep their old dispatcher.
+        void                    setDispatcher(_In_ const WinToastDispatcher::Options& options);
+        inline std::shared_ptr<WinToastDispatcher> dispatcher() const { return _dispatcher; }
+        // Delivers queued outcomes on the calling thread (WinToastDispatcher::Polled).
+        std::size_t             poll(_In_ std::size_t maxOutcomes = static_cast<std::size_t>(-1));
+        // Toasts still tracked for hideToast/clear. Entries leave on their own once
+        // the toast is activated, dismissed, fails or expires.
+        inline std::size_t      liveToasts() const { return _registry->size(); }
+        inline std::size_t      liveToastsHighWaterMark() const { return _registry->highWaterMark(); }
+        // Per-stage latency histograms and send/failure/outcome counters since
+        // start (or the last resetStats). Empty when built with WINTOAST_NO_STATS.
+        WinToastStats::Snapshot stats() const;
+        void                    resetStats();
+        // Writes every send's stages, rate-limit/dedup decisions and outcome callbacks
+        // to a trace-event file (see WinToastTracer); nullptr (the default) stops.
+        // Toasts already shown keep reporting their outcome to the old tracer.
+        void                    setTracer(_In_opt_ std::shared_ptr<WinToastTracer> tracer);
+        inline std::shared_ptr<WinToastTracer> tracer() const { return _tracer; }
+        // Puts a rate limiter in front of the notifier; nullptr (the default) sends
+        // everything. With a limiter showToast may also return TOAST_REJECTED or
+        // TOAST_DROPPED, or an id whose toast is queued and sent on a later pump.
+        // Queued sends refer back to this WinToast.
+        void                    setRateLimiter(_In_opt_ std::shared_ptr<WinToastRateLimiter> limiter);
+        inline std::shared_ptr<WinToastRateLimiter> rateLimiter() const { return _rateLimiter; }
+        // Sends the delayed toasts whose buckets have refilled, on the calling
+        // thread. showToast and showToasts pump on their own; call this from a timer
+        // to drain a backlog when nothing new comes in (see nextReleaseIn).
+        std::size_t             pumpRateLimiter();
+        // Opt-in suppression of repeated identical toasts; nullptr (the default)
+        // turns it off. A suppressed toast makes showToast return TOAST_DUPLICATE.
+        void                    setDeduplicator(_In_opt_ std::shared_ptr<WinToastDeduplicator> deduplicator);
+        inline std::shared_ptr<WinToastDeduplicator> deduplicator() const { return _deduplicator; }
+        // Routes every send through an open crash-safe spool; nullptr (the default)
+        // shows toasts directly. showToast then returns as soon as the toast is in
+        // the spool (TOAST_DROPPED if the spool turned it away) and the spool's
+        // sender thread shows it. Toasts recovered from an earlier run are shown
+        // too, with new ids, reporting to replayHandler (owned; may be null).
+        // The spool refers back to this WinToast until it is replaced.
+        void                    setSpool(_In_opt_ std::shared_ptr<WinToastSpool> spool, _In_opt_ IWinToastHandler* replayHandler = nullptr);
+        inline std::shared_ptr<WinToastSpool> spool() const { return _spool; }
+        // Shows local, downscaled copies of toast images from an open cache;
+        // nullptr (the default) shows every image from where it is. Images not
+        // cached yet are shown from their source and cached in the background.
+        void                    setImageCache(_In_opt_ std::shared_ptr<WinToastImageCache> cache);
+        inline std::shared_ptr<WinToastImageCache> imageCache() const { return _imageCache; }
+        // Appends each toast's outcome to an open history; nullptr (the default)
+        // stops. Toasts already shown keep reporting to the old history.
+        void                    setHistory(_In_opt_ std::shared_ptr<WinToastHistory> history);
+        inline std::shared_ptr<WinToastHistory> history() const { return _history; }
+
+        // On any of these the caller still owns the handler it passed.
+        static const INT64      TOAST_REJECTED = -2;    // rate limited, Reject policy: slow down and retry
+        static const INT64      TOAST_DROPPED = -3;     // rate limited, Drop policy or delay queue full; or spool full
+        static const INT64      TOAST_DUPLICATE = -4;   // same content shown within the dedup window
 
         enum ShortcutResult {
             SHORTCUT_UNCHANGED = 0,
@@ -123,22 +209,104 @@ namespace WinToastLib {
             SHORTCUT_COM_INIT_FAILURE = -3,
             SHORTCUT_CREATE_FAILED = -4
         };
+        // Validates (or creates) the Start menu shortcut. A stamp file next to the
+        // user's local app data remembers the last validation, so unchanged
+        // shortcuts are not reloaded through the shell on every start.
         virtual enum ShortcutResult createShortcut();
+        // Replaces filesystem/shell-link access (e.g. with WinToastMemoryShellLinks).
+        void                    setShellLinks(_In_ std::shared_ptr<IWinToastShellLinks> links);
+        inline std::shared_ptr<WinToastShortcutCache> shortcuts() const { return _shortcuts; }
     protected:
-        bool											_isInitialized;
-        bool                                            _hasCoInitialized;
+        std::atomic<bool>                               _isInitialized;
+        std::mutex                                      _initializeMutex;
+        std::mutex                                      _sessionMutex;
         std::wstring                                    _appName;
         std::wstring                                    _aumi;
-        std::map<INT64, ComPtr<IToastNotification>>     _buffer;
+        std::shared_ptr<WinToastRegistry>               _registry;
+        std::shared_ptr<IWinToastBackend>               _backend;
+        std::shared_ptr<WinToastStats>                  _stats;
+        std::shared_ptr<WinToastTracer>                 _tracer;
+        std::shared_ptr<WinToastDispatcher>             _dispatcher;
+        WinToastPrototypeCache                          _prototypes;
+        std::shared_ptr<WinToastRateLimiter>            _rateLimiter;
+        std::shared_ptr<WinToastDeduplicator>           _deduplicator;
+        std::shared_ptr<WinToastShortcutCache>          _shortcuts;
+        std::shared_ptr<WinToastSpool>                  _spool;
+        std::shared_ptr<IWinToastHandler>               _spoolReplayHandler;
+        std::mutex                                      _spoolMutex;
+        // Handlers of spooled toasts not shown yet, by toast id (the record tag);
+        // null once the toast is withdrawn.
+        std::unordered_map<INT64, std::shared_ptr<IWinToastHandler>> _spooled;
+        std::shared_ptr<WinToastHistory>                _history;
+        std::shared_ptr<WinToastImageCache>             _imageCache;
+        // Its flusher thread updates toasts through the backend.
+        std::shared_ptr<WinToastUpdateCoalescer>        _progress;
+        // Last: its timeout thread hides toasts through this object.
+        std::unique_ptr<WinToastAsync>                  _async;
+
+        // Tag, group and initial data of a toast shown with an identity: a
+        // progress toast, or a template with a tag.
+        struct Identity {
+            std::wstring                tag;
+            std::wstring                group;
+            WinToastNotificationData    data;
+            bool                        progressBar;
+        };
+
+        // Toast is a WinToastTemplate, or a WinToastFrozenToast for sends released
+        // from the rate limiter queue.
+        template <typename Toast>
+        HRESULT     compilePayloadHelper(_In_ const Toast& toast, _In_ bool modernFeatures, _Out_ std::wstring& xml, _In_ bool progressBar = false);
+        template <typename Toast>
+        HRESULT     showToastHelper(_In_ const Toast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                    _In_ bool modernFeatures, _Inout_ std::wstring& xml, _In_ INT64 id, _Out_ WinToastNotificationHandle& notification,
+                                    _In_opt_ const Identity* identity = nullptr);
+        // owned, when set, is toast itself and may be modified in place.
+        INT64       sendHelper(_In_ const WinToastTemplate& toast, _Inout_opt_ WinToastTemplate* owned, _In_ IWinToastHandler* handler);
+        // Looks toast up in the deduplicator; hash is what commitDuplicateHelper
+        // records once the toast is shown or queued.
+        HRESULT     deduplicateHelper(_In_ const WinToastTemplate& toast, _Inout_opt_ WinToastTemplate* owned, _Out_ std::unique_ptr<WinToastTemplate>& counted,
+                                      _Out_ std::uint64_t& hash);
+        void        commitDuplicateHelper(_In_ std::uint64_t hash);
+        HRESULT     rateLimitHelper(_In_ const WinToastTemplate& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler, _In_ INT64 id);
+        void        sendDeferredHelper(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler, _In_ INT64 id);
+        // Shows a toast whose id the producer already has. A failure goes to the
+        // handler unless reportFailure is false.
+        HRESULT     deliverHelper(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler, _In_ INT64 id,
+                                  _In_ bool reportFailure = true);
+        void        failedHelper(_In_ const std::shared_ptr<IWinToastHandler>& handler, _In_ INT64 id);
+        HRESULT     spoolHelper(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler, _In_ INT64 id);
+        // Spool send function: false leaves the record to be retried, which is
+        // what happens when the notifier fails.
+        bool        spoolSendHelper(_In_ const WinToastFrozenToast& toast, _In_ const WinToastSpool::Entry& entry);
+        // Takes back a toast the rate limiter or the spool has not shown yet.
+        bool        withdrawHelper(_In_ INT64 id);
+        // Binds the shown toast id to its tag in the registry and reports the
+        // toast it superseded, if any.
+        void        supersedeHelper(_In_ INT64 id, _In_ const Identity& identity, _In_ const std::shared_ptr<IWinToastHandler>& forwarder);
+        void        expireHelper();
+        bool        modernFeaturesHelper() const;
+        HRESULT     ensureSessionHelper();
+    };
 
-        HRESULT     validateShellLinkHelper(_Out_ bool& wasChanged);
-        HRESULT		createShellLinkHelper();
-        HRESULT		setImageFieldHelper(_In_ IXmlDocument *xml, _In_ const std::wstring& path);
-        HRESULT     setAudioFieldHelper(_In_ IXmlDocument *xml, _In_ const std::wstring& path, _In_opt_ WinToastTemplate::AudioOption option = WinToastTemplate::AudioOption::Default);
-        HRESULT     setTextFieldHelper(_In_ IXmlDocument *xml, _In_ const std::wstring& text, _In_ int pos);
-        HRESULT     setAttributionTextFieldHelper(_In_ IXmlDocument *xml, _In_ const std::wstring& text);
-        HRESULT     addActionHelper(_In_ IXmlDocument *xml, _In_ const std::wstring& action, _In_ const std::wstring& arguments);
-		ComPtr<IToastNotifier> notifier(_In_ bool* succeded) const;
+    // WinToastPool tenant backed by a WinToast of its own, so every AUMI keeps
+    // its own shortcut, registry, stats and notifier session. initialize() runs
+    // WinToast::initialize, which also attaches the AUMI to the process; that
+    // setting is process-wide and ends up with the last tenant initialized, but
+    // each tenant's toasts still go out through a notifier for its own AUMI.
+    class WinToastTenant : public IWinToastTenant {
+    public:
+        WinToastTenant(_In_ const std::wstring& aumi, _In_ const std::wstring& appName);
+
+        bool                    initialize() override;
+        std::int64_t            show(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler) override;
+        inline WinToast&        toast() { return _toast; }
+
+        // Factory for WinToastPool that makes a WinToastTenant per AUMI.
+        static WinToastPool::TenantFactory factory();
+
+    private:
+        WinToast                _toast;
     };
 }
 #endif // WINTOASTLIB_H
\ No newline at end of file
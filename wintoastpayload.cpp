@@ -0,0 +1,347 @@
+#include "wintoastpayload.h"
+#include <cwchar>
+
+using namespace WinToastLib;
+
+const wchar_t WinToastPayload::ImageUriPrefix[] = L"file:///";
+
+namespace {
+
+    // The same emitter runs twice: once with a counting sink to size the buffer
+    // and once with an appending sink to fill it.
+    class CountingSink {
+    public:
+        inline void literal(const wchar_t*, std::size_t length) { _size += length; }
+        inline void character(wchar_t) { ++_size; }
+        inline std::size_t size() const { return _size; }
+    private:
+        std::size_t _size = 0;
+    };
+
+    class AppendingSink {
+    public:
+        explicit AppendingSink(std::wstring& out) : _out(out) {}
+        inline void literal(const wchar_t* text, std::size_t length) { _out.append(text, length); }
+        inline void character(wchar_t c) { _out.push_back(c); }
+    private:
+        std::wstring& _out;
+    };
+
+    template <std::size_t N>
+    inline std::size_t literalLength(const wchar_t (&)[N]) { return N - 1; }
+
+#define EMIT(sink, text) (sink).literal(text, literalLength(text))
+
+    // Text is anything iterable over wchar_t: std::wstring or a frozen toast's WinToastStringRef.
+    template <typename Sink, typename Text>
+    void emitEscaped(Sink& sink, const Text& text) {
+        for (wchar_t c : text) {
+            switch (c) {
+            case L'&':  EMIT(sink, L"&amp;");  break;
+            case L'<':  EMIT(sink, L"&lt;");   break;
+            case L'>':  EMIT(sink, L"&gt;");   break;
+            case L'"':  EMIT(sink, L"&quot;"); break;
+            case L'\'': EMIT(sink, L"&apos;"); break;
+            default:    sink.character(c);     break;
+            }
+        }
+    }
+
+    template <typename Sink>
+    void emitNumber(Sink& sink, int value) {
+        wchar_t buf[12];
+        int length = std::swprintf(buf, sizeof(buf) / sizeof(*buf), L"%d", value);
+        sink.literal(buf, length > 0 ? static_cast<std::size_t>(length) : 0);
+    }
+
+    inline bool isSeparator(wchar_t c) { return c == L'\\' || c == L'/'; }
+
+    // The URI form of an image path; see WinToastPayload::ImageUriPrefix.
+    template <typename Sink, typename Text>
+    void emitImageUri(Sink& sink, const Text& path) {
+        const wchar_t* text = path.data();
+        std::size_t length = path.length();
+        if (length >= 8 && !std::wmemcmp(text, L"\\\\?\\UNC\\", 8)) {
+            text += 8;
+            length -= 8;
+            EMIT(sink, L"file://");
+        } else {
+            if (length >= 4 && !std::wmemcmp(text, L"\\\\?\\", 4)) {
+                text += 4;
+                length -= 4;
+            }
+            if (length >= 2 && isSeparator(text[0]) && isSeparator(text[1])) {
+                text += 2;
+                length -= 2;
+                EMIT(sink, L"file://");
+            } else if (length >= 1 && text[0] == L'/') {
+                // Already rooted (POSIX-style); file:// plus the path gives three slashes.
+                EMIT(sink, L"file://");
+            } else {
+                EMIT(sink, WinToastPayload::ImageUriPrefix);
+            }
+        }
+        for (std::size_t i = 0; i < length; i++) {
+            switch (text[i]) {
+            case L'\\': sink.character(L'/');   break;
+            case L'%':  EMIT(sink, L"%25");     break;
+            case L'#':  EMIT(sink, L"%23");     break;
+            case L'?':  EMIT(sink, L"%3F");     break;
+            case L'&':  EMIT(sink, L"&amp;");   break;
+            case L'<':  EMIT(sink, L"&lt;");    break;
+            case L'>':  EMIT(sink, L"&gt;");    break;
+            case L'"':  EMIT(sink, L"&quot;");  break;
+            case L'\'': EMIT(sink, L"&apos;");  break;
+            default:    sink.character(text[i]); break;
+            }
+        }
+    }
+
+    // Copies the skeleton from *cursor up to slot and moves the cursor there.
+    template <typename Sink>
+    inline void emitSkeleton(Sink& sink, const WinToastPrototype& prototype, std::size_t& cursor, std::size_t slot) {
+        sink.literal(prototype.skeleton.data() + cursor, slot - cursor);
+        cursor = slot;
+    }
+
+    // Toast is a WinToastTemplate or a WinToastFrozenToast; both have the same getters.
+    template <typename Sink, typename Toast>
+    void emitPayload(Sink& sink, const WinToastPrototype& prototype, const Toast& toast, const std::wstring* imagePath, bool progressBar) {
+        const bool modernFeatures = prototype.modernFeatures;
+        const bool withActions = modernFeatures && toast.actionsCount() > 0;
+        const bool withAudio = modernFeatures && !(toast.audioPath().empty() && toast.audioOption() == WinToastTemplate::Default);
+        const bool withProgress = progressBar && WinToastPayload::supportsProgress(prototype);
+        std::size_t cursor = 0;
+
+        emitSkeleton(sink, prototype, cursor, prototype.toastAttributesSlot);
+        if (withActions) {
+            EMIT(sink, L" template=\"ToastGeneric\" duration=\"short\"");
+        }
+        if (withProgress) {
+            // <progress> is an adaptive element; the legacy bindings drop it.
+            emitSkeleton(sink, prototype, cursor, prototype.bindingNameSlot);
+            EMIT(sink, L"ToastGeneric");
+            cursor += prototype.bindingNameLength;
+        }
+
+        if (prototype.imageSourceSlot != WinToastPrototype::NoSlot) {
+            emitSkeleton(sink, prototype, cursor, prototype.imageSourceSlot);
+            if (imagePath) {
+                emitImageUri(sink, *imagePath);
+            } else {
+                emitImageUri(sink, toast.imagePath());
+            }
+        }
+
+        const int fieldsCount = toast.textFieldsCount();
+        const int slotsCount = static_cast<int>(prototype.textSlots.size());
+        for (int i = 0; i < fieldsCount && i < slotsCount; i++) {
+            emitSkeleton(sink, prototype, cursor, prototype.textSlots[i]);
+            emitEscaped(sink, toast.textField(WinToastTemplate::TextField(i)));
+        }
+
+        emitSkeleton(sink, prototype, cursor, prototype.bindingEndSlot);
+        if (withProgress) {
+            // The keys of WinToastProgressBar::data().
+            EMIT(sink, L"<progress title=\"{progressTitle}\" value=\"{progressValue}\" "
+                       L"valueStringOverride=\"{progressValueString}\" status=\"{progressStatus}\"/>");
+        }
+        if (modernFeatures && !toast.attributionText().empty()) {
+            EMIT(sink, L"<text placement=\"attribution\">");
+            emitEscaped(sink, toast.attributionText());
+            EMIT(sink, L"</text>");
+        }
+
+        emitSkeleton(sink, prototype, cursor, prototype.toastEndSlot);
+        if (withActions) {
+            EMIT(sink, L"<actions>");
+            const int actionsCount = toast.actionsCount();
+            for (int i = 0; i < actionsCount; i++) {
+                EMIT(sink, L"<action content=\"");
+                emitEscaped(sink, toast.actionLabel(i));
+                EMIT(sink, L"\" arguments=\"");
+                emitNumber(sink, i);
+                EMIT(sink, L"\"/>");
+            }
+            EMIT(sink, L"</actions>");
+        }
+
+        if (withAudio) {
+            EMIT(sink, L"<audio");
+            if (!toast.audioPath().empty()) {
+                EMIT(sink, L" src=\"");
+                emitEscaped(sink, toast.audioPath());
+                EMIT(sink, L"\"");
+            }
+            //
+            // These options are mutually exclusive
+            //
+            switch (toast.audioOption()) {
+            case WinToastTemplate::AudioOption::Loop:
+                EMIT(sink, L" loop=\"true\"");
+                break;
+            case WinToastTemplate::AudioOption::Silent:
+                EMIT(sink, L" silent=\"true\"");
+                break;
+            default:
+                break;
+            }
+            EMIT(sink, L"/>");
+        }
+        emitSkeleton(sink, prototype, cursor, prototype.skeleton.size());
+    }
+
+#undef EMIT
+
+    WinToastPrototypeCache& sharedPrototypeCache() {
+        static WinToastPrototypeCache cache;
+        return cache;
+    }
+}
+
+bool WinToastBuiltinTemplateProvider::createPrototype(_In_ WinToastTemplate::WinToastTemplateType type, _In_ bool modernFeatures, _Out_ WinToastPrototype& prototype) {
+    if (type < 0 || type >= WinToastTemplate::WinToastTemplateTypeCount) {
+        return false;
+    }
+    static const int TextFieldsCount[] = { 1, 2, 2, 3, 1, 2, 2, 3 };
+
+    prototype.type = type;
+    prototype.modernFeatures = modernFeatures;
+    prototype.textSlots.clear();
+    std::wstring& xml = prototype.skeleton;
+    xml.assign(L"<toast");
+    prototype.toastAttributesSlot = xml.size();
+    xml.append(L"><visual><binding template=\"");
+    prototype.bindingNameSlot = xml.size();
+    xml.append(WinToastPayload::templateName(type));
+    prototype.bindingNameLength = xml.size() - prototype.bindingNameSlot;
+    xml.append(L"\">");
+    prototype.imageSourceSlot = WinToastPrototype::NoSlot;
+    if (type < WinToastTemplate::Text01) {
+        xml.append(L"<image id=\"1\" src=\"");
+        prototype.imageSourceSlot = xml.size();
+        xml.append(L"\"/>");
+    }
+    for (int i = 0; i < TextFieldsCount[type]; i++) {
+        xml.append(L"<text id=\"");
+        xml.append(std::to_wstring(i + 1));
+        xml.append(L"\">");
+        prototype.textSlots.push_back(xml.size());
+        xml.append(L"</text>");
+    }
+    prototype.bindingEndSlot = xml.size();
+    xml.append(L"</binding></visual>");
+    prototype.toastEndSlot = xml.size();
+    xml.append(L"</toast>");
+    return true;
+}
+
+WinToastPrototypeCache::WinToastPrototypeCache(_In_opt_ std::shared_ptr<IWinToastTemplateProvider> provider) :
+    _provider(provider ? provider : std::make_shared<WinToastBuiltinTemplateProvider>())
+{
+}
+
+std::shared_ptr<const WinToastPrototype> WinToastPrototypeCache::get(_In_ WinToastTemplate::WinToastTemplateType type, _In_ bool modernFeatures) {
+    if (type < 0 || type >= WinToastTemplate::WinToastTemplateTypeCount) {
+        return nullptr;
+    }
+    const int slot = type * 2 + (modernFeatures ? 1 : 0);
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_prototypes[slot]) {
+        ++_hits;
+        return _prototypes[slot];
+    }
+    ++_misses;
+    auto prototype = std::make_shared<WinToastPrototype>();
+    if (!_provider->createPrototype(type, modernFeatures, *prototype)) {
+        return nullptr;
+    }
+    _prototypes[slot] = prototype;
+    return _prototypes[slot];
+}
+
+void WinToastPrototypeCache::invalidate() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& prototype : _prototypes) {
+        prototype.reset();
+    }
+}
+
+void WinToastPrototypeCache::setProvider(_In_ std::shared_ptr<IWinToastTemplateProvider> provider) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _provider = provider ? provider : std::make_shared<WinToastBuiltinTemplateProvider>();
+    for (auto& prototype : _prototypes) {
+        prototype.reset();
+    }
+}
+
+std::size_t WinToastPrototypeCache::hits() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _hits;
+}
+
+std::size_t WinToastPrototypeCache::misses() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _misses;
+}
+
+const wchar_t* WinToastPayload::templateName(_In_ WinToastTemplate::WinToastTemplateType type) {
+    static const wchar_t* const Names[] = {
+        L"ToastImageAndText01", L"ToastImageAndText02", L"ToastImageAndText03", L"ToastImageAndText04",
+        L"ToastText01", L"ToastText02", L"ToastText03", L"ToastText04"
+    };
+    return (type >= 0 && type < WinToastTemplate::WinToastTemplateTypeCount) ? Names[type] : Names[0];
+}
+
+std::size_t WinToastPayload::measure(_In_ const WinToastPrototype& prototype, _In_ const WinToastTemplate& toast,
+                                     _In_opt_ const std::wstring* imagePath, _In_ bool progressBar) {
+    CountingSink sink;
+    emitPayload(sink, prototype, toast, imagePath, progressBar);
+    return sink.size();
+}
+
+void WinToastPayload::compile(_In_ const WinToastPrototype& prototype, _In_ const WinToastTemplate& toast, _Out_ std::wstring& xml,
+                              _In_opt_ const std::wstring* imagePath, _In_ bool progressBar) {
+    xml.clear();
+    xml.reserve(measure(prototype, toast, imagePath, progressBar));
+    AppendingSink sink(xml);
+    emitPayload(sink, prototype, toast, imagePath, progressBar);
+}
+
+std::size_t WinToastPayload::measure(_In_ const WinToastPrototype& prototype, _In_ const WinToastFrozenToast& toast,
+                                     _In_opt_ const std::wstring* imagePath, _In_ bool progressBar) {
+    CountingSink sink;
+    emitPayload(sink, prototype, toast, imagePath, progressBar);
+    return sink.size();
+}
+
+void WinToastPayload::compile(_In_ const WinToastPrototype& prototype, _In_ const WinToastFrozenToast& toast, _Out_ std::wstring& xml,
+                              _In_opt_ const std::wstring* imagePath, _In_ bool progressBar) {
+    xml.clear();
+    // The modern size was measured when the toast was frozen; that saves the
+    // counting pass for every send that uses the built-in layouts and its own image.
+    const bool measured = prototype.modernFeatures && !imagePath && !progressBar;
+    xml.reserve(measured ? toast.payloadSize() : measure(prototype, toast, imagePath, progressBar));
+    AppendingSink sink(xml);
+    emitPayload(sink, prototype, toast, imagePath, progressBar);
+}
+
+std::size_t WinToastPayload::measure(_In_ const WinToastTemplate& toast, _In_ bool modernFeatures) {
+    auto prototype = sharedPrototypeCache().get(toast.type(), modernFeatures);
+    return prototype ? measure(*prototype, toast) : 0;
+}
+
+void WinToastPayload::compile(_In_ const WinToastTemplate& toast, _In_ bool modernFeatures, _Out_ std::wstring& xml) {
+    auto prototype = sharedPrototypeCache().get(toast.type(), modernFeatures);
+    if (prototype) {
+        compile(*prototype, toast, xml);
+    } else {
+        xml.clear();
+    }
+}
+
+std::wstring WinToastPayload::compile(_In_ const WinToastTemplate& toast, _In_ bool modernFeatures) {
+    std::wstring xml;
+    compile(toast, modernFeatures, xml);
+    return xml;
+}
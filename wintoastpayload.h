@@ -0,0 +1,120 @@
+#ifndef WINTOASTPAYLOAD_H
+#define WINTOASTPAYLOAD_H
+#include "wintoastfrozen.h"
+#include <memory>
+#include <mutex>
+
+namespace WinToastLib {
+
+    // Parsed skeleton of one template type: the static markup plus the offsets
+    // where per-toast content goes. Slots are stored in document order, so a send
+    // is a single left-to-right copy of skeleton pieces interleaved with fields.
+    //
+    // Layout, in the order the old DOM helpers appended things:
+    //   <toast[ template="ToastGeneric" duration="short"]>
+    //     <visual><binding template="ToastXxx|ToastGeneric">
+    //       [<image id="1" src="file:///C:/...|file://server/share/..."/>] <text id="n">..</text>...
+    //       [<progress title="{progressTitle}" value="{progressValue}" .../>]
+    //       [<text placement="attribution">..</text>]
+    //     </binding></visual>
+    //     [<actions><action content=".." arguments="i"/>...</actions>]
+    //     [<audio src=".." loop|silent="true"/>]
+    //   </toast>
+    // Attribution, actions and audio are only emitted when modernFeatures is set.
+    // The progress bar (see WinToastProgressBar) needs modernFeatures too and is
+    // only emitted when asked for; <progress> renders in the adaptive
+    // ToastGeneric binding only, so it replaces the legacy template name.
+    struct WinToastPrototype {
+        static const std::size_t                    NoSlot = static_cast<std::size_t>(-1);
+
+        WinToastTemplate::WinToastTemplateType      type;
+        bool                                        modernFeatures;
+        std::wstring                                skeleton;
+        std::size_t                                 toastAttributesSlot;    // right after "<toast"
+        std::size_t                                 bindingNameSlot = NoSlot;   // start of the binding's template name,
+        std::size_t                                 bindingNameLength = 0;      // NoSlot when a provider leaves it out
+        std::size_t                                 imageSourceSlot;        // inside src="", NoSlot for text-only types
+        std::vector<std::size_t>                    textSlots;              // inside each <text id="n"></text>
+        std::size_t                                 bindingEndSlot;         // right before "</binding>"
+        std::size_t                                 toastEndSlot;           // right before "</toast>"
+    };
+
+    // Source of prototypes. The built-in provider synthesises them from the
+    // known legacy template layouts; other implementations can be plugged in to
+    // observe or fake template fetches.
+    class IWinToastTemplateProvider {
+    public:
+        virtual ~IWinToastTemplateProvider() {}
+        virtual bool createPrototype(_In_ WinToastTemplate::WinToastTemplateType type, _In_ bool modernFeatures, _Out_ WinToastPrototype& prototype) = 0;
+    };
+
+    class WinToastBuiltinTemplateProvider : public IWinToastTemplateProvider {
+    public:
+        bool createPrototype(_In_ WinToastTemplate::WinToastTemplateType type, _In_ bool modernFeatures, _Out_ WinToastPrototype& prototype) override;
+    };
+
+    // Holds one prototype per (template type, modern features) pair, built on
+    // first use and shared by every later send until invalidate() is called.
+    class WinToastPrototypeCache {
+    public:
+        explicit WinToastPrototypeCache(_In_opt_ std::shared_ptr<IWinToastTemplateProvider> provider = nullptr);
+
+        std::shared_ptr<const WinToastPrototype>    get(_In_ WinToastTemplate::WinToastTemplateType type, _In_ bool modernFeatures);
+        void                                        invalidate();
+        void                                        setProvider(_In_ std::shared_ptr<IWinToastTemplateProvider> provider);
+        std::size_t                                 hits() const;
+        std::size_t                                 misses() const;
+
+    private:
+        static const int                            SlotCount = WinToastTemplate::WinToastTemplateTypeCount * 2;
+
+        mutable std::mutex                          _mutex;
+        std::shared_ptr<IWinToastTemplateProvider>  _provider;
+        std::shared_ptr<const WinToastPrototype>    _prototypes[SlotCount];
+        std::size_t                                 _hits = 0;
+        std::size_t                                 _misses = 0;
+    };
+
+    // Compiles a WinToastTemplate straight into the toast XML that used to be
+    // produced by GetTemplateContent() plus one DOM edit per field. The output
+    // is exactly what the platform gets through LoadXml, so it can be compared
+    // against golden strings without any COM involved.
+    class WinToastPayload {
+    public:
+        // Exact number of characters compile() will produce. imagePath, when
+        // given, is shown instead of the toast's own (e.g. a cached copy).
+        // progressBar adds a bar whose fields are bound data placeholders, in a
+        // ToastGeneric binding; it is ignored unless supportsProgress(prototype).
+        static std::size_t      measure(_In_ const WinToastPrototype& prototype, _In_ const WinToastTemplate& toast,
+                                        _In_opt_ const std::wstring* imagePath = nullptr, _In_ bool progressBar = false);
+        // Replaces the contents of xml, reserving the measured size up front so
+        // the write pass never reallocates. Reusing xml across calls keeps its capacity.
+        static void             compile(_In_ const WinToastPrototype& prototype, _In_ const WinToastTemplate& toast, _Out_ std::wstring& xml,
+                                        _In_opt_ const std::wstring* imagePath = nullptr, _In_ bool progressBar = false);
+        // Same for a frozen toast, producing identical output.
+        static std::size_t      measure(_In_ const WinToastPrototype& prototype, _In_ const WinToastFrozenToast& toast,
+                                        _In_opt_ const std::wstring* imagePath = nullptr, _In_ bool progressBar = false);
+        static void             compile(_In_ const WinToastPrototype& prototype, _In_ const WinToastFrozenToast& toast, _Out_ std::wstring& xml,
+                                        _In_opt_ const std::wstring* imagePath = nullptr, _In_ bool progressBar = false);
+
+        // Whether compile() can add a progress bar: it needs modern features and
+        // the binding's template name to replace.
+        static inline bool      supportsProgress(_In_ const WinToastPrototype& prototype) {
+            return prototype.modernFeatures && prototype.bindingNameSlot != WinToastPrototype::NoSlot;
+        }
+
+        // Convenience overloads going through a process-wide prototype cache.
+        static std::size_t      measure(_In_ const WinToastTemplate& toast, _In_ bool modernFeatures);
+        static void             compile(_In_ const WinToastTemplate& toast, _In_ bool modernFeatures, _Out_ std::wstring& xml);
+        static std::wstring     compile(_In_ const WinToastTemplate& toast, _In_ bool modernFeatures);
+
+        static const wchar_t*   templateName(_In_ WinToastTemplate::WinToastTemplateType type);
+        // Image paths become file URIs: drive paths as file:///C:/..., UNC paths as
+        // file://server/share/..., without any \\?\ prefix, with / separators and
+        // %, # and ? percent-encoded. There is no MAX_PATH limit; paths up to the
+        // long-path maximum are accepted.
+        static const wchar_t    ImageUriPrefix[];
+        static const std::size_t MaxImagePathLength = 32767;
+    };
+}
+#endif // WINTOASTPAYLOAD_H
@@ -0,0 +1,350 @@
+#include "wintoastpool.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace WinToastLib;
+
+namespace {
+    class PoolSilentHandler : public IWinToastHandler {
+    public:
+        void toastActivated() const override {}
+        void toastActivated(int) const override {}
+        void toastDismissed(WinToastDismissalReason) const override {}
+        void toastFailed() const override {}
+    };
+
+    template <typename Ready>
+    bool finishesLater(_In_ const Ready& a, _In_ const Ready& b) {
+        return a.finish > b.finish || (a.finish == b.finish && a.sequence > b.sequence);
+    }
+}
+
+WinToastBackendTenant::WinToastBackendTenant(_In_ const std::wstring& aumi, _In_ std::shared_ptr<IWinToastBackend> backend, _In_ bool modernFeatures)
+    : _aumi(aumi),
+      _modernFeatures(modernFeatures),
+      _backend(std::move(backend)),
+      _registry(std::make_shared<WinToastRegistry>()),
+#ifndef WINTOAST_NO_STATS
+      _stats(std::make_shared<WinToastStats>()),
+#endif
+      _dispatcher(std::make_shared<WinToastDispatcher>()) {
+    if (_backend) {
+        _backend->setStats(_stats);
+    }
+}
+
+bool WinToastBackendTenant::initialize() {
+    return _backend && (_backend->hasSession() || _backend->openSession(_aumi) >= 0);
+}
+
+std::int64_t WinToastBackendTenant::show(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler) {
+    WINTOAST_STATS_COUNT(_stats, countSend());
+    long hr = _backend->hasSession() ? 0 : _backend->openSession(_aumi);
+    std::int64_t id = -1;
+    if (hr >= 0) {
+        std::wstring xml;
+        WinToastPayload::compile(*_prototypes.get(toast.type(), _modernFeatures), toast, xml);
+        id = _registry->nextId();
+        _registry->reserve(id);
+        // The registry holds the notification, which holds this handler: capture
+        // it weakly, as WinToast does, or toasts left on screen keep it alive.
+        std::weak_ptr<WinToastRegistry> registry = _registry;
+        std::shared_ptr<WinToastStats> stats = _stats;
+        std::shared_ptr<IWinToastHandler> dispatching = std::make_shared<WinToastDispatchingHandler>(_dispatcher, handler, id,
+            [registry, stats](const WinToastOutcome& outcome) {
+                if (auto live = registry.lock()) {
+                    live->erase(outcome.toastId);
+                }
+                WINTOAST_STATS_COUNT(stats, countOutcome(WinToastStats::outcomeOf(outcome)));
+            });
+        WinToastNotificationHandle notification;
+        hr = _backend->show(xml, toast.expiration(), dispatching, notification);
+        if (hr >= 0) {
+            _registry->attach(id, std::move(notification));
+        } else {
+            _registry->erase(id);
+            id = -1;
+        }
+    }
+    if (hr >= 0) {
+        WINTOAST_STATS_COUNT(_stats, countShown());
+    } else {
+        WINTOAST_STATS_COUNT(_stats, countFailure(hr));
+    }
+    return id;
+}
+
+bool WinToastBackendTenant::hide(_In_ std::int64_t id) {
+    WinToastNotificationHandle notification;
+    const bool find = _registry->take(id, notification);
+    if (find && notification && _backend->hasSession()) {
+        _backend->hide(notification);
+    }
+    return find;
+}
+
+WinToastPool::WinToastPool(_In_ TenantFactory factory) : WinToastPool(std::move(factory), Options()) {}
+
+WinToastPool::WinToastPool(_In_ TenantFactory factory, _In_ const Options& options)
+    : _factory(std::move(factory)),
+      _options(options) {
+    _options.shards = std::max<std::size_t>(_options.shards, 1);
+    _options.queueCapacity = std::max<std::size_t>(_options.queueCapacity, 1);
+    if (!(_options.defaultWeight > 0)) {
+        _options.defaultWeight = 1.0;
+    }
+    _shards.reset(new Shard[_options.shards]);
+}
+
+WinToastPool::~WinToastPool() {
+    stop();
+    // Every submitter got Queued, so every toast reports an outcome.
+    for (std::size_t i = 0; i < _options.shards; ++i) {
+        for (auto& entry : _shards[i].tenants) {
+            for (Pending& pending : entry.second->queue) {
+                pending.handler->toastFailed();
+            }
+        }
+    }
+}
+
+WinToastPool::Shard& WinToastPool::shardOf(_In_ const std::wstring& aumi) const {
+    return _shards[std::hash<std::wstring>()(aumi) % _options.shards];
+}
+
+std::shared_ptr<WinToastPool::Tenant> WinToastPool::find(_In_ const std::wstring& aumi) const {
+    Shard& shard = shardOf(aumi);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.tenants.find(aumi);
+    return it != shard.tenants.end() ? it->second : nullptr;
+}
+
+void WinToastPool::addTenant(_In_ const std::wstring& aumi, _In_ const std::wstring& appName, _In_ double weight) {
+    Shard& shard = shardOf(aumi);
+    std::shared_ptr<Tenant> tenant;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::shared_ptr<Tenant>& slot = shard.tenants[aumi];
+        if (!slot) {
+            slot = std::make_shared<Tenant>();
+            slot->aumi = aumi;
+        }
+        tenant = slot;
+    }
+    std::lock_guard<std::mutex> lock(tenant->mutex);
+    tenant->appName = appName;
+    tenant->weight = weight > 0 ? weight : _options.defaultWeight;
+}
+
+bool WinToastPool::setWeight(_In_ const std::wstring& aumi, _In_ double weight) {
+    std::shared_ptr<Tenant> tenant = find(aumi);
+    if (!tenant) {
+        return false;
+    }
+    // Applies from the tenant's next toast on.
+    tenant->weight = weight > 0 ? weight : _options.defaultWeight;
+    return true;
+}
+
+WinToastPool::SubmitResult WinToastPool::submit(_In_ const std::wstring& aumi, _In_ const WinToastTemplate& toast, _In_ IWinToastHandler* handler) {
+    Pending pending;
+    pending.handler = handler ? std::shared_ptr<IWinToastHandler>(handler) : std::make_shared<PoolSilentHandler>();
+    if (_stopped.load(std::memory_order_acquire)) {
+        return Stopped;
+    }
+    std::shared_ptr<Tenant> tenant = find(aumi);
+    if (!tenant) {
+        return UnknownTenant;
+    }
+    pending.toast = WinToastFrozenToast(toast);
+    bool activate = false;
+    {
+        std::lock_guard<std::mutex> lock(tenant->mutex);
+        if (tenant->queue.size() >= _options.queueCapacity) {
+            tenant->rejected.fetch_add(1, std::memory_order_relaxed);
+            return QueueFull;
+        }
+        tenant->queue.push_back(std::move(pending));
+        tenant->submitted.fetch_add(1, std::memory_order_relaxed);
+        if (!tenant->scheduled) {
+            tenant->scheduled = activate = true;
+        }
+    }
+    if (activate) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        scheduleLocked(tenant);
+        _work.notify_one();
+    }
+    return Queued;
+}
+
+void WinToastPool::scheduleLocked(_In_ const std::shared_ptr<Tenant>& tenant) {
+    // A tenant coming back from idle starts at the current virtual time: it gets
+    // no credit for the time it sent nothing.
+    Ready ready;
+    ready.start = std::max(_virtualTime, tenant->lastFinish);
+    ready.finish = ready.start + 1.0 / tenant->weight.load(std::memory_order_relaxed);
+    ready.sequence = _sequence++;
+    ready.tenant = tenant;
+    _ready.push_back(std::move(ready));
+    std::push_heap(_ready.begin(), _ready.end(), finishesLater<Ready>);
+}
+
+std::size_t WinToastPool::dispatch(_In_ std::size_t maxToasts) {
+    std::size_t taken = 0;
+    while (taken < maxToasts && sendNext()) {
+        ++taken;
+    }
+    return taken;
+}
+
+bool WinToastPool::sendNext() {
+    Ready ready;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_ready.empty()) {
+            return false;
+        }
+        std::pop_heap(_ready.begin(), _ready.end(), finishesLater<Ready>);
+        ready = std::move(_ready.back());
+        _ready.pop_back();
+        _virtualTime = std::max(_virtualTime, ready.start);
+        ready.tenant->lastFinish = ready.finish;
+        ++_sending;
+    }
+    Tenant& tenant = *ready.tenant;
+    Pending pending;
+    {
+        std::lock_guard<std::mutex> lock(tenant.mutex);
+        pending = std::move(tenant.queue.front());
+        tenant.queue.pop_front();
+    }
+    send(tenant, pending);
+    // Still scheduled while the toast was out, so no submitter scheduled the
+    // tenant twice; it goes back into the heap only if it has more.
+    bool backlogged;
+    {
+        std::lock_guard<std::mutex> lock(tenant.mutex);
+        backlogged = !tenant.queue.empty();
+        tenant.scheduled = backlogged;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    --_sending;
+    if (backlogged) {
+        scheduleLocked(ready.tenant);
+        _work.notify_one();
+    } else if (_ready.empty() && _sending == 0) {
+        _idle.notify_all();
+    }
+    return true;
+}
+
+void WinToastPool::send(_Inout_ Tenant& tenant, _Inout_ Pending& pending) {
+    if (!tenant.initialized.load(std::memory_order_acquire)) {
+        if (!tenant.context) {
+            std::wstring appName;
+            {
+                std::lock_guard<std::mutex> lock(tenant.mutex);
+                appName = tenant.appName;
+            }
+            tenant.context = _factory(tenant.aumi, appName);
+        }
+        if (tenant.context && tenant.context->initialize()) {
+            tenant.initialized.store(true, std::memory_order_release);
+        }
+    }
+    const std::int64_t id = tenant.initialized.load(std::memory_order_relaxed) ? tenant.context->show(pending.toast, pending.handler) : -1;
+    if (id >= 0) {
+        tenant.sent.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        tenant.failed.fetch_add(1, std::memory_order_relaxed);
+        pending.handler->toastFailed();
+    }
+}
+
+void WinToastPool::start() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopped.store(false, std::memory_order_release);
+    if (!_stopping) {
+        return;
+    }
+    _stopping = false;
+    for (std::size_t i = 0; i < std::max<std::size_t>(_options.senders, 1); ++i) {
+        _senders.emplace_back(&WinToastPool::senderLoop, this);
+    }
+}
+
+void WinToastPool::stop() {
+    std::vector<std::thread> senders;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        _stopped.store(true, std::memory_order_release);
+        senders.swap(_senders);
+    }
+    _work.notify_all();
+    for (std::thread& sender : senders) {
+        sender.join();
+    }
+}
+
+void WinToastPool::senderLoop() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _work.wait(lock, [this] { return _stopping || !_ready.empty(); });
+            if (_stopping) {
+                return;
+            }
+        }
+        sendNext();
+    }
+}
+
+bool WinToastPool::waitIdle(_In_ std::int64_t timeoutMilliseconds) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _idle.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [this] { return _ready.empty() && _sending == 0; });
+}
+
+bool WinToastPool::tenantCounters(_In_ const std::wstring& aumi, _Out_ TenantCounters& counters) const {
+    std::shared_ptr<Tenant> tenant = find(aumi);
+    counters = tenant ? countersOf(*tenant) : TenantCounters();
+    return tenant != nullptr;
+}
+
+WinToastPool::Counters WinToastPool::counters() const {
+    Counters counters = {};
+    std::vector<std::shared_ptr<Tenant>> tenants;
+    for (std::size_t i = 0; i < _options.shards; ++i) {
+        tenants.clear();
+        {
+            std::lock_guard<std::mutex> lock(_shards[i].mutex);
+            for (const auto& entry : _shards[i].tenants) {
+                tenants.push_back(entry.second);
+            }
+        }
+        for (const std::shared_ptr<Tenant>& tenant : tenants) {
+            const TenantCounters one = countersOf(*tenant);
+            ++counters.tenants;
+            counters.submitted += one.submitted;
+            counters.sent += one.sent;
+            counters.failed += one.failed;
+            counters.rejected += one.rejected;
+            counters.queued += one.queued;
+        }
+    }
+    return counters;
+}
+
+WinToastPool::TenantCounters WinToastPool::countersOf(_In_ Tenant& tenant) {
+    TenantCounters counters;
+    counters.weight = tenant.weight.load(std::memory_order_relaxed);
+    counters.submitted = tenant.submitted.load(std::memory_order_relaxed);
+    counters.sent = tenant.sent.load(std::memory_order_relaxed);
+    counters.failed = tenant.failed.load(std::memory_order_relaxed);
+    counters.rejected = tenant.rejected.load(std::memory_order_relaxed);
+    counters.initialized = tenant.initialized.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(tenant.mutex);
+    counters.queued = tenant.queue.size();
+    return counters;
+}
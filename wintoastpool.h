@@ -0,0 +1,193 @@
+#ifndef WINTOASTPOOL_H
+#define WINTOASTPOOL_H
+#include "wintoastbackend.h"
+#include "wintoastdispatch.h"
+#include "wintoastfrozen.h"
+#include "wintoastpayload.h"
+#include "wintoastregistry.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace WinToastLib {
+
+    // One notifier context of a WinToastPool: everything needed to show toasts
+    // under one AUMI. The pool creates it on the tenant's first toast and only
+    // ever calls it from one thread at a time.
+    class IWinToastTenant {
+    public:
+        virtual ~IWinToastTenant() {}
+        // Called before every send until it succeeds once.
+        virtual bool            initialize() = 0;
+        // Shows toast; returns its id, or a negative value if it was not shown.
+        // handler hears about the outcome of shown toasts only.
+        virtual std::int64_t    show(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler) = 0;
+    };
+
+    // Tenant built straight on a backend, with its own notifier session,
+    // registry, prototypes and stats. With a WinToastMemoryBackend per tenant it
+    // stands in for WinToastTenant where no notification platform is available.
+    class WinToastBackendTenant : public IWinToastTenant {
+    public:
+        WinToastBackendTenant(_In_ const std::wstring& aumi, _In_ std::shared_ptr<IWinToastBackend> backend, _In_ bool modernFeatures = true);
+
+        bool                    initialize() override;
+        std::int64_t            show(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler) override;
+        // Same contract as WinToast::hideToast.
+        bool                    hide(_In_ std::int64_t id);
+
+        inline std::shared_ptr<IWinToastBackend> backend() const { return _backend; }
+        inline std::shared_ptr<WinToastRegistry> registry() const { return _registry; }
+        inline std::shared_ptr<WinToastStats> stats() const { return _stats; }
+
+    private:
+        std::wstring                        _aumi;
+        bool                                _modernFeatures;
+        std::shared_ptr<IWinToastBackend>   _backend;
+        std::shared_ptr<WinToastRegistry>   _registry;
+        std::shared_ptr<WinToastStats>      _stats;
+        std::shared_ptr<WinToastDispatcher> _dispatcher;
+        WinToastPrototypeCache              _prototypes;
+    };
+
+    // Sends toasts for several products (AUMIs) from one process. Each tenant
+    // gets its own notifier context, made by the factory on its first toast, and
+    // its own bounded queue. Senders take toasts from the queues in weighted fair
+    // order (start-time fair queuing with one unit of cost per toast): over any
+    // busy period each backlogged tenant gets a share of the sends proportional
+    // to its weight, so a tenant flooding its queue only delays itself.
+    //
+    // Tenants live in shards, each behind its own lock; submit() takes one shard
+    // lock and the tenant's lock, and the scheduler lock only when the tenant's
+    // queue goes from empty to non-empty. A tenant is sent for by one sender at
+    // a time, in submission order.
+    class WinToastPool {
+    public:
+        typedef std::function<std::shared_ptr<IWinToastTenant>(const std::wstring& aumi, const std::wstring& appName)> TenantFactory;
+
+        struct Options {
+            std::size_t         shards = 16;
+            std::size_t         queueCapacity = 256;    // per tenant; more are rejected
+            double              defaultWeight = 1.0;
+            std::size_t         senders = 2;            // threads started by start()
+        };
+
+        // Stopped: stop() was called and start() was not called again since.
+        enum SubmitResult { Queued = 0, UnknownTenant, QueueFull, Stopped };
+
+        struct TenantCounters {
+            double              weight;
+            std::uint64_t       submitted;
+            std::uint64_t       sent;
+            std::uint64_t       failed;                 // not shown, or the context would not initialize
+            std::uint64_t       rejected;               // queue full
+            std::size_t         queued;
+            bool                initialized;
+        };
+
+        struct Counters {
+            std::size_t         tenants;
+            std::uint64_t       submitted;
+            std::uint64_t       sent;
+            std::uint64_t       failed;
+            std::uint64_t       rejected;
+            std::size_t         queued;
+        };
+
+        explicit WinToastPool(_In_ TenantFactory factory);
+        WinToastPool(_In_ TenantFactory factory, _In_ const Options& options);
+        // Stops the senders; toasts still queued report toastFailed.
+        ~WinToastPool();
+        WinToastPool(const WinToastPool&) = delete;
+        WinToastPool& operator=(const WinToastPool&) = delete;
+
+        // Registers a tenant, or changes the app name and weight of a known one
+        // (a context already made keeps its app name). weight <= 0 means
+        // defaultWeight.
+        void                    addTenant(_In_ const std::wstring& aumi, _In_ const std::wstring& appName, _In_ double weight = 0);
+        bool                    setWeight(_In_ const std::wstring& aumi, _In_ double weight);
+        // Queues toast for aumi. handler is owned, like WinToast::showToast's
+        // (null ignores the outcome); when the result is not Queued it has
+        // already been deleted.
+        SubmitResult            submit(_In_ const std::wstring& aumi, _In_ const WinToastTemplate& toast, _In_ IWinToastHandler* handler);
+
+        // Sends up to maxToasts queued toasts on the calling thread, in fair
+        // order. Returns how many were taken (sent or failed).
+        std::size_t             dispatch(_In_ std::size_t maxToasts = static_cast<std::size_t>(-1));
+        // Starts options.senders threads that dispatch as toasts arrive.
+        void                    start();
+        // Stops the sender threads; queued toasts stay queued, and submit()
+        // turns new ones away with Stopped until the next start().
+        void                    stop();
+        // Waits until every queue is empty and no toast is being sent.
+        bool                    waitIdle(_In_ std::int64_t timeoutMilliseconds);
+
+        bool                    tenantCounters(_In_ const std::wstring& aumi, _Out_ TenantCounters& counters) const;
+        Counters                counters() const;
+        inline const Options&   options() const { return _options; }
+
+    private:
+        struct Pending {
+            WinToastFrozenToast                 toast;
+            std::shared_ptr<IWinToastHandler>   handler;
+        };
+
+        struct Tenant {
+            std::wstring                        aumi;
+            std::wstring                        appName;
+            std::atomic<double>                 weight{ 1.0 };
+            std::mutex                          mutex;
+            std::deque<Pending>                 queue;
+            bool                                scheduled = false;  // in the ready heap, or being sent for
+            double                              lastFinish = 0;     // scheduler lock
+            // Sender only (one at a time per tenant).
+            std::shared_ptr<IWinToastTenant>    context;
+            std::atomic<bool>                   initialized{ false };
+            std::atomic<std::uint64_t>          submitted{ 0 };
+            std::atomic<std::uint64_t>          sent{ 0 };
+            std::atomic<std::uint64_t>          failed{ 0 };
+            std::atomic<std::uint64_t>          rejected{ 0 };
+        };
+
+        struct Shard {
+            mutable std::mutex                  mutex;
+            std::unordered_map<std::wstring, std::shared_ptr<Tenant>> tenants;
+        };
+
+        // Tenant with a non-empty queue, ordered by the virtual finish time of
+        // its head toast; sequence breaks ties in arrival order.
+        struct Ready {
+            double                              start;
+            double                              finish;
+            std::uint64_t                       sequence;
+            std::shared_ptr<Tenant>             tenant;
+        };
+
+        Shard&                  shardOf(_In_ const std::wstring& aumi) const;
+        std::shared_ptr<Tenant> find(_In_ const std::wstring& aumi) const;
+        void                    scheduleLocked(_In_ const std::shared_ptr<Tenant>& tenant);
+        bool                    sendNext();
+        void                    send(_Inout_ Tenant& tenant, _Inout_ Pending& pending);
+        void                    senderLoop();
+        static TenantCounters   countersOf(_In_ Tenant& tenant);
+
+        TenantFactory           _factory;
+        Options                 _options;
+        std::unique_ptr<Shard[]> _shards;
+        mutable std::mutex      _mutex;             // scheduler: ready heap, virtual time, senders
+        std::condition_variable _work;
+        std::condition_variable _idle;
+        std::vector<Ready>      _ready;             // min-heap on (finish, sequence)
+        double                  _virtualTime = 0;
+        std::uint64_t           _sequence = 0;
+        std::size_t             _sending = 0;
+        bool                    _stopping = true;
+        std::atomic<bool>       _stopped{ false };  // by stop(), as opposed to never started
+        std::vector<std::thread> _senders;
+    };
+}
+#endif // WINTOASTPOOL_H
@@ -0,0 +1,221 @@
+#include "wintoastprogress.h"
+#include <algorithm>
+#include <cwchar>
+
+using namespace WinToastLib;
+
+namespace {
+    std::int64_t intervalFor(_In_ double maxUpdatesPerSecond) {
+        return maxUpdatesPerSecond > 0 ? static_cast<std::int64_t>(1e6 / maxUpdatesPerSecond) : 0;
+    }
+}
+
+WinToastNotificationData WinToastProgressBar::data() const {
+    WinToastNotificationData data;
+    data.values.reserve(4);
+    data.values.emplace_back(L"progressTitle", title);
+    if (value < 0) {
+        data.values.emplace_back(L"progressValue", L"indeterminate");
+    } else {
+        wchar_t buf[16];
+        const int length = std::swprintf(buf, sizeof(buf) / sizeof(*buf), L"%.4f", std::min(value, 1.0));
+        data.values.emplace_back(L"progressValue", std::wstring(buf, length > 0 ? static_cast<std::size_t>(length) : 0));
+    }
+    data.values.emplace_back(L"progressValueString", valueString);
+    data.values.emplace_back(L"progressStatus", status);
+    return data;
+}
+
+WinToastUpdateCoalescer::WinToastUpdateCoalescer(_In_ UpdateFunction send, _In_opt_ std::shared_ptr<IWinToastClock> clock)
+    : WinToastUpdateCoalescer(std::move(send), Options(), std::move(clock)) {}
+
+WinToastUpdateCoalescer::WinToastUpdateCoalescer(_In_ UpdateFunction send, _In_ const Options& options, _In_opt_ std::shared_ptr<IWinToastClock> clock)
+    : _send(std::move(send)),
+      _clock(clock ? std::move(clock) : WinToastSteadyClock::instance()),
+      _interval(intervalFor(options.maxUpdatesPerSecond)) {}
+
+WinToastUpdateCoalescer::~WinToastUpdateCoalescer() {
+    stop();
+}
+
+void WinToastUpdateCoalescer::track(_In_ std::int64_t id, _In_ const std::wstring& tag, _In_ const std::wstring& group) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Entry& entry = _entries[id];
+    if (entry.pending) {
+        _pending--;
+    }
+    entry = Entry();
+    entry.tag = tag;
+    entry.group = group;
+    // The data shown with the toast counts as sequence 1.
+    entry.sequence = 1;
+}
+
+void WinToastUpdateCoalescer::untrack(_In_ std::int64_t id) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _entries.find(id);
+    if (found != _entries.end()) {
+        if (found->second.pending) {
+            _pending--;
+        }
+        // Its heap entry goes stale and is skipped.
+        _entries.erase(found);
+    }
+}
+
+bool WinToastUpdateCoalescer::update(_In_ std::int64_t id, _In_ WinToastNotificationData data) {
+    Send send;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto found = _entries.find(id);
+        if (found == _entries.end()) {
+            return false;
+        }
+        Entry& entry = found->second;
+        _counters.submitted++;
+        if (entry.pending) {
+            _counters.coalesced++;
+        }
+        entry.data = std::move(data);
+        const std::int64_t now = _clock->nowMicroseconds();
+        if (!slotFree(entry, now)) {
+            if (!entry.pending) {
+                entry.pending = true;
+                _pending++;
+                _due.push_back(Due{ entry.lastSentAt + _interval, id });
+                std::push_heap(_due.begin(), _due.end(), &WinToastUpdateCoalescer::later);
+                _wakeup.notify_one();
+            }
+            return true;
+        }
+        take(entry, id, now, send);
+    }
+    // The producer pays for at most one platform call per slot.
+    deliver(send);
+    return true;
+}
+
+std::size_t WinToastUpdateCoalescer::flush() {
+    std::vector<Send> sends;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const std::int64_t now = _clock->nowMicroseconds();
+        while (!_due.empty() && _due.front().at <= now) {
+            const std::int64_t id = _due.front().id;
+            std::pop_heap(_due.begin(), _due.end(), &WinToastUpdateCoalescer::later);
+            _due.pop_back();
+            auto found = _entries.find(id);
+            if (found == _entries.end() || !found->second.pending) {
+                continue;
+            }
+            sends.emplace_back();
+            take(found->second, id, now, sends.back());
+        }
+    }
+    for (const Send& send : sends) {
+        deliver(send);
+    }
+    return sends.size();
+}
+
+std::int64_t WinToastUpdateCoalescer::nextFlushIn() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_due.empty()) {
+        return -1;
+    }
+    return std::max<std::int64_t>(_due.front().at - _clock->nowMicroseconds(), 0);
+}
+
+void WinToastUpdateCoalescer::start() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_stopping) {
+        return;
+    }
+    _stopping = false;
+    _flusher = std::thread(&WinToastUpdateCoalescer::flusherLoop, this);
+}
+
+void WinToastUpdateCoalescer::stop() {
+    std::thread flusher;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        flusher.swap(_flusher);
+    }
+    _wakeup.notify_all();
+    if (flusher.joinable()) {
+        flusher.join();
+    }
+}
+
+void WinToastUpdateCoalescer::setMaxUpdatesPerSecond(_In_ double maxUpdatesPerSecond) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _interval = intervalFor(maxUpdatesPerSecond);
+    // Slots already scheduled keep their time.
+}
+
+WinToastUpdateCoalescer::Counters WinToastUpdateCoalescer::counters() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Counters counters = _counters;
+    counters.tracked = _entries.size();
+    counters.pending = _pending;
+    return counters;
+}
+
+bool WinToastUpdateCoalescer::slotFree(_In_ const Entry& entry, _In_ std::int64_t now) const {
+    return !entry.everSent || now - entry.lastSentAt >= _interval;
+}
+
+void WinToastUpdateCoalescer::take(_Inout_ Entry& entry, _In_ std::int64_t id, _In_ std::int64_t now, _Out_ Send& send) {
+    if (entry.pending) {
+        entry.pending = false;
+        _pending--;
+    }
+    entry.everSent = true;
+    entry.lastSentAt = now;
+    send.id = id;
+    send.tag = entry.tag;
+    send.group = entry.group;
+    send.data = std::move(entry.data);
+    send.data.sequence = ++entry.sequence;
+    entry.data = WinToastNotificationData();
+}
+
+void WinToastUpdateCoalescer::deliver(_In_ const Send& send) {
+    const long hr = _send(send.tag, send.group, send.data);
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (hr >= 0) {
+        _counters.sent++;
+        return;
+    }
+    _counters.failed++;
+    if (hr == IWinToastBackend::UpdateNotFound) {
+        // Dismissed, activated or expired: nothing left to update.
+        auto found = _entries.find(send.id);
+        if (found != _entries.end() && found->second.tag == send.tag && found->second.group == send.group) {
+            if (found->second.pending) {
+                _pending--;
+            }
+            _entries.erase(found);
+            _counters.lost++;
+        }
+    }
+}
+
+void WinToastUpdateCoalescer::flusherLoop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stopping) {
+        if (_due.empty()) {
+            _wakeup.wait(lock);
+            continue;
+        }
+        const std::int64_t wait = _due.front().at - _clock->nowMicroseconds();
+        if (wait > 0) {
+            _wakeup.wait_for(lock, std::chrono::microseconds(wait));
+            continue;
+        }
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
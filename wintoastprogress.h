@@ -0,0 +1,121 @@
+#ifndef WINTOASTPROGRESS_H
+#define WINTOASTPROGRESS_H
+#include "wintoastbackend.h"
+#include "wintoastclock.h"
+#include <condition_variable>
+#include <functional>
+#include <thread>
+
+namespace WinToastLib {
+
+    // What the bar of a progress toast shows. Every field is bound data (see
+    // WinToastPayload::compile), so all of them can change while the toast is
+    // on screen.
+    struct WinToastProgressBar {
+        std::wstring            title;          // above the bar; may be empty
+        double                  value = 0;      // 0..1; negative shows an indeterminate bar
+        std::wstring            valueString;    // shown instead of the percentage, e.g. "3/10 files"
+        std::wstring            status;         // below the bar, e.g. "Uploading..."
+
+        // Values for the payload's {progressTitle}, {progressValue},
+        // {progressValueString} and {progressStatus} placeholders.
+        WinToastNotificationData data() const;
+    };
+
+    // Throttles in-place updates of tagged notifications. update() only records
+    // a toast's latest data; that data reaches the platform at most
+    // maxUpdatesPerSecond times per toast: straight away when the toast's last
+    // platform update is old enough, otherwise from flush() (or the flusher
+    // thread) as soon as it is. Values replaced in between are never sent, and
+    // every update carries a higher sequence than the one before, so the
+    // platform drops an older one that arrives late.
+    class WinToastUpdateCoalescer {
+    public:
+        // Same contract as IWinToastBackend::update.
+        typedef std::function<long(const std::wstring& tag, const std::wstring& group, const WinToastNotificationData& data)> UpdateFunction;
+
+        struct Options {
+            double              maxUpdatesPerSecond = 4.0;  // per toast; <= 0 sends every update
+        };
+
+        struct Counters {
+            std::uint64_t       submitted;      // update() calls for tracked toasts
+            std::uint64_t       sent;           // platform updates that succeeded
+            std::uint64_t       coalesced;      // values replaced before they were sent
+            std::uint64_t       failed;         // platform updates that failed
+            std::uint64_t       lost;           // toasts untracked because the platform no longer had them
+            std::size_t         tracked;
+            std::size_t         pending;        // toasts with data waiting for their next slot
+        };
+
+        explicit WinToastUpdateCoalescer(_In_ UpdateFunction send, _In_opt_ std::shared_ptr<IWinToastClock> clock = nullptr);
+        WinToastUpdateCoalescer(_In_ UpdateFunction send, _In_ const Options& options, _In_opt_ std::shared_ptr<IWinToastClock> clock = nullptr);
+        // Stops the flusher thread; pending data is dropped.
+        ~WinToastUpdateCoalescer();
+        WinToastUpdateCoalescer(const WinToastUpdateCoalescer&) = delete;
+        WinToastUpdateCoalescer& operator=(const WinToastUpdateCoalescer&) = delete;
+
+        // Starts coalescing updates for the toast shown as id under tag and
+        // group. Its first update may go out right away.
+        void                    track(_In_ std::int64_t id, _In_ const std::wstring& tag, _In_ const std::wstring& group);
+        void                    untrack(_In_ std::int64_t id);
+        // Records data (its sequence is assigned here) as the latest for id and
+        // sends it if the toast's slot is free. False when id is not tracked.
+        bool                    update(_In_ std::int64_t id, _In_ WinToastNotificationData data);
+        // Sends every pending update whose slot has come, on the calling thread.
+        // Returns how many were sent.
+        std::size_t             flush();
+        // Microseconds until flush() could send something; -1 when nothing is pending.
+        std::int64_t            nextFlushIn() const;
+        // Starts a thread that flushes as slots come up, on the steady clock.
+        void                    start();
+        void                    stop();
+
+        void                    setMaxUpdatesPerSecond(_In_ double maxUpdatesPerSecond);
+        Counters                counters() const;
+
+    private:
+        struct Entry {
+            std::wstring                tag;
+            std::wstring                group;
+            std::uint32_t               sequence = 0;       // last one handed out
+            std::int64_t                lastSentAt = 0;
+            bool                        everSent = false;
+            bool                        pending = false;
+            WinToastNotificationData    data;
+        };
+
+        // A pending toast and when its next slot comes; stale once the toast
+        // is sent or untracked in the meantime.
+        struct Due {
+            std::int64_t                at;
+            std::int64_t                id;
+        };
+
+        struct Send {
+            std::int64_t                id;
+            std::wstring                tag;
+            std::wstring                group;
+            WinToastNotificationData    data;
+        };
+
+        bool                    slotFree(_In_ const Entry& entry, _In_ std::int64_t now) const;
+        void                    take(_Inout_ Entry& entry, _In_ std::int64_t id, _In_ std::int64_t now, _Out_ Send& send);
+        void                    deliver(_In_ const Send& send);
+        static bool             later(_In_ const Due& a, _In_ const Due& b) { return a.at > b.at; }
+        void                    flusherLoop();
+
+        UpdateFunction          _send;
+        std::shared_ptr<IWinToastClock> _clock;
+        mutable std::mutex      _mutex;
+        std::condition_variable _wakeup;
+        std::int64_t            _interval;          // microseconds between a toast's updates
+        std::unordered_map<std::int64_t, Entry> _entries;
+        std::vector<Due>        _due;               // min-heap on at
+        std::size_t             _pending = 0;
+        Counters                _counters = {};
+        bool                    _stopping = true;
+        std::thread             _flusher;
+    };
+}
+#endif // WINTOASTPROGRESS_H
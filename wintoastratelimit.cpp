@@ -0,0 +1,210 @@
+#include "wintoastratelimit.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace WinToastLib;
+
+WinToastRateLimiter::WinToastRateLimiter(_In_opt_ std::shared_ptr<IWinToastClock> clock) :
+    _clock(clock ? std::move(clock) : WinToastSteadyClock::instance())
+{
+    BucketConfig unlimited;
+    unlimited.ratePerSecond = 0;
+    _global = makeBucket(unlimited, _clock->nowMicroseconds());
+}
+
+WinToastRateLimiter::Bucket WinToastRateLimiter::makeBucket(_In_ const BucketConfig& config, _In_ std::int64_t now) {
+    Bucket bucket;
+    bucket.config = config;
+    bucket.config.burst = std::max(config.burst, 1.0);
+    bucket.tokens = bucket.config.burst;
+    bucket.updatedAt = now;
+    bucket.queued = 0;
+    return bucket;
+}
+
+void WinToastRateLimiter::setGlobal(_In_ const BucketConfig& config) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Bucket bucket = makeBucket(config, _clock->nowMicroseconds());
+    bucket.tokens = std::min(bucket.tokens, _global.tokens);
+    bucket.queued = _global.queued;
+    _global = bucket;
+}
+
+void WinToastRateLimiter::setDefaultSource(_In_ const BucketConfig& config) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _defaultSource = config;
+}
+
+void WinToastRateLimiter::setSource(_In_ const std::wstring& source, _In_ const BucketConfig& config) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Bucket bucket = makeBucket(config, _clock->nowMicroseconds());
+    auto it = _sources.find(source);
+    if (it != _sources.end()) {
+        bucket.tokens = std::min(bucket.tokens, it->second.tokens);
+        bucket.queued = it->second.queued;
+        it->second = bucket;
+    } else {
+        _sources.emplace(source, bucket);
+    }
+}
+
+WinToastRateLimiter::Bucket& WinToastRateLimiter::sourceBucket(_In_ const std::wstring& source) {
+    auto it = _sources.find(source);
+    if (it == _sources.end()) {
+        it = _sources.emplace(source, makeBucket(_defaultSource, _clock->nowMicroseconds())).first;
+    }
+    return it->second;
+}
+
+void WinToastRateLimiter::refill(_Inout_ Bucket& bucket, _In_ std::int64_t now) const {
+    if (bucket.config.ratePerSecond <= 0 || now <= bucket.updatedAt) {
+        return;
+    }
+    const double earned = static_cast<double>(now - bucket.updatedAt) * bucket.config.ratePerSecond / 1000000.0;
+    bucket.tokens = std::min(bucket.config.burst, bucket.tokens + earned);
+    bucket.updatedAt = now;
+}
+
+bool WinToastRateLimiter::hasToken(_In_ const Bucket& bucket) {
+    return bucket.config.ratePerSecond <= 0 || bucket.tokens >= 1.0;
+}
+
+void WinToastRateLimiter::takeToken(_Inout_ Bucket& bucket) {
+    if (bucket.config.ratePerSecond > 0) {
+        bucket.tokens -= 1.0;
+    }
+}
+
+std::int64_t WinToastRateLimiter::waitFor(_In_ const Bucket& bucket) {
+    if (hasToken(bucket)) {
+        return 0;
+    }
+    return static_cast<std::int64_t>(std::ceil((1.0 - bucket.tokens) * 1000000.0 / bucket.config.ratePerSecond));
+}
+
+WinToastRateLimiter::Decision WinToastRateLimiter::admit(_In_ const std::wstring& source) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::int64_t now = _clock->nowMicroseconds();
+    Bucket& bucket = sourceBucket(source);
+    refill(bucket, now);
+    refill(_global, now);
+
+    // A bucket with a backlog is treated as empty so new toasts never overtake
+    // delayed ones.
+    Bucket* blocked = nullptr;
+    if (!hasToken(bucket) || bucket.queued > 0) {
+        blocked = &bucket;
+    } else if (!hasToken(_global) || _global.queued > 0) {
+        blocked = &_global;
+    }
+
+    if (!blocked) {
+        takeToken(bucket);
+        takeToken(_global);
+        _counters.admitted++;
+        return Admitted;
+    }
+    switch (blocked->config.policy) {
+    case Delay:
+        return MustQueue;
+    case Reject:
+        _counters.rejected++;
+        return Rejected;
+    default:
+        _counters.dropped++;
+        return Dropped;
+    }
+}
+
+bool WinToastRateLimiter::enqueue(_In_ const std::wstring& source, _In_ std::function<void()> send, _In_ std::int64_t tag) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Bucket& bucket = sourceBucket(source);
+    const bool global = hasToken(bucket) && bucket.queued == 0;
+    Bucket& owner = global ? _global : bucket;
+    if (owner.queued >= owner.config.queueCapacity) {
+        _counters.dropped++;
+        return false;
+    }
+    owner.queued++;
+    _pending.push_back(Pending{ source, global, tag, std::move(send) });
+    _counters.queued++;
+    return true;
+}
+
+bool WinToastRateLimiter::withdraw(_In_ std::int64_t tag) {
+    if (tag == 0) {
+        return false;
+    }
+    // The send (and whatever it holds) is released outside the lock.
+    std::function<void()> send;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = std::find_if(_pending.begin(), _pending.end(), [tag](const Pending& pending) { return pending.tag == tag; });
+    if (it == _pending.end()) {
+        return false;
+    }
+    (it->global ? _global : sourceBucket(it->source)).queued--;
+    send.swap(it->send);
+    _pending.erase(it);
+    _counters.withdrawn++;
+    return true;
+}
+
+std::size_t WinToastRateLimiter::drain() {
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_pending.empty()) {
+            return 0;
+        }
+        const std::int64_t now = _clock->nowMicroseconds();
+        refill(_global, now);
+
+        std::deque<Pending> waiting;
+        for (auto& pending : _pending) {
+            Bucket& bucket = sourceBucket(pending.source);
+            refill(bucket, now);
+            if (!hasToken(_global) || !hasToken(bucket)) {
+                waiting.push_back(std::move(pending));
+                continue;
+            }
+            takeToken(bucket);
+            takeToken(_global);
+            (pending.global ? _global : bucket).queued--;
+            ready.push_back(std::move(pending.send));
+        }
+        _pending.swap(waiting);
+        _counters.released += ready.size();
+    }
+
+    // Sends run outside the lock; they may well call back into admit().
+    for (auto& send : ready) {
+        send();
+    }
+    return ready.size();
+}
+
+std::int64_t WinToastRateLimiter::nextReleaseIn() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_pending.empty()) {
+        return -1;
+    }
+    const std::int64_t now = _clock->nowMicroseconds();
+    refill(_global, now);
+    std::int64_t soonest = -1;
+    for (const auto& pending : _pending) {
+        Bucket& bucket = sourceBucket(pending.source);
+        refill(bucket, now);
+        const std::int64_t wait = std::max(waitFor(bucket), waitFor(_global));
+        if (soonest < 0 || wait < soonest) {
+            soonest = wait;
+        }
+    }
+    return soonest;
+}
+
+WinToastRateLimiter::Counters WinToastRateLimiter::counters() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Counters counters = _counters;
+    counters.queueDepth = _pending.size();
+    return counters;
+}
@@ -0,0 +1,96 @@
+#ifndef WINTOASTRATELIMIT_H
+#define WINTOASTRATELIMIT_H
+#include "wintoastclock.h"
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace WinToastLib {
+
+    // Token buckets in front of the notifier: one per source tag (see
+    // WinToastTemplate::setSource) plus a global ceiling shared by all sources.
+    // A toast goes out only if both its source bucket and the global bucket hold
+    // a token. Otherwise the policy of the bucket that ran dry applies:
+    //  - Drop:   the toast is discarded
+    //  - Delay:  the toast waits in that bucket's bounded queue until drain()
+    //            finds tokens for it; a full queue drops it
+    //  - Reject: the caller gets a distinct error and is expected to back off
+    class WinToastRateLimiter {
+    public:
+        enum Policy { Drop = 0, Delay, Reject };
+        enum Decision { Admitted = 0, MustQueue, Dropped, Rejected };
+
+        struct BucketConfig {
+            double              ratePerSecond = 10.0;   // sustained rate; <= 0 means unlimited
+            double              burst = 10.0;           // bucket size
+            Policy              policy = Delay;
+            std::size_t         queueCapacity = 64;     // Delay only
+        };
+
+        struct Counters {
+            std::uint64_t       admitted;
+            std::uint64_t       queued;
+            std::uint64_t       released;
+            std::uint64_t       dropped;
+            std::uint64_t       rejected;
+            std::uint64_t       withdrawn;      // queued sends taken back with withdraw()
+            std::size_t         queueDepth;
+        };
+
+        explicit WinToastRateLimiter(_In_opt_ std::shared_ptr<IWinToastClock> clock = nullptr);
+
+        void                    setGlobal(_In_ const BucketConfig& config);
+        // Config for sources without one of their own.
+        void                    setDefaultSource(_In_ const BucketConfig& config);
+        void                    setSource(_In_ const std::wstring& source, _In_ const BucketConfig& config);
+
+        // Takes a token for source if one is available. MustQueue means the
+        // toast should be handed to enqueue().
+        Decision                admit(_In_ const std::wstring& source);
+        // Parks a delayed send. Returns false (and counts a drop) when the
+        // bucket's queue is full. A non-zero tag lets withdraw() find it again.
+        bool                    enqueue(_In_ const std::wstring& source, _In_ std::function<void()> send, _In_ std::int64_t tag = 0);
+        // Discards the queued send enqueued with tag, without running it. Returns
+        // false when there is none (never queued, or already released).
+        bool                    withdraw(_In_ std::int64_t tag);
+        // Runs every queued send whose buckets have refilled, oldest first, on the
+        // calling thread. Returns how many were released.
+        std::size_t             drain();
+        // Microseconds until drain() could release something; -1 when nothing is queued.
+        std::int64_t            nextReleaseIn();
+
+        Counters                counters() const;
+
+    private:
+        struct Bucket {
+            BucketConfig        config;
+            double              tokens;
+            std::int64_t        updatedAt;
+            std::size_t         queued;
+        };
+
+        struct Pending {
+            std::wstring        source;
+            bool                global;         // waiting in the global queue rather than the source's
+            std::int64_t        tag;
+            std::function<void()> send;
+        };
+
+        Bucket&                 sourceBucket(_In_ const std::wstring& source);
+        void                    refill(_Inout_ Bucket& bucket, _In_ std::int64_t now) const;
+        static bool             hasToken(_In_ const Bucket& bucket);
+        static void             takeToken(_Inout_ Bucket& bucket);
+        static std::int64_t     waitFor(_In_ const Bucket& bucket);
+        static Bucket           makeBucket(_In_ const BucketConfig& config, _In_ std::int64_t now);
+
+        mutable std::mutex      _mutex;
+        std::shared_ptr<IWinToastClock> _clock;
+        Bucket                  _global;
+        BucketConfig            _defaultSource;
+        std::unordered_map<std::wstring, Bucket> _sources;
+        std::deque<Pending>     _pending;
+        Counters                _counters = {};
+    };
+}
+#endif // WINTOASTRATELIMIT_H
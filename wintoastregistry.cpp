@@ -0,0 +1,366 @@
+#include "wintoastregistry.h"
+#include <algorithm>
+#include <functional>
+
+using namespace WinToastLib;
+
+namespace {
+    const std::size_t NotFound = static_cast<std::size_t>(-1);
+
+    inline std::size_t roundUpToPowerOfTwo(std::size_t value) {
+        std::size_t size = 8;
+        while (size < value) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    typedef std::pair<std::int64_t, std::int64_t> Expiration;
+    typedef std::greater<Expiration> EarliestFirst;
+}
+
+WinToastRegistry::WinToastRegistry(_In_ std::size_t minimumCapacity, _In_ std::size_t shards) {
+    std::size_t count = 1;
+    while (count < shards) {
+        count <<= 1;
+    }
+    _shardMask = count - 1;
+    _minimumCapacity = roundUpToPowerOfTwo((minimumCapacity + count - 1) / count);
+    _shards.reset(new Shard[count]);
+    _tagShards.reset(new TagShard[count]);
+    for (std::size_t i = 0; i < count; i++) {
+        _shards[i].slots.resize(_minimumCapacity);
+    }
+}
+
+inline std::size_t WinToastRegistry::home(_In_ const Shard& shard, _In_ std::int64_t id) {
+    // splitmix64 finalizer: sequential ids spread over the whole table.
+    std::uint64_t x = static_cast<std::uint64_t>(id);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x = x ^ (x >> 31);
+    return static_cast<std::size_t>(x) & (shard.slots.size() - 1);
+}
+
+std::int64_t WinToastRegistry::nextId() {
+    return _nextId.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+WinToastRegistry::TagShard& WinToastRegistry::tagShardOf(_In_ const std::wstring& key) const {
+    return _tagShards[std::hash<std::wstring>()(key) & _shardMask];
+}
+
+std::size_t WinToastRegistry::find(_In_ const Shard& shard, _In_ std::int64_t id) {
+    const std::size_t mask = shard.slots.size() - 1;
+    for (std::size_t i = home(shard, id);; i = (i + 1) & mask) {
+        if (shard.slots[i].id == id) {
+            return i;
+        }
+        if (shard.slots[i].id == 0) {
+            return NotFound;
+        }
+    }
+}
+
+void WinToastRegistry::place(_Inout_ Shard& shard, _Inout_ Slot& slot) {
+    const std::size_t mask = shard.slots.size() - 1;
+    std::size_t i = home(shard, slot.id);
+    while (shard.slots[i].id != 0) {
+        i = (i + 1) & mask;
+    }
+    shard.slots[i] = std::move(slot);
+}
+
+void WinToastRegistry::rehash(_Inout_ Shard& shard, _In_ std::size_t capacity) {
+    std::vector<Slot> old(capacity);
+    old.swap(shard.slots);
+    for (auto& slot : old) {
+        if (slot.id != 0) {
+            place(shard, slot);
+        }
+    }
+}
+
+void WinToastRegistry::removeAt(_Inout_ Shard& shard, _In_ std::size_t index, _Out_ std::unique_ptr<Tag>& tag) {
+    std::vector<Slot>& slots = shard.slots;
+    tag = std::move(slots[index].tag);
+    if (tag) {
+        unbindTag(*tag, slots[index].id);
+    }
+    // Backward-shift deletion: pull later members of the probe run into the hole
+    // so lookups never need tombstones.
+    const std::size_t mask = slots.size() - 1;
+    std::size_t hole = index;
+    for (std::size_t i = (hole + 1) & mask; slots[i].id != 0; i = (i + 1) & mask) {
+        const std::size_t wanted = home(shard, slots[i].id);
+        const bool canMove = (hole <= i) ? (wanted <= hole || wanted > i) : (wanted <= hole && wanted > i);
+        if (canMove) {
+            slots[hole] = std::move(slots[i]);
+            hole = i;
+        }
+    }
+    slots[hole] = Slot();
+    shard.size--;
+    _size.fetch_sub(1, std::memory_order_relaxed);
+
+    if (slots.size() > _minimumCapacity && shard.size * 8 < slots.size()) {
+        rehash(shard, slots.size() / 2);
+    }
+    if (shard.expirations.size() > 2 * shard.size + 64) {
+        compactExpirations(shard);
+    }
+}
+
+void WinToastRegistry::compactExpirations(_Inout_ Shard& shard) {
+    shard.expirations.clear();
+    for (const auto& slot : shard.slots) {
+        if (slot.id != 0 && slot.expiresAt != NoExpiration) {
+            shard.expirations.emplace_back(slot.expiresAt, slot.id);
+        }
+    }
+    std::make_heap(shard.expirations.begin(), shard.expirations.end(), EarliestFirst());
+    publishNextExpiration(shard);
+}
+
+void WinToastRegistry::publishNextExpiration(_Inout_ Shard& shard) {
+    shard.nextExpiration.store(shard.expirations.empty() ? INT64_MAX : shard.expirations.front().first, std::memory_order_relaxed);
+}
+
+void WinToastRegistry::reserve(_In_ std::int64_t id, _In_ std::int64_t expiresAt) {
+    Shard& shard = shardOf(id);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (find(shard, id) != NotFound) {
+            return;
+        }
+        if ((shard.size + 1) * 10 > shard.slots.size() * 7) {
+            rehash(shard, shard.slots.size() * 2);
+        }
+        Slot slot;
+        slot.id = id;
+        slot.expiresAt = expiresAt;
+        place(shard, slot);
+        shard.size++;
+        if (expiresAt != NoExpiration) {
+            shard.expirations.emplace_back(expiresAt, id);
+            std::push_heap(shard.expirations.begin(), shard.expirations.end(), EarliestFirst());
+            publishNextExpiration(shard);
+        }
+    }
+    const std::size_t size = _size.fetch_add(1, std::memory_order_relaxed) + 1;
+    std::size_t highWaterMark = _highWaterMark.load(std::memory_order_relaxed);
+    while (size > highWaterMark && !_highWaterMark.compare_exchange_weak(highWaterMark, size, std::memory_order_relaxed)) {
+    }
+}
+
+bool WinToastRegistry::attach(_In_ std::int64_t id, _In_ WinToastNotificationHandle notification) {
+    Shard& shard = shardOf(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const std::size_t index = find(shard, id);
+    if (index == NotFound) {
+        // Already gone: an outcome arrived before the send finished.
+        return false;
+    }
+    shard.slots[index].notification = std::move(notification);
+    return true;
+}
+
+std::size_t WinToastRegistry::attach(_Inout_ std::vector<std::pair<std::int64_t, WinToastNotificationHandle>>& notifications) {
+    std::size_t attached = 0;
+    for (std::size_t s = 0; s <= _shardMask; s++) {
+        Shard& shard = _shards[s];
+        std::unique_lock<std::mutex> lock(shard.mutex, std::defer_lock);
+        for (auto& entry : notifications) {
+            if ((static_cast<std::size_t>(entry.first) & _shardMask) != s) {
+                continue;
+            }
+            if (!lock.owns_lock()) {
+                lock.lock();
+            }
+            const std::size_t index = find(shard, entry.first);
+            if (index != NotFound) {
+                shard.slots[index].notification = std::move(entry.second);
+                attached++;
+            }
+        }
+    }
+    return attached;
+}
+
+void WinToastRegistry::insert(_In_ std::int64_t id, _In_ WinToastNotificationHandle notification, _In_ std::int64_t expiresAt) {
+    reserve(id, expiresAt);
+    attach(id, std::move(notification));
+}
+
+bool WinToastRegistry::contains(_In_ std::int64_t id) const {
+    const Shard& shard = shardOf(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return find(shard, id) != NotFound;
+}
+
+bool WinToastRegistry::take(_In_ std::int64_t id, _Out_ WinToastNotificationHandle& notification) {
+    Shard& shard = shardOf(id);
+    std::unique_ptr<Tag> tag;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const std::size_t index = find(shard, id);
+    if (index == NotFound) {
+        return false;
+    }
+    notification = std::move(shard.slots[index].notification);
+    removeAt(shard, index, tag);
+    return true;
+}
+
+bool WinToastRegistry::erase(_In_ std::int64_t id) {
+    WinToastNotificationHandle notification;
+    // The handle is released outside the lock: dropping the last reference to a
+    // platform notification may run arbitrary code.
+    return take(id, notification);
+}
+
+std::vector<WinToastNotificationHandle> WinToastRegistry::takeAll() {
+    std::vector<WinToastNotificationHandle> notifications;
+    std::vector<std::unique_ptr<Tag>> tags;
+    notifications.reserve(size());
+    for (std::size_t s = 0; s <= _shardMask; s++) {
+        Shard& shard = _shards[s];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& slot : shard.slots) {
+            if (slot.id != 0 && slot.notification) {
+                notifications.push_back(std::move(slot.notification));
+            }
+            if (slot.tag) {
+                unbindTag(*slot.tag, slot.id);
+                tags.push_back(std::move(slot.tag));
+            }
+        }
+        std::vector<Slot>(_minimumCapacity).swap(shard.slots);
+        shard.expirations.clear();
+        publishNextExpiration(shard);
+        _size.fetch_sub(shard.size, std::memory_order_relaxed);
+        shard.size = 0;
+    }
+    return notifications;
+}
+
+std::size_t WinToastRegistry::expire(_In_ std::int64_t now, _In_opt_ const std::function<void(std::int64_t id)>& onExpired) {
+    std::vector<WinToastNotificationHandle> expired;
+    std::vector<std::unique_ptr<Tag>> tags;
+    std::vector<std::int64_t> ids;
+    for (std::size_t s = 0; s <= _shardMask; s++) {
+        Shard& shard = _shards[s];
+        if (shard.nextExpiration.load(std::memory_order_relaxed) > now) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        while (!shard.expirations.empty() && shard.expirations.front().first <= now) {
+            const Expiration due = shard.expirations.front();
+            std::pop_heap(shard.expirations.begin(), shard.expirations.end(), EarliestFirst());
+            shard.expirations.pop_back();
+            const std::size_t index = find(shard, due.second);
+            // Stale heap nodes (entry already removed) are simply skipped.
+            if (index != NotFound && shard.slots[index].expiresAt == due.first) {
+                expired.push_back(std::move(shard.slots[index].notification));
+                tags.emplace_back();
+                removeAt(shard, index, tags.back());
+                if (onExpired) {
+                    ids.push_back(due.second);
+                }
+            }
+        }
+        publishNextExpiration(shard);
+    }
+    for (std::int64_t id : ids) {
+        onExpired(id);
+    }
+    return expired.size();
+}
+
+bool WinToastRegistry::bindTag(_In_ std::int64_t id, _In_ std::wstring key,
+                               _In_ std::shared_ptr<IWinToastHandler> handler, _Out_ Superseded& superseded) {
+    superseded = Superseded();
+    std::int64_t previous = 0;
+    {
+        Shard& shard = shardOf(id);
+        std::unique_ptr<Tag> tag(new Tag{ std::move(key), std::move(handler) });
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const std::size_t index = find(shard, id);
+        if (index == NotFound) {
+            // Already gone: an outcome arrived before the send finished.
+            return false;
+        }
+        Slot& slot = shard.slots[index];
+        if (slot.tag) {
+            unbindTag(*slot.tag, id);
+        }
+        TagShard& tags = tagShardOf(tag->key);
+        std::lock_guard<std::mutex> tagLock(tags.mutex);
+        auto bound = tags.ids.find(tag->key);
+        if (bound != tags.ids.end()) {
+            previous = bound->second;
+            bound->second = id;
+        } else {
+            tags.ids.emplace(tag->key, id);
+        }
+        tag.swap(slot.tag);
+    }
+    if (previous == 0) {
+        return false;
+    }
+
+    // The key now names id, so removing the older entry leaves the binding alone.
+    Shard& shard = shardOf(previous);
+    std::unique_ptr<Tag> tag;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const std::size_t index = find(shard, previous);
+    if (index == NotFound) {
+        return false;
+    }
+    superseded.id = previous;
+    superseded.notification = std::move(shard.slots[index].notification);
+    removeAt(shard, index, tag);
+    superseded.handler = std::move(tag->handler);
+    return true;
+}
+
+std::int64_t WinToastRegistry::findTag(_In_ const std::wstring& key) const {
+    const TagShard& tags = tagShardOf(key);
+    std::lock_guard<std::mutex> lock(tags.mutex);
+    auto found = tags.ids.find(key);
+    return found != tags.ids.end() ? found->second : 0;
+}
+
+std::size_t WinToastRegistry::tagged() const {
+    std::size_t tagged = 0;
+    for (std::size_t s = 0; s <= _shardMask; s++) {
+        std::lock_guard<std::mutex> lock(_tagShards[s].mutex);
+        tagged += _tagShards[s].ids.size();
+    }
+    return tagged;
+}
+
+void WinToastRegistry::unbindTag(_In_ const Tag& tag, _In_ std::int64_t id) {
+    TagShard& tags = tagShardOf(tag.key);
+    std::lock_guard<std::mutex> lock(tags.mutex);
+    auto found = tags.ids.find(tag.key);
+    if (found != tags.ids.end() && found->second == id) {
+        tags.ids.erase(found);
+    }
+}
+
+std::size_t WinToastRegistry::size() const {
+    return _size.load(std::memory_order_relaxed);
+}
+
+std::size_t WinToastRegistry::highWaterMark() const {
+    return _highWaterMark.load(std::memory_order_relaxed);
+}
+
+std::size_t WinToastRegistry::capacity() const {
+    std::size_t capacity = 0;
+    for (std::size_t s = 0; s <= _shardMask; s++) {
+        std::lock_guard<std::mutex> lock(_shards[s].mutex);
+        capacity += _shards[s].slots.size();
+    }
+    return capacity;
+}
@@ -0,0 +1,138 @@
+#ifndef WINTOASTREGISTRY_H
+#define WINTOASTREGISTRY_H
+#include "wintoastbackend.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace WinToastLib {
+
+    // Live toasts by id. Ids are handed out from a 64-bit atomic counter, so they
+    // are unique for the life of the registry and cost no lock. Entries are
+    // spread over shards by id (consecutive ids land in different shards), each
+    // an open-addressing table (linear probing, backward-shift deletion) behind
+    // its own lock, so threads sending or completing different toasts rarely
+    // wait for each other. Entries are dropped when the toast reports an
+    // outcome, is hidden, or its expiration passes. Each shard keeps its
+    // expirations in a min-heap, so expire() only looks at entries that are due.
+    //
+    // Entries of tagged toasts can also be bound to their tag and group, in a
+    // second set of shards keyed by tag (see bindTag). Binding a key that is
+    // already bound takes the older entry out, the way the platform replaces a
+    // notification shown again under the same tag and group. Bindings leave
+    // with their entry, however it goes.
+    //
+    // Every method may be called from any thread. Time values are opaque to the
+    // registry: expiresAt and now only have to use the same clock (WinToast uses
+    // FILETIME ticks, see MyDateTime).
+    class WinToastRegistry {
+    public:
+        static const std::int64_t               NoExpiration = 0;
+        static const std::size_t                DefaultShards = 16;
+
+        // The entry bindTag took out because its key was bound to another id.
+        struct Superseded {
+            std::int64_t                        id = 0;
+            WinToastNotificationHandle          notification;
+            std::shared_ptr<IWinToastHandler>   handler;
+        };
+
+        // minimumCapacity is for the whole registry; shards is rounded up to a
+        // power of two.
+        explicit WinToastRegistry(_In_ std::size_t minimumCapacity = 16, _In_ std::size_t shards = DefaultShards);
+
+        std::int64_t                            nextId();
+        // Tracks id before its notification exists, so an outcome racing with the
+        // send still finds (and removes) it. attach() fills the handle in later.
+        void                                    reserve(_In_ std::int64_t id, _In_ std::int64_t expiresAt = NoExpiration);
+        bool                                    attach(_In_ std::int64_t id, _In_ WinToastNotificationHandle notification);
+        // Attaches a whole batch, taking each shard's lock once.
+        std::size_t                             attach(_Inout_ std::vector<std::pair<std::int64_t, WinToastNotificationHandle>>& notifications);
+        void                                    insert(_In_ std::int64_t id, _In_ WinToastNotificationHandle notification, _In_ std::int64_t expiresAt = NoExpiration);
+
+        bool                                    contains(_In_ std::int64_t id) const;
+        bool                                    take(_In_ std::int64_t id, _Out_ WinToastNotificationHandle& notification);
+        bool                                    erase(_In_ std::int64_t id);
+        // Empties the registry one shard at a time; entries added meanwhile to a
+        // shard already emptied stay.
+        std::vector<WinToastNotificationHandle> takeAll();
+        // Drops every entry whose expiration is <= now. Returns how many were
+        // dropped. onExpired, when given, is called with each of their ids once
+        // every lock is released.
+        std::size_t                             expire(_In_ std::int64_t now, _In_opt_ const std::function<void(std::int64_t id)>& onExpired = nullptr);
+
+        // Binds key (see IWinToastBackend::tagKey) to id, which must be tracked,
+        // together with the handler its outcomes go to. An entry bound to key
+        // before is taken out into superseded, so the caller can report it and
+        // release it after every lock is dropped; returns whether there was one.
+        // Nothing is bound when id is no longer tracked.
+        bool                                    bindTag(_In_ std::int64_t id, _In_ std::wstring key,
+                                                        _In_ std::shared_ptr<IWinToastHandler> handler, _Out_ Superseded& superseded);
+        // Id bound to key, or 0.
+        std::int64_t                            findTag(_In_ const std::wstring& key) const;
+        std::size_t                             tagged() const;
+
+        // size and highWaterMark never lock; while other threads change the
+        // registry they are a recent value rather than an exact one.
+        std::size_t                             size() const;
+        std::size_t                             highWaterMark() const;
+        std::size_t                             capacity() const;
+        inline std::size_t                      shards() const { return _shardMask + 1; }
+
+    private:
+        struct Tag {
+            std::wstring                        key;
+            std::shared_ptr<IWinToastHandler>   handler;
+        };
+
+        struct Slot {
+            std::int64_t                        id = 0;             // 0 marks an empty slot
+            std::int64_t                        expiresAt = NoExpiration;
+            WinToastNotificationHandle          notification;
+            std::unique_ptr<Tag>                tag;                // set once bound
+        };
+
+        struct Shard {
+            mutable std::mutex                  mutex;
+            std::vector<Slot>                   slots;
+            std::vector<std::pair<std::int64_t, std::int64_t>> expirations;   // (expiresAt, id) min-heap
+            std::size_t                         size = 0;
+            // Earliest expiration in the heap, readable without the lock so
+            // expire() skips shards with nothing due.
+            std::atomic<std::int64_t>           nextExpiration{ INT64_MAX };
+        };
+
+        struct TagShard {
+            mutable std::mutex                  mutex;
+            std::unordered_map<std::wstring, std::int64_t> ids;
+        };
+
+        inline Shard&                           shardOf(_In_ std::int64_t id) const { return _shards[static_cast<std::size_t>(id) & _shardMask]; }
+        TagShard&                               tagShardOf(_In_ const std::wstring& key) const;
+        static std::size_t                      find(_In_ const Shard& shard, _In_ std::int64_t id);
+        static void                             place(_Inout_ Shard& shard, _Inout_ Slot& slot);
+        // Unbinds the slot's tag and hands it to the caller, to be released once
+        // the shard lock is dropped.
+        void                                    removeAt(_Inout_ Shard& shard, _In_ std::size_t index, _Out_ std::unique_ptr<Tag>& tag);
+        void                                    unbindTag(_In_ const Tag& tag, _In_ std::int64_t id);
+        static void                             rehash(_Inout_ Shard& shard, _In_ std::size_t capacity);
+        static void                             compactExpirations(_Inout_ Shard& shard);
+        static void                             publishNextExpiration(_Inout_ Shard& shard);
+        static inline std::size_t               home(_In_ const Shard& shard, _In_ std::int64_t id);
+
+        std::unique_ptr<Shard[]>                _shards;
+        // Same count as _shards. An entry's lock is always taken before its tag's.
+        std::unique_ptr<TagShard[]>             _tagShards;
+        std::size_t                             _shardMask;
+        std::size_t                             _minimumCapacity;   // per shard
+        std::atomic<std::int64_t>               _nextId{ 0 };
+        std::atomic<std::size_t>                _size{ 0 };
+        std::atomic<std::size_t>                _highWaterMark{ 0 };
+    };
+}
+#endif // WINTOASTREGISTRY_H
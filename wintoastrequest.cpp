@@ -0,0 +1,583 @@
+#include "wintoastrequest.h"
+#include <atomic>
+#include <chrono>
+#include <cwchar>
+#include <cwctype>
+#include <iostream>
+#include <memory>
+
+using namespace WinToastLib;
+
+const wchar_t WinToastRequest::DefaultText[] = L"Very Important Reminder";
+const wchar_t WinToastRequest::DefaultAttribute[] = L"Don't worry, be happy!";
+
+std::vector<std::wstring> WinToastLib::splitArguments(_In_ const std::wstring& line) {
+    std::vector<std::wstring> args;
+    std::wstring current;
+    bool inQuotes = false;
+    bool hasArgument = false;
+    for (std::size_t i = 0; i < line.size(); i++) {
+        const wchar_t c = line[i];
+        if (c == L'\\' && i + 1 < line.size() && line[i + 1] == L'"') {
+            current.push_back(L'"');
+            hasArgument = true;
+            i++;
+        } else if (c == L'"') {
+            inQuotes = !inQuotes;
+            hasArgument = true;
+        } else if (!inQuotes && (c == L' ' || c == L'\t' || c == L'\r' || c == L'\n')) {
+            if (hasArgument) {
+                args.push_back(current);
+                current.clear();
+                hasArgument = false;
+            }
+        } else {
+            current.push_back(c);
+            hasArgument = true;
+        }
+    }
+    if (hasArgument) {
+        args.push_back(current);
+    }
+    return args;
+}
+
+WinToastRequest::SwitchResult WinToastRequest::parseSwitch(_In_ const std::vector<std::wstring>& args, _Inout_ std::size_t& i) {
+    const std::wstring& name = args[i];
+    const bool known = name == L"--id" || name == L"--text" || name == L"--attribute" || name == L"--action"
+                    || name == L"--image" || name == L"--expires" || name == L"--audio-state"
+                    || name == L"--tag" || name == L"--group";
+    if (!known) {
+        return NotAToastSwitch;
+    }
+    if (i + 1 >= args.size()) {
+        return MissingValue;
+    }
+    const std::wstring& value = args[++i];
+    i++;
+
+    if (name == L"--id") {
+        id = value;
+    } else if (name == L"--text") {
+        text = value;
+        hasText = true;
+    } else if (name == L"--attribute") {
+        attribute = value;
+        hasAttribute = true;
+    } else if (name == L"--action") {
+        actions.push_back(value);
+    } else if (name == L"--image") {
+        imagePath = value;
+    } else if (name == L"--expires") {
+        expiration = std::wcstoll(value.c_str(), nullptr, 10);
+    } else if (name == L"--tag") {
+        tag = value;
+    } else if (name == L"--group") {
+        group = value;
+    } else {
+        wchar_t* end = nullptr;
+        const long option = std::wcstol(value.c_str(), &end, 10);
+        if (end == value.c_str() || option < WinToastTemplate::Default || option > WinToastTemplate::Loop) {
+            return BadValue;
+        }
+        audioOption = static_cast<WinToastTemplate::AudioOption>(option);
+    }
+    return Consumed;
+}
+
+bool WinToastRequest::parseLine(_In_ const std::wstring& line, _Out_ std::wstring& error) {
+    const std::vector<std::wstring> args = splitArguments(line);
+    std::size_t i = 0;
+    while (i < args.size()) {
+        switch (parseSwitch(args, i)) {
+        case Consumed:
+            break;
+        case NotAToastSwitch:
+            error = L"option not recognized: " + args[i];
+            return false;
+        case MissingValue:
+            error = L"missing value for " + args[i];
+            return false;
+        default:
+            error = L"bad value for " + args[i - 2];
+            return false;
+        }
+    }
+    return true;
+}
+
+WinToastTemplate WinToastRequest::toTemplate() const {
+    const bool withImage = !imagePath.empty();
+    WinToastTemplate templ(withImage ? WinToastTemplate::ImageAndText02 : WinToastTemplate::Text02);
+    templ.setTextField(hasText ? text : DefaultText, WinToastTemplate::FirstLine);
+    templ.setAudioOption(audioOption);
+    templ.setAttributionText(hasAttribute ? attribute : DefaultAttribute);
+    for (auto const &action : actions)
+        templ.addAction(action);
+    templ.setExpiration(expiration * 1000);
+    if (withImage)
+        templ.setImagePath(imagePath);
+    templ.setTag(tag).setGroup(group);
+    return templ;
+}
+
+namespace {
+    void appendCodePoint(_Inout_ std::wstring& out, _In_ std::uint32_t code) {
+        if (sizeof(wchar_t) == 2 && code > 0xffff) {
+            code -= 0x10000;
+            out.push_back(static_cast<wchar_t>(0xd800 + (code >> 10)));
+            out.push_back(static_cast<wchar_t>(0xdc00 + (code & 0x3ff)));
+        } else {
+            out.push_back(static_cast<wchar_t>(code));
+        }
+    }
+
+    // Lenient UTF-8 decoding: malformed sequences become U+FFFD.
+    std::wstring decodeUtf8(_In_ const std::string& bytes) {
+        std::wstring out;
+        out.reserve(bytes.size());
+        for (std::size_t i = 0; i < bytes.size();) {
+            const unsigned char lead = static_cast<unsigned char>(bytes[i]);
+            const std::size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xe ? 3 : (lead >> 3) == 0x1e ? 4 : 0;
+            std::uint32_t code = length == 1 ? lead : length == 2 ? lead & 0x1f : length == 3 ? lead & 0x0f : lead & 0x07;
+            bool valid = length > 0 && i + length <= bytes.size();
+            for (std::size_t k = 1; valid && k < length; k++) {
+                const unsigned char next = static_cast<unsigned char>(bytes[i + k]);
+                valid = (next >> 6) == 0x2;
+                code = (code << 6) | (next & 0x3f);
+            }
+            if (valid && code <= 0x10ffff && !(code >= 0xd800 && code <= 0xdfff)) {
+                appendCodePoint(out, code);
+                i += length;
+            } else {
+                out.push_back(0xfffd);
+                i++;
+            }
+        }
+        return out;
+    }
+
+    // Batch fields are the switches without their dashes; parseSwitch checks them.
+    bool applyField(_Inout_ WinToastRequest& request, _In_ const std::wstring& name, _In_ const std::wstring& value, _Out_ std::wstring& error) {
+        const std::vector<std::wstring> args = { L"--" + name, value };
+        std::size_t i = 0;
+        switch (request.parseSwitch(args, i)) {
+        case WinToastRequest::Consumed:
+            return true;
+        case WinToastRequest::NotAToastSwitch:
+            error = L"field not recognized: " + name;
+            return false;
+        default:
+            error = L"bad value for " + name;
+            return false;
+        }
+    }
+
+    // Just enough JSON for one flat object per line: string keys, string or
+    // number values, arrays of strings, null.
+    class JsonLine {
+    public:
+        explicit JsonLine(const std::wstring& text) : _text(text) {}
+
+        bool parse(_Inout_ WinToastRequest& request, _Out_ std::wstring& error) {
+            if (!consume(L'{')) {
+                return fail(L"expected '{'", error);
+            }
+            if (!consume(L'}')) {
+                do {
+                    std::wstring name;
+                    if (!string(name) || !consume(L':')) {
+                        return fail(L"expected \"name\":", error);
+                    }
+                    if (!value(request, name, error)) {
+                        return false;
+                    }
+                } while (consume(L','));
+                if (!consume(L'}')) {
+                    return fail(L"expected ',' or '}'", error);
+                }
+            }
+            skipSpace();
+            return _position == _text.size() || fail(L"text after the object", error);
+        }
+
+    private:
+        bool value(_Inout_ WinToastRequest& request, _In_ const std::wstring& name, _Out_ std::wstring& error) {
+            std::wstring text;
+            skipSpace();
+            if (consume(L'[')) {
+                if (consume(L']')) {
+                    return true;
+                }
+                do {
+                    if (!string(text)) {
+                        return fail(L"expected a string in " + name, error);
+                    }
+                    if (!applyField(request, name, text, error)) {
+                        return false;
+                    }
+                } while (consume(L','));
+                return consume(L']') || fail(L"expected ',' or ']' in " + name, error);
+            }
+            if (_position < _text.size() && _text[_position] == L'"') {
+                return string(text) ? applyField(request, name, text, error) : fail(L"unterminated string in " + name, error);
+            }
+            if (_text.compare(_position, 4, L"null") == 0) {
+                _position += 4;
+                return true;
+            }
+            const std::size_t start = _position;
+            while (_position < _text.size() && std::wcschr(L"+-.0123456789eE", _text[_position]) && _text[_position] != L'\0') {
+                _position++;
+            }
+            if (_position == start) {
+                return fail(L"bad value for " + name, error);
+            }
+            return applyField(request, name, _text.substr(start, _position - start), error);
+        }
+
+        bool string(_Out_ std::wstring& out) {
+            out.clear();
+            skipSpace();
+            if (_position >= _text.size() || _text[_position] != L'"') {
+                return false;
+            }
+            for (_position++; _position < _text.size(); _position++) {
+                wchar_t c = _text[_position];
+                if (c == L'"') {
+                    _position++;
+                    return true;
+                }
+                if (c != L'\\') {
+                    out.push_back(c);
+                    continue;
+                }
+                if (++_position >= _text.size()) {
+                    return false;
+                }
+                switch (c = _text[_position]) {
+                case L'b': out.push_back(L'\b'); break;
+                case L'f': out.push_back(L'\f'); break;
+                case L'n': out.push_back(L'\n'); break;
+                case L'r': out.push_back(L'\r'); break;
+                case L't': out.push_back(L'\t'); break;
+                case L'u': {
+                    std::uint32_t code;
+                    if (!hex(code)) {
+                        return false;
+                    }
+                    // A surrogate pair arrives as two escapes.
+                    const std::size_t mark = _position;
+                    std::uint32_t low;
+                    if (code >= 0xd800 && code < 0xdc00 && _text.compare(_position + 1, 2, L"\\u") == 0 && (_position += 2, hex(low))
+                        && low >= 0xdc00 && low <= 0xdfff) {
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    } else {
+                        _position = mark;
+                    }
+                    appendCodePoint(out, code);
+                    break;
+                }
+                default:
+                    out.push_back(c);       // \" \\ \/
+                    break;
+                }
+            }
+            return false;
+        }
+
+        // Reads the four digits after \u; leaves _position on the last one.
+        bool hex(_Out_ std::uint32_t& code) {
+            code = 0;
+            for (int digit = 0; digit < 4; digit++) {
+                if (++_position >= _text.size() || !std::iswxdigit(_text[_position])) {
+                    return false;
+                }
+                const wchar_t c = _text[_position];
+                code = code * 16 + (c <= L'9' ? c - L'0' : (c | 0x20) - L'a' + 10);
+            }
+            return true;
+        }
+
+        bool consume(_In_ wchar_t c) {
+            skipSpace();
+            if (_position < _text.size() && _text[_position] == c) {
+                _position++;
+                return true;
+            }
+            return false;
+        }
+
+        void skipSpace() {
+            while (_position < _text.size() && std::iswspace(_text[_position])) {
+                _position++;
+            }
+        }
+
+        bool fail(_In_ const std::wstring& message, _Out_ std::wstring& error) {
+            error = message + L" at column " + std::to_wstring(_position + 1);
+            return false;
+        }
+
+        const std::wstring&     _text;
+        std::size_t             _position = 0;
+    };
+}
+
+WinToastBatchReader::WinToastBatchReader(_In_ std::istream& in) : _in(in) {}
+
+bool WinToastBatchReader::readLine(_Out_ std::wstring& line) {
+    std::string bytes;
+    if (!std::getline(_in, bytes)) {
+        return false;
+    }
+    if (!bytes.empty() && bytes.back() == '\r') {
+        bytes.pop_back();
+    }
+    if (_format == Unknown && bytes.compare(0, 3, "\xef\xbb\xbf") == 0) {
+        bytes.erase(0, 3);
+    }
+    line = decodeUtf8(bytes);
+    return true;
+}
+
+bool WinToastBatchReader::next(_Out_ WinToastRequest& request, _Out_ std::wstring& error) {
+    request = WinToastRequest();
+    error.clear();
+    std::wstring line;
+    while (readLine(line)) {
+        const std::size_t start = line.find_first_not_of(L" \t");
+        if (start == std::wstring::npos || line[start] == L'#') {
+            continue;
+        }
+        if (_format == Unknown) {
+            _format = line[start] == L'{' ? JsonLines : Csv;
+            if (_format == Csv) {
+                if (!parseCsv(line, _columns, error)) {
+                    _record++;
+                    return true;
+                }
+                for (std::wstring& column : _columns) {
+                    column.erase(0, column.find_first_not_of(L" \t"));
+                    column.erase(column.find_last_not_of(L" \t") + 1);
+                }
+                continue;
+            }
+        }
+        _record++;
+        if (_format == JsonLines) {
+            JsonLine(line).parse(request, error);
+            return true;
+        }
+        std::vector<std::wstring> fields;
+        if (!parseCsv(std::move(line), fields, error)) {
+            return true;
+        }
+        if (fields.size() > _columns.size()) {
+            error = L"more fields than columns";
+            return true;
+        }
+        for (std::size_t field = 0; field < fields.size(); field++) {
+            // Empty cells leave the switch unset, as if it was not given.
+            if (!fields[field].empty() && !applyField(request, _columns[field], fields[field], error)) {
+                return true;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+bool WinToastBatchReader::parseCsv(_In_ std::wstring line, _Out_ std::vector<std::wstring>& fields, _Out_ std::wstring& error) {
+    fields.assign(1, std::wstring());
+    bool quoted = false;
+    for (std::size_t i = 0;; i++) {
+        if (i == line.size()) {
+            if (!quoted) {
+                return true;
+            }
+            // The quoted field goes on with the next line.
+            std::wstring more;
+            if (!readLine(more)) {
+                error = L"unterminated quoted field";
+                return false;
+            }
+            fields.back().push_back(L'\n');
+            line = std::move(more);
+            i = static_cast<std::size_t>(-1);
+            continue;
+        }
+        const wchar_t c = line[i];
+        if (quoted) {
+            if (c != L'"') {
+                fields.back().push_back(c);
+            } else if (i + 1 < line.size() && line[i + 1] == L'"') {
+                fields.back().push_back(L'"');
+                i++;
+            } else {
+                quoted = false;
+            }
+        } else if (c == L',') {
+            fields.emplace_back();
+        } else if (c == L'"' && fields.back().empty()) {
+            quoted = true;
+        } else {
+            fields.back().push_back(c);
+        }
+    }
+}
+
+class WinToastRequestServer::OutcomeHandler : public IWinToastHandler {
+public:
+    OutcomeHandler(WinToastRequestServer* server, const std::wstring& id) : _server(server), _id(id) {}
+
+    void toastActivated() const override {
+        report(L"activated");
+    }
+
+    void toastActivated(int actionIndex) const override {
+        report(L"action " + std::to_wstring(actionIndex));
+    }
+
+    void toastDismissed(WinToastDismissalReason state) const override {
+        switch (state) {
+        case UserCanceled:
+            report(L"dismissed user-canceled");
+            break;
+        case ApplicationHidden:
+            report(L"dismissed application-hidden");
+            break;
+        case TimedOut:
+            report(L"dismissed timed-out");
+            break;
+        default:
+            report(L"dismissed unknown");
+            break;
+        }
+    }
+
+    void toastFailed() const override {
+        report(L"failed");
+    }
+
+private:
+    void report(const std::wstring& outcome) const {
+        _server->emit(_id + L" " + outcome);
+        // A toast can be activated and then dismissed; only the first outcome
+        // retires it from the in-flight count.
+        if (!_reported.exchange(true)) {
+            _server->completed();
+        }
+    }
+
+    WinToastRequestServer*          _server;
+    std::wstring                    _id;
+    mutable std::atomic<bool>       _reported{ false };
+};
+
+WinToastRequestServer::WinToastRequestServer(_In_ SendFunction send, _In_ std::wostream& out) :
+    _send(send),
+    _out(out)
+{
+}
+
+std::size_t WinToastRequestServer::serve(_In_ std::wistream& in) {
+    std::size_t failures = 0;
+    std::wstring line;
+    while (std::getline(in, line)) {
+        if (!handleLine(line)) {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+bool WinToastRequestServer::handleLine(_In_ const std::wstring& line) {
+    const std::size_t start = line.find_first_not_of(L" \t\r");
+    if (start == std::wstring::npos || line[start] == L'#') {
+        return true;
+    }
+
+    WinToastRequest request;
+    std::wstring error;
+    const bool parsed = request.parseLine(line, error);
+    if (request.id.empty()) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        request.id = std::to_wstring(++_nextId);
+    }
+    if (!parsed) {
+        emit(request.id + L" failed " + error);
+        return false;
+    }
+    return sendRequest(request, false);
+}
+
+std::size_t WinToastRequestServer::serveBatch(_In_ std::istream& in) {
+    WinToastBatchReader reader(in);
+    WinToastRequest request;
+    std::wstring error;
+    std::size_t failures = 0;
+    while (reader.next(request, error)) {
+        if (request.id.empty()) {
+            request.id = std::to_wstring(reader.record());
+        }
+        if (!error.empty()) {
+            emit(request.id + L" failed " + error);
+            failures++;
+        } else if (!sendRequest(request, true)) {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+bool WinToastRequestServer::sendRequest(_In_ const WinToastRequest& request, _In_ bool reportSent) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _inFlight++;
+    }
+    std::unique_ptr<OutcomeHandler> handler(new OutcomeHandler(this, request.id));
+    if (_send(request.toTemplate(), handler.get()) < 0) {
+        emit(request.id + L" failed show");
+        completed();
+        return false;
+    }
+    handler.release();
+    if (reportSent) {
+        emit(request.id + L" sent");
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _sent++;
+    return true;
+}
+
+bool WinToastRequestServer::waitIdle(_In_ std::int64_t timeoutMilliseconds) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _idle.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), [this] { return _inFlight == 0; });
+}
+
+std::size_t WinToastRequestServer::inFlight() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _inFlight;
+}
+
+std::size_t WinToastRequestServer::sent() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _sent;
+}
+
+void WinToastRequestServer::emit(_In_ const std::wstring& line) {
+    // Outcomes arrive on platform callback threads; keep lines whole.
+    std::lock_guard<std::mutex> lock(_mutex);
+    _out << line << std::endl;
+}
+
+void WinToastRequestServer::completed() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_inFlight > 0) {
+        _inFlight--;
+    }
+    if (_inFlight == 0) {
+        _idle.notify_all();
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef WINTOASTREQUEST_H
+#define WINTOASTREQUEST_H
+#include "wintoasttemplate.h"
+#include <condition_variable>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+
+namespace WinToastLib {
+
+    // One toast as described by WinToast.exe switches (--text, --attribute,
+    // --action, --image, --expires, --audio-state, --tag, --group), plus the
+    // caller's request id.
+    struct WinToastRequest {
+        std::wstring                        id;
+        std::wstring                        text;
+        std::wstring                        attribute;
+        std::wstring                        imagePath;
+        std::vector<std::wstring>           actions;
+        std::int64_t                        expiration = 0;     // seconds, 0 for none
+        WinToastTemplate::AudioOption       audioOption = WinToastTemplate::Default;
+        std::wstring                        tag;                // replaces the live toast with the same tag and group
+        std::wstring                        group;
+        bool                                hasText = false;
+        bool                                hasAttribute = false;
+
+        enum SwitchResult { NotAToastSwitch = 0, Consumed, MissingValue, BadValue };
+
+        // Consumes the per-toast switch at args[i] (and its value), advancing i past
+        // what it read. Anything else is left to the caller.
+        SwitchResult                        parseSwitch(_In_ const std::vector<std::wstring>& args, _Inout_ std::size_t& i);
+        // Parses a whole request line such as: --id 7 --text "Disk full" --action Retry
+        bool                                parseLine(_In_ const std::wstring& line, _Out_ std::wstring& error);
+        // Builds the template WinToast.exe has always sent for these switches.
+        WinToastTemplate                    toTemplate() const;
+
+        static const wchar_t                DefaultText[];
+        static const wchar_t                DefaultAttribute[];
+    };
+
+    // Splits a line into arguments using the usual command-line quoting rules:
+    // whitespace separates, double quotes group, \" is a literal quote.
+    std::vector<std::wstring> splitArguments(_In_ const std::wstring& line);
+
+    // Reads toast requests from a batch file one record at a time, so a file of
+    // any size is never held in memory. The format is told by the first record:
+    // JSON lines when it starts with '{', otherwise CSV (RFC 4180) whose first
+    // row names the columns. Names are the WinToast.exe switches without the
+    // dashes: id, text, attribute, action, image, expires, audio-state, tag,
+    // group. A JSON "action" may be an array of labels; a CSV "action" column
+    // may repeat. Blank lines and lines starting with '#' are skipped. Input is
+    // UTF-8.
+    class WinToastBatchReader {
+    public:
+        enum Format { Unknown = 0, JsonLines, Csv };
+
+        explicit WinToastBatchReader(_In_ std::istream& in);
+
+        // Reads the next record. Returns false at the end of the input; otherwise
+        // error is empty if request holds the record, or says why it was rejected.
+        bool                    next(_Out_ WinToastRequest& request, _Out_ std::wstring& error);
+        // 1-based number of the record last returned, the CSV header excluded.
+        inline std::size_t      record() const { return _record; }
+        inline Format           format() const { return _format; }
+
+    private:
+        bool                    readLine(_Out_ std::wstring& line);
+        bool                    parseJson(_In_ const std::wstring& line, _Inout_ WinToastRequest& request, _Out_ std::wstring& error) const;
+        // A CSV row, reading on while a quoted field spans lines.
+        bool                    parseCsv(_In_ std::wstring line, _Out_ std::vector<std::wstring>& fields, _Out_ std::wstring& error);
+
+        std::istream&           _in;
+        Format                  _format = Unknown;
+        std::vector<std::wstring> _columns;
+        std::size_t             _record = 0;
+    };
+
+    // Long-running request loop behind WinToast.exe --serve. Reads one request
+    // per line, hands each toast to send and writes one line per outcome:
+    //   <id> activated | <id> action <n> | <id> dismissed <reason> | <id> failed [<why>]
+    // send is anything with showToast semantics (takes ownership of the template,
+    // and of the handler when it returns a toast id; a negative value on failure
+    // leaves the handler with the caller).
+    class WinToastRequestServer {
+    public:
+        typedef std::function<std::int64_t(WinToastTemplate&&, IWinToastHandler*)> SendFunction;
+
+        WinToastRequestServer(_In_ SendFunction send, _In_ std::wostream& out);
+
+        // Runs until the input ends. Returns the number of requests that could not be sent.
+        std::size_t             serve(_In_ std::wistream& in);
+        // Sends every record of a batch file (see WinToastBatchReader) and reports
+        // each as "<id> sent" or "<id> failed <why>" before its outcome; ids default
+        // to the record number. Returns the number of records that could not be sent.
+        std::size_t             serveBatch(_In_ std::istream& in);
+        // Handles a single request line; blank lines and lines starting with '#' are ignored.
+        bool                    handleLine(_In_ const std::wstring& line);
+        // Waits until every sent toast has reported an outcome, or the timeout passes.
+        bool                    waitIdle(_In_ std::int64_t timeoutMilliseconds);
+
+        std::size_t             inFlight() const;
+        std::size_t             sent() const;
+
+    private:
+        class OutcomeHandler;
+        friend class OutcomeHandler;
+
+        bool                    sendRequest(_In_ const WinToastRequest& request, _In_ bool reportSent);
+        void                    emit(_In_ const std::wstring& line);
+        void                    completed();
+
+        SendFunction            _send;
+        std::wostream&          _out;
+        mutable std::mutex      _mutex;
+        std::condition_variable _idle;
+        std::size_t             _inFlight = 0;
+        std::size_t             _sent = 0;
+        std::size_t             _nextId = 0;
+    };
+}
+#endif // WINTOASTREQUEST_H
@@ -0,0 +1,197 @@
+#include "wintoastshortcut.h"
+#include <sstream>
+
+using namespace WinToastLib;
+
+namespace {
+    const wchar_t StampHeader[] = L"WinToastShortcutStamp 1";
+    // E_FAIL, through int32 so it stays negative where long is 64-bit.
+    const long LinkNotLoadable = static_cast<long>(static_cast<std::int32_t>(0x80004005u));
+
+    bool readField(_Inout_ std::wistringstream& in, _In_ const std::wstring& key, _Out_ std::wstring& value) {
+        std::wstring line;
+        if (!std::getline(in, line) || line.compare(0, key.length(), key) != 0 || line.length() <= key.length() || line[key.length()] != L'=') {
+            return false;
+        }
+        value = line.substr(key.length() + 1);
+        return true;
+    }
+}
+
+WinToastShortcutCache::WinToastShortcutCache(_In_ std::shared_ptr<IWinToastShellLinks> links) :
+    _links(std::move(links))
+{
+}
+
+std::wstring WinToastShortcutCache::formatStamp(_In_ const std::wstring& linkPath, _In_ const WinToastFileStamp& stamp, _In_ const std::wstring& aumi) {
+    std::wostringstream out;
+    out << StampHeader << L"\n"
+        << L"path=" << linkPath << L"\n"
+        << L"size=" << stamp.size << L"\n"
+        << L"lastWrite=" << stamp.lastWriteTime << L"\n"
+        << L"aumi=" << aumi << L"\n";
+    return out.str();
+}
+
+bool WinToastShortcutCache::parseStamp(_In_ const std::wstring& text, _Out_ std::wstring& linkPath,
+                                       _Out_ WinToastFileStamp& stamp, _Out_ std::wstring& aumi) {
+    std::wistringstream in(text);
+    std::wstring line, size, lastWrite;
+    if (!std::getline(in, line) || line != StampHeader) {
+        return false;
+    }
+    if (!readField(in, L"path", linkPath) || !readField(in, L"size", size)
+        || !readField(in, L"lastWrite", lastWrite) || !readField(in, L"aumi", aumi)) {
+        return false;
+    }
+    try {
+        std::size_t used = 0;
+        stamp.size = std::stoull(size, &used);
+        if (used != size.length()) {
+            return false;
+        }
+        stamp.lastWriteTime = std::stoll(lastWrite, &used);
+        return used == lastWrite.length();
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+void WinToastShortcutCache::writeStamp(_In_ const std::wstring& linkPath, _In_ const std::wstring& stampPath, _In_ const std::wstring& aumi) {
+    // Saving the link changes its size and time, so they are read back afterwards.
+    WinToastFileStamp stamp;
+    if (_links->stat(linkPath, stamp) && _links->writeText(stampPath, formatStamp(linkPath, stamp, aumi))) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _counters.stampWrites++;
+    }
+}
+
+WinToastShortcutCache::Result WinToastShortcutCache::ensure(_In_ const std::wstring& linkPath, _In_ const std::wstring& stampPath,
+                                                            _In_ const std::wstring& aumi, _Out_ long& hr) {
+    hr = 0;
+    WinToastFileStamp current;
+    const bool exists = _links->stat(linkPath, current);
+    if (exists) {
+        std::wstring text, stampedPath, stampedAumi;
+        WinToastFileStamp stamped;
+        if (_links->readText(stampPath, text) && parseStamp(text, stampedPath, stamped, stampedAumi)
+            && stampedPath == linkPath && stampedAumi == aumi && stamped == current) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _counters.hits++;
+            return Unchanged;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _counters.misses++;
+    }
+
+    if (exists) {
+        bool wasChanged = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _counters.validations++;
+        }
+        hr = _links->validateLink(linkPath, aumi, wasChanged);
+        if (hr >= 0) {
+            writeStamp(linkPath, stampPath, aumi);
+            return wasChanged ? WasChanged : Unchanged;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _counters.creations++;
+    }
+    hr = _links->createLink(linkPath, aumi);
+    if (hr < 0) {
+        return Failed;
+    }
+    writeStamp(linkPath, stampPath, aumi);
+    return WasCreated;
+}
+
+WinToastShortcutCache::Counters WinToastShortcutCache::counters() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _counters;
+}
+
+void WinToastMemoryShellLinks::touch(_Inout_ File& file) {
+    file.stamp.size = file.text.length() * sizeof(wchar_t);
+    file.stamp.lastWriteTime = ++_clock;
+}
+
+bool WinToastMemoryShellLinks::stat(_In_ const std::wstring& path, _Out_ WinToastFileStamp& stamp) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _counters.stats++;
+    auto it = _files.find(path);
+    if (it == _files.end()) {
+        return false;
+    }
+    stamp = it->second.stamp;
+    return true;
+}
+
+bool WinToastMemoryShellLinks::readText(_In_ const std::wstring& path, _Out_ std::wstring& text) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _files.find(path);
+    if (it == _files.end() || it->second.isLink) {
+        return false;
+    }
+    text = it->second.text;
+    return true;
+}
+
+bool WinToastMemoryShellLinks::writeText(_In_ const std::wstring& path, _In_ const std::wstring& text) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    File& file = _files[path];
+    file.text = text;
+    file.isLink = false;
+    touch(file);
+    return true;
+}
+
+long WinToastMemoryShellLinks::validateLink(_In_ const std::wstring& linkPath, _In_ const std::wstring& aumi, _Out_ bool& wasChanged) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _counters.linkLoads++;
+    wasChanged = false;
+    auto it = _files.find(linkPath);
+    if (it == _files.end() || !it->second.isLink) {
+        return LinkNotLoadable;
+    }
+    if (it->second.text != aumi) {
+        it->second.text = aumi;
+        touch(it->second);
+        _counters.linkSaves++;
+        wasChanged = true;
+    }
+    return 0;
+}
+
+long WinToastMemoryShellLinks::createLink(_In_ const std::wstring& linkPath, _In_ const std::wstring& aumi) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    File& file = _files[linkPath];
+    file.text = aumi;
+    file.isLink = true;
+    touch(file);
+    _counters.linkSaves++;
+    return 0;
+}
+
+void WinToastMemoryShellLinks::setLink(_In_ const std::wstring& linkPath, _In_ const std::wstring& aumi) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    File& file = _files[linkPath];
+    file.text = aumi;
+    file.isLink = true;
+    touch(file);
+}
+
+void WinToastMemoryShellLinks::remove(_In_ const std::wstring& path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _files.erase(path);
+}
+
+WinToastMemoryShellLinks::Counters WinToastMemoryShellLinks::counters() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _counters;
+}
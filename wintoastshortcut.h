@@ -0,0 +1,107 @@
+#ifndef WINTOASTSHORTCUT_H
+#define WINTOASTSHORTCUT_H
+#include "wintoasttemplate.h"
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace WinToastLib {
+
+    // What a stamp remembers about a shortcut file.
+    struct WinToastFileStamp {
+        std::uint64_t           size = 0;
+        std::int64_t            lastWriteTime = 0;      // FILETIME ticks on Windows; any monotonic file time elsewhere
+
+        bool operator==(const WinToastFileStamp& other) const {
+            return size == other.size && lastWriteTime == other.lastWriteTime;
+        }
+    };
+
+    // Filesystem and shell-link access needed to keep the Start menu shortcut
+    // valid. Return values are HRESULTs spelled as long, as in IWinToastBackend.
+    class IWinToastShellLinks {
+    public:
+        virtual ~IWinToastShellLinks() {}
+        // False when path does not exist.
+        virtual bool            stat(_In_ const std::wstring& path, _Out_ WinToastFileStamp& stamp) = 0;
+        virtual bool            readText(_In_ const std::wstring& path, _Out_ std::wstring& text) = 0;
+        virtual bool            writeText(_In_ const std::wstring& path, _In_ const std::wstring& text) = 0;
+        // Full check: loads the link and compares its AUMI, rewriting it when it
+        // differs (wasChanged). Fails when the link cannot be loaded.
+        virtual long            validateLink(_In_ const std::wstring& linkPath, _In_ const std::wstring& aumi, _Out_ bool& wasChanged) = 0;
+        virtual long            createLink(_In_ const std::wstring& linkPath, _In_ const std::wstring& aumi) = 0;
+    };
+
+    // Skips the shell-link load on startup when nothing changed. After every
+    // successful validation or creation a small stamp file records the link's
+    // path, size, last-write time and the AUMI it was validated for. If the stamp
+    // still matches the file on the next start the link is taken as valid;
+    // otherwise the full validation (or creation) runs and the stamp is rewritten.
+    class WinToastShortcutCache {
+    public:
+        enum Result { Unchanged = 0, WasChanged = 1, WasCreated = 2, Failed = -1 };
+
+        struct Counters {
+            std::size_t         hits;
+            std::size_t         misses;
+            std::size_t         validations;
+            std::size_t         creations;
+            std::size_t         stampWrites;
+        };
+
+        explicit WinToastShortcutCache(_In_ std::shared_ptr<IWinToastShellLinks> links);
+
+        // hr receives the failing HRESULT when the result is Failed.
+        Result                  ensure(_In_ const std::wstring& linkPath, _In_ const std::wstring& stampPath,
+                                       _In_ const std::wstring& aumi, _Out_ long& hr);
+        Counters                counters() const;
+        inline std::shared_ptr<IWinToastShellLinks> links() const { return _links; }
+
+        static std::wstring     formatStamp(_In_ const std::wstring& linkPath, _In_ const WinToastFileStamp& stamp, _In_ const std::wstring& aumi);
+        static bool             parseStamp(_In_ const std::wstring& text, _Out_ std::wstring& linkPath,
+                                           _Out_ WinToastFileStamp& stamp, _Out_ std::wstring& aumi);
+
+    private:
+        void                    writeStamp(_In_ const std::wstring& linkPath, _In_ const std::wstring& stampPath, _In_ const std::wstring& aumi);
+
+        std::shared_ptr<IWinToastShellLinks> _links;
+        mutable std::mutex      _mutex;
+        Counters                _counters = {};
+    };
+
+    // Files and links kept in memory, with counts of the expensive link loads.
+    class WinToastMemoryShellLinks : public IWinToastShellLinks {
+    public:
+        struct Counters {
+            std::size_t         stats;
+            std::size_t         linkLoads;
+            std::size_t         linkSaves;
+        };
+
+        bool                    stat(_In_ const std::wstring& path, _Out_ WinToastFileStamp& stamp) override;
+        bool                    readText(_In_ const std::wstring& path, _Out_ std::wstring& text) override;
+        bool                    writeText(_In_ const std::wstring& path, _In_ const std::wstring& text) override;
+        long                    validateLink(_In_ const std::wstring& linkPath, _In_ const std::wstring& aumi, _Out_ bool& wasChanged) override;
+        long                    createLink(_In_ const std::wstring& linkPath, _In_ const std::wstring& aumi) override;
+
+        // Simulates another program touching the link (new size/time, new AUMI).
+        void                    setLink(_In_ const std::wstring& linkPath, _In_ const std::wstring& aumi);
+        void                    remove(_In_ const std::wstring& path);
+        Counters                counters() const;
+
+    private:
+        struct File {
+            std::wstring        text;                   // link files hold their AUMI here
+            bool                isLink = false;
+            WinToastFileStamp   stamp;
+        };
+
+        void                    touch(_Inout_ File& file);
+
+        mutable std::mutex      _mutex;
+        std::map<std::wstring, File> _files;
+        std::int64_t            _clock = 0;
+        Counters                _counters = {};
+    };
+}
+#endif // WINTOASTSHORTCUT_H
@@ -0,0 +1,635 @@
+#include "wintoastspool.h"
+#include "wintoastfile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace WinToastLib;
+
+namespace {
+    const std::uint32_t FileMagic = 0x50535457;         // "WTSP"
+    const std::uint32_t FileVersion = 1;
+    const std::uint32_t CommittedMarker = 0x43525457;   // "WTRC"
+    const std::uint32_t PaddingMarker = 0x50525457;     // "WTRP": the rest of this lap is unused
+    const std::uint32_t Pending = 0;
+    const std::uint32_t Delivered = 1;
+    const std::uint64_t MinCapacity = 4096;
+    const std::uint64_t FnvOffsetBasis = 0xcbf29ce484222325ULL;
+    const std::uint64_t FnvPrime = 0x100000001b3ULL;
+
+    // First bytes of the file; the ring follows at DataOffset. head moves before
+    // headSequence so a crash between the two stores leaves a header that still
+    // finds the oldest record (see recoverLocked).
+    struct FileHeader {
+        std::uint32_t           magic;
+        std::uint32_t           version;
+        std::uint64_t           capacity;
+        std::uint64_t           head;
+        std::uint64_t           headSequence;
+    };
+
+    const std::uint64_t DataOffset = 64;
+
+    inline std::uint64_t align8(_In_ std::uint64_t value) {
+        return (value + 7) & ~static_cast<std::uint64_t>(7);
+    }
+
+    // Keeps the compiler from moving a commit marker ahead of the bytes it covers.
+    inline void orderStores() {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+}
+
+// Spool record header; the serialized toast follows, padded to 8 bytes.
+// marker is written last, and checksum covers sequence, tag, length and payload.
+struct WinToastSpool::Record {
+    std::uint32_t               marker;
+    std::uint32_t               state;
+    std::uint64_t               sequence;
+    std::uint64_t               tag;
+    std::uint32_t               length;
+    std::uint32_t               reserved;
+    std::uint64_t               checksum;
+
+    inline std::uint8_t*        payload() { return reinterpret_cast<std::uint8_t*>(this + 1); }
+    inline std::uint64_t        bytes() const { return align8(sizeof(Record) + length); }
+
+    std::uint64_t computeChecksum() {
+        std::uint64_t hash = (FnvOffsetBasis ^ sequence) * FnvPrime;
+        hash = (hash ^ tag) * FnvPrime;
+        hash = (hash ^ length) * FnvPrime;
+        const std::uint8_t* data = payload();
+        std::uint32_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * FnvPrime;
+        }
+        for (; i < length; i++) {
+            hash = (hash ^ data[i]) * FnvPrime;
+        }
+        return hash;
+    }
+};
+
+// A file mapped read/write in one piece. flush() writes a byte range back to
+// disk and waits for it.
+class WinToastSpool::MappedFile {
+public:
+    ~MappedFile() {
+#ifdef _WIN32
+        if (_data) {
+            UnmapViewOfFile(_data);
+        }
+        if (_mapping) {
+            CloseHandle(_mapping);
+        }
+        if (_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(_file);
+        }
+#else
+        if (_data) {
+            munmap(_data, static_cast<std::size_t>(_size));
+        }
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+#endif
+    }
+
+    // Maps path whole; an empty or new file is first grown to sizeIfNew.
+    bool open(_In_ const std::wstring& path, _In_ std::uint64_t sizeIfNew) {
+#ifdef _WIN32
+        _file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (_file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(_file, &size)) {
+            return false;
+        }
+        _size = static_cast<std::uint64_t>(size.QuadPart);
+        if (_size == 0) {
+            size.QuadPart = static_cast<LONGLONG>(sizeIfNew);
+            if (!SetFilePointerEx(_file, size, nullptr, FILE_BEGIN) || !SetEndOfFile(_file)) {
+                return false;
+            }
+            _size = sizeIfNew;
+            _created = true;
+        }
+        _mapping = CreateFileMappingW(_file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+        if (!_mapping) {
+            return false;
+        }
+        _data = static_cast<std::uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+#else
+        _fd = ::open(narrowPath(path).c_str(), O_RDWR | O_CREAT, 0600);
+        if (_fd < 0) {
+            return false;
+        }
+        struct stat status;
+        if (fstat(_fd, &status) != 0) {
+            return false;
+        }
+        _size = static_cast<std::uint64_t>(status.st_size);
+        if (_size == 0) {
+            if (ftruncate(_fd, static_cast<off_t>(sizeIfNew)) != 0) {
+                return false;
+            }
+            _size = sizeIfNew;
+            _created = true;
+        }
+        void* data = mmap(nullptr, static_cast<std::size_t>(_size), PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        _data = data == MAP_FAILED ? nullptr : static_cast<std::uint8_t*>(data);
+#endif
+        return _data != nullptr;
+    }
+
+    void flush(_In_ std::uint64_t offset, _In_ std::uint64_t length) {
+        if (!_data || length == 0) {
+            return;
+        }
+#ifdef _WIN32
+        FlushViewOfFile(_data + offset, static_cast<SIZE_T>(length));
+        FlushFileBuffers(_file);
+#else
+        static const std::uint64_t PageSize = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+        const std::uint64_t start = offset - offset % PageSize;
+        msync(_data + start, static_cast<std::size_t>(offset + length - start), MS_SYNC);
+#endif
+    }
+
+    inline std::uint8_t*        data() const { return _data; }
+    inline std::uint64_t        size() const { return _size; }
+    inline bool                 created() const { return _created; }
+
+private:
+#ifdef _WIN32
+    HANDLE                      _file = INVALID_HANDLE_VALUE;
+    HANDLE                      _mapping = nullptr;
+#else
+    int                         _fd = -1;
+#endif
+    std::uint8_t*               _data = nullptr;
+    std::uint64_t               _size = 0;
+    bool                        _created = false;
+};
+
+WinToastSpool::WinToastSpool() : WinToastSpool(Options()) {}
+
+WinToastSpool::WinToastSpool(_In_ const Options& options) : _options(options) {}
+
+WinToastSpool::~WinToastSpool() {
+    close();
+}
+
+bool WinToastSpool::open(_In_ const std::wstring& path) {
+    close();
+    std::unique_lock<std::mutex> lock(_mutex);
+    const std::uint64_t capacity = align8(std::max<std::uint64_t>(_options.capacityBytes, MinCapacity));
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(path, DataOffset + capacity) || file->size() < DataOffset + MinCapacity) {
+        return false;
+    }
+    FileHeader* header = reinterpret_cast<FileHeader*>(file->data());
+    if (file->created() || header->magic == 0) {
+        // A crash right after creating the file leaves it zero-filled.
+        std::memset(file->data(), 0, static_cast<std::size_t>(DataOffset));
+        header->version = FileVersion;
+        header->capacity = (file->size() - DataOffset) & ~static_cast<std::uint64_t>(7);
+        orderStores();
+        header->magic = FileMagic;
+        file->flush(0, DataOffset);
+    }
+    if (header->magic != FileMagic || header->version != FileVersion
+        || header->capacity < MinCapacity || header->capacity % 8 != 0 || header->capacity > file->size() - DataOffset) {
+        return false;
+    }
+    _file = std::move(file);
+    _stopping = false;
+    _counters = Counters();
+    return recoverLocked();
+}
+
+bool WinToastSpool::recoverLocked() {
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(_file->data());
+    const std::uint64_t cap = capacity();
+    _durableHead = header->head;
+    _head = header->head;
+    _headSequence = header->headSequence;
+    _pending = 0;
+
+    // Walk the chain from the persisted head: the first record may be any
+    // sequence at or past headSequence (head is stored first), every later one
+    // must follow on directly. Stale records from earlier laps break the chain.
+    std::uint64_t offset = _head;
+    std::uint64_t expected = _headSequence;
+    bool first = true;
+    std::uint64_t end = _head;
+    while (offset - _head < cap) {
+        const std::uint64_t room = cap - offset % cap;
+        Record* record = recordAt(offset);
+        if (room < sizeof(Record) || record->marker == PaddingMarker) {
+            offset += room;
+            continue;
+        }
+        if (record->marker != CommittedMarker || record->length > room - sizeof(Record)
+            || (first ? record->sequence < expected : record->sequence != expected)
+            || record->checksum != record->computeChecksum()) {
+            break;
+        }
+        first = false;
+        expected = record->sequence + 1;
+        offset += record->bytes();
+        end = offset;
+        if (record->state == Delivered && _pending == 0) {
+            _head = offset;
+            _headSequence = expected;
+        } else {
+            _pending++;
+        }
+    }
+    if (end - _head > cap) {
+        return false;
+    }
+    _tail = end;
+    _nextSequence = expected;
+    _replayedBelow = expected;
+    _durableTail = _tail;
+    persistHeadLocked();
+    _counters.replayed = _pending;
+    return true;
+}
+
+void WinToastSpool::close() {
+    stop();
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_file) {
+        return;
+    }
+    // An appender or deliverer may still be flushing outside the lock.
+    _changed.wait(lock, [this] { return _unlockedFlushes == 0; });
+    persistHeadLocked();
+    flushRange(_durableTail, _tail);
+    _file->flush(0, DataOffset);
+    _file.reset();
+}
+
+bool WinToastSpool::isOpen() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _file != nullptr;
+}
+
+std::uint64_t WinToastSpool::capacity() const {
+    return reinterpret_cast<const FileHeader*>(_file->data())->capacity;
+}
+
+WinToastSpool::Record* WinToastSpool::recordAt(_In_ std::uint64_t offset) const {
+    return reinterpret_cast<Record*>(_file->data() + DataOffset + offset % capacity());
+}
+
+WinToastSpool::AppendResult WinToastSpool::append(_In_ const WinToastFrozenToast& toast, _In_ std::uint64_t tag, _Out_opt_ std::uint64_t* sequence) {
+    std::vector<std::uint8_t> payload;
+    toast.serialize(payload);
+    std::unique_lock<std::mutex> lock(_mutex);
+    const AppendResult result = appendLocked(lock, payload, tag, sequence);
+    if (result == Appended && _options.durableAppend) {
+        commitThrough(lock, _tail);
+    }
+    return result;
+}
+
+std::vector<WinToastSpool::AppendResult> WinToastSpool::appendBatch(_In_ const std::vector<WinToastFrozenToast>& toasts,
+                                                                    _In_opt_ const std::vector<std::uint64_t>* tags) {
+    std::vector<AppendResult> results;
+    results.reserve(toasts.size());
+    std::vector<std::uint8_t> payload;
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (std::size_t i = 0; i < toasts.size(); i++) {
+        payload.clear();
+        toasts[i].serialize(payload);
+        results.push_back(appendLocked(lock, payload, tags ? (*tags)[i] : 0, nullptr));
+    }
+    if (_options.durableAppend) {
+        commitThrough(lock, _tail);
+    }
+    return results;
+}
+
+void WinToastSpool::commit() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_file) {
+        commitThrough(lock, _tail);
+    }
+}
+
+WinToastSpool::AppendResult WinToastSpool::appendLocked(_Inout_ std::unique_lock<std::mutex>& lock, _In_ const std::vector<std::uint8_t>& payload,
+                                                        _In_ std::uint64_t tag, _Out_opt_ std::uint64_t* sequence) {
+    if (!_file) {
+        return NotOpen;
+    }
+    const std::uint64_t cap = capacity();
+    const std::uint64_t needed = align8(sizeof(Record) + payload.size());
+    if (payload.empty() || needed > cap) {
+        _counters.rejected++;
+        return TooLarge;
+    }
+    if (!makeRoomLocked(lock, needed)) {
+        _counters.rejected++;
+        return Rejected;
+    }
+
+    const std::uint64_t room = cap - _tail % cap;
+    if (needed > room) {
+        if (room >= sizeof(Record)) {
+            Record* padding = recordAt(_tail);
+            padding->marker = PaddingMarker;
+        }
+        _tail += room;
+    }
+    Record* record = recordAt(_tail);
+    record->marker = 0;
+    orderStores();
+    std::memcpy(record->payload(), payload.data(), payload.size());
+    record->state = Pending;
+    record->sequence = _nextSequence;
+    record->tag = tag;
+    record->length = static_cast<std::uint32_t>(payload.size());
+    record->reserved = 0;
+    record->checksum = record->computeChecksum();
+    orderStores();
+    record->marker = CommittedMarker;
+
+    if (sequence) {
+        *sequence = _nextSequence;
+    }
+    _nextSequence++;
+    _tail += needed;
+    _pending++;
+    _counters.appended++;
+    _changed.notify_all();
+    return Appended;
+}
+
+bool WinToastSpool::makeRoomLocked(_Inout_ std::unique_lock<std::mutex>& lock, _In_ std::uint64_t needed) {
+    const std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(_options.blockTimeoutMilliseconds);
+    for (;;) {
+        if (!_file) {
+            return false;
+        }
+        const std::uint64_t cap = capacity();
+        const std::uint64_t room = cap - _tail % cap;
+        if (_head == _tail && needed > room) {
+            // Empty: start the next lap instead of padding behind the head.
+            _head = _tail = _tail + room;
+            persistHeadLocked();
+            continue;
+        }
+        const std::uint64_t total = needed > room ? room + needed : needed;
+        // Space is only reused once the header on disk no longer points into it,
+        // otherwise a power cut could leave the head on top of newer records.
+        if (cap - (_tail - _durableHead) >= total) {
+            return true;
+        }
+        if (cap - (_tail - _head) >= total) {
+            flushHeadLocked(lock);
+            continue;
+        }
+        switch (_options.overflow) {
+        case DropOldest:
+            if (!dropOldestLocked()) {
+                return false;
+            }
+            break;
+        case Block:
+            if (_changed.wait_until(lock, deadline) == std::cv_status::timeout) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+}
+
+bool WinToastSpool::dropOldestLocked() {
+    const std::uint64_t cap = capacity();
+    while (_head < _tail) {
+        const std::uint64_t room = cap - _head % cap;
+        Record* record = recordAt(_head);
+        if (room < sizeof(Record) || record->marker == PaddingMarker) {
+            _head += room;
+            continue;
+        }
+        _head += record->bytes();
+        _headSequence = record->sequence + 1;
+        if (record->state != Delivered) {
+            _pending--;
+            _counters.dropped++;
+        }
+        persistHeadLocked();
+        return true;
+    }
+    return false;
+}
+
+void WinToastSpool::commitThrough(_Inout_ std::unique_lock<std::mutex>& lock, _In_ std::uint64_t tail) {
+    while (_file && _durableTail < tail) {
+        if (_flushing) {
+            // Someone else is flushing; their flush or the next one covers us.
+            _changed.wait(lock);
+            continue;
+        }
+        _flushing = true;
+        _unlockedFlushes++;
+        const std::uint64_t from = _durableTail;
+        const std::uint64_t to = _tail;
+        lock.unlock();
+        flushRange(from, to);
+        lock.lock();
+        _durableTail = to;
+        _flushing = false;
+        _unlockedFlushes--;
+        _counters.flushes++;
+        _changed.notify_all();
+    }
+}
+
+void WinToastSpool::flushRange(_In_ std::uint64_t from, _In_ std::uint64_t to) {
+    if (to <= from) {
+        return;
+    }
+    const std::uint64_t cap = capacity();
+    if (to - from >= cap) {
+        _file->flush(DataOffset, cap);
+        return;
+    }
+    const std::uint64_t start = from % cap;
+    if (start + (to - from) <= cap) {
+        _file->flush(DataOffset + start, to - from);
+    } else {
+        _file->flush(DataOffset + start, cap - start);
+        _file->flush(DataOffset, to % cap);
+    }
+}
+
+void WinToastSpool::persistHeadLocked() {
+    FileHeader* header = reinterpret_cast<FileHeader*>(_file->data());
+    header->head = _head;
+    orderStores();
+    header->headSequence = _headSequence;
+}
+
+void WinToastSpool::flushHeadLocked(_Inout_ std::unique_lock<std::mutex>& lock) {
+    const std::uint64_t head = _head;
+    persistHeadLocked();
+    _unlockedFlushes++;
+    lock.unlock();
+    _file->flush(0, DataOffset);
+    lock.lock();
+    _unlockedFlushes--;
+    _durableHead = std::max(_durableHead, head);
+    _changed.notify_all();
+}
+
+bool WinToastSpool::nextLocked(_Out_ WinToastFrozenToast& toast, _Out_ Entry& entry, _Out_ std::uint64_t& offset) {
+    if (!_file) {
+        return false;
+    }
+    const std::uint64_t cap = capacity();
+    while (_head < _tail) {
+        const std::uint64_t room = cap - _head % cap;
+        Record* record = recordAt(_head);
+        if (room < sizeof(Record) || record->marker == PaddingMarker) {
+            _head += room;
+            continue;
+        }
+        std::size_t consumed = 0;
+        if (record->state == Delivered
+            || !WinToastFrozenToast::deserialize(record->payload(), record->length, toast, consumed)) {
+            // Only a record written by another build of the library fails to
+            // deserialize; it can never be sent, so it is dropped.
+            if (record->state != Delivered) {
+                _pending--;
+                _counters.dropped++;
+            }
+            _head += record->bytes();
+            _headSequence = record->sequence + 1;
+            continue;
+        }
+        entry.sequence = record->sequence;
+        entry.tag = record->tag;
+        entry.replayed = record->sequence < _replayedBelow;
+        offset = _head;
+        return true;
+    }
+    return false;
+}
+
+void WinToastSpool::deliveredLocked(_In_ std::uint64_t sequence, _In_ std::uint64_t offset) {
+    // Dropped (DropOldest) while it was being sent.
+    if (!_file || sequence < _headSequence || offset != _head) {
+        return;
+    }
+    Record* record = recordAt(offset);
+    record->state = Delivered;
+    _head = offset + record->bytes();
+    _headSequence = sequence + 1;
+    _pending--;
+    _counters.delivered++;
+    persistHeadLocked();
+    _changed.notify_all();
+}
+
+std::size_t WinToastSpool::deliver(_In_ const SendFunction& send, _In_ std::size_t maxRecords) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    std::size_t delivered = 0;
+    WinToastFrozenToast toast;
+    Entry entry = {};
+    std::uint64_t offset = 0;
+    while (delivered < maxRecords && nextLocked(toast, entry, offset)) {
+        lock.unlock();
+        const bool sent = send(toast, entry);
+        lock.lock();
+        if (!sent) {
+            break;
+        }
+        deliveredLocked(entry.sequence, offset);
+        delivered++;
+    }
+    if (_file && _head != _durableHead) {
+        flushHeadLocked(lock);
+    }
+    return delivered;
+}
+
+void WinToastSpool::start(_In_ SendFunction send) {
+    stop();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = false;
+    _sender = std::thread(&WinToastSpool::senderLoop, this, std::move(send));
+}
+
+void WinToastSpool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        _changed.notify_all();
+    }
+    if (_sender.joinable()) {
+        // A send function may end up here, e.g. through a handler calling exit().
+        if (_sender.get_id() == std::this_thread::get_id()) {
+            _sender.detach();
+        } else {
+            _sender.join();
+        }
+    }
+}
+
+void WinToastSpool::senderLoop(_In_ SendFunction send) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    WinToastFrozenToast toast;
+    Entry entry = {};
+    std::uint64_t offset = 0;
+    while (!_stopping) {
+        if (!nextLocked(toast, entry, offset)) {
+            // Out of work: persist the delivery marks of the run, once.
+            if (_file && _head != _durableHead) {
+                flushHeadLocked(lock);
+                continue;
+            }
+            _changed.wait(lock);
+            continue;
+        }
+        lock.unlock();
+        const bool sent = send(toast, entry);
+        toast = WinToastFrozenToast();
+        lock.lock();
+        if (sent) {
+            deliveredLocked(entry.sequence, offset);
+        } else {
+            _changed.wait_for(lock, std::chrono::milliseconds(_options.retryMilliseconds), [this] { return _stopping; });
+        }
+    }
+}
+
+WinToastSpool::Counters WinToastSpool::counters() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Counters counters = _counters;
+    counters.pending = _pending;
+    counters.usedBytes = _file ? static_cast<std::size_t>(_tail - _head) : 0;
+    counters.capacityBytes = _file ? static_cast<std::size_t>(capacity()) : 0;
+    return counters;
+}
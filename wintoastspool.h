@@ -0,0 +1,136 @@
+#ifndef WINTOASTSPOOL_H
+#define WINTOASTSPOOL_H
+#include "wintoastfrozen.h"
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace WinToastLib {
+
+    // Crash-safe queue between producers and the notifier: a memory-mapped,
+    // append-only ring file of serialized toasts (WinToastFrozenToast::serialize).
+    //
+    // append() writes a record into the mapping and sets its commit marker last;
+    // the record is durable once the mapping is flushed. Flushes are group
+    // commits: an appender that finds a flush in progress waits for the next one
+    // instead of issuing its own, and appendBatch() flushes once for the whole
+    // burst. A sender (start(), or deliver() on the caller's thread) hands records
+    // to the notifier oldest first and marks them delivered; the head pointer in
+    // the file header is persisted after each run of deliveries.
+    //
+    // open() scans the file from the persisted head and keeps every record with
+    // a valid marker and checksum, so whatever was not delivered before a crash is
+    // delivered again after the restart. Delivery is at least once: a toast shown
+    // right before the crash, whose delivery mark was not flushed yet, comes back.
+    class WinToastSpool {
+    public:
+        enum Overflow {
+            RejectNew = 0,      // append fails, the spool is left as is
+            DropOldest,         // undelivered records are discarded, oldest first, to make room
+            Block               // append waits for the sender, up to blockTimeoutMilliseconds
+        };
+        enum AppendResult { Appended = 0, Rejected, TooLarge, NotOpen };
+
+        struct Options {
+            std::size_t         capacityBytes = 1 << 20;    // ring size for a new file; an existing file keeps its own
+            Overflow            overflow = RejectNew;
+            std::int64_t        blockTimeoutMilliseconds = 1000;
+            // Wait in append() until the record is flushed to disk. Off, records
+            // only survive a crash of the process, not of the machine, until the
+            // sender's next flush.
+            bool                durableAppend = true;
+            std::int64_t        retryMilliseconds = 1000;   // after the send function asks to retry
+        };
+
+        struct Counters {
+            std::uint64_t       appended;
+            std::uint64_t       delivered;
+            std::uint64_t       replayed;           // undelivered records found by open()
+            std::uint64_t       dropped;            // by DropOldest
+            std::uint64_t       rejected;           // full (RejectNew, Block timeout) or too large
+            std::uint64_t       flushes;            // data flushes, each covering one or more appends
+            std::size_t         pending;
+            std::size_t         usedBytes;
+            std::size_t         capacityBytes;
+        };
+
+        struct Entry {
+            std::uint64_t       sequence;           // numbers every record ever appended to the file
+            std::uint64_t       tag;                // as given to append()
+            bool                replayed;           // recovered by open(), i.e. appended before the last restart
+        };
+
+        // Hands one toast to the notifier. Returning false keeps the record and
+        // retries it after retryMilliseconds (e.g. notifier not ready yet).
+        typedef std::function<bool(const WinToastFrozenToast& toast, const Entry& entry)> SendFunction;
+
+        WinToastSpool();
+        explicit WinToastSpool(_In_ const Options& options);
+        // Stops the sender, flushes and unmaps the file.
+        ~WinToastSpool();
+
+        // Maps path, creating it if needed, and recovers the undelivered records.
+        bool                    open(_In_ const std::wstring& path);
+        void                    close();
+        bool                    isOpen() const;
+
+        // tag is stored with the record and handed back to the sender, e.g. to find
+        // the producer again. sequence receives the record's number when Appended.
+        AppendResult            append(_In_ const WinToastFrozenToast& toast, _In_ std::uint64_t tag = 0, _Out_opt_ std::uint64_t* sequence = nullptr);
+        // Appends every toast and flushes once. tags, when given, pairs up with
+        // toasts. Results are in the same order.
+        std::vector<AppendResult> appendBatch(_In_ const std::vector<WinToastFrozenToast>& toasts, _In_opt_ const std::vector<std::uint64_t>* tags = nullptr);
+        // Flushes every record appended so far.
+        void                    commit();
+
+        // Runs a sender thread until stop() or close().
+        void                    start(_In_ SendFunction send);
+        void                    stop();
+        // Delivers up to maxRecords on the calling thread, stopping at the first
+        // retry. Returns how many were delivered. Not to be mixed with start().
+        std::size_t             deliver(_In_ const SendFunction& send, _In_ std::size_t maxRecords = static_cast<std::size_t>(-1));
+
+        Counters                counters() const;
+        inline const Options&   options() const { return _options; }
+
+    private:
+        class MappedFile;
+        struct Record;
+
+        bool                    recoverLocked();
+        AppendResult            appendLocked(_Inout_ std::unique_lock<std::mutex>& lock, _In_ const std::vector<std::uint8_t>& payload,
+                                             _In_ std::uint64_t tag, _Out_opt_ std::uint64_t* sequence);
+        bool                    makeRoomLocked(_Inout_ std::unique_lock<std::mutex>& lock, _In_ std::uint64_t needed);
+        bool                    dropOldestLocked();
+        void                    commitThrough(_Inout_ std::unique_lock<std::mutex>& lock, _In_ std::uint64_t tail);
+        bool                    nextLocked(_Out_ WinToastFrozenToast& toast, _Out_ Entry& entry, _Out_ std::uint64_t& offset);
+        void                    deliveredLocked(_In_ std::uint64_t sequence, _In_ std::uint64_t offset);
+        void                    persistHeadLocked();
+        void                    flushHeadLocked(_Inout_ std::unique_lock<std::mutex>& lock);
+        void                    flushRange(_In_ std::uint64_t from, _In_ std::uint64_t to);
+        void                    senderLoop(_In_ SendFunction send);
+        Record*                 recordAt(_In_ std::uint64_t offset) const;
+        std::uint64_t           capacity() const;
+
+        Options                 _options;
+        std::unique_ptr<MappedFile> _file;
+        mutable std::mutex      _mutex;
+        std::condition_variable _changed;           // records appended, delivered or flushed; sender stopping
+        std::uint64_t           _head = 0;          // logical offsets: the ring position is offset % capacity
+        std::uint64_t           _tail = 0;
+        std::uint64_t           _headSequence = 0;
+        std::uint64_t           _nextSequence = 0;
+        std::uint64_t           _replayedBelow = 0; // sequences recovered by open()
+        std::uint64_t           _durableTail = 0;   // everything before it is flushed
+        std::uint64_t           _durableHead = 0;   // head as last flushed to the file header
+        std::size_t             _pending = 0;
+        bool                    _flushing = false;  // a data flush runs outside the lock
+        std::size_t             _unlockedFlushes = 0;
+        bool                    _stopping = false;
+        std::thread             _sender;
+        Counters                _counters = {};
+    };
+}
+#endif // WINTOASTSPOOL_H
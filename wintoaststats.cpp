@@ -0,0 +1,183 @@
+#include "wintoaststats.h"
+#include <iomanip>
+
+using namespace WinToastLib;
+
+namespace {
+    inline int bucketOf(_In_ std::uint64_t nanoseconds) {
+        int bucket = 0;
+        while (nanoseconds > 1 && bucket < WinToastStats::BucketCount - 1) {
+            nanoseconds >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+
+    inline void raiseTo(_Inout_ std::atomic<std::uint64_t>& value, _In_ std::uint64_t candidate) {
+        std::uint64_t current = value.load(std::memory_order_relaxed);
+        while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+WinToastStats::WinToastStats() {
+    reset();
+}
+
+void WinToastStats::record(_In_ Stage stage, _In_ std::uint64_t nanoseconds) {
+    Histogram& histogram = _stages[stage];
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+    histogram.totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    histogram.buckets[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    raiseTo(histogram.maxNanoseconds, nanoseconds);
+}
+
+void WinToastStats::countFailure(_In_ long hr) {
+    _failures.fetch_add(1, std::memory_order_relaxed);
+    // Claim-once slots: a failure code takes the first free slot and keeps it.
+    for (auto& slot : _results) {
+        long current = slot.hr.load(std::memory_order_acquire);
+        if (current == 0 && slot.hr.compare_exchange_strong(current, hr, std::memory_order_acq_rel)) {
+            current = hr;
+        }
+        if (current == hr) {
+            slot.count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    _otherFailures.fetch_add(1, std::memory_order_relaxed);
+}
+
+WinToastStats::Outcome WinToastStats::outcomeOf(_In_ const WinToastOutcome& outcome) {
+    switch (outcome.kind) {
+    case WinToastOutcome::Activated:
+        return Activated;
+    case WinToastOutcome::ActionActivated:
+        return ActionActivated;
+    case WinToastOutcome::Dismissed:
+        switch (outcome.reason) {
+        case IWinToastHandler::ApplicationHidden:
+            return DismissedApplicationHidden;
+        case IWinToastHandler::TimedOut:
+            return DismissedTimedOut;
+        default:
+            return DismissedUserCanceled;
+        }
+    default:
+        return Failed;
+    }
+}
+
+WinToastStats::Snapshot WinToastStats::snapshot() const {
+    Snapshot snapshot;
+    for (int stage = 0; stage < StageCount; stage++) {
+        const Histogram& histogram = _stages[stage];
+        StageSnapshot& out = snapshot.stages[stage];
+        out.count = histogram.count.load(std::memory_order_relaxed);
+        out.totalNanoseconds = histogram.totalNanoseconds.load(std::memory_order_relaxed);
+        out.maxNanoseconds = histogram.maxNanoseconds.load(std::memory_order_relaxed);
+        for (int bucket = 0; bucket < BucketCount; bucket++) {
+            out.buckets[bucket] = histogram.buckets[bucket].load(std::memory_order_relaxed);
+        }
+    }
+    snapshot.sends = _sends.load(std::memory_order_relaxed);
+    snapshot.shown = _shown.load(std::memory_order_relaxed);
+    snapshot.failures = _failures.load(std::memory_order_relaxed);
+    for (const auto& slot : _results) {
+        const long hr = slot.hr.load(std::memory_order_acquire);
+        if (hr != 0) {
+            snapshot.failuresByResult.emplace_back(hr, slot.count.load(std::memory_order_relaxed));
+        }
+    }
+    snapshot.otherFailures = _otherFailures.load(std::memory_order_relaxed);
+    for (int outcome = 0; outcome < OutcomeCount; outcome++) {
+        snapshot.outcomes[outcome] = _outcomes[outcome].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+void WinToastStats::reset() {
+    for (auto& histogram : _stages) {
+        histogram.count.store(0, std::memory_order_relaxed);
+        histogram.totalNanoseconds.store(0, std::memory_order_relaxed);
+        histogram.maxNanoseconds.store(0, std::memory_order_relaxed);
+        for (auto& bucket : histogram.buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+    _sends.store(0, std::memory_order_relaxed);
+    _shown.store(0, std::memory_order_relaxed);
+    _failures.store(0, std::memory_order_relaxed);
+    for (auto& slot : _results) {
+        slot.count.store(0, std::memory_order_relaxed);
+        slot.hr.store(0, std::memory_order_release);
+    }
+    _otherFailures.store(0, std::memory_order_relaxed);
+    for (auto& outcome : _outcomes) {
+        outcome.store(0, std::memory_order_relaxed);
+    }
+}
+
+const char* WinToastStats::stageName(_In_ Stage stage) {
+    static const char* const Names[StageCount] = {
+        "factory-lookup", "notifier-creation", "template-fetch", "field-population", "payload-load",
+        "notification-creation", "handler-wiring", "show", "send"
+    };
+    return Names[stage];
+}
+
+const char* WinToastStats::outcomeName(_In_ Outcome outcome) {
+    static const char* const Names[OutcomeCount] = {
+        "activated", "action-activated", "dismissed-user-canceled", "dismissed-application-hidden", "dismissed-timed-out", "failed"
+    };
+    return Names[outcome];
+}
+
+std::uint64_t WinToastStats::StageSnapshot::percentile(_In_ double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    const std::uint64_t rank = static_cast<std::uint64_t>(fraction * static_cast<double>(count - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (int bucket = 0; bucket < BucketCount; bucket++) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            // Never report more than the largest sample actually seen.
+            const std::uint64_t upper = (bucket == BucketCount - 1) ? maxNanoseconds : (std::uint64_t(2) << bucket);
+            return upper < maxNanoseconds ? upper : maxNanoseconds;
+        }
+    }
+    return maxNanoseconds;
+}
+
+void WinToastStats::Snapshot::write(_Inout_ std::wostream& out) const {
+    out << L"sends " << sends << L", shown " << shown << L", failed " << failures << std::endl;
+    for (const auto& failure : failuresByResult) {
+        // HRESULTs are 32 bits; long may be wider and sign-extend them.
+        out << L"  hr 0x" << std::hex << std::setw(8) << std::setfill(L'0') << static_cast<std::uint32_t>(failure.first)
+            << std::dec << std::setfill(L' ') << L": " << failure.second << std::endl;
+    }
+    if (otherFailures) {
+        out << L"  other: " << otherFailures << std::endl;
+    }
+    out << L"outcomes";
+    for (int outcome = 0; outcome < OutcomeCount; outcome++) {
+        out << L" " << outcomeName(static_cast<Outcome>(outcome)) << L"=" << outcomes[outcome];
+    }
+    out << std::endl;
+    out << L"stage (us)              count       mean        p50        p90        p99        max" << std::endl;
+    for (int stage = 0; stage < StageCount; stage++) {
+        const StageSnapshot& s = stages[stage];
+        if (s.count == 0) {
+            continue;
+        }
+        const std::string name = stageName(static_cast<Stage>(stage));
+        out << std::left << std::setw(22) << std::wstring(name.begin(), name.end()) << std::right
+            << std::setw(8) << s.count << std::fixed << std::setprecision(1)
+            << std::setw(11) << s.totalNanoseconds / 1000.0 / s.count
+            << std::setw(11) << s.percentile(0.50) / 1000.0
+            << std::setw(11) << s.percentile(0.90) / 1000.0
+            << std::setw(11) << s.percentile(0.99) / 1000.0
+            << std::setw(11) << s.maxNanoseconds / 1000.0 << std::endl;
+    }
+}
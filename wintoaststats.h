@@ -0,0 +1,172 @@
+#ifndef WINTOASTSTATS_H
+#define WINTOASTSTATS_H
+#include "wintoastdispatch.h"
+#include "wintoasttrace.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <ostream>
+
+namespace WinToastLib {
+
+    // Send-path instrumentation: a fixed-bucket latency histogram per stage plus
+    // counters for sends, failures (by HRESULT) and outcomes. Recording is a few
+    // relaxed atomic increments, so any thread may record at any time.
+    //
+    // Define WINTOAST_NO_STATS to compile the recording out: WINTOAST_STATS_COUNT
+    // expands to nothing, stage timers skip the histograms and WinToast::stats()
+    // stays empty.
+    class WinToastStats {
+    public:
+        enum Stage {
+            FactoryLookup = 0,      // activation factories for the session
+            NotifierCreation,       // CreateToastNotifierWithId
+            TemplateFetch,          // prototype for the template type
+            FieldPopulation,        // compiling the payload from the template fields
+            PayloadLoad,            // parsing the payload into an XmlDocument
+            NotificationCreation,   // CreateToastNotification (+ expiration)
+            HandlerWiring,          // Activated/Dismissed/Failed subscriptions
+            Show,                   // notifier Show
+            Send,                   // the whole showToast, end to end
+            StageCount
+        };
+
+        enum Outcome {
+            Activated = 0,
+            ActionActivated,
+            DismissedUserCanceled,
+            DismissedApplicationHidden,
+            DismissedTimedOut,
+            Failed,
+            OutcomeCount
+        };
+
+        // Bucket b holds durations in [2^b, 2^(b+1)) nanoseconds; the last one is open-ended.
+        static const int            BucketCount = 40;
+        // Distinct failure HRESULTs tracked; the rest are counted as "other".
+        static const int            ResultSlots = 16;
+
+        struct StageSnapshot {
+            std::uint64_t           count;
+            std::uint64_t           totalNanoseconds;
+            std::uint64_t           maxNanoseconds;
+            std::uint64_t           buckets[BucketCount];
+
+            // Upper bound of the bucket holding the given fraction of samples.
+            std::uint64_t           percentile(_In_ double fraction) const;
+        };
+
+        struct Snapshot {
+            StageSnapshot           stages[StageCount];
+            std::uint64_t           sends;
+            std::uint64_t           shown;
+            std::uint64_t           failures;
+            std::vector<std::pair<long, std::uint64_t>> failuresByResult;
+            std::uint64_t           otherFailures;
+            std::uint64_t           outcomes[OutcomeCount];
+
+            void                    write(_Inout_ std::wostream& out) const;
+        };
+
+        WinToastStats();
+
+        void                        record(_In_ Stage stage, _In_ std::uint64_t nanoseconds);
+        inline void                 countSend() { _sends.fetch_add(1, std::memory_order_relaxed); }
+        inline void                 countShown() { _shown.fetch_add(1, std::memory_order_relaxed); }
+        void                        countFailure(_In_ long hr);
+        inline void                 countOutcome(_In_ Outcome outcome) { _outcomes[outcome].fetch_add(1, std::memory_order_relaxed); }
+        static Outcome              outcomeOf(_In_ const WinToastOutcome& outcome);
+
+        Snapshot                    snapshot() const;
+        void                        reset();
+
+        static const char*          stageName(_In_ Stage stage);
+        static const char*          outcomeName(_In_ Outcome outcome);
+
+    private:
+        struct Histogram {
+            std::atomic<std::uint64_t>  count{ 0 };
+            std::atomic<std::uint64_t>  totalNanoseconds{ 0 };
+            std::atomic<std::uint64_t>  maxNanoseconds{ 0 };
+            std::atomic<std::uint64_t>  buckets[BucketCount];
+        };
+
+        struct ResultSlot {
+            std::atomic<long>           hr{ 0 };            // 0 (S_OK) marks a free slot
+            std::atomic<std::uint64_t>  count{ 0 };
+        };
+
+        Histogram                   _stages[StageCount];
+        std::atomic<std::uint64_t>  _sends{ 0 };
+        std::atomic<std::uint64_t>  _shown{ 0 };
+        std::atomic<std::uint64_t>  _failures{ 0 };
+        ResultSlot                  _results[ResultSlots];
+        std::atomic<std::uint64_t>  _otherFailures{ 0 };
+        std::atomic<std::uint64_t>  _outcomes[OutcomeCount];
+    };
+
+    // Times consecutive stages of one function: each lap() charges the time since
+    // the previous lap (or construction) to the given stage, and with a tracer
+    // also emits it as a span tagged with toastId. Null recorders make it a no-op.
+    class WinToastStageTimer {
+    public:
+        explicit WinToastStageTimer(_In_opt_ WinToastStats* stats, _In_opt_ WinToastTracer* tracer = nullptr, _In_ std::int64_t toastId = -1) :
+            _stats(stats), _tracer(tracer), _toastId(toastId) {
+            if (_stats) {
+                _last = std::chrono::steady_clock::now();
+            }
+            if (_tracer) {
+                _traceLast = _tracer->now();
+            }
+        }
+
+        inline void lap(_In_ WinToastStats::Stage stage) {
+            if (_stats) {
+                const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                _stats->record(stage, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - _last).count()));
+                _last = now;
+            }
+            if (_tracer) {
+                const std::int64_t now = _tracer->now();
+                _tracer->complete(WinToastStats::stageName(stage), _traceLast, now - _traceLast, _toastId);
+                _traceLast = now;
+            }
+        }
+
+    private:
+        WinToastStats*                          _stats;
+        WinToastTracer*                         _tracer;
+        std::int64_t                            _toastId;
+        std::chrono::steady_clock::time_point   _last;
+        std::int64_t                            _traceLast = 0;
+    };
+}
+
+// Stage timers feed both the histograms and the tracer, so they are compiled
+// out only when both are (WINTOAST_NO_STATS and WINTOAST_NO_TRACE).
+#ifndef WINTOAST_NO_STATS
+#define WINTOAST_STATS_RECORDER(stats)          (stats).get()
+#define WINTOAST_STATS_COUNT(stats, call)       do { if (stats) { (stats)->call; } } while (0)
+#else
+#define WINTOAST_STATS_RECORDER(stats)          static_cast<WinToastLib::WinToastStats*>(nullptr)
+#define WINTOAST_STATS_COUNT(stats, call)       ((void)0)
+#endif
+
+#ifndef WINTOAST_NO_TRACE
+#define WINTOAST_TRACE_RECORDER(tracer)         (tracer).get()
+#define WINTOAST_TRACE(tracer, call)            do { if (tracer) { (tracer)->call; } } while (0)
+#else
+#define WINTOAST_TRACE_RECORDER(tracer)         static_cast<WinToastLib::WinToastTracer*>(nullptr)
+#define WINTOAST_TRACE(tracer, call)            ((void)0)
+#endif
+
+#if !defined(WINTOAST_NO_STATS) || !defined(WINTOAST_NO_TRACE)
+#define WINTOAST_STAGE_TIMER(timer, stats, tracer, toastId) \
+    WinToastLib::WinToastStageTimer timer(WINTOAST_STATS_RECORDER(stats), WINTOAST_TRACE_RECORDER(tracer), toastId)
+#define WINTOAST_STAGE_LAP(timer, stage)        (timer).lap(WinToastLib::WinToastStats::stage)
+#else
+#define WINTOAST_STAGE_TIMER(timer, stats, tracer, toastId) ((void)0)
+#define WINTOAST_STAGE_LAP(timer, stage)        ((void)0)
+#endif
+
+#endif // WINTOASTSTATS_H
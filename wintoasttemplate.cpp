@@ -0,0 +1,100 @@
+#include "wintoasttemplate.h"
+
+using namespace WinToastLib;
+
+namespace {
+    const std::uint64_t FnvOffsetBasis = 0xcbf29ce484222325ULL;
+    const std::uint64_t FnvPrime = 0x100000001b3ULL;
+
+    // One round per UTF-16 code unit rather than per byte, with the length folded
+    // in after each string so ("ab", "c") and ("a", "bc") differ.
+    inline void hashValue(_Inout_ std::uint64_t& hash, _In_ std::uint64_t value) {
+        hash = (hash ^ value) * FnvPrime;
+    }
+
+    inline void hashString(_Inout_ std::uint64_t& hash, _In_ const std::wstring& value) {
+        for (wchar_t c : value) {
+            hashValue(hash, static_cast<std::uint64_t>(c));
+        }
+        hashValue(hash, value.length());
+    }
+}
+
+WinToastTemplate::WinToastTemplate(_In_ WinToastTemplateType type) : _type(type) {
+    static const std::size_t TextFieldsCount[] = { 1, 2, 2, 3, 1, 2, 2, 3};
+    _textFields = std::vector<std::wstring>(TextFieldsCount[_type], L"");
+}
+
+WinToastTemplate& WinToastTemplate::setTextField(_In_ const std::wstring& txt, _In_ WinToastTemplate::TextField pos) {
+    _textFields[pos] = txt;
+    return *this;
+}
+
+WinToastTemplate& WinToastTemplate::setTextField(_In_ std::wstring&& txt, _In_ WinToastTemplate::TextField pos) {
+    _textFields[pos] = std::move(txt);
+    return *this;
+}
+
+WinToastTemplate& WinToastTemplate::setImagePath(_In_ const std::wstring& imgPath) {
+    _imagePath = imgPath;
+    return *this;
+}
+
+WinToastTemplate& WinToastTemplate::setImagePath(_In_ std::wstring&& imgPath) {
+    _imagePath = std::move(imgPath);
+    return *this;
+}
+
+WinToastTemplate& WinToastTemplate::setAudioPath(_In_ const std::wstring& audioPath) {
+    _audioPath = audioPath;
+    return *this;
+}
+
+WinToastTemplate& WinToastTemplate::setAudioPath(_In_ std::wstring&& audioPath) {
+    _audioPath = std::move(audioPath);
+    return *this;
+}
+
+WinToastTemplate& WinToastTemplate::setAudioOption(_In_ const WinToastTemplate::AudioOption & audioOption) {
+    _audioOption = audioOption;
+    return *this;
+}
+
+WinToastTemplate& WinToastTemplate::setAttributionText(_In_ const std::wstring& attributionText) {
+    _attributionText = attributionText;
+    return *this;
+}
+
+WinToastTemplate& WinToastTemplate::setAttributionText(_In_ std::wstring&& attributionText) {
+    _attributionText = std::move(attributionText);
+    return *this;
+}
+
+WinToastTemplate& WinToastTemplate::addAction(_In_ const std::wstring & label)
+{
+	_actions.push_back(label);
+    return *this;
+}
+
+WinToastTemplate& WinToastTemplate::addAction(_In_ std::wstring&& label)
+{
+	_actions.push_back(std::move(label));
+    return *this;
+}
+
+std::uint64_t WinToastTemplate::contentHash() const {
+    std::uint64_t hash = FnvOffsetBasis;
+    hashValue(hash, _type);
+    for (const auto& text : _textFields) {
+        hashString(hash, text);
+    }
+    hashString(hash, _attributionText);
+    hashValue(hash, _actions.size());
+    for (const auto& action : _actions) {
+        hashString(hash, action);
+    }
+    hashString(hash, _imagePath);
+    hashString(hash, _audioPath);
+    hashValue(hash, _audioOption);
+    return hash;
+}
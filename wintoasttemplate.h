@@ -0,0 +1,126 @@
+#ifndef WINTOASTTEMPLATE_H
+#define WINTOASTTEMPLATE_H
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// This header is kept free of Windows headers so the toast model and everything
+// built on top of it (payload compiler, registry, ...) can be compiled anywhere.
+// The enum values mirror the ABI ones; wintoastlib.cpp checks they stay in sync.
+#ifdef _WIN32
+#include <sal.h>
+#else
+#ifndef _In_
+#define _In_
+#endif
+#ifndef _In_opt_
+#define _In_opt_
+#endif
+#ifndef _Out_
+#define _Out_
+#endif
+#ifndef _Out_opt_
+#define _Out_opt_
+#endif
+#ifndef _Inout_
+#define _Inout_
+#endif
+#endif
+
+namespace WinToastLib {
+
+    class IWinToastHandler {
+    public:
+        enum WinToastDismissalReason {
+            UserCanceled = 0,       // ToastDismissalReason_UserCanceled
+            ApplicationHidden = 1,  // ToastDismissalReason_ApplicationHidden
+            TimedOut = 2            // ToastDismissalReason_TimedOut
+        };
+        virtual ~IWinToastHandler() {}
+        virtual void toastActivated() const = 0;
+        virtual void toastActivated(int actionIndex) const = 0;
+        virtual void toastDismissed(WinToastDismissalReason state) const = 0;
+        virtual void toastFailed() const = 0;
+    };
+
+    class WinToastTemplate {
+    public:
+        enum AudioOption { Default = 0, Silent = 1, Loop = 2 };
+        enum TextField { FirstLine = 0, SecondLine, ThirdLine };
+        enum WinToastTemplateType {
+            ImageAndText01 = 0,     // ToastTemplateType_ToastImageAndText01
+            ImageAndText02 = 1,     // ToastTemplateType_ToastImageAndText02
+            ImageAndText03 = 2,     // ToastTemplateType_ToastImageAndText03
+            ImageAndText04 = 3,     // ToastTemplateType_ToastImageAndText04
+            Text01 = 4,             // ToastTemplateType_ToastText01
+            Text02 = 5,             // ToastTemplateType_ToastText02
+            Text03 = 6,             // ToastTemplateType_ToastText03
+            Text04 = 7,             // ToastTemplateType_ToastText04
+            WinToastTemplateTypeCount
+        };
+
+        // No user-declared destructor, so templates keep their implicit move
+        // operations and can be handed over without copying any string.
+        WinToastTemplate(_In_ WinToastTemplateType type = ImageAndText02);
+
+        // Setters return the template so a toast can be built in one expression;
+        // the rvalue overloads take the string over instead of copying it.
+        WinToastTemplate&                           setTextField(_In_ const std::wstring& txt, _In_ TextField pos);
+        WinToastTemplate&                           setTextField(_In_ std::wstring&& txt, _In_ TextField pos);
+        WinToastTemplate&                           setImagePath(_In_ const std::wstring& imgPath);
+        WinToastTemplate&                           setImagePath(_In_ std::wstring&& imgPath);
+        WinToastTemplate&                           setAudioPath(_In_ const std::wstring& audioPath);
+        WinToastTemplate&                           setAudioPath(_In_ std::wstring&& audioPath);
+        WinToastTemplate&                           setAudioOption(_In_ const WinToastTemplate::AudioOption& audioOption);
+        WinToastTemplate&                           setAttributionText(_In_ const std::wstring& attributionText);
+        WinToastTemplate&                           setAttributionText(_In_ std::wstring&& attributionText);
+        WinToastTemplate&                           addAction(_In_ const std::wstring& label);
+        WinToastTemplate&                           addAction(_In_ std::wstring&& label);
+        inline WinToastTemplate&                    setExpiration(_In_ std::int64_t millisecondsFromNow) { _expiration = millisecondsFromNow; return *this; }
+        // Tag naming the producer; the rate limiter keeps one bucket per source.
+        inline WinToastTemplate&                    setSource(_In_ const std::wstring& source) { _source = source; return *this; }
+        inline WinToastTemplate&                    setSource(_In_ std::wstring&& source) { _source = std::move(source); return *this; }
+        // Identity for replace-by-tag: a toast shown with the same tag and group
+        // as a live one supersedes it, in Action Center and in WinToast's
+        // registry, instead of stacking next to it. No tag (the default) always
+        // shows a new toast.
+        inline WinToastTemplate&                    setTag(_In_ const std::wstring& tag) { _tag = tag; return *this; }
+        inline WinToastTemplate&                    setTag(_In_ std::wstring&& tag) { _tag = std::move(tag); return *this; }
+        inline WinToastTemplate&                    setGroup(_In_ const std::wstring& group) { _group = group; return *this; }
+        inline WinToastTemplate&                    setGroup(_In_ std::wstring&& group) { _group = std::move(group); return *this; }
+        inline int                                  textFieldsCount() const { return static_cast<int>(_textFields.size()); }
+        inline int                                  actionsCount() const { return static_cast<int>(_actions.size()); }
+        inline bool                                 hasImage() const { return _type < Text01; }
+        // References into the template: valid until it is changed or destroyed.
+        inline const std::vector<std::wstring>&     textFields() const { return _textFields; }
+        inline const std::wstring&                  textField(_In_ TextField pos) const { return _textFields[pos]; }
+        inline const std::wstring&                  actionLabel(_In_ int pos) const { return _actions[pos]; }
+        inline const std::wstring&                  imagePath() const { return _imagePath; }
+        inline const std::wstring&                  audioPath() const { return _audioPath; }
+        inline const std::wstring&                  attributionText() const { return _attributionText; }
+        inline std::int64_t                         expiration() const { return _expiration; }
+        inline const std::wstring&                  source() const { return _source; }
+        inline const std::wstring&                  tag() const { return _tag; }
+        inline const std::wstring&                  group() const { return _group; }
+        inline WinToastTemplateType                 type() const { return _type; }
+        inline WinToastTemplate::AudioOption        audioOption() const { return _audioOption; }
+        // 64-bit FNV-1a over what the user sees: type, text fields, attribution,
+        // actions, image and audio. Source, expiration, tag and group are left out.
+        std::uint64_t                               contentHash() const;
+
+    private:
+        std::vector<std::wstring>			_textFields;
+        std::wstring                        _imagePath;
+        std::wstring                        _audioPath;
+        std::vector<std::wstring>           _actions;
+        std::int64_t                        _expiration = 0;
+        WinToastTemplateType                _type;
+        WinToastTemplate::AudioOption       _audioOption = WinToastTemplate::AudioOption::Default;
+        std::wstring                        _attributionText;
+        std::wstring                        _source;
+        std::wstring                        _tag;
+        std::wstring                        _group;
+    };
+}
+#endif // WINTOASTTEMPLATE_H
@@ -0,0 +1,141 @@
+#include "wintoasttest.h"
+#include "wintoastfile.h"
+#include <cstdlib>
+#include <exception>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace WinToastLib;
+
+namespace {
+    const std::atomic<std::uint64_t>* AllocationCounter = nullptr;
+
+    const std::wstring& scratchDirectory() {
+        static const std::wstring directory = [] {
+#ifdef _WIN32
+            const char* root = std::getenv("TEMP");
+            const char* const DefaultRoot = ".";
+            const int pid = _getpid();
+#else
+            const char* root = std::getenv("TMPDIR");
+            const char* const DefaultRoot = "/tmp";
+            const int pid = static_cast<int>(getpid());
+#endif
+            const std::string base(root && *root ? root : DefaultRoot);
+            std::wstring path(base.begin(), base.end());
+            path += L"/wintoasttest-" + std::to_wstring(pid);
+            createDirectory(path);
+            return path;
+        }();
+        return directory;
+    }
+}
+
+void WinToastTestSuite::add(_In_ const std::string& name, _In_ Body body) {
+    _cases.emplace_back(name, std::move(body));
+}
+
+void WinToastTestSuite::addStandardCases() {
+    addPayloadCases();
+    addRegistryCases();
+    addTraceCases();
+    addAllocationCases();
+    addStressCases();
+    addSpoolCases();
+    addHistoryCases();
+    addRequestCases();
+    addShortcutCases();
+    addCapabilitiesCases();
+    addPoolCases();
+    addDedupCases();
+    addProgressCases();
+    addAsyncCases();
+    addRateLimitCases();
+    addDispatchCases();
+    addBackendCases();
+    addStatsCases();
+    addImageCacheCases();
+}
+
+std::size_t WinToastTestSuite::run(_In_ const std::string& filter, _Inout_ std::ostream& out) const {
+    std::size_t ran = 0;
+    std::size_t failed = 0;
+    for (const auto& testCase : _cases) {
+        if (!filter.empty() && testCase.first.find(filter) == std::string::npos) {
+            continue;
+        }
+        ++ran;
+        try {
+            testCase.second();
+            out << "ok    " << testCase.first << "\n";
+        } catch (const Failure& failure) {
+            ++failed;
+            out << "FAIL  " << testCase.first << "\n  " << failure.file << ":" << failure.line << ": " << failure.what << "\n";
+        } catch (const std::exception& e) {
+            ++failed;
+            out << "FAIL  " << testCase.first << "\n  exception: " << e.what() << "\n";
+        }
+        out.flush();
+    }
+    out << (ran - failed) << "/" << ran << " passed\n";
+    return failed;
+}
+
+void WinToastTestSuite::setAllocationCounter(_In_opt_ const std::atomic<std::uint64_t>* counter) {
+    AllocationCounter = counter;
+}
+
+bool WinToastTestSuite::countsAllocations() {
+    return AllocationCounter != nullptr;
+}
+
+std::uint64_t WinToastTestSuite::allocations() {
+    return AllocationCounter ? AllocationCounter->load(std::memory_order_relaxed) : 0;
+}
+
+int WinToastTestSuite::main(_In_ const std::vector<std::string>& args, _Inout_ std::ostream& out) {
+    if (args.size() > 1 || (!args.empty() && args[0].compare(0, 2, "--") == 0)) {
+        return 2;
+    }
+    WinToastTestSuite suite;
+    suite.addStandardCases();
+    const std::size_t failed = suite.run(args.empty() ? std::string() : args[0], out);
+    // Empty unless a case failed midway; remove() takes empty directories off Windows.
+    removeFile(scratchDirectory());
+    return failed ? 1 : 0;
+}
+
+std::wstring WinToastTestSuite::scratchPath(_In_ const std::wstring& name) {
+    return scratchDirectory() + L"/" + name;
+}
+
+std::string WinToastTestSuite::describe(_In_ const std::wstring& value) {
+    // Test data is ASCII apart from the odd escape test; anything else shows as \x{..}.
+    std::string text("\"");
+    for (wchar_t c : value) {
+        if (c >= 0x20 && c < 0x7f) {
+            text.push_back(static_cast<char>(c));
+        } else {
+            std::ostringstream escaped;
+            escaped << "\\x{" << std::hex << static_cast<unsigned long>(c) << "}";
+            text.append(escaped.str());
+        }
+    }
+    text.push_back('"');
+    return text;
+}
+
+std::string WinToastTestSuite::describe(_In_ const wchar_t* value) {
+    return describe(std::wstring(value));
+}
+
+std::string WinToastTestSuite::describe(_In_ const std::string& value) {
+    return "\"" + value + "\"";
+}
+
+std::string WinToastTestSuite::describe(_In_ const char* value) {
+    return describe(std::string(value));
+}
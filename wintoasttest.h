@@ -0,0 +1,93 @@
+#ifndef WINTOASTTEST_H
+#define WINTOASTTEST_H
+#include "wintoasttemplate.h"
+#include <atomic>
+#include <functional>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+namespace WinToastLib {
+
+    // Unit tests for the portable parts of the pipeline, laid out like
+    // WinToastBenchmark: a flat list of named cases run in order. A case stops at
+    // the first check that does not hold; the runner reports it and goes on with
+    // the next case. Each area adds its cases from its own wintoasttest_<area>.cpp.
+    // Nothing here touches Windows (see wintoasttest_main.cpp).
+    class WinToastTestSuite {
+    public:
+        typedef std::function<void()> Body;
+
+        // Thrown by the WINTOAST_CHECK macros.
+        struct Failure {
+            const char*         file;
+            int                 line;
+            std::string         what;
+        };
+
+        void                    add(_In_ const std::string& name, _In_ Body body);
+        void                    addStandardCases();
+        void                    addPayloadCases();
+        void                    addRegistryCases();
+        void                    addTraceCases();
+        void                    addAllocationCases();
+        void                    addStressCases();
+        void                    addSpoolCases();
+        void                    addHistoryCases();
+        void                    addRequestCases();
+        void                    addShortcutCases();
+        void                    addCapabilitiesCases();
+        void                    addPoolCases();
+        void                    addDedupCases();
+        void                    addProgressCases();
+        void                    addAsyncCases();
+        void                    addRateLimitCases();
+        void                    addDispatchCases();
+        void                    addBackendCases();
+        void                    addStatsCases();
+        void                    addImageCacheCases();
+        // Runs the cases whose name contains filter and writes one line per case
+        // to out. Returns the number of cases that failed.
+        std::size_t             run(_In_ const std::string& filter, _Inout_ std::ostream& out) const;
+
+        // Process-wide count of heap allocations, kept by the host binary like
+        // WinToastBenchmark's. Cases that count allocations are skipped without it.
+        static void             setAllocationCounter(_In_opt_ const std::atomic<std::uint64_t>* counter);
+        static bool             countsAllocations();
+        static std::uint64_t    allocations();
+        // A path for name in a directory of this run's own, under the system's
+        // temporary directory. Cases remove what they create.
+        static std::wstring     scratchPath(_In_ const std::wstring& name);
+        // Parses [filter], runs the standard cases and returns a process exit code.
+        static int              main(_In_ const std::vector<std::string>& args, _Inout_ std::ostream& out);
+
+        template <typename Actual, typename Expected>
+        static void             checkEqual(_In_ const Actual& actual, _In_ const Expected& expected, _In_ const char* expression,
+                                           _In_ const char* file, _In_ int line) {
+            if (!(actual == expected)) {
+                throw Failure{ file, line, std::string(expression) + "\n    actual:   " + describe(actual) + "\n    expected: " + describe(expected) };
+            }
+        }
+        static std::string      describe(_In_ const std::wstring& value);
+        static std::string      describe(_In_ const wchar_t* value);
+        static std::string      describe(_In_ const std::string& value);
+        static std::string      describe(_In_ const char* value);
+        template <typename T>
+        static std::string      describe(_In_ const T& value) {
+            std::ostringstream text;
+            text << value;
+            return text.str();
+        }
+
+    private:
+        std::vector<std::pair<std::string, Body>> _cases;
+    };
+}
+
+#define WINTOAST_CHECK(condition) \
+    do { if (!(condition)) { throw ::WinToastLib::WinToastTestSuite::Failure{ __FILE__, __LINE__, #condition }; } } while (0)
+
+#define WINTOAST_CHECK_EQUAL(actual, expected) \
+    ::WinToastLib::WinToastTestSuite::checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)
+
+#endif // WINTOASTTEST_H
@@ -0,0 +1,98 @@
+#include "wintoasttest.h"
+#include "wintoastpayload.h"
+#include "wintoastfrozen.h"
+
+using namespace WinToastLib;
+
+namespace {
+    // Long enough that no string fits the small-string buffer, so every copy shows up.
+    WinToastTemplate richToast() {
+        WinToastTemplate toast(WinToastTemplate::ImageAndText04);
+        toast.setTextField(L"Build 4711 failed on host-07 with a longer line", WinToastTemplate::FirstLine)
+             .setTextField(L"3 tests failed in the notification pipeline", WinToastTemplate::SecondLine)
+             .setTextField(L"Click to open the log & retry <now>", WinToastTemplate::ThirdLine)
+             .setImagePath(L"C:\\Users\\builder\\AppData\\Local\\CI\\icons\\failed.png")
+             .setAttributionText(L"via the continuous integration server")
+             .addAction(L"Open the build log")
+             .addAction(L"Retry the failed tests");
+        return toast;
+    }
+
+    // Heap allocations made by body.
+    template <typename Body>
+    std::uint64_t countAllocations(_In_ const Body& body) {
+        const std::uint64_t before = WinToastTestSuite::allocations();
+        body();
+        return WinToastTestSuite::allocations() - before;
+    }
+
+    volatile std::size_t Sink = 0;
+}
+
+void WinToastTestSuite::addAllocationCases() {
+    add("allocation.template", [] {
+        if (!countsAllocations()) {
+            return;
+        }
+        const WinToastTemplate toast = richToast();
+        // Getters hand out references: reading every field allocates nothing.
+        WINTOAST_CHECK_EQUAL(countAllocations([&toast] {
+            std::size_t total = 0;
+            for (int i = 0; i < toast.textFieldsCount(); i++) {
+                total += toast.textField(WinToastTemplate::TextField(i)).size();
+            }
+            for (int i = 0; i < toast.actionsCount(); i++) {
+                total += toast.actionLabel(i).size();
+            }
+            total += toast.textFields().size() + toast.imagePath().size() + toast.attributionText().size();
+            Sink = total;
+        }), std::uint64_t(0));
+
+        // Handing a built template over moves its strings; a copy allocates each one.
+        WinToastTemplate source = richToast();
+        const std::uint64_t copied = countAllocations([&source] {
+            WinToastTemplate copy(source);
+            Sink = copy.textFieldsCount();
+        });
+        const std::uint64_t moved = countAllocations([&source] {
+            WinToastTemplate taken(std::move(source));
+            Sink = taken.textFieldsCount();
+        });
+        WINTOAST_CHECK(copied >= 8);
+        WINTOAST_CHECK_EQUAL(moved, std::uint64_t(0));
+
+        // The rvalue setters take the string over.
+        WinToastTemplate target(WinToastTemplate::Text02);
+        std::wstring line(64, L'x');
+        WINTOAST_CHECK_EQUAL(countAllocations([&target, &line] {
+            target.setTextField(std::move(line), WinToastTemplate::FirstLine);
+        }), std::uint64_t(0));
+    });
+
+    add("allocation.payload", [] {
+        if (!countsAllocations()) {
+            return;
+        }
+        // Once the prototype is cached and the buffer has grown, a send compiles
+        // its payload without touching the heap, from a template or a frozen toast.
+        WinToastPrototypeCache cache;
+        const WinToastTemplate toast = richToast();
+        const WinToastFrozenToast frozen(toast);
+        std::wstring xml;
+        WinToastPayload::compile(*cache.get(toast.type(), true), toast, xml);
+        const std::uint64_t perSend = countAllocations([&] {
+            for (int i = 0; i < 100; i++) {
+                WinToastPayload::compile(*cache.get(toast.type(), true), toast, xml);
+                WinToastPayload::compile(*cache.get(frozen.type(), true), frozen, xml);
+            }
+        });
+        WINTOAST_CHECK_EQUAL(perSend, std::uint64_t(0));
+
+        // Compiling into a fresh string costs exactly one allocation: measure() sizes it.
+        WINTOAST_CHECK_EQUAL(countAllocations([&] {
+            std::wstring fresh;
+            WinToastPayload::compile(*cache.get(toast.type(), true), toast, fresh);
+            Sink = fresh.size();
+        }), std::uint64_t(1));
+    });
+}
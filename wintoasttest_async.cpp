@@ -0,0 +1,253 @@
+#include "wintoasttest.h"
+// WinToastAsync needs C++20; a C++14 build runs without these cases (see the
+// second build line under Tests in README.MD).
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#define WINTOAST_TEST_ASYNC
+#include "wintoastasync.h"
+#include <chrono>
+#endif
+
+using namespace WinToastLib;
+
+#ifdef WINTOAST_TEST_ASYNC
+namespace {
+    // Stands in for WinToast::showToast and hideToast: keeps the handlers of
+    // accepted toasts so a case can complete them later, from any thread.
+    struct FakeNotifier {
+        WinToastAsync::SendFunction send() {
+            return [this](WinToastTemplate&&, IWinToastHandler* handler) -> std::int64_t {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (refuse) {
+                    return -1;
+                }
+                handlers.emplace_back(handler);
+                return static_cast<std::int64_t>(handlers.size() - 1);
+            };
+        }
+
+        WinToastAsync::HideFunction hide() {
+            return [this](std::int64_t id) {
+                std::lock_guard<std::mutex> lock(mutex);
+                hidden.push_back(id);
+                return true;
+            };
+        }
+
+        const IWinToastHandler& handler(_In_ std::int64_t id) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return *handlers[static_cast<std::size_t>(id)];
+        }
+
+        std::vector<std::int64_t> hiddenIds() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return hidden;
+        }
+
+        std::mutex                                      mutex;
+        std::vector<std::unique_ptr<IWinToastHandler>>  handlers;
+        std::vector<std::int64_t>                       hidden;
+        bool                                            refuse = false;
+    };
+
+    // A coroutine nobody waits for; it stores what it awaited in result.
+    struct Detached {
+        struct promise_type {
+            Detached            get_return_object() { return {}; }
+            std::suspend_never  initial_suspend() noexcept { return {}; }
+            std::suspend_never  final_suspend() noexcept { return {}; }
+            void                return_void() {}
+            void                unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    Detached awaitInto(WinToastOperation operation, std::optional<WinToastResult>& result) {
+        result = co_await operation;
+    }
+
+    WinToastTemplate smallToast() {
+        WinToastTemplate toast(WinToastTemplate::Text01);
+        toast.setTextField(L"Build finished", WinToastTemplate::FirstLine);
+        return toast;
+    }
+}
+#endif
+
+void WinToastTestSuite::addAsyncCases() {
+#ifdef WINTOAST_TEST_ASYNC
+    add("async.outcomes", [] {
+        FakeNotifier notifier;
+        WinToastAsync async(notifier.send(), notifier.hide());
+
+        std::optional<WinToastResult> result;
+        WinToastOperation operation = async.show(smallToast());
+        awaitInto(operation, result);
+        WINTOAST_CHECK(!operation.done());
+        WINTOAST_CHECK(!result);
+        notifier.handler(operation.toastId()).toastActivated();
+        WINTOAST_CHECK(operation.done());
+        WINTOAST_CHECK(result && result->kind == WinToastResult::Activated);
+        WINTOAST_CHECK_EQUAL(result->toastId, std::int64_t(0));
+
+        // Only the first outcome counts.
+        operation = async.show(smallToast());
+        awaitInto(operation, result);
+        notifier.handler(operation.toastId()).toastActivated(2);
+        notifier.handler(operation.toastId()).toastDismissed(IWinToastHandler::UserCanceled);
+        WINTOAST_CHECK(result->kind == WinToastResult::ActionActivated);
+        WINTOAST_CHECK_EQUAL(result->actionIndex, 2);
+
+        // get() blocks for an outcome delivered on another thread.
+        operation = async.show(smallToast());
+        std::thread platform([&notifier, id = operation.toastId()] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            notifier.handler(id).toastDismissed(IWinToastHandler::TimedOut);
+        });
+        WinToastResult outcome = operation.get();
+        platform.join();
+        WINTOAST_CHECK(outcome.kind == WinToastResult::Dismissed);
+        WINTOAST_CHECK(outcome.reason == IWinToastHandler::TimedOut);
+
+        operation = async.show(smallToast());
+        notifier.handler(operation.toastId()).toastFailed();
+        // Already ended: co_await does not suspend.
+        awaitInto(operation, result);
+        WINTOAST_CHECK(result->kind == WinToastResult::Failed);
+        WINTOAST_CHECK_EQUAL(result->toastId, std::int64_t(3));
+
+        // A toast that was never sent fails at once; its handler stays with async.
+        notifier.refuse = true;
+        operation = async.show(smallToast());
+        WINTOAST_CHECK(operation.done());
+        outcome = operation.get();
+        WINTOAST_CHECK(outcome.kind == WinToastResult::Failed);
+        WINTOAST_CHECK_EQUAL(outcome.toastId, std::int64_t(-1));
+        WINTOAST_CHECK_EQUAL(notifier.handlers.size(), std::size_t(4));
+        WINTOAST_CHECK(notifier.hiddenIds().empty());
+    });
+
+    add("async.timeout", [] {
+        FakeNotifier notifier;
+        WinToastOperation leftover;
+        {
+            WinToastAsync async(notifier.send(), notifier.hide());
+            WinToastAsync::Options options;
+            options.timeoutMilliseconds = 20;
+
+            // By default the toast stays in Action Center.
+            WinToastOperation kept = async.show(smallToast(), options);
+            options.hideOnTimeout = true;
+            WinToastOperation hidden = async.show(smallToast(), options);
+            WINTOAST_CHECK(kept.get().kind == WinToastResult::TimedOut);
+            WINTOAST_CHECK(hidden.get().kind == WinToastResult::TimedOut);
+            const std::vector<std::int64_t> ids = notifier.hiddenIds();
+            WINTOAST_CHECK_EQUAL(ids.size(), std::size_t(1));
+            WINTOAST_CHECK_EQUAL(ids[0], hidden.toastId());
+            // A late outcome changes nothing.
+            notifier.handler(kept.toastId()).toastActivated();
+            WINTOAST_CHECK(kept.get().kind == WinToastResult::TimedOut);
+
+            // An outcome before the deadline wins, and the timer no longer counts.
+            options.timeoutMilliseconds = 60 * 1000;
+            WinToastOperation answered = async.show(smallToast(), options);
+            WinToastOperation waiting = async.show(smallToast(), options);
+            WINTOAST_CHECK_EQUAL(async.pendingTimeouts(), std::size_t(2));
+            notifier.handler(answered.toastId()).toastActivated();
+            WINTOAST_CHECK(answered.get().kind == WinToastResult::Activated);
+            WINTOAST_CHECK_EQUAL(async.pendingTimeouts(), std::size_t(1));
+            WINTOAST_CHECK(!waiting.done());
+
+            // Tearing async down ends what is still waiting for its timeout.
+            leftover = waiting;
+        }
+        WINTOAST_CHECK(leftover.done());
+        WINTOAST_CHECK(leftover.get().kind == WinToastResult::TimedOut);
+        WINTOAST_CHECK_EQUAL(notifier.hiddenIds().size(), std::size_t(1));
+    });
+
+    add("async.cancel", [] {
+        FakeNotifier notifier;
+        WinToastAsync async(notifier.send(), notifier.hide());
+
+        std::optional<WinToastResult> result;
+        WinToastOperation operation = async.show(smallToast());
+        awaitInto(operation, result);
+        WINTOAST_CHECK(operation.cancel());
+        WINTOAST_CHECK(result && result->kind == WinToastResult::Cancelled);
+        WINTOAST_CHECK(!operation.cancel());
+        notifier.handler(operation.toastId()).toastActivated();
+        WINTOAST_CHECK(operation.get().kind == WinToastResult::Cancelled);
+
+        // A stop request cancels too, whether it comes before or after the send.
+        std::stop_source source;
+        WinToastAsync::Options options;
+        options.stop = source.get_token();
+        WinToastOperation stopped = async.show(smallToast(), options);
+        awaitInto(stopped, result);
+        WINTOAST_CHECK(!stopped.done());
+        source.request_stop();
+        WINTOAST_CHECK(result->kind == WinToastResult::Cancelled);
+        WinToastOperation late = async.show(smallToast(), options);
+        WINTOAST_CHECK(late.done());
+        WINTOAST_CHECK(late.get().kind == WinToastResult::Cancelled);
+
+        // A toast that already ended is not hidden again.
+        WinToastOperation finished = async.show(smallToast());
+        notifier.handler(finished.toastId()).toastDismissed(IWinToastHandler::ApplicationHidden);
+        WINTOAST_CHECK(!finished.cancel());
+
+        const std::vector<std::int64_t> ids = notifier.hiddenIds();
+        WINTOAST_CHECK_EQUAL(ids.size(), std::size_t(3));
+        WINTOAST_CHECK_EQUAL(ids[0], operation.toastId());
+        WINTOAST_CHECK_EQUAL(ids[1], stopped.toastId());
+        WINTOAST_CHECK_EQUAL(ids[2], late.toastId());
+    });
+
+    add("async.executor", [] {
+        FakeNotifier notifier;
+        WinToastAsync async(notifier.send(), notifier.hide());
+        auto executor = std::make_shared<WinToastQueuedExecutor>();
+        WinToastAsync::Options options;
+        options.executor = executor;
+
+        std::optional<WinToastResult> first, second;
+        WinToastOperation a = async.show(smallToast(), options);
+        WinToastOperation b = async.show(smallToast(), options);
+        awaitInto(a, first);
+        awaitInto(b, second);
+
+        // Outcomes arrive on the platform's thread; the coroutines wait for run().
+        std::thread platform([&notifier, &a, &b] {
+            notifier.handler(b.toastId()).toastActivated(0);
+            notifier.handler(a.toastId()).toastFailed();
+        });
+        platform.join();
+        WINTOAST_CHECK(a.done() && b.done());
+        WINTOAST_CHECK(!first && !second);
+        WINTOAST_CHECK_EQUAL(executor->pending(), std::size_t(2));
+
+        WINTOAST_CHECK_EQUAL(executor->run(1), std::size_t(1));
+        WINTOAST_CHECK(second && second->kind == WinToastResult::ActionActivated);
+        WINTOAST_CHECK(!first);
+        WINTOAST_CHECK_EQUAL(executor->run(), std::size_t(1));
+        WINTOAST_CHECK(first && first->kind == WinToastResult::Failed);
+        WINTOAST_CHECK_EQUAL(executor->run(), std::size_t(0));
+
+        // Awaiting a toast that has already ended does not go through the executor.
+        std::optional<WinToastResult> third;
+        awaitInto(a, third);
+        WINTOAST_CHECK(third && third->kind == WinToastResult::Failed);
+        WINTOAST_CHECK_EQUAL(executor->pending(), std::size_t(0));
+
+        // runFor waits for a continuation queued from elsewhere.
+        WinToastOperation c = async.show(smallToast(), options);
+        awaitInto(c, third);
+        std::thread later([&notifier, id = c.toastId()] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            notifier.handler(id).toastActivated();
+        });
+        WINTOAST_CHECK_EQUAL(executor->runFor(10000), std::size_t(1));
+        later.join();
+        WINTOAST_CHECK(third->kind == WinToastResult::Activated);
+    });
+#endif
+}
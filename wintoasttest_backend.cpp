@@ -0,0 +1,89 @@
+#include "wintoasttest.h"
+#include "wintoastpool.h"
+
+using namespace WinToastLib;
+
+namespace {
+    // E_FAIL, negative where long is 64-bit too.
+    const long Failed = static_cast<long>(static_cast<std::int32_t>(0x80004005u));
+
+    class ActivationCounter : public IWinToastHandler {
+    public:
+        explicit ActivationCounter(_In_ std::atomic<int>& activations) : _activations(activations) {}
+        void toastActivated() const override { _activations++; }
+        void toastActivated(int) const override {}
+        void toastDismissed(WinToastDismissalReason) const override {}
+        void toastFailed() const override {}
+
+    private:
+        std::atomic<int>&   _activations;
+    };
+
+    WinToastFrozenToast smallToast() {
+        WinToastTemplate toast(WinToastTemplate::Text01);
+        toast.setTextField(L"Build finished", WinToastTemplate::FirstLine);
+        return WinToastFrozenToast(toast);
+    }
+}
+
+void WinToastTestSuite::addBackendCases() {
+    add("backend.session", [] {
+        // WinToastBackendTenant opens the notifier session the way WinToast does:
+        // on the first send, and again only after a failure dropped it.
+        auto backend = std::make_shared<WinToastMemoryBackend>();
+        WinToastBackendTenant tenant(L"WinToast.App", backend);
+        const WinToastFrozenToast toast = smallToast();
+        std::atomic<int> activations{ 0 };
+        auto handler = std::make_shared<ActivationCounter>(activations);
+        WINTOAST_CHECK(!backend->hasSession());
+
+        for (int i = 0; i < 1000; i++) {
+            WINTOAST_CHECK(tenant.show(toast, handler) >= 0);
+        }
+        WinToastMemoryBackend::Counters counters = backend->counters();
+        WINTOAST_CHECK_EQUAL(counters.sessionsOpened, std::size_t(1));
+        // Both factories (manager and notification), looked up once.
+        WINTOAST_CHECK_EQUAL(counters.factoryLookups, std::size_t(2));
+        WINTOAST_CHECK_EQUAL(counters.notifiersCreated, std::size_t(1));
+        WINTOAST_CHECK_EQUAL(counters.shows, std::size_t(1000));
+        WINTOAST_CHECK_EQUAL(counters.failures, std::size_t(0));
+        WINTOAST_CHECK(backend->aumi() == L"WinToast.App");
+        WINTOAST_CHECK(backend->activate(backend->lastShown()));
+        WINTOAST_CHECK_EQUAL(activations.load(), 1);
+
+        // A failing call drops the session; the next send builds a new one.
+        backend->failNext(Failed);
+        WINTOAST_CHECK_EQUAL(tenant.show(toast, handler), std::int64_t(-1));
+        WINTOAST_CHECK(!backend->hasSession());
+        for (int i = 0; i < 100; i++) {
+            WINTOAST_CHECK(tenant.show(toast, handler) >= 0);
+        }
+        counters = backend->counters();
+        WINTOAST_CHECK_EQUAL(counters.failures, std::size_t(1));
+        WINTOAST_CHECK_EQUAL(counters.sessionsOpened, std::size_t(2));
+        WINTOAST_CHECK_EQUAL(counters.factoryLookups, std::size_t(4));
+        WINTOAST_CHECK_EQUAL(counters.notifiersCreated, std::size_t(2));
+        WINTOAST_CHECK_EQUAL(counters.shows, std::size_t(1100));
+
+        // Each of several failures in a row costs a session.
+        backend->failNext(Failed, 3);
+        for (int i = 0; i < 3; i++) {
+            WINTOAST_CHECK_EQUAL(tenant.show(toast, handler), std::int64_t(-1));
+        }
+        WINTOAST_CHECK(tenant.show(toast, handler) >= 0);
+        counters = backend->counters();
+        WINTOAST_CHECK_EQUAL(counters.failures, std::size_t(4));
+        WINTOAST_CHECK_EQUAL(counters.sessionsOpened, std::size_t(5));
+        WINTOAST_CHECK_EQUAL(counters.notifiersCreated, std::size_t(5));
+        WINTOAST_CHECK_EQUAL(counters.shows, std::size_t(1101));
+
+        // Without a session the backend refuses to show anything.
+        backend->closeSession();
+        WinToastNotificationHandle notification;
+        WINTOAST_CHECK(backend->show(L"<toast/>", 0, handler, notification) < 0);
+        WINTOAST_CHECK(!notification);
+        WINTOAST_CHECK(tenant.show(toast, handler) >= 0);
+        WINTOAST_CHECK_EQUAL(backend->counters().sessionsOpened, std::size_t(6));
+        WINTOAST_CHECK_EQUAL(backend->counters().failures, std::size_t(4));
+    });
+}
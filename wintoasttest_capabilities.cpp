@@ -0,0 +1,81 @@
+#include "wintoasttest.h"
+#include "wintoastcapabilities.h"
+#include <thread>
+#include <vector>
+
+using namespace WinToastLib;
+
+namespace {
+    // Reports a fixed system and counts how often it was asked.
+    class FixedProbe : public IWinToastCapabilityProbe {
+    public:
+        explicit FixedProbe(_In_ bool modern) : _modern(modern) {}
+
+        WinToastCapabilities probe() override {
+            _calls++;
+            WinToastCapabilities capabilities;
+            capabilities.set(WinToastCapabilities::AppUserModelId);
+            capabilities.set(WinToastCapabilities::ShellLinkProperties);
+            capabilities.set(WinToastCapabilities::WinRTActivation);
+            capabilities.set(WinToastCapabilities::Actions, _modern);
+            capabilities.set(WinToastCapabilities::Audio, _modern);
+            capabilities.set(WinToastCapabilities::Attribution, _modern);
+            capabilities.majorVersion = _modern ? 10 : 6;
+            return capabilities;
+        }
+
+        inline std::size_t calls() const { return _calls.load(); }
+
+    private:
+        const bool                  _modern;
+        std::atomic<std::size_t>    _calls{ 0 };
+    };
+}
+
+void WinToastTestSuite::addCapabilitiesCases() {
+    add("capabilities.probe-once", [] {
+        // The snapshot is process-wide; start from a dropped one and leave it that way.
+        WinToastCapabilitySnapshot::install(nullptr);
+        const std::size_t before = WinToastCapabilitySnapshot::probeCount();
+        FixedProbe fallback(false);
+
+        const int Threads = 16;
+        std::vector<const WinToastCapabilities*> seen(Threads);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < Threads; t++) {
+            threads.emplace_back([&fallback, &seen, t] {
+                for (int i = 0; i < 10000; i++) {
+                    seen[t] = &WinToastCapabilitySnapshot::get(fallback);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        WINTOAST_CHECK_EQUAL(fallback.calls(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(WinToastCapabilitySnapshot::probeCount(), before + 1);
+        for (const WinToastCapabilities* capabilities : seen) {
+            WINTOAST_CHECK(capabilities == seen[0]);
+        }
+        const WinToastCapabilities& legacy = *seen[0];
+        WINTOAST_CHECK(legacy.compatible());
+        WINTOAST_CHECK(!legacy.modern());
+        WINTOAST_CHECK_EQUAL(legacy.majorVersion, std::uint32_t(6));
+
+        // An installed probe replaces the fallback and is run once as well.
+        auto modern = std::make_shared<FixedProbe>(true);
+        WinToastCapabilitySnapshot::install(modern);
+        WINTOAST_CHECK(WinToastCapabilitySnapshot::get(fallback).modern());
+        WINTOAST_CHECK(WinToastCapabilitySnapshot::get(fallback).modern());
+        WINTOAST_CHECK_EQUAL(modern->calls(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(fallback.calls(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(WinToastCapabilitySnapshot::probeCount(), before + 2);
+        // References handed out earlier still read the old snapshot.
+        WINTOAST_CHECK(!legacy.modern());
+
+        WinToastCapabilitySnapshot::install(nullptr);
+        WINTOAST_CHECK(!WinToastCapabilitySnapshot::get(fallback).modern());
+        WINTOAST_CHECK_EQUAL(fallback.calls(), std::size_t(2));
+        WinToastCapabilitySnapshot::install(nullptr);
+    });
+}
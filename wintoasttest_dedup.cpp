@@ -0,0 +1,108 @@
+#include "wintoasttest.h"
+#include "wintoastdedup.h"
+
+using namespace WinToastLib;
+
+namespace {
+    const std::int64_t Second = 1000000;
+
+    WinToastDeduplicator::Options windowOf(_In_ std::int64_t seconds) {
+        WinToastDeduplicator::Options options;
+        options.windowMicroseconds = seconds * Second;
+        return options;
+    }
+}
+
+void WinToastTestSuite::addDedupCases() {
+    add("dedup.window", [] {
+        auto clock = std::make_shared<WinToastManualClock>();
+        WinToastDeduplicator dedup(windowOf(60), clock);
+        const std::uint64_t hash = 0x9e3779b97f4a7c15ULL;
+
+        WinToastDeduplicator::Verdict verdict = dedup.check(hash);
+        WINTOAST_CHECK(!verdict.suppress);
+        WINTOAST_CHECK_EQUAL(verdict.repeats, std::uint32_t(0));
+
+        // Repeats inside the window are suppressed and counted.
+        clock->advance(10 * Second);
+        verdict = dedup.check(hash);
+        WINTOAST_CHECK(verdict.suppress);
+        WINTOAST_CHECK_EQUAL(verdict.repeats, std::uint32_t(1));
+        clock->advance(49 * Second);
+        verdict = dedup.check(hash);
+        WINTOAST_CHECK(verdict.suppress);
+        WINTOAST_CHECK_EQUAL(verdict.repeats, std::uint32_t(2));
+
+        // The window runs from the copy that was shown, not from the repeats.
+        clock->advance(1 * Second);
+        verdict = dedup.check(hash);
+        WINTOAST_CHECK(!verdict.suppress);
+        WINTOAST_CHECK_EQUAL(verdict.repeats, std::uint32_t(2));
+        WINTOAST_CHECK(WinToastDeduplicator::repeatAttribution(L"Build bot", verdict.repeats) == L"Build bot (2 repeats)");
+
+        // That copy opened a new window, with the count reset.
+        verdict = dedup.check(hash);
+        WINTOAST_CHECK(verdict.suppress);
+        WINTOAST_CHECK_EQUAL(verdict.repeats, std::uint32_t(1));
+        WINTOAST_CHECK(WinToastDeduplicator::repeatAttribution(L"", verdict.repeats) == L"(1 repeat)");
+
+        // Other content is not affected.
+        WINTOAST_CHECK(!dedup.check(hash + 1).suppress);
+
+        const WinToastDeduplicator::Counters counters = dedup.counters();
+        WINTOAST_CHECK_EQUAL(counters.checked, std::uint64_t(6));
+        WINTOAST_CHECK_EQUAL(counters.suppressed, std::uint64_t(3));
+        WINTOAST_CHECK_EQUAL(counters.evictions, std::uint64_t(0));
+
+        dedup.clear();
+        WINTOAST_CHECK(!dedup.check(hash).suppress);
+    });
+
+    add("dedup.uncommitted", [] {
+        // A toast turned away after lookup (rate limited, spool full) was never
+        // committed, so sending it again is not a repeat.
+        auto clock = std::make_shared<WinToastManualClock>();
+        WinToastDeduplicator dedup(windowOf(60), clock);
+        const std::uint64_t hash = 42;
+
+        for (int i = 0; i < 3; i++) {
+            WINTOAST_CHECK(!dedup.lookup(hash).suppress);
+            clock->advance(Second);
+        }
+        dedup.commit(hash);
+        WINTOAST_CHECK(dedup.lookup(hash).suppress);
+        WINTOAST_CHECK_EQUAL(dedup.counters().checked, std::uint64_t(4));
+        WINTOAST_CHECK_EQUAL(dedup.counters().suppressed, std::uint64_t(1));
+    });
+
+    add("dedup.eviction", [] {
+        // One set of two ways: every hash competes for the same two entries.
+        auto clock = std::make_shared<WinToastManualClock>();
+        WinToastDeduplicator::Options options = windowOf(60);
+        options.sets = 1;
+        options.ways = 2;
+        WinToastDeduplicator dedup(options, clock);
+
+        WINTOAST_CHECK(!dedup.check(1).suppress);
+        clock->advance(Second);
+        WINTOAST_CHECK(!dedup.check(2).suppress);
+        clock->advance(Second);
+        // The set is full: 3 pushes out 1, the entry shown longest ago.
+        WINTOAST_CHECK(!dedup.check(3).suppress);
+        WINTOAST_CHECK_EQUAL(dedup.counters().evictions, std::uint64_t(1));
+        WINTOAST_CHECK(dedup.check(2).suppress);
+        WINTOAST_CHECK(dedup.check(3).suppress);
+
+        // 1 gets through early, and pushes out 2 in turn.
+        WINTOAST_CHECK(!dedup.check(1).suppress);
+        WINTOAST_CHECK_EQUAL(dedup.counters().evictions, std::uint64_t(2));
+        WINTOAST_CHECK(dedup.check(1).suppress);
+        WINTOAST_CHECK(dedup.check(3).suppress);
+
+        // Entries whose window has closed are replaced without counting.
+        clock->advance(60 * Second);
+        WINTOAST_CHECK(!dedup.check(4).suppress);
+        WINTOAST_CHECK(!dedup.check(5).suppress);
+        WINTOAST_CHECK_EQUAL(dedup.counters().evictions, std::uint64_t(2));
+    });
+}
@@ -0,0 +1,151 @@
+#include "wintoasttest.h"
+#include "wintoastdispatch.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace WinToastLib;
+
+namespace {
+    // Counts deliveries per outcome; each outcome carries its number as the
+    // action index.
+    class DeliveryCounter : public IWinToastHandler {
+    public:
+        explicit DeliveryCounter(_In_ std::size_t outcomes) : _deliveries(outcomes) {}
+        void toastActivated() const override {}
+        void toastActivated(int actionIndex) const override {
+            _deliveries[static_cast<std::size_t>(actionIndex)]++;
+            std::lock_guard<std::mutex> lock(_mutex);
+            _order.push_back(actionIndex);
+        }
+        void toastDismissed(WinToastDismissalReason) const override {}
+        void toastFailed() const override {}
+
+        inline int deliveries(_In_ std::size_t outcome) const { return _deliveries[outcome].load(); }
+        std::vector<int> order() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _order;
+        }
+
+    private:
+        mutable std::vector<std::atomic<int>>   _deliveries;
+        mutable std::mutex                      _mutex;
+        mutable std::vector<int>                _order;
+    };
+
+    WinToastOutcome outcomeFor(_In_ int number, _In_ const std::shared_ptr<IWinToastHandler>& handler) {
+        WinToastOutcome outcome;
+        outcome.toastId = number;
+        outcome.kind = WinToastOutcome::ActionActivated;
+        outcome.actionIndex = number;
+        outcome.handler = handler;
+        return outcome;
+    }
+
+    // Posts Producers x PerProducer outcomes from as many threads at once and
+    // notes which ones the dispatcher accepted.
+    std::vector<char> postFromThreads(_In_ WinToastDispatcher& dispatcher, _In_ const std::shared_ptr<IWinToastHandler>& handler,
+                                      _In_ int producers, _In_ int perProducer) {
+        std::vector<char> accepted(static_cast<std::size_t>(producers * perProducer), 0);
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; p++) {
+            threads.emplace_back([&, p] {
+                for (int i = 0; i < perProducer; i++) {
+                    const int number = p * perProducer + i;
+                    accepted[static_cast<std::size_t>(number)] = dispatcher.post(outcomeFor(number, handler)) ? 1 : 0;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return accepted;
+    }
+
+    bool settle(_In_ const WinToastDispatcher& dispatcher, _In_ int timeoutMilliseconds) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+        for (;;) {
+            const WinToastDispatcher::Counters counters = dispatcher.counters();
+            if (counters.delivered + counters.dropped == counters.posted && counters.depth == 0) {
+                return true;
+            }
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void WinToastTestSuite::addDispatchCases() {
+    add("dispatch.polled", [] {
+        // Nothing is delivered until poll(); beyond the capacity, posts are dropped.
+        WinToastDispatcher::Options options;
+        options.mode = WinToastDispatcher::Polled;
+        options.capacity = 8;
+        WinToastDispatcher dispatcher(options);
+        auto counter = std::make_shared<DeliveryCounter>(40);
+        const std::vector<char> accepted = postFromThreads(dispatcher, counter, 4, 10);
+
+        WinToastDispatcher::Counters counters = dispatcher.counters();
+        WINTOAST_CHECK_EQUAL(counters.posted, std::uint64_t(40));
+        WINTOAST_CHECK_EQUAL(counters.dropped, std::uint64_t(32));
+        WINTOAST_CHECK_EQUAL(counters.delivered, std::uint64_t(0));
+        WINTOAST_CHECK_EQUAL(counters.depth, std::size_t(8));
+        WINTOAST_CHECK_EQUAL(counters.highWaterDepth, std::size_t(8));
+        WINTOAST_CHECK(counter->order().empty());
+
+        WINTOAST_CHECK_EQUAL(dispatcher.poll(3), std::size_t(3));
+        WINTOAST_CHECK_EQUAL(dispatcher.counters().depth, std::size_t(5));
+        WINTOAST_CHECK_EQUAL(dispatcher.poll(), std::size_t(5));
+        WINTOAST_CHECK_EQUAL(dispatcher.poll(), std::size_t(0));
+        for (std::size_t i = 0; i < accepted.size(); i++) {
+            WINTOAST_CHECK_EQUAL(counter->deliveries(i), int(accepted[i]));
+        }
+        counters = dispatcher.counters();
+        WINTOAST_CHECK_EQUAL(counters.delivered + counters.dropped, counters.posted);
+        WINTOAST_CHECK_EQUAL(counters.depth, std::size_t(0));
+
+        // From one producer, outcomes come out in the order they went in.
+        for (int i = 0; i < 8; i++) {
+            WINTOAST_CHECK(dispatcher.post(outcomeFor(i, counter)));
+        }
+        WINTOAST_CHECK(!dispatcher.post(outcomeFor(8, counter)));
+        WINTOAST_CHECK_EQUAL(dispatcher.poll(), std::size_t(8));
+        const std::vector<int> order = counter->order();
+        for (int i = 0; i < 8; i++) {
+            WINTOAST_CHECK_EQUAL(order[order.size() - 8 + static_cast<std::size_t>(i)], i);
+        }
+        WINTOAST_CHECK_EQUAL(dispatcher.counters().highWaterDepth, std::size_t(8));
+    });
+
+    add("dispatch.multi-producer", [] {
+        // Eight producers against one dedicated thread and against a pool of
+        // four: every accepted outcome is delivered exactly once, and nothing
+        // that was dropped is delivered at all.
+        const int Producers = 8;
+        const int PerProducer = 20000;
+        const WinToastDispatcher::Mode modes[] = { WinToastDispatcher::DedicatedThread, WinToastDispatcher::ThreadPool };
+        for (WinToastDispatcher::Mode mode : modes) {
+            WinToastDispatcher::Options options;
+            options.mode = mode;
+            options.capacity = 64;
+            options.threads = 4;
+            WinToastDispatcher dispatcher(options);
+            auto counter = std::make_shared<DeliveryCounter>(static_cast<std::size_t>(Producers * PerProducer));
+            const std::vector<char> accepted = postFromThreads(dispatcher, counter, Producers, PerProducer);
+            WINTOAST_CHECK(settle(dispatcher, 10000));
+
+            const WinToastDispatcher::Counters counters = dispatcher.counters();
+            WINTOAST_CHECK_EQUAL(counters.posted, std::uint64_t(Producers * PerProducer));
+            WINTOAST_CHECK_EQUAL(counters.delivered + counters.dropped, counters.posted);
+            WINTOAST_CHECK(counters.highWaterDepth <= std::size_t(64));
+            std::uint64_t acceptedCount = 0;
+            for (std::size_t i = 0; i < accepted.size(); i++) {
+                WINTOAST_CHECK_EQUAL(counter->deliveries(i), int(accepted[i]));
+                acceptedCount += accepted[i];
+            }
+            WINTOAST_CHECK_EQUAL(acceptedCount, counters.delivered);
+        }
+    });
+}
@@ -0,0 +1,201 @@
+#include "wintoasttest.h"
+#include "wintoastfile.h"
+#include "wintoasthistory.h"
+#include <sstream>
+
+using namespace WinToastLib;
+
+namespace {
+    WinToastHistory::Record sampleRecord(_In_ std::int64_t id, _In_ std::int64_t timestamp, _In_ WinToastStats::Outcome outcome,
+                                         _In_ int type = 0, _In_ const wchar_t* headline = L"build failed") {
+        WinToastHistory::Record record;
+        record.toastId = id;
+        record.timestamp = timestamp;
+        record.outcome = outcome;
+        record.latencyMilliseconds = 10;
+        record.type = WinToastTemplate::WinToastTemplateType(type);
+        record.textHash = WinToastHistory::hashText(headline);
+        if (outcome == WinToastStats::ActionActivated) {
+            record.actionIndex = 1;
+            record.actionLabels = { L"Retry", L"Open log" };
+        }
+        return record;
+    }
+
+    // Removes every file of the history at prefix.
+    void removeHistory(_In_ const std::wstring& prefix) {
+        const std::size_t slash = prefix.find_last_of(L"/\\");
+        const std::wstring directory = prefix.substr(0, slash);
+        const std::wstring stem = prefix.substr(slash + 1) + L".";
+        std::vector<std::wstring> names;
+        listDirectory(directory, [&](const std::wstring& name) {
+            if (name.compare(0, stem.size(), stem) == 0) {
+                names.push_back(name);
+            }
+        });
+        for (const std::wstring& name : names) {
+            removeFile(directory + L"/" + name);
+        }
+    }
+
+    std::uint64_t fileSize(_In_ const std::wstring& path) {
+        std::uint64_t size = 0;
+        std::int64_t modified = 0;
+        WINTOAST_CHECK(fileStatus(path, size, modified));
+        return size;
+    }
+}
+
+void WinToastTestSuite::addHistoryCases() {
+    add("history.rollover", [] {
+        const std::wstring prefix = scratchPath(L"rollover");
+        removeHistory(prefix);
+        WinToastHistory::Options options;
+        options.batchRecords = 10;
+        options.segmentBytes = 4000;
+        options.flushIntervalMilliseconds = 60000;
+        {
+            // Flushed after every batch, so blocks start at every tenth record.
+            WinToastHistory history(options);
+            WINTOAST_CHECK(history.open(prefix));
+            for (int i = 0; i < 1000; i++) {
+                history.record(sampleRecord(i, 1000 + i, WinToastStats::Outcome(i % WinToastStats::OutcomeCount), i % 3,
+                                            i % 2 ? L"build failed" : L"build ok"));
+                if (i % 10 == 9) {
+                    history.flush();
+                }
+            }
+            const WinToastHistory::Counters counters = history.counters();
+            WINTOAST_CHECK_EQUAL(counters.written, std::uint64_t(1000));
+            WINTOAST_CHECK_EQUAL(counters.dropped, std::uint64_t(0));
+            WINTOAST_CHECK(counters.segments > 1);
+
+            // Whole blocks come from the index; only the two at the ends of the range are read.
+            WinToastHistory::Query query;
+            WinToastHistory::Summary summary = history.summarize(query);
+            WINTOAST_CHECK_EQUAL(summary.count, std::uint64_t(1000));
+            WINTOAST_CHECK_EQUAL(summary.blocksRead, std::uint64_t(0));
+            query.from = 1105;
+            query.to = 1505;
+            summary = history.summarize(query);
+            WINTOAST_CHECK_EQUAL(summary.count, std::uint64_t(400));
+            WINTOAST_CHECK_EQUAL(summary.blocksRead, std::uint64_t(2));
+            WINTOAST_CHECK_EQUAL(summary.latencyMilliseconds, std::uint64_t(4000));
+
+            query.outcomes = 1u << WinToastStats::DismissedTimedOut;
+            std::size_t visited = 0;
+            history.query(query, [&visited](const WinToastHistory::Record& record) {
+                WINTOAST_CHECK(record.outcome == WinToastStats::DismissedTimedOut);
+                visited++;
+                return true;
+            });
+            WINTOAST_CHECK(visited > 0);
+            WINTOAST_CHECK_EQUAL(history.summarize(query).count, static_cast<std::uint64_t>(visited));
+
+            query = WinToastHistory::Query();
+            query.matchText = true;
+            query.textHash = WinToastHistory::hashText(L"build failed");
+            WINTOAST_CHECK_EQUAL(history.summarize(query).count, std::uint64_t(500));
+            query.outcomes = 1u << WinToastStats::ActionActivated;
+            visited = 0;
+            history.query(query, [&visited](const WinToastHistory::Record& record) {
+                WINTOAST_CHECK(record.actionLabels.size() == 2 && record.actionLabels[1] == L"Open log");
+                WINTOAST_CHECK_EQUAL(record.actionIndex, 1);
+                visited++;
+                return true;
+            });
+            WINTOAST_CHECK(visited > 0);
+        }
+        // Reopened with a retention limit, old segments go once new ones roll over.
+        options.maxSegments = 3;
+        WinToastHistory history(options);
+        WINTOAST_CHECK(history.open(prefix));
+        WINTOAST_CHECK_EQUAL(history.summarize(WinToastHistory::Query()).count, std::uint64_t(1000));
+        for (int i = 0; i < 100; i++) {
+            history.record(sampleRecord(2000 + i, 5000 + i, WinToastStats::Activated));
+        }
+        history.flush();
+        WINTOAST_CHECK(history.counters().segments <= 3);
+        const std::uint64_t kept = history.summarize(WinToastHistory::Query()).count;
+        WINTOAST_CHECK(kept < 1100);
+        WinToastHistory::Query newest;
+        newest.from = 5000;
+        WINTOAST_CHECK_EQUAL(history.summarize(newest).count, std::uint64_t(100));
+        history.close();
+        removeHistory(prefix);
+    });
+
+    add("history.index-repair", [] {
+        // The .idx entry of a block is written after the block itself; a crash in
+        // between leaves a torn entry, or none. open() indexes such blocks again.
+        const std::wstring prefix = scratchPath(L"repair");
+        const std::wstring index = prefix + L".1.idx";
+        removeHistory(prefix);
+        WinToastHistory::Options options;
+        options.batchRecords = 50;
+        options.flushIntervalMilliseconds = 60000;
+        {
+            // Flushed after every batch, as above: recorded in one go, a late
+            // writer can split them into more than 4 blocks.
+            WinToastHistory history(options);
+            WINTOAST_CHECK(history.open(prefix));
+            for (int i = 0; i < 200; i++) {
+                history.record(sampleRecord(i, i, WinToastStats::Activated));
+                if (i % 50 == 49) {
+                    history.flush();
+                }
+            }
+            WINTOAST_CHECK_EQUAL(history.counters().blocks, std::uint64_t(4));
+        }
+        const std::uint64_t entryBytes = fileSize(index) / 4;
+        WINTOAST_CHECK(truncateFile(index, entryBytes * 2 + entryBytes / 2));
+        {
+            WinToastHistory history(options);
+            WINTOAST_CHECK(history.open(prefix));
+            WINTOAST_CHECK_EQUAL(history.summarize(WinToastHistory::Query()).count, std::uint64_t(200));
+            WINTOAST_CHECK_EQUAL(history.query(WinToastHistory::Query(), [](const WinToastHistory::Record&) { return true; }), std::size_t(200));
+        }
+        // The repair was written back: the torn entry is gone, and the records
+        // after the last whole one are indexed again as one block.
+        WINTOAST_CHECK_EQUAL(fileSize(index), entryBytes * 3);
+
+        // Garbage after the last entry is cut off, and appends continue after it.
+        std::FILE* file = openFile(index, "ab");
+        WINTOAST_CHECK(file != nullptr);
+        std::fwrite("garbage", 1, 7, file);
+        std::fclose(file);
+        {
+            WinToastHistory history(options);
+            WINTOAST_CHECK(history.open(prefix));
+            for (int i = 200; i < 260; i++) {
+                history.record(sampleRecord(i, i, WinToastStats::Failed));
+            }
+            history.flush();
+        }
+        WinToastHistory history(options);
+        WINTOAST_CHECK(history.open(prefix));
+        WINTOAST_CHECK_EQUAL(history.summarize(WinToastHistory::Query()).count, std::uint64_t(260));
+        WinToastHistory::Query failed;
+        failed.outcomes = 1u << WinToastStats::Failed;
+        WINTOAST_CHECK_EQUAL(history.summarize(failed).count, std::uint64_t(60));
+        history.close();
+        removeHistory(prefix);
+    });
+
+    add("history.query-main", [] {
+        const std::wstring prefix = scratchPath(L"cli");
+        removeHistory(prefix);
+        {
+            WinToastHistory history;
+            WINTOAST_CHECK(history.open(prefix));
+            history.record(sampleRecord(1, WinToastHistory::now(), WinToastStats::ActionActivated));
+            history.record(sampleRecord(2, WinToastHistory::now(), WinToastStats::Failed, 0, L"build ok"));
+        }
+        std::wostringstream out;
+        WINTOAST_CHECK_EQUAL(WinToastHistory::queryMain({ prefix, L"--list", L"--outcome", L"clicked", L"--text", L"build failed" }, out), 0);
+        WINTOAST_CHECK(out.str().find(L"Open log") != std::wstring::npos);
+        WINTOAST_CHECK(WinToastHistory::queryMain({ prefix, L"--outcome", L"bogus" }, out) != 0);
+        WINTOAST_CHECK(WinToastHistory::queryMain({ prefix, L"--since" }, out) != 0);
+        removeHistory(prefix);
+    });
+}
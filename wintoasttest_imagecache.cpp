@@ -0,0 +1,261 @@
+#include "wintoasttest.h"
+#include "wintoastimagecache.h"
+#include "wintoastfile.h"
+#include <atomic>
+#include <cstdio>
+
+using namespace WinToastLib;
+
+namespace {
+    // The portable codec, counting decodes.
+    class CountingCodec : public IWinToastImageCodec {
+    public:
+        bool decode(_In_ const std::uint8_t* data, _In_ std::size_t size, _Out_ WinToastImage& image) override {
+            _decodes++;
+            return _codec.decode(data, size, image);
+        }
+        bool encodePng(_In_ const WinToastImage& image, _Out_ std::vector<std::uint8_t>& png) override {
+            return _codec.encodePng(image, png);
+        }
+
+        inline int decodes() const { return _decodes.load(); }
+
+    private:
+        WinToastPortableImageCodec  _codec;
+        std::atomic<int>            _decodes{ 0 };
+    };
+
+    // A size x size 24-bit bottom-up BMP of one colour.
+    std::vector<std::uint8_t> solidBmp(_In_ int size, _In_ std::uint8_t red, _In_ std::uint8_t green, _In_ std::uint8_t blue) {
+        const std::size_t stride = (static_cast<std::size_t>(size) * 3 + 3) & ~static_cast<std::size_t>(3);
+        std::vector<std::uint8_t> file(54 + stride * size, 0);
+        auto put32 = [&file](std::size_t offset, std::uint32_t value) {
+            for (int i = 0; i < 4; i++) {
+                file[offset + i] = static_cast<std::uint8_t>(value >> (8 * i));
+            }
+        };
+        file[0] = 'B';
+        file[1] = 'M';
+        put32(2, static_cast<std::uint32_t>(file.size()));
+        put32(10, 54);
+        put32(14, 40);
+        put32(18, static_cast<std::uint32_t>(size));
+        put32(22, static_cast<std::uint32_t>(size));
+        file[26] = 1;
+        file[28] = 24;
+        for (int y = 0; y < size; y++) {
+            std::uint8_t* row = &file[54 + stride * y];
+            for (int x = 0; x < size; x++) {
+                row[x * 3] = blue;
+                row[x * 3 + 1] = green;
+                row[x * 3 + 2] = red;
+            }
+        }
+        return file;
+    }
+
+    bool writeBytes(_In_ const std::wstring& path, _In_ const std::vector<std::uint8_t>& contents) {
+        std::FILE* file = openFile(path, "wb");
+        if (!file) {
+            return false;
+        }
+        const bool written = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        return std::fclose(file) == 0 && written;
+    }
+
+    bool exists(_In_ const std::wstring& path) {
+        std::uint64_t size;
+        std::int64_t modified;
+        return fileStatus(path, size, modified);
+    }
+
+    // Removes directory and the files in it.
+    void removeTree(_In_ const std::wstring& directory) {
+        std::vector<std::wstring> names;
+        listDirectory(directory, [&names](const std::wstring& name) { names.push_back(name); });
+        for (const std::wstring& name : names) {
+            removeFile(directory + L"/" + name);
+        }
+        removeFile(directory);
+    }
+
+    // Sources live next to the cache's directory, in a directory of their own.
+    struct Scratch {
+        explicit Scratch(_In_ const std::wstring& name) :
+            sources(WinToastTestSuite::scratchPath(name + L"-sources")), copies(WinToastTestSuite::scratchPath(name + L"-copies")) {
+            removeTree(sources);
+            removeTree(copies);
+            createDirectory(sources);
+        }
+        ~Scratch() {
+            removeTree(sources);
+            removeTree(copies);
+        }
+
+        std::wstring source(_In_ const std::wstring& name) const { return sources + L"/" + name; }
+
+        const std::wstring  sources;
+        const std::wstring  copies;
+    };
+
+    // Resolves source until a copy is ready; empty if it never is.
+    std::wstring resolveReady(_In_ WinToastImageCache& cache, _In_ const std::wstring& source) {
+        for (int attempt = 0; attempt < 2; attempt++) {
+            const std::wstring copy = cache.resolve(source);
+            if (!copy.empty() || !cache.waitIdle(10000)) {
+                return copy;
+            }
+        }
+        return std::wstring();
+    }
+}
+
+void WinToastTestSuite::addImageCacheCases() {
+    add("imagecache.hit", [] {
+        Scratch scratch(L"imagecache-hit");
+        auto codec = std::make_shared<CountingCodec>();
+        WinToastImageCache::Options options;
+        options.maxDimension = 16;
+        options.workers = 1;
+        std::wstring copy;
+        {
+            WinToastImageCache cache(options, codec);
+            WINTOAST_CHECK(cache.open(scratch.copies));
+            const std::wstring big = scratch.source(L"big.bmp");
+            WINTOAST_CHECK(writeBytes(big, solidBmp(64, 200, 30, 30)));
+
+            // The first toast shows the source while a worker makes the copy.
+            WINTOAST_CHECK(cache.resolve(big).empty());
+            WINTOAST_CHECK(cache.waitIdle(10000));
+            WINTOAST_CHECK(cache.state(big) == WinToastImageCache::Ready);
+            copy = cache.resolve(big);
+            WINTOAST_CHECK(!copy.empty());
+            WINTOAST_CHECK(exists(copy));
+            WINTOAST_CHECK(copy.compare(copy.length() - 4, 4, L".png") == 0);
+
+            // Later toasts get the copy from memory, without decoding again.
+            for (int i = 0; i < 5; i++) {
+                WINTOAST_CHECK_EQUAL(cache.resolve(big), copy);
+            }
+            WINTOAST_CHECK_EQUAL(codec->decodes(), 1);
+
+            // The same contents under another name share the copy.
+            const std::wstring twin = scratch.source(L"twin.bmp");
+            WINTOAST_CHECK(writeBytes(twin, solidBmp(64, 200, 30, 30)));
+            WINTOAST_CHECK_EQUAL(resolveReady(cache, twin), copy);
+            WINTOAST_CHECK_EQUAL(codec->decodes(), 1);
+
+            // Sources that cannot be read fail, and are shown as they are.
+            const std::wstring missing = scratch.source(L"missing.bmp");
+            WINTOAST_CHECK(resolveReady(cache, missing).empty());
+            WINTOAST_CHECK(cache.state(missing) == WinToastImageCache::Failed);
+
+            const WinToastImageCache::Counters counters = cache.counters();
+            WINTOAST_CHECK_EQUAL(counters.hits, std::uint64_t(7));
+            WINTOAST_CHECK_EQUAL(counters.processed, std::uint64_t(2));
+            WINTOAST_CHECK_EQUAL(counters.shared, std::uint64_t(1));
+            WINTOAST_CHECK_EQUAL(counters.downscaled, std::uint64_t(1));
+            WINTOAST_CHECK_EQUAL(counters.failed, std::uint64_t(1));
+            WINTOAST_CHECK_EQUAL(counters.entries, std::size_t(1));
+        }
+
+        // The next run takes the copy over: it hashes the source but does not decode it.
+        WinToastImageCache cache(options, codec);
+        WINTOAST_CHECK(cache.open(scratch.copies));
+        WINTOAST_CHECK_EQUAL(cache.counters().entries, std::size_t(1));
+        WINTOAST_CHECK_EQUAL(resolveReady(cache, scratch.source(L"big.bmp")), copy);
+        WINTOAST_CHECK_EQUAL(codec->decodes(), 1);
+        WINTOAST_CHECK_EQUAL(cache.counters().shared, std::uint64_t(1));
+    });
+
+    add("imagecache.eviction", [] {
+        Scratch scratch(L"imagecache-eviction");
+        auto codec = std::make_shared<CountingCodec>();
+        // Every 16 x 16 copy has the same size: stored PNG blocks do not compress.
+        WinToastImage sample;
+        sample.width = 16;
+        sample.height = 16;
+        sample.pixels.assign(16 * 16 * 4, 0);
+        std::vector<std::uint8_t> png;
+        WINTOAST_CHECK(WinToastPortableImageCodec().encodePng(sample, png));
+        const std::size_t copyBytes = png.size();
+
+        // Room for two copies, not three.
+        WinToastImageCache::Options options;
+        options.maxDimension = 16;
+        options.maxBytes = copyBytes * 5 / 2;
+        options.workers = 1;
+        WinToastImageCache cache(options, codec);
+        WINTOAST_CHECK(cache.open(scratch.copies));
+        const std::wstring a = scratch.source(L"a.bmp"), b = scratch.source(L"b.bmp"), c = scratch.source(L"c.bmp");
+        WINTOAST_CHECK(writeBytes(a, solidBmp(16, 255, 0, 0)));
+        WINTOAST_CHECK(writeBytes(b, solidBmp(16, 0, 255, 0)));
+        WINTOAST_CHECK(writeBytes(c, solidBmp(16, 0, 0, 255)));
+
+        const std::wstring copyA = resolveReady(cache, a);
+        const std::wstring copyB = resolveReady(cache, b);
+        WINTOAST_CHECK(!copyA.empty() && !copyB.empty());
+        WINTOAST_CHECK_EQUAL(cache.counters().bytes, 2 * copyBytes);
+        // a was used last, so b goes when c comes in.
+        WINTOAST_CHECK_EQUAL(cache.resolve(a), copyA);
+        WINTOAST_CHECK(!resolveReady(cache, c).empty());
+
+        WinToastImageCache::Counters counters = cache.counters();
+        WINTOAST_CHECK_EQUAL(counters.evicted, std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(counters.entries, std::size_t(2));
+        WINTOAST_CHECK_EQUAL(counters.bytes, 2 * copyBytes);
+        WINTOAST_CHECK_EQUAL(counters.copied, std::uint64_t(3));
+        WINTOAST_CHECK(cache.state(b) == WinToastImageCache::Missing);
+        WINTOAST_CHECK(cache.state(a) == WinToastImageCache::Ready);
+        WINTOAST_CHECK(!exists(copyB));
+        WINTOAST_CHECK(exists(copyA));
+
+        // An evicted source is copied again on its next use, pushing out a.
+        WINTOAST_CHECK(cache.resolve(b).empty());
+        WINTOAST_CHECK(cache.waitIdle(10000));
+        WINTOAST_CHECK_EQUAL(cache.resolve(b), copyB);
+        WINTOAST_CHECK_EQUAL(codec->decodes(), 4);
+        WINTOAST_CHECK(cache.state(a) == WinToastImageCache::Missing);
+        WINTOAST_CHECK_EQUAL(cache.counters().evicted, std::uint64_t(2));
+    });
+
+    add("imagecache.revalidate", [] {
+        Scratch scratch(L"imagecache-revalidate");
+        auto codec = std::make_shared<CountingCodec>();
+        WinToastImageCache::Options options;
+        options.maxDimension = 16;
+        options.workers = 1;
+        // Every resolve checks the source's stamp again.
+        options.revalidateMilliseconds = 0;
+        WinToastImageCache cache(options, codec);
+        WINTOAST_CHECK(cache.open(scratch.copies));
+        const std::wstring source = scratch.source(L"logo.bmp");
+        WINTOAST_CHECK(writeBytes(source, solidBmp(16, 255, 0, 0)));
+        const std::wstring first = resolveReady(cache, source);
+        WINTOAST_CHECK(!first.empty());
+
+        // An unchanged stamp is not read again.
+        WINTOAST_CHECK_EQUAL(cache.resolve(source), first);
+        WINTOAST_CHECK(cache.waitIdle(10000));
+        WINTOAST_CHECK_EQUAL(cache.counters().processed, std::uint64_t(1));
+
+        // A new size is a new stamp: the old copy is shown once more while the
+        // new one is made.
+        WINTOAST_CHECK(writeBytes(source, solidBmp(12, 0, 0, 255)));
+        WINTOAST_CHECK_EQUAL(cache.resolve(source), first);
+        WINTOAST_CHECK(cache.waitIdle(10000));
+        const std::wstring second = cache.resolve(source);
+        WINTOAST_CHECK(!second.empty());
+        WINTOAST_CHECK(second != first);
+        WINTOAST_CHECK_EQUAL(cache.counters().processed, std::uint64_t(2));
+        WINTOAST_CHECK_EQUAL(codec->decodes(), 2);
+
+        // A source that went away fails on its next check.
+        WINTOAST_CHECK(cache.waitIdle(10000));
+        WINTOAST_CHECK(removeFile(source));
+        cache.resolve(source);
+        WINTOAST_CHECK(cache.waitIdle(10000));
+        WINTOAST_CHECK(cache.state(source) == WinToastImageCache::Failed);
+        WINTOAST_CHECK(cache.resolve(source).empty());
+    });
+}
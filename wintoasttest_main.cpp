@@ -0,0 +1,70 @@
+// Standalone entry point for the unit tests, for builds without the Windows
+// parts of WinToast. On Linux, compile wintoasttest*.cpp (this file included),
+// the portable sources listed in wintoastbench_main.cpp and wintoastrequest.cpp,
+// wintoasthistory.cpp, wintoastspool.cpp, wintoastfile.cpp, wintoastimagecache.cpp
+// and wintoastcapabilities.cpp, e.g.
+//
+//   g++ -std=c++14 -g -pthread -o wintoasttest wintoasttest*.cpp <the files above>
+//   ./wintoasttest [filter]
+//
+// Built with -std=c++20 and wintoastasync.cpp added, it also runs the async cases.
+//
+// Exits with 0 when every case passed. Like the benchmark runner, it replaces the
+// global operator new so the allocation cases can count heap allocations.
+#include "wintoasttest.h"
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+namespace {
+    std::atomic<std::uint64_t> Allocations{ 0 };
+
+    void* countedAllocation(std::size_t size) {
+        Allocations.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size ? size : 1);
+    }
+}
+
+void* operator new(std::size_t size) {
+    if (void* p = countedAllocation(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocation(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocation(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char** argv) {
+    WinToastLib::WinToastTestSuite::setAllocationCounter(&Allocations);
+    const int status = WinToastLib::WinToastTestSuite::main(std::vector<std::string>(argv + 1, argv + argc), std::cout);
+    if (status == 2) {
+        std::cerr << "Usage: wintoasttest [filter]" << std::endl;
+    }
+    return status;
+}
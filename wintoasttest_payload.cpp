@@ -0,0 +1,245 @@
+#include "wintoasttest.h"
+#include "wintoastpayload.h"
+#include "wintoastfrozen.h"
+
+using namespace WinToastLib;
+
+namespace {
+    // Every text field filled in as "Line n", plus an image for the image types.
+    WinToastTemplate sampleToast(_In_ WinToastTemplate::WinToastTemplateType type) {
+        WinToastTemplate toast(type);
+        for (int i = 0; i < toast.textFieldsCount(); i++) {
+            toast.setTextField(L"Line " + std::to_wstring(i + 1), WinToastTemplate::TextField(i));
+        }
+        if (toast.hasImage()) {
+            toast.setImagePath(L"C:\\Images\\logo.png");
+        }
+        return toast;
+    }
+
+    // Markup, escaping and the modern-only parts all at once.
+    WinToastTemplate featuredToast() {
+        WinToastTemplate toast(WinToastTemplate::ImageAndText02);
+        toast.setTextField(L"Tom & \"Jerry\" <3", WinToastTemplate::FirstLine)
+             .setTextField(L"it's", WinToastTemplate::SecondLine)
+             .setImagePath(L"\\\\server\\share\\a b#1.png")
+             .setAttributionText(L"via <app>")
+             .addAction(L"Yes")
+             .addAction(L"No & later")
+             .setAudioPath(L"ms-winsoundevent:Notification.IM")
+             .setAudioOption(WinToastTemplate::Loop);
+        return toast;
+    }
+
+    const wchar_t* const FeaturedModern =
+        L"<toast template=\"ToastGeneric\" duration=\"short\"><visual><binding template=\"ToastImageAndText02\">"
+        L"<image id=\"1\" src=\"file://server/share/a b%231.png\"/>"
+        L"<text id=\"1\">Tom &amp; &quot;Jerry&quot; &lt;3</text><text id=\"2\">it&apos;s</text>"
+        L"<text placement=\"attribution\">via &lt;app&gt;</text></binding></visual>"
+        L"<actions><action content=\"Yes\" arguments=\"0\"/><action content=\"No &amp; later\" arguments=\"1\"/></actions>"
+        L"<audio src=\"ms-winsoundevent:Notification.IM\" loop=\"true\"/></toast>";
+
+    const wchar_t* const FeaturedLegacy =
+        L"<toast><visual><binding template=\"ToastImageAndText02\">"
+        L"<image id=\"1\" src=\"file://server/share/a b%231.png\"/>"
+        L"<text id=\"1\">Tom &amp; &quot;Jerry&quot; &lt;3</text><text id=\"2\">it&apos;s</text></binding></visual></toast>";
+
+    // Builds the built-in prototypes and counts how often each one was asked
+    // for; refuses every type while failing is set.
+    class CountingProvider : public IWinToastTemplateProvider {
+    public:
+        bool createPrototype(_In_ WinToastTemplate::WinToastTemplateType type, _In_ bool modernFeatures, _Out_ WinToastPrototype& prototype) override {
+            _calls[type * 2 + (modernFeatures ? 1 : 0)]++;
+            return !failing && _builtin.createPrototype(type, modernFeatures, prototype);
+        }
+
+        inline int calls(_In_ WinToastTemplate::WinToastTemplateType type, _In_ bool modernFeatures) const {
+            return _calls[type * 2 + (modernFeatures ? 1 : 0)];
+        }
+        int total() const {
+            int sum = 0;
+            for (int calls : _calls) {
+                sum += calls;
+            }
+            return sum;
+        }
+
+        bool                            failing = false;
+
+    private:
+        WinToastBuiltinTemplateProvider _builtin;
+        int                             _calls[WinToastTemplate::WinToastTemplateTypeCount * 2] = {};
+    };
+}
+
+void WinToastTestSuite::addPayloadCases() {
+    add("payload.golden.types", [] {
+        // Without actions, audio or attribution both feature levels give the same document.
+        static const wchar_t* const Expected[] = {
+            L"<toast><visual><binding template=\"ToastImageAndText01\"><image id=\"1\" src=\"file:///C:/Images/logo.png\"/>"
+            L"<text id=\"1\">Line 1</text></binding></visual></toast>",
+            L"<toast><visual><binding template=\"ToastImageAndText02\"><image id=\"1\" src=\"file:///C:/Images/logo.png\"/>"
+            L"<text id=\"1\">Line 1</text><text id=\"2\">Line 2</text></binding></visual></toast>",
+            L"<toast><visual><binding template=\"ToastImageAndText03\"><image id=\"1\" src=\"file:///C:/Images/logo.png\"/>"
+            L"<text id=\"1\">Line 1</text><text id=\"2\">Line 2</text></binding></visual></toast>",
+            L"<toast><visual><binding template=\"ToastImageAndText04\"><image id=\"1\" src=\"file:///C:/Images/logo.png\"/>"
+            L"<text id=\"1\">Line 1</text><text id=\"2\">Line 2</text><text id=\"3\">Line 3</text></binding></visual></toast>",
+            L"<toast><visual><binding template=\"ToastText01\"><text id=\"1\">Line 1</text></binding></visual></toast>",
+            L"<toast><visual><binding template=\"ToastText02\"><text id=\"1\">Line 1</text><text id=\"2\">Line 2</text></binding></visual></toast>",
+            L"<toast><visual><binding template=\"ToastText03\"><text id=\"1\">Line 1</text><text id=\"2\">Line 2</text></binding></visual></toast>",
+            L"<toast><visual><binding template=\"ToastText04\"><text id=\"1\">Line 1</text><text id=\"2\">Line 2</text>"
+            L"<text id=\"3\">Line 3</text></binding></visual></toast>"
+        };
+        for (int type = 0; type < WinToastTemplate::WinToastTemplateTypeCount; type++) {
+            const WinToastTemplate toast = sampleToast(WinToastTemplate::WinToastTemplateType(type));
+            WINTOAST_CHECK_EQUAL(WinToastPayload::compile(toast, true), Expected[type]);
+            WINTOAST_CHECK_EQUAL(WinToastPayload::compile(toast, false), Expected[type]);
+        }
+    });
+
+    add("payload.golden.features", [] {
+        const WinToastTemplate toast = featuredToast();
+        WINTOAST_CHECK_EQUAL(WinToastPayload::compile(toast, true), FeaturedModern);
+        WINTOAST_CHECK_EQUAL(WinToastPayload::compile(toast, false), FeaturedLegacy);
+    });
+
+    add("payload.golden.frozen", [] {
+        // A frozen toast compiles to exactly what its template does.
+        WinToastPrototypeCache cache;
+        for (int type = 0; type < WinToastTemplate::WinToastTemplateTypeCount; type++) {
+            const WinToastTemplate toast = sampleToast(WinToastTemplate::WinToastTemplateType(type));
+            const WinToastFrozenToast frozen(toast);
+            for (bool modernFeatures : { false, true }) {
+                auto prototype = cache.get(toast.type(), modernFeatures);
+                WINTOAST_CHECK(prototype != nullptr);
+                std::wstring xml;
+                WinToastPayload::compile(*prototype, frozen, xml);
+                WINTOAST_CHECK_EQUAL(xml, WinToastPayload::compile(toast, modernFeatures));
+            }
+        }
+        auto prototype = cache.get(WinToastTemplate::ImageAndText02, true);
+        std::wstring xml;
+        WinToastPayload::compile(*prototype, WinToastFrozenToast(featuredToast()), xml);
+        WINTOAST_CHECK_EQUAL(xml, FeaturedModern);
+    });
+
+    add("payload.golden.progress", [] {
+        WinToastPrototypeCache cache;
+        WinToastTemplate toast(WinToastTemplate::ImageAndText02);
+        toast.setTextField(L"Copying", WinToastTemplate::FirstLine)
+             .setTextField(L"3 files", WinToastTemplate::SecondLine)
+             .setImagePath(L"C:\\Images\\logo.png")
+             .setAttributionText(L"via app");
+        auto modern = cache.get(toast.type(), true);
+        WINTOAST_CHECK(WinToastPayload::supportsProgress(*modern));
+        std::wstring xml;
+        WinToastPayload::compile(*modern, toast, xml, nullptr, true);
+        WINTOAST_CHECK_EQUAL(xml,
+            L"<toast><visual><binding template=\"ToastGeneric\"><image id=\"1\" src=\"file:///C:/Images/logo.png\"/>"
+            L"<text id=\"1\">Copying</text><text id=\"2\">3 files</text>"
+            L"<progress title=\"{progressTitle}\" value=\"{progressValue}\" valueStringOverride=\"{progressValueString}\" status=\"{progressStatus}\"/>"
+            L"<text placement=\"attribution\">via app</text></binding></visual></toast>");
+        WINTOAST_CHECK_EQUAL(WinToastPayload::measure(*modern, toast, nullptr, true), xml.size());
+        std::wstring frozen;
+        WinToastPayload::compile(*modern, WinToastFrozenToast(toast), frozen, nullptr, true);
+        WINTOAST_CHECK_EQUAL(frozen, xml);
+
+        // The legacy bindings cannot show the bar, so it is never emitted there.
+        auto legacy = cache.get(toast.type(), false);
+        WINTOAST_CHECK(!WinToastPayload::supportsProgress(*legacy));
+        WinToastPayload::compile(*legacy, toast, xml, nullptr, true);
+        WINTOAST_CHECK_EQUAL(xml, WinToastPayload::compile(toast, false));
+    });
+
+    add("payload.measure", [] {
+        // measure() sizes the buffer compile() fills, so it must agree to the character.
+        const WinToastTemplate featured = featuredToast();
+        for (bool modernFeatures : { false, true }) {
+            WINTOAST_CHECK_EQUAL(WinToastPayload::measure(featured, modernFeatures), WinToastPayload::compile(featured, modernFeatures).size());
+            for (int type = 0; type < WinToastTemplate::WinToastTemplateTypeCount; type++) {
+                const WinToastTemplate toast = sampleToast(WinToastTemplate::WinToastTemplateType(type));
+                WINTOAST_CHECK_EQUAL(WinToastPayload::measure(toast, modernFeatures), WinToastPayload::compile(toast, modernFeatures).size());
+            }
+        }
+    });
+
+    add("payload.prototype-cache", [] {
+        auto provider = std::make_shared<CountingProvider>();
+        WinToastPrototypeCache cache(provider);
+
+        // One prototype per type and feature level, built on first use and
+        // shared from then on.
+        std::shared_ptr<const WinToastPrototype> first[WinToastTemplate::WinToastTemplateTypeCount][2];
+        for (int round = 0; round < 3; round++) {
+            for (int type = 0; type < WinToastTemplate::WinToastTemplateTypeCount; type++) {
+                for (bool modernFeatures : { false, true }) {
+                    auto prototype = cache.get(WinToastTemplate::WinToastTemplateType(type), modernFeatures);
+                    WINTOAST_CHECK(prototype != nullptr);
+                    WINTOAST_CHECK(prototype->type == type);
+                    WINTOAST_CHECK_EQUAL(prototype->modernFeatures, modernFeatures);
+                    if (round == 0) {
+                        first[type][modernFeatures] = prototype;
+                    } else {
+                        WINTOAST_CHECK(prototype == first[type][modernFeatures]);
+                    }
+                }
+            }
+        }
+        const int Slots = WinToastTemplate::WinToastTemplateTypeCount * 2;
+        WINTOAST_CHECK_EQUAL(provider->total(), Slots);
+        WINTOAST_CHECK_EQUAL(provider->calls(WinToastTemplate::Text02, true), 1);
+        WINTOAST_CHECK_EQUAL(cache.misses(), std::size_t(Slots));
+        WINTOAST_CHECK_EQUAL(cache.hits(), std::size_t(2 * Slots));
+        WINTOAST_CHECK(cache.get(WinToastTemplate::WinToastTemplateType(-1), true) == nullptr);
+        WINTOAST_CHECK(cache.get(WinToastTemplate::WinToastTemplateTypeCount, true) == nullptr);
+        WINTOAST_CHECK_EQUAL(provider->total(), Slots);
+
+        // invalidate() drops every prototype; prototypes handed out stay valid.
+        cache.invalidate();
+        auto rebuilt = cache.get(WinToastTemplate::Text02, true);
+        WINTOAST_CHECK(rebuilt != first[WinToastTemplate::Text02][1]);
+        WINTOAST_CHECK(rebuilt->skeleton == first[WinToastTemplate::Text02][1]->skeleton);
+        WINTOAST_CHECK_EQUAL(provider->calls(WinToastTemplate::Text02, true), 2);
+        WINTOAST_CHECK_EQUAL(provider->calls(WinToastTemplate::Text02, false), 1);
+
+        // A prototype the provider could not build is not cached.
+        provider->failing = true;
+        WINTOAST_CHECK(cache.get(WinToastTemplate::Text01, true) == nullptr);
+        WINTOAST_CHECK(cache.get(WinToastTemplate::Text01, true) == nullptr);
+        WINTOAST_CHECK_EQUAL(provider->calls(WinToastTemplate::Text01, true), 3);
+        provider->failing = false;
+
+        // A new provider replaces the source and everything built from the old one.
+        auto replacement = std::make_shared<CountingProvider>();
+        cache.setProvider(replacement);
+        WINTOAST_CHECK(cache.get(WinToastTemplate::Text02, true) != rebuilt);
+        WINTOAST_CHECK(cache.get(WinToastTemplate::Text02, true) != nullptr);
+        WINTOAST_CHECK_EQUAL(replacement->calls(WinToastTemplate::Text02, true), 1);
+        WINTOAST_CHECK_EQUAL(provider->calls(WinToastTemplate::Text02, true), 2);
+        // Null goes back to the built-in provider.
+        cache.setProvider(nullptr);
+        WINTOAST_CHECK(cache.get(WinToastTemplate::Text02, true) != nullptr);
+        WINTOAST_CHECK_EQUAL(replacement->total(), 1);
+    });
+
+    add("payload.image-uri", [] {
+        struct {
+            const wchar_t* path;
+            const wchar_t* uri;
+        } const Cases[] = {
+            { L"C:\\a\\b.png",                  L"file:///C:/a/b.png" },
+            { L"\\\\?\\C:\\long\\b.png",        L"file:///C:/long/b.png" },
+            { L"\\\\?\\UNC\\server\\s\\b.png",  L"file://server/s/b.png" },
+            { L"//server/s/b.png",              L"file://server/s/b.png" },
+            { L"/tmp/b.png",                    L"file:///tmp/b.png" },
+            { L"C:\\100%\\a?b&c.png",           L"file:///C:/100%25/a%3Fb&amp;c.png" },
+        };
+        for (const auto& c : Cases) {
+            WinToastTemplate toast(WinToastTemplate::ImageAndText01);
+            toast.setTextField(L"x", WinToastTemplate::FirstLine).setImagePath(c.path);
+            const std::wstring xml = WinToastPayload::compile(toast, true);
+            const std::wstring expected = std::wstring(L"src=\"") + c.uri + L"\"";
+            WINTOAST_CHECK(xml.find(expected) != std::wstring::npos);
+        }
+    });
+}
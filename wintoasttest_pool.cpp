@@ -0,0 +1,167 @@
+#include "wintoasttest.h"
+#include "wintoastpool.h"
+#include <map>
+
+using namespace WinToastLib;
+
+namespace {
+    class FailureCounter : public IWinToastHandler {
+    public:
+        explicit FailureCounter(_In_ std::atomic<int>& failures) : _failures(failures) {}
+        void toastActivated() const override {}
+        void toastActivated(int) const override {}
+        void toastDismissed(WinToastDismissalReason) const override {}
+        void toastFailed() const override { _failures++; }
+
+    private:
+        std::atomic<int>&   _failures;
+    };
+
+    // Backend tenant that notes which tenant each send was for, in send order.
+    class RecordingTenant : public WinToastBackendTenant {
+    public:
+        RecordingTenant(_In_ const std::wstring& aumi, _In_ std::vector<std::wstring>& order, _In_ std::mutex& mutex) :
+            WinToastBackendTenant(aumi, std::make_shared<WinToastMemoryBackend>()), _aumi(aumi), _order(order), _mutex(mutex) {}
+
+        std::int64_t show(_In_ const WinToastFrozenToast& toast, _In_ const std::shared_ptr<IWinToastHandler>& handler) override {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _order.push_back(_aumi);
+            }
+            return WinToastBackendTenant::show(toast, handler);
+        }
+
+    private:
+        std::wstring                _aumi;
+        std::vector<std::wstring>&  _order;
+        std::mutex&                 _mutex;
+    };
+
+    std::map<std::wstring, std::size_t> tally(_In_ const std::vector<std::wstring>& order, _In_ std::size_t from, _In_ std::size_t to) {
+        std::map<std::wstring, std::size_t> counts;
+        for (std::size_t i = from; i < to; i++) {
+            counts[order[i]]++;
+        }
+        return counts;
+    }
+
+    WinToastTemplate smallToast() {
+        WinToastTemplate toast(WinToastTemplate::Text01);
+        toast.setTextField(L"Build finished", WinToastTemplate::FirstLine);
+        return toast;
+    }
+}
+
+void WinToastTestSuite::addPoolCases() {
+    add("pool.fair-shares", [] {
+        std::vector<std::wstring> order;
+        std::mutex mutex;
+        WinToastPool::Options options;
+        options.queueCapacity = 1000;
+        WinToastPool pool([&](const std::wstring& aumi, const std::wstring&) -> std::shared_ptr<IWinToastTenant> {
+            if (aumi == L"Broken") {
+                return nullptr;
+            }
+            return std::make_shared<RecordingTenant>(aumi, order, mutex);
+        }, options);
+        pool.addTenant(L"A", L"Noisy");
+        pool.addTenant(L"B", L"Heavy", 2);
+        pool.addTenant(L"C", L"Quiet");
+        pool.addTenant(L"Broken", L"Broken");
+
+        std::atomic<int> failures{ 0 };
+        const WinToastTemplate toast = smallToast();
+        for (int i = 0; i < 900; i++) {
+            WINTOAST_CHECK(pool.submit(L"A", toast, new FailureCounter(failures)) == WinToastPool::Queued);
+        }
+        for (int i = 0; i < 300; i++) {
+            pool.submit(L"B", toast, new FailureCounter(failures));
+        }
+        for (int i = 0; i < 100; i++) {
+            pool.submit(L"C", toast, new FailureCounter(failures));
+        }
+        WINTOAST_CHECK(pool.submit(L"Z", toast, new FailureCounter(failures)) == WinToastPool::UnknownTenant);
+        WINTOAST_CHECK(pool.submit(L"Broken", toast, new FailureCounter(failures)) == WinToastPool::Queued);
+
+        // While all three are backlogged, sends split 1:2:1 whatever the queue
+        // lengths; a context that will not initialize fails its toast.
+        WINTOAST_CHECK_EQUAL(pool.dispatch(401), std::size_t(401));
+        WINTOAST_CHECK_EQUAL(failures.load(), 1);
+        WINTOAST_CHECK_EQUAL(order.size(), std::size_t(400));
+        std::map<std::wstring, std::size_t> counts = tally(order, 0, order.size());
+        WINTOAST_CHECK(counts[L"A"] >= 99 && counts[L"A"] <= 101);
+        WINTOAST_CHECK(counts[L"B"] >= 199 && counts[L"B"] <= 201);
+        WINTOAST_CHECK(counts[L"C"] >= 99 && counts[L"C"] <= 101);
+
+        // A tenant that arrives late gets its share at once instead of queuing
+        // behind A's backlog.
+        pool.addTenant(L"D", L"Late");
+        for (int i = 0; i < 4; i++) {
+            pool.submit(L"D", toast, new FailureCounter(failures));
+        }
+        const std::size_t before = order.size();
+        pool.dispatch(12);
+        counts = tally(order, before, order.size());
+        WINTOAST_CHECK(counts[L"D"] >= 2);
+
+        // The rest goes out on the pool's own senders.
+        pool.start();
+        WINTOAST_CHECK(pool.waitIdle(10000));
+        const WinToastPool::Counters counters = pool.counters();
+        WINTOAST_CHECK_EQUAL(counters.tenants, std::size_t(5));
+        WINTOAST_CHECK_EQUAL(counters.submitted, std::uint64_t(1305));
+        WINTOAST_CHECK_EQUAL(counters.sent, std::uint64_t(1304));
+        WINTOAST_CHECK_EQUAL(counters.failed, std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(counters.queued, std::size_t(0));
+        WinToastPool::TenantCounters tenant;
+        WINTOAST_CHECK(pool.tenantCounters(L"B", tenant));
+        WINTOAST_CHECK_EQUAL(tenant.sent, std::uint64_t(300));
+        WINTOAST_CHECK(tenant.initialized);
+        WINTOAST_CHECK_EQUAL(tenant.weight, 2.0);
+        WINTOAST_CHECK(pool.tenantCounters(L"Broken", tenant));
+        WINTOAST_CHECK(!tenant.initialized);
+        WINTOAST_CHECK(!pool.tenantCounters(L"Z", tenant));
+        pool.stop();
+        WINTOAST_CHECK_EQUAL(failures.load(), 1);
+    });
+
+    add("pool.limits", [] {
+        WinToastPool::Options options;
+        options.queueCapacity = 2;
+        std::atomic<int> failures{ 0 };
+        const WinToastTemplate toast = smallToast();
+        {
+            WinToastPool pool([](const std::wstring& aumi, const std::wstring&) {
+                return std::make_shared<WinToastBackendTenant>(aumi, std::make_shared<WinToastMemoryBackend>());
+            }, options);
+            pool.addTenant(L"A", L"App");
+            WINTOAST_CHECK(pool.submit(L"A", toast, new FailureCounter(failures)) == WinToastPool::Queued);
+            WINTOAST_CHECK(pool.submit(L"A", toast, new FailureCounter(failures)) == WinToastPool::Queued);
+            WINTOAST_CHECK(pool.submit(L"A", toast, new FailureCounter(failures)) == WinToastPool::QueueFull);
+            WinToastPool::TenantCounters tenant;
+            WINTOAST_CHECK(pool.tenantCounters(L"A", tenant));
+            WINTOAST_CHECK_EQUAL(tenant.rejected, std::uint64_t(1));
+            WINTOAST_CHECK_EQUAL(tenant.queued, std::size_t(2));
+
+            // Stopped pools turn toasts away until started again.
+            pool.start();
+            WINTOAST_CHECK(pool.waitIdle(10000));
+            pool.stop();
+            WINTOAST_CHECK(pool.submit(L"A", toast, new FailureCounter(failures)) == WinToastPool::Stopped);
+            pool.start();
+            pool.stop();
+            WINTOAST_CHECK(pool.submit(L"A", toast, new FailureCounter(failures)) == WinToastPool::Stopped);
+            WINTOAST_CHECK_EQUAL(pool.counters().sent, std::uint64_t(2));
+        }
+        {
+            // Toasts still queued when the pool goes away report a failure.
+            WinToastPool pool([](const std::wstring& aumi, const std::wstring&) {
+                return std::make_shared<WinToastBackendTenant>(aumi, std::make_shared<WinToastMemoryBackend>());
+            }, options);
+            pool.addTenant(L"A", L"App");
+            pool.submit(L"A", toast, new FailureCounter(failures));
+            pool.submit(L"A", toast, new FailureCounter(failures));
+        }
+        WINTOAST_CHECK_EQUAL(failures.load(), 2);
+    });
+}
@@ -0,0 +1,142 @@
+#include "wintoasttest.h"
+#include "wintoastprogress.h"
+#include <algorithm>
+
+using namespace WinToastLib;
+
+namespace {
+    const std::int64_t Millisecond = 1000;
+
+    // Stands in for IWinToastBackend::update: keeps every call, and answers
+    // UpdateNotFound for the tags in gone.
+    struct UpdateRecorder {
+        struct Call {
+            std::wstring                tag;
+            WinToastNotificationData    data;
+        };
+
+        WinToastUpdateCoalescer::UpdateFunction function() {
+            return [this](const std::wstring& tag, const std::wstring&, const WinToastNotificationData& data) -> long {
+                calls.push_back(Call{ tag, data });
+                return std::find(gone.begin(), gone.end(), tag) != gone.end() ? IWinToastBackend::UpdateNotFound : 0;
+            };
+        }
+
+        std::vector<Call>           calls;
+        std::vector<std::wstring>   gone;
+    };
+
+    WinToastNotificationData barAt(_In_ double value) {
+        WinToastProgressBar bar;
+        bar.value = value;
+        return bar.data();
+    }
+
+    std::wstring valueOf(_In_ const WinToastNotificationData& data) {
+        for (const auto& value : data.values) {
+            if (value.first == L"progressValue") {
+                return value.second;
+            }
+        }
+        return std::wstring();
+    }
+}
+
+void WinToastTestSuite::addProgressCases() {
+    add("progress.coalesce", [] {
+        // Four updates a second: one slot every 250 ms per toast.
+        auto clock = std::make_shared<WinToastManualClock>();
+        UpdateRecorder recorder;
+        WinToastUpdateCoalescer coalescer(recorder.function(), clock);
+        coalescer.track(1, L"upload", L"transfers");
+
+        // The first update goes out at once.
+        WINTOAST_CHECK(coalescer.update(1, barAt(0.1)));
+        WINTOAST_CHECK_EQUAL(recorder.calls.size(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(coalescer.nextFlushIn(), std::int64_t(-1));
+
+        // Eight more inside the same slot only replace each other.
+        for (int i = 2; i <= 9; i++) {
+            clock->advance(10 * Millisecond);
+            WINTOAST_CHECK(coalescer.update(1, barAt(i / 10.0)));
+        }
+        WINTOAST_CHECK_EQUAL(recorder.calls.size(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(coalescer.flush(), std::size_t(0));
+        WINTOAST_CHECK_EQUAL(coalescer.nextFlushIn(), 170 * Millisecond);
+
+        // The slot opens exactly one interval after the last send.
+        clock->set(250 * Millisecond - 1);
+        WINTOAST_CHECK_EQUAL(coalescer.flush(), std::size_t(0));
+        WINTOAST_CHECK_EQUAL(coalescer.nextFlushIn(), std::int64_t(1));
+        clock->advance(1);
+        WINTOAST_CHECK_EQUAL(coalescer.nextFlushIn(), std::int64_t(0));
+        WINTOAST_CHECK_EQUAL(coalescer.flush(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(coalescer.nextFlushIn(), std::int64_t(-1));
+        WINTOAST_CHECK_EQUAL(recorder.calls.size(), std::size_t(2));
+        WINTOAST_CHECK_EQUAL(valueOf(recorder.calls[1].data), L"0.9000");
+        WINTOAST_CHECK_EQUAL(recorder.calls[1].tag, L"upload");
+
+        // The next slot is counted from that send, not from the update.
+        clock->advance(100 * Millisecond);
+        WINTOAST_CHECK(coalescer.update(1, barAt(1.0)));
+        WINTOAST_CHECK_EQUAL(coalescer.nextFlushIn(), 150 * Millisecond);
+        clock->advance(150 * Millisecond);
+        WINTOAST_CHECK_EQUAL(coalescer.flush(), std::size_t(1));
+        clock->advance(250 * Millisecond);
+        WINTOAST_CHECK(coalescer.update(1, barAt(-1)));
+        WINTOAST_CHECK_EQUAL(recorder.calls.size(), std::size_t(4));
+        WINTOAST_CHECK_EQUAL(valueOf(recorder.calls[3].data), L"indeterminate");
+
+        // The shown toast was sequence 1; every update after it is higher.
+        std::uint32_t last = 1;
+        for (const UpdateRecorder::Call& call : recorder.calls) {
+            WINTOAST_CHECK(call.data.sequence > last);
+            last = call.data.sequence;
+        }
+
+        const WinToastUpdateCoalescer::Counters counters = coalescer.counters();
+        WINTOAST_CHECK_EQUAL(counters.submitted, std::uint64_t(11));
+        WINTOAST_CHECK_EQUAL(counters.sent, std::uint64_t(4));
+        WINTOAST_CHECK_EQUAL(counters.coalesced, std::uint64_t(7));
+        WINTOAST_CHECK_EQUAL(counters.failed, std::uint64_t(0));
+        WINTOAST_CHECK_EQUAL(counters.tracked, std::size_t(1));
+        WINTOAST_CHECK_EQUAL(counters.pending, std::size_t(0));
+        WINTOAST_CHECK(!coalescer.update(2, barAt(0.5)));
+    });
+
+    add("progress.lost", [] {
+        auto clock = std::make_shared<WinToastManualClock>();
+        UpdateRecorder recorder;
+        recorder.gone.push_back(L"dismissed");
+        WinToastUpdateCoalescer coalescer(recorder.function(), clock);
+
+        // The platform no longer has the toast: it is dropped, and later
+        // updates are refused.
+        coalescer.track(1, L"dismissed", L"");
+        WINTOAST_CHECK(coalescer.update(1, barAt(0.1)));
+        WINTOAST_CHECK(!coalescer.update(1, barAt(0.2)));
+        WinToastUpdateCoalescer::Counters counters = coalescer.counters();
+        WINTOAST_CHECK_EQUAL(counters.failed, std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(counters.lost, std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(counters.tracked, std::size_t(0));
+
+        // Untracking a toast with an update waiting leaves nothing to send.
+        coalescer.track(2, L"upload", L"");
+        WINTOAST_CHECK(coalescer.update(2, barAt(0.1)));
+        WINTOAST_CHECK(coalescer.update(2, barAt(0.2)));
+        WINTOAST_CHECK_EQUAL(coalescer.counters().pending, std::size_t(1));
+        coalescer.untrack(2);
+        WINTOAST_CHECK_EQUAL(coalescer.counters().pending, std::size_t(0));
+        clock->advance(1000 * Millisecond);
+        WINTOAST_CHECK_EQUAL(coalescer.flush(), std::size_t(0));
+        WINTOAST_CHECK_EQUAL(coalescer.nextFlushIn(), std::int64_t(-1));
+        WINTOAST_CHECK_EQUAL(recorder.calls.size(), std::size_t(2));
+
+        // Tracked again under the same id, it starts over.
+        coalescer.track(2, L"upload", L"");
+        WINTOAST_CHECK(coalescer.update(2, barAt(0.3)));
+        WINTOAST_CHECK_EQUAL(recorder.calls.size(), std::size_t(3));
+        WINTOAST_CHECK_EQUAL(recorder.calls[2].data.sequence, std::uint32_t(2));
+        WINTOAST_CHECK_EQUAL(coalescer.counters().sent, std::uint64_t(2));
+    });
+}
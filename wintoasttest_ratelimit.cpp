@@ -0,0 +1,148 @@
+#include "wintoasttest.h"
+#include "wintoastratelimit.h"
+
+using namespace WinToastLib;
+
+namespace {
+    const std::int64_t Second = 1000000;
+
+    WinToastRateLimiter::BucketConfig bucket(_In_ double ratePerSecond, _In_ double burst, _In_ WinToastRateLimiter::Policy policy,
+                                             _In_ std::size_t queueCapacity = 64) {
+        WinToastRateLimiter::BucketConfig config;
+        config.ratePerSecond = ratePerSecond;
+        config.burst = burst;
+        config.policy = policy;
+        config.queueCapacity = queueCapacity;
+        return config;
+    }
+}
+
+void WinToastTestSuite::addRateLimitCases() {
+    add("ratelimit.policies", [] {
+        auto clock = std::make_shared<WinToastManualClock>();
+        WinToastRateLimiter limiter(clock);
+        limiter.setSource(L"drop", bucket(1, 2, WinToastRateLimiter::Drop));
+        limiter.setSource(L"reject", bucket(1, 1, WinToastRateLimiter::Reject));
+        limiter.setSource(L"delay", bucket(1, 1, WinToastRateLimiter::Delay, 2));
+
+        WINTOAST_CHECK(limiter.admit(L"drop") == WinToastRateLimiter::Admitted);
+        WINTOAST_CHECK(limiter.admit(L"drop") == WinToastRateLimiter::Admitted);
+        WINTOAST_CHECK(limiter.admit(L"drop") == WinToastRateLimiter::Dropped);
+        WINTOAST_CHECK(limiter.admit(L"reject") == WinToastRateLimiter::Admitted);
+        WINTOAST_CHECK(limiter.admit(L"reject") == WinToastRateLimiter::Rejected);
+
+        // Delayed sends wait in the source's queue; one past its capacity is dropped.
+        int sent = 0;
+        WINTOAST_CHECK(limiter.admit(L"delay") == WinToastRateLimiter::Admitted);
+        for (int i = 0; i < 3; i++) {
+            WINTOAST_CHECK(limiter.admit(L"delay") == WinToastRateLimiter::MustQueue);
+            WINTOAST_CHECK_EQUAL(limiter.enqueue(L"delay", [&sent] { sent++; }), i < 2);
+        }
+
+        // Each source has its own bucket; sources without a config get the default.
+        WINTOAST_CHECK(limiter.admit(L"other") == WinToastRateLimiter::Admitted);
+
+        WinToastRateLimiter::Counters counters = limiter.counters();
+        WINTOAST_CHECK_EQUAL(counters.admitted, std::uint64_t(5));
+        WINTOAST_CHECK_EQUAL(counters.dropped, std::uint64_t(2));
+        WINTOAST_CHECK_EQUAL(counters.rejected, std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(counters.queued, std::uint64_t(2));
+        WINTOAST_CHECK_EQUAL(counters.queueDepth, std::size_t(2));
+
+        // A second later every bucket has earned one token.
+        clock->advance(Second);
+        WINTOAST_CHECK_EQUAL(limiter.drain(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(sent, 1);
+        WINTOAST_CHECK(limiter.admit(L"drop") == WinToastRateLimiter::Admitted);
+        WINTOAST_CHECK(limiter.admit(L"reject") == WinToastRateLimiter::Admitted);
+        counters = limiter.counters();
+        WINTOAST_CHECK_EQUAL(counters.released, std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(counters.queueDepth, std::size_t(1));
+    });
+
+    add("ratelimit.global", [] {
+        // The global ceiling turns a toast away even when its source has tokens,
+        // and its own policy applies.
+        auto clock = std::make_shared<WinToastManualClock>();
+        {
+            WinToastRateLimiter limiter(clock);
+            limiter.setGlobal(bucket(1, 2, WinToastRateLimiter::Reject));
+            limiter.setDefaultSource(bucket(100, 100, WinToastRateLimiter::Drop));
+            WINTOAST_CHECK(limiter.admit(L"a") == WinToastRateLimiter::Admitted);
+            WINTOAST_CHECK(limiter.admit(L"b") == WinToastRateLimiter::Admitted);
+            WINTOAST_CHECK(limiter.admit(L"a") == WinToastRateLimiter::Rejected);
+            WINTOAST_CHECK_EQUAL(limiter.counters().rejected, std::uint64_t(1));
+            WINTOAST_CHECK_EQUAL(limiter.counters().dropped, std::uint64_t(0));
+        }
+        {
+            WinToastRateLimiter limiter(clock);
+            limiter.setGlobal(bucket(1, 1, WinToastRateLimiter::Delay, 1));
+            limiter.setDefaultSource(bucket(100, 100, WinToastRateLimiter::Drop));
+            std::vector<std::wstring> sent;
+            WINTOAST_CHECK(limiter.admit(L"a") == WinToastRateLimiter::Admitted);
+            WINTOAST_CHECK(limiter.admit(L"b") == WinToastRateLimiter::MustQueue);
+            WINTOAST_CHECK(limiter.enqueue(L"b", [&sent] { sent.push_back(L"b"); }));
+            // The global queue holds one.
+            WINTOAST_CHECK(limiter.admit(L"a") == WinToastRateLimiter::MustQueue);
+            WINTOAST_CHECK(!limiter.enqueue(L"a", [&sent] { sent.push_back(L"a"); }));
+            WINTOAST_CHECK_EQUAL(limiter.counters().dropped, std::uint64_t(1));
+
+            WINTOAST_CHECK_EQUAL(limiter.nextReleaseIn(), Second);
+            clock->advance(Second);
+            WINTOAST_CHECK_EQUAL(limiter.drain(), std::size_t(1));
+            WINTOAST_CHECK_EQUAL(sent.size(), std::size_t(1));
+            WINTOAST_CHECK_EQUAL(sent[0], L"b");
+            WINTOAST_CHECK_EQUAL(limiter.nextReleaseIn(), std::int64_t(-1));
+        }
+    });
+
+    add("ratelimit.drain", [] {
+        auto clock = std::make_shared<WinToastManualClock>();
+        WinToastRateLimiter limiter(clock);
+        limiter.setSource(L"build", bucket(2, 1, WinToastRateLimiter::Delay, 8));
+
+        std::vector<int> order;
+        auto sendOf = [&order](int n) { return [&order, n] { order.push_back(n); }; };
+        WINTOAST_CHECK(limiter.admit(L"build") == WinToastRateLimiter::Admitted);
+        for (int n = 1; n <= 3; n++) {
+            WINTOAST_CHECK(limiter.admit(L"build") == WinToastRateLimiter::MustQueue);
+            WINTOAST_CHECK(limiter.enqueue(L"build", sendOf(n), n));
+        }
+        WINTOAST_CHECK_EQUAL(limiter.drain(), std::size_t(0));
+        WINTOAST_CHECK_EQUAL(limiter.nextReleaseIn(), Second / 2);
+
+        // A withdrawn send never runs.
+        WINTOAST_CHECK(limiter.withdraw(2));
+        WINTOAST_CHECK(!limiter.withdraw(2));
+
+        // With a token back, a new toast still queues behind the backlog.
+        clock->advance(Second / 2);
+        WINTOAST_CHECK(limiter.admit(L"build") == WinToastRateLimiter::MustQueue);
+        WINTOAST_CHECK(limiter.enqueue(L"build", sendOf(4), 4));
+        WINTOAST_CHECK_EQUAL(limiter.drain(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(limiter.drain(), std::size_t(0));
+
+        // The bucket holds one token however long the wait: one release per slot.
+        clock->advance(10 * Second);
+        WINTOAST_CHECK_EQUAL(limiter.drain(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(limiter.nextReleaseIn(), Second / 2);
+        clock->advance(Second / 2);
+        WINTOAST_CHECK_EQUAL(limiter.drain(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(limiter.nextReleaseIn(), std::int64_t(-1));
+        WINTOAST_CHECK_EQUAL(order.size(), std::size_t(3));
+        WINTOAST_CHECK_EQUAL(order[0], 1);
+        WINTOAST_CHECK_EQUAL(order[1], 3);
+        WINTOAST_CHECK_EQUAL(order[2], 4);
+
+        const WinToastRateLimiter::Counters counters = limiter.counters();
+        WINTOAST_CHECK_EQUAL(counters.admitted, std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(counters.queued, std::uint64_t(4));
+        WINTOAST_CHECK_EQUAL(counters.released, std::uint64_t(3));
+        WINTOAST_CHECK_EQUAL(counters.withdrawn, std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(counters.queueDepth, std::size_t(0));
+        // With the backlog gone, toasts go straight out again once a token is back.
+        WINTOAST_CHECK(limiter.admit(L"build") == WinToastRateLimiter::MustQueue);
+        clock->advance(Second / 2);
+        WINTOAST_CHECK(limiter.admit(L"build") == WinToastRateLimiter::Admitted);
+    });
+}
@@ -0,0 +1,124 @@
+#include "wintoasttest.h"
+#include "wintoastbackend.h"
+#include "wintoastdispatch.h"
+#include "wintoastregistry.h"
+#include <algorithm>
+#include <deque>
+
+using namespace WinToastLib;
+
+namespace {
+    class NullHandler : public IWinToastHandler {
+    public:
+        void toastActivated() const override {}
+        void toastActivated(int) const override {}
+        void toastDismissed(WinToastDismissalReason) const override {}
+        void toastFailed() const override {}
+    };
+}
+
+void WinToastTestSuite::addRegistryCases() {
+    add("registry.bounded", [] {
+        // Millions of toasts through the in-memory notifier, with at most Window
+        // on screen at a time. Each one leaves by an outcome or by expiring, the
+        // way they do under WinToast, and nothing may pile up in the registry.
+        const std::size_t Toasts = 2000000;
+        const std::size_t Window = 1000;
+        const std::int64_t Lifetime = 500;
+        auto registry = std::make_shared<WinToastRegistry>();
+        auto backend = std::make_shared<WinToastMemoryBackend>();
+        auto dispatcher = std::make_shared<WinToastDispatcher>();
+        auto handler = std::make_shared<NullHandler>();
+        std::weak_ptr<WinToastRegistry> weak = registry;
+        WINTOAST_CHECK(backend->openSession(L"WinToast.Test") >= 0);
+
+        std::deque<WinToastNotificationHandle> onScreen;
+        std::size_t expired = 0;
+        std::int64_t previousId = 0;
+        for (std::size_t i = 0; i < Toasts; i++) {
+            const std::int64_t now = static_cast<std::int64_t>(i);
+            const std::int64_t id = registry->nextId();
+            WINTOAST_CHECK(id > previousId);
+            previousId = id;
+            // Every fourth toast expires before the window would close it.
+            registry->reserve(id, i % 4 == 0 ? now + Lifetime : WinToastRegistry::NoExpiration);
+            auto forwarder = std::make_shared<WinToastDispatchingHandler>(dispatcher, handler, id,
+                [weak](const WinToastOutcome& outcome) {
+                    if (auto live = weak.lock()) {
+                        live->erase(outcome.toastId);
+                    }
+                });
+            WinToastNotificationHandle notification;
+            WINTOAST_CHECK(backend->show(L"<toast/>", 0, forwarder, notification) >= 0);
+            WINTOAST_CHECK(registry->attach(id, notification));
+            onScreen.push_back(std::move(notification));
+
+            if (onScreen.size() > Window) {
+                switch (i % 3) {
+                case 0:  backend->dismiss(onScreen.front(), IWinToastHandler::UserCanceled); break;
+                case 1:  backend->fail(onScreen.front());                                    break;
+                default: backend->activate(onScreen.front());                                break;
+                }
+                onScreen.pop_front();
+            }
+            if (i % 256 == 0) {
+                expired += registry->expire(now);
+            }
+            if (i % 65536 == 0) {
+                WINTOAST_CHECK(registry->size() <= Window + 1);
+                WINTOAST_CHECK(registry->capacity() <= 8 * Window);
+            }
+        }
+        WINTOAST_CHECK(expired > 0);
+        WINTOAST_CHECK(registry->highWaterMark() <= Window + 1);
+        WINTOAST_CHECK(registry->capacity() <= 8 * Window);
+        WINTOAST_CHECK_EQUAL(backend->counters().shows, Toasts);
+
+        // Whatever is left goes with clear().
+        WINTOAST_CHECK(registry->takeAll().size() <= Window);
+        WINTOAST_CHECK_EQUAL(registry->size(), std::size_t(0));
+    });
+
+    add("registry.expire", [] {
+        WinToastRegistry registry;
+        const std::int64_t Expirations[] = { 50, 10, WinToastRegistry::NoExpiration, 30, 20, 40 };
+        std::vector<std::int64_t> ids;
+        for (std::int64_t expiresAt : Expirations) {
+            ids.push_back(registry.nextId());
+            registry.insert(ids.back(), WinToastNotificationHandle(), expiresAt);
+        }
+        std::vector<std::int64_t> dropped;
+        auto collect = [&dropped](std::int64_t id) { dropped.push_back(id); };
+        WINTOAST_CHECK_EQUAL(registry.expire(9, collect), std::size_t(0));
+        WINTOAST_CHECK_EQUAL(registry.expire(30, collect), std::size_t(3));
+        std::sort(dropped.begin(), dropped.end());
+        WINTOAST_CHECK(dropped == (std::vector<std::int64_t>{ ids[1], ids[3], ids[4] }));
+        // A toast that already left is not reported again.
+        WINTOAST_CHECK(registry.erase(ids[5]));
+        dropped.clear();
+        WINTOAST_CHECK_EQUAL(registry.expire(1000, collect), std::size_t(1));
+        WINTOAST_CHECK(dropped == std::vector<std::int64_t>{ ids[0] });
+        WINTOAST_CHECK(registry.contains(ids[2]));
+        WINTOAST_CHECK_EQUAL(registry.size(), std::size_t(1));
+    });
+
+    add("registry.tags", [] {
+        WinToastRegistry registry;
+        auto handler = std::make_shared<NullHandler>();
+        const std::wstring key = IWinToastBackend::tagKey(L"build", L"ci");
+        const std::int64_t first = registry.nextId();
+        const std::int64_t second = registry.nextId();
+        registry.insert(first, WinToastNotificationHandle());
+        registry.insert(second, WinToastNotificationHandle());
+        WinToastRegistry::Superseded superseded;
+        WINTOAST_CHECK(!registry.bindTag(first, key, handler, superseded));
+        WINTOAST_CHECK_EQUAL(registry.findTag(key), first);
+        // Binding the key again takes the older entry out.
+        WINTOAST_CHECK(registry.bindTag(second, key, handler, superseded));
+        WINTOAST_CHECK(!registry.contains(first));
+        WINTOAST_CHECK_EQUAL(registry.findTag(key), second);
+        WINTOAST_CHECK(registry.erase(second));
+        WINTOAST_CHECK_EQUAL(registry.findTag(key), std::int64_t(0));
+        WINTOAST_CHECK_EQUAL(registry.tagged(), std::size_t(0));
+    });
+}
@@ -0,0 +1,149 @@
+#include "wintoasttest.h"
+#include "wintoastrequest.h"
+#include <cwchar>
+#include <sstream>
+
+using namespace WinToastLib;
+
+namespace {
+    // Reads every record of a batch file; errors[i] is empty when requests[i] was accepted.
+    WinToastBatchReader::Format readAll(_In_ const std::string& text, _Out_ std::vector<WinToastRequest>& requests,
+                                        _Out_ std::vector<std::wstring>& errors) {
+        std::istringstream in(text);
+        WinToastBatchReader reader(in);
+        requests.clear();
+        errors.clear();
+        WinToastRequest request;
+        std::wstring error;
+        while (reader.next(request, error)) {
+            requests.push_back(request);
+            errors.push_back(error);
+            WINTOAST_CHECK_EQUAL(reader.record(), requests.size());
+        }
+        return reader.format();
+    }
+
+    bool startsWith(_In_ const std::wstring& text, _In_ const wchar_t* prefix) {
+        return text.compare(0, std::wcslen(prefix), prefix) == 0;
+    }
+}
+
+void WinToastTestSuite::addRequestCases() {
+    add("request.batch.json", [] {
+        std::vector<WinToastRequest> requests;
+        std::vector<std::wstring> errors;
+        // A byte order mark, CRLF endings, escapes, surrogate pairs and raw UTF-8.
+        const WinToastBatchReader::Format format = readAll(
+            "\xef\xbb\xbf{\"text\": \"Disk \\u00e9 \\ud83d\\ude00 full\", \"action\": [\"Retry\", \"Ignore\"], \"expires\": 30}\r\n"
+            "\n"
+            "  # a comment\n"
+            "{\"id\": \"x7\", \"text\": \"h\xc3\xa9\", \"audio-state\": 1, \"image\": \"C:\\\\a.png\", \"tag\": null}\n"
+            "{}\n"
+            "{\"text\": \"bad\", \"audio-state\": 9}\n"
+            "{\"txt\": \"unknown\"}\n"
+            "{\"text\": \"x\" trailing\n"
+            "{\"text\": \"unterminated}\n"
+            "{\"action\": [\"a\" \"b\"]}\n",
+            requests, errors);
+        WINTOAST_CHECK(format == WinToastBatchReader::JsonLines);
+        WINTOAST_CHECK_EQUAL(requests.size(), std::size_t(8));
+
+        WINTOAST_CHECK_EQUAL(errors[0], L"");
+        const WinToastTemplate first = requests[0].toTemplate();
+        WINTOAST_CHECK_EQUAL(first.textField(WinToastTemplate::FirstLine), L"Disk \u00e9 \U0001F600 full");
+        WINTOAST_CHECK_EQUAL(first.actionsCount(), 2);
+        WINTOAST_CHECK_EQUAL(first.actionLabel(1), L"Ignore");
+        WINTOAST_CHECK_EQUAL(first.expiration(), std::int64_t(30000));
+
+        WINTOAST_CHECK_EQUAL(errors[1], L"");
+        WINTOAST_CHECK_EQUAL(requests[1].id, L"x7");
+        const WinToastTemplate second = requests[1].toTemplate();
+        WINTOAST_CHECK_EQUAL(second.textField(WinToastTemplate::FirstLine), L"h\u00e9");
+        WINTOAST_CHECK(second.audioOption() == WinToastTemplate::Silent);
+        WINTOAST_CHECK_EQUAL(second.imagePath(), L"C:\\a.png");
+        WINTOAST_CHECK_EQUAL(requests[1].tag, L"");
+
+        WINTOAST_CHECK_EQUAL(errors[2], L"");
+        WINTOAST_CHECK_EQUAL(errors[3], L"bad value for audio-state");
+        WINTOAST_CHECK_EQUAL(errors[4], L"field not recognized: txt");
+        WINTOAST_CHECK(startsWith(errors[5], L"expected ',' or '}'"));
+        WINTOAST_CHECK(startsWith(errors[6], L"unterminated string in text"));
+        WINTOAST_CHECK(startsWith(errors[7], L"expected ',' or ']' in action"));
+    });
+
+    add("request.batch.csv", [] {
+        std::vector<WinToastRequest> requests;
+        std::vector<std::wstring> errors;
+        // Padded column names, a repeated column, quoted commas, quotes and line breaks.
+        const WinToastBatchReader::Format format = readAll(
+            "# exported by the build server\n"
+            "id, text ,attribute,action,action,expires,audio-state\r\n"
+            "1,\"Build, failed\",ci,Retry,Open log,\n"
+            "2,\"multi\n"
+            "line \"\"quoted\"\"\",,,,5\n"
+            "\n"
+            ",plain\n"
+            "4,a,b,c,d,e,f,g\n"
+            "5,x,,,,,loud\n"
+            "6,\"unterminated\n",
+            requests, errors);
+        WINTOAST_CHECK(format == WinToastBatchReader::Csv);
+        WINTOAST_CHECK_EQUAL(requests.size(), std::size_t(6));
+
+        WINTOAST_CHECK_EQUAL(errors[0], L"");
+        const WinToastTemplate first = requests[0].toTemplate();
+        WINTOAST_CHECK_EQUAL(first.textField(WinToastTemplate::FirstLine), L"Build, failed");
+        WINTOAST_CHECK_EQUAL(first.attributionText(), L"ci");
+        WINTOAST_CHECK_EQUAL(first.actionsCount(), 2);
+        WINTOAST_CHECK_EQUAL(first.actionLabel(1), L"Open log");
+        WINTOAST_CHECK_EQUAL(first.expiration(), std::int64_t(0));
+
+        WINTOAST_CHECK_EQUAL(errors[1], L"");
+        const WinToastTemplate second = requests[1].toTemplate();
+        WINTOAST_CHECK_EQUAL(second.textField(WinToastTemplate::FirstLine), L"multi\nline \"quoted\"");
+        WINTOAST_CHECK_EQUAL(second.expiration(), std::int64_t(5000));
+
+        // Short rows leave the remaining columns unset; an empty id is left to the caller.
+        WINTOAST_CHECK_EQUAL(errors[2], L"");
+        WINTOAST_CHECK_EQUAL(requests[2].id, L"");
+        WINTOAST_CHECK_EQUAL(requests[2].toTemplate().textField(WinToastTemplate::FirstLine), L"plain");
+
+        WINTOAST_CHECK_EQUAL(errors[3], L"more fields than columns");
+        WINTOAST_CHECK_EQUAL(errors[4], L"bad value for audio-state");
+        WINTOAST_CHECK_EQUAL(errors[5], L"unterminated quoted field");
+    });
+
+    add("request.batch.serve", [] {
+        // The whole batch goes through one sender; each record is reported, and
+        // the failures add up to the exit code.
+        std::vector<std::wstring> sent;
+        auto send = [&sent](WinToastTemplate&& toast, IWinToastHandler* handler) -> std::int64_t {
+            const std::wstring text = toast.textField(WinToastTemplate::FirstLine);
+            if (text == L"refused") {
+                return -1;
+            }
+            sent.push_back(text);
+            handler->toastActivated(0);
+            delete handler;
+            return std::int64_t(sent.size());
+        };
+        std::wostringstream out;
+        WinToastRequestServer server(send, out);
+        std::istringstream in(
+            "text,action\n"
+            "first,Open\n"
+            "refused,\n"
+            "third,\n"
+            "fourth,\"Retry\n");
+        WINTOAST_CHECK_EQUAL(server.serveBatch(in), std::size_t(2));
+        WINTOAST_CHECK(server.waitIdle(1000));
+        WINTOAST_CHECK_EQUAL(server.sent(), std::size_t(2));
+        WINTOAST_CHECK(sent.size() == 2 && sent[0] == L"first" && sent[1] == L"third");
+        const std::wstring report = out.str();
+        WINTOAST_CHECK(report.find(L"1 sent\n") != std::wstring::npos);
+        WINTOAST_CHECK(report.find(L"1 action 0\n") != std::wstring::npos);
+        WINTOAST_CHECK(report.find(L"2 failed show\n") != std::wstring::npos);
+        WINTOAST_CHECK(report.find(L"3 sent\n") != std::wstring::npos);
+        WINTOAST_CHECK(report.find(L"4 failed unterminated quoted field\n") != std::wstring::npos);
+    });
+}
@@ -0,0 +1,90 @@
+#include "wintoasttest.h"
+#include "wintoastshortcut.h"
+
+using namespace WinToastLib;
+
+void WinToastTestSuite::addShortcutCases() {
+    add("shortcut.stamp", [] {
+        // Only a stamp that matches the link's path, size, write time and AUMI
+        // skips the shell-link load; anything else validates or creates again.
+        auto links = std::make_shared<WinToastMemoryShellLinks>();
+        WinToastShortcutCache cache(links);
+        const std::wstring link = L"C:/Start Menu/Programs/WinToast.lnk";
+        const std::wstring stamp = L"C:/Local/WinToast.lnkstamp";
+        long hr = 0;
+
+        WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.App", hr) == WinToastShortcutCache::WasCreated);
+        for (int i = 0; i < 3; i++) {
+            WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.App", hr) == WinToastShortcutCache::Unchanged);
+        }
+        WINTOAST_CHECK_EQUAL(links->counters().linkLoads, std::size_t(0));
+        WinToastShortcutCache::Counters counters = cache.counters();
+        WINTOAST_CHECK_EQUAL(counters.hits, std::size_t(3));
+        WINTOAST_CHECK_EQUAL(counters.misses, std::size_t(1));
+        WINTOAST_CHECK_EQUAL(counters.creations, std::size_t(1));
+        WINTOAST_CHECK_EQUAL(counters.stampWrites, std::size_t(1));
+
+        // A new AUMI rewrites the link once, then hits again.
+        WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.Other", hr) == WinToastShortcutCache::WasChanged);
+        WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.Other", hr) == WinToastShortcutCache::Unchanged);
+        WINTOAST_CHECK_EQUAL(links->counters().linkLoads, std::size_t(1));
+
+        // Another program rewrote the link.
+        links->setLink(link, L"Someone.Else");
+        WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.Other", hr) == WinToastShortcutCache::WasChanged);
+        // The stamp itself is unreadable.
+        WINTOAST_CHECK(links->writeText(stamp, L"garbage"));
+        WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.Other", hr) == WinToastShortcutCache::Unchanged);
+        // The stamp was written for another link.
+        const std::wstring moved = L"C:/Start Menu/Programs/Tools/WinToast.lnk";
+        WINTOAST_CHECK(cache.ensure(moved, stamp, L"WinToast.Other", hr) == WinToastShortcutCache::WasCreated);
+        WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.Other", hr) == WinToastShortcutCache::Unchanged);
+        // The link is gone.
+        links->remove(link);
+        WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.Other", hr) == WinToastShortcutCache::WasCreated);
+        WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.Other", hr) == WinToastShortcutCache::Unchanged);
+
+        counters = cache.counters();
+        WINTOAST_CHECK_EQUAL(counters.hits, std::size_t(5));
+        WINTOAST_CHECK_EQUAL(counters.misses, std::size_t(7));
+        WINTOAST_CHECK_EQUAL(counters.validations, std::size_t(4));
+        WINTOAST_CHECK_EQUAL(counters.creations, std::size_t(3));
+        WINTOAST_CHECK_EQUAL(counters.stampWrites, std::size_t(7));
+        WINTOAST_CHECK_EQUAL(links->counters().linkLoads, std::size_t(4));
+    });
+
+    add("shortcut.not-a-link", [] {
+        // A file that cannot be loaded as a link is replaced, not stamped.
+        auto links = std::make_shared<WinToastMemoryShellLinks>();
+        WinToastShortcutCache cache(links);
+        const std::wstring link = L"C:/Start Menu/Programs/WinToast.lnk";
+        const std::wstring stamp = L"C:/Local/WinToast.lnkstamp";
+        long hr = 0;
+
+        WINTOAST_CHECK(links->writeText(link, L"not a link"));
+        WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.App", hr) == WinToastShortcutCache::WasCreated);
+        WINTOAST_CHECK(hr >= 0);
+        WINTOAST_CHECK(cache.ensure(link, stamp, L"WinToast.App", hr) == WinToastShortcutCache::Unchanged);
+        const WinToastShortcutCache::Counters counters = cache.counters();
+        WINTOAST_CHECK_EQUAL(counters.validations, std::size_t(1));
+        WINTOAST_CHECK_EQUAL(counters.creations, std::size_t(1));
+        WINTOAST_CHECK_EQUAL(counters.hits, std::size_t(1));
+    });
+
+    add("shortcut.stamp-format", [] {
+        WinToastFileStamp written;
+        written.size = 1234;
+        written.lastWriteTime = 132537600000000000;
+        const std::wstring text = WinToastShortcutCache::formatStamp(L"C:/Links/Win Toast.lnk", written, L"WinToast.App");
+        std::wstring path, aumi;
+        WinToastFileStamp read;
+        WINTOAST_CHECK(WinToastShortcutCache::parseStamp(text, path, read, aumi));
+        WINTOAST_CHECK_EQUAL(path, L"C:/Links/Win Toast.lnk");
+        WINTOAST_CHECK_EQUAL(aumi, L"WinToast.App");
+        WINTOAST_CHECK(read == written);
+
+        WINTOAST_CHECK(!WinToastShortcutCache::parseStamp(L"", path, read, aumi));
+        WINTOAST_CHECK(!WinToastShortcutCache::parseStamp(L"garbage", path, read, aumi));
+        WINTOAST_CHECK(!WinToastShortcutCache::parseStamp(text.substr(0, text.size() / 2), path, read, aumi));
+    });
+}
@@ -0,0 +1,369 @@
+#include "wintoasttest.h"
+#include "wintoastfile.h"
+#include "wintoastspool.h"
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace WinToastLib;
+
+namespace {
+    // The first line carries the toast's number, so a delivered record can be
+    // matched to its append.
+    WinToastFrozenToast numberedToast(_In_ int number) {
+        WinToastTemplate toast(WinToastTemplate::ImageAndText02);
+        toast.setTextField(L"Toast number " + std::to_wstring(number), WinToastTemplate::FirstLine)
+             .setTextField(L"body", WinToastTemplate::SecondLine)
+             .setSource(L"spool");
+        return WinToastFrozenToast(toast);
+    }
+
+    int numberOf(_In_ const WinToastFrozenToast& toast) {
+        return std::stoi(toast.textField(WinToastTemplate::FirstLine).str().substr(13));
+    }
+
+    // File layout, as written by wintoastspool.cpp: a 64-byte header, then
+    // records of a 40-byte header (marker first) and the payload, padded to 8.
+    const std::size_t SpoolDataOffset = 64;
+    const std::size_t SpoolRecordHeader = 40;
+
+    std::size_t numberedRecordBytes() {
+        std::vector<std::uint8_t> payload;
+        numberedToast(0).serialize(payload);
+        return (SpoolRecordHeader + payload.size() + 7) & ~static_cast<std::size_t>(7);
+    }
+
+    void overwrite(_In_ const std::wstring& path, _In_ std::size_t offset, _In_ const void* bytes, _In_ std::size_t length) {
+        std::fstream file(narrowPath(path), std::ios::in | std::ios::out | std::ios::binary);
+        WINTOAST_CHECK(file.good());
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(length));
+        WINTOAST_CHECK(file.good());
+    }
+}
+
+void WinToastTestSuite::addSpoolCases() {
+    add("spool.replay", [] {
+        const std::wstring path = scratchPath(L"replay.spool");
+        removeFile(path);
+        std::vector<int> delivered;
+        auto collect = [&delivered](const WinToastFrozenToast& toast, const WinToastSpool::Entry& entry) {
+            WINTOAST_CHECK_EQUAL(entry.sequence, static_cast<std::uint64_t>(numberOf(toast)));
+            WINTOAST_CHECK_EQUAL(entry.tag, entry.sequence + 1000);
+            delivered.push_back(numberOf(toast));
+            return true;
+        };
+        {
+            WinToastSpool spool;
+            WINTOAST_CHECK(spool.open(path));
+            for (int i = 0; i < 100; i++) {
+                WINTOAST_CHECK(spool.append(numberedToast(i), 1000 + i) == WinToastSpool::Appended);
+            }
+            WINTOAST_CHECK_EQUAL(spool.deliver(collect, 40), std::size_t(40));
+            WINTOAST_CHECK_EQUAL(spool.counters().pending, std::size_t(60));
+        }
+        // What was not delivered comes back after a restart, in order, once.
+        {
+            WinToastSpool spool;
+            WINTOAST_CHECK(spool.open(path));
+            WINTOAST_CHECK_EQUAL(spool.counters().replayed, std::uint64_t(60));
+            WINTOAST_CHECK_EQUAL(spool.deliver([&](const WinToastFrozenToast& toast, const WinToastSpool::Entry& entry) {
+                WINTOAST_CHECK(entry.replayed);
+                return collect(toast, entry);
+            }), std::size_t(60));
+            std::uint64_t sequence = 0;
+            WINTOAST_CHECK(spool.append(numberedToast(100), 1100, &sequence) == WinToastSpool::Appended);
+            WINTOAST_CHECK_EQUAL(sequence, std::uint64_t(100));
+        }
+        WINTOAST_CHECK_EQUAL(delivered.size(), std::size_t(100));
+        for (int i = 0; i < 100; i++) {
+            WINTOAST_CHECK_EQUAL(delivered[i], i);
+        }
+        {
+            WinToastSpool spool;
+            WINTOAST_CHECK(spool.open(path));
+            WINTOAST_CHECK_EQUAL(spool.counters().replayed, std::uint64_t(1));
+        }
+        WINTOAST_CHECK(removeFile(path));
+    });
+
+    add("spool.retry", [] {
+        // A send that asks to retry keeps the record, and stops the run.
+        const std::wstring path = scratchPath(L"retry.spool");
+        removeFile(path);
+        WinToastSpool spool;
+        WINTOAST_CHECK(spool.open(path));
+        spool.append(numberedToast(0));
+        spool.append(numberedToast(1));
+        std::size_t calls = 0;
+        WINTOAST_CHECK_EQUAL(spool.deliver([&calls](const WinToastFrozenToast&, const WinToastSpool::Entry&) { calls++; return false; }), std::size_t(0));
+        WINTOAST_CHECK_EQUAL(calls, std::size_t(1));
+        WINTOAST_CHECK_EQUAL(spool.counters().pending, std::size_t(2));
+        WINTOAST_CHECK_EQUAL(spool.deliver([](const WinToastFrozenToast& toast, const WinToastSpool::Entry&) { return numberOf(toast) == 0; }), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(spool.counters().pending, std::size_t(1));
+        spool.close();
+        WINTOAST_CHECK(removeFile(path));
+    });
+
+    add("spool.overflow.drop-oldest", [] {
+        const std::wstring path = scratchPath(L"drop.spool");
+        removeFile(path);
+        WinToastSpool::Options options;
+        options.capacityBytes = 4096;
+        options.overflow = WinToastSpool::DropOldest;
+        options.durableAppend = false;
+        WinToastSpool spool(options);
+        WINTOAST_CHECK(spool.open(path));
+        int next = 0;
+        std::vector<int> delivered;
+        auto collect = [&delivered](const WinToastFrozenToast& toast, const WinToastSpool::Entry&) {
+            delivered.push_back(numberOf(toast));
+            return true;
+        };
+        // Appends outrun deliveries, the ring wraps, and reopening keeps the order.
+        std::uint64_t dropped = 0;
+        for (int round = 0; round < 50; round++) {
+            for (int i = 0; i < 7; i++) {
+                WINTOAST_CHECK(spool.append(numberedToast(next++)) == WinToastSpool::Appended);
+            }
+            spool.deliver(collect, 3);
+            if (round % 5 == 0) {
+                dropped += spool.counters().dropped;
+                spool.close();
+                WINTOAST_CHECK(spool.open(path));
+            }
+        }
+        dropped += spool.counters().dropped;
+        WINTOAST_CHECK(dropped > 0);
+        spool.deliver(collect);
+        for (std::size_t i = 1; i < delivered.size(); i++) {
+            WINTOAST_CHECK(delivered[i] > delivered[i - 1]);
+        }
+        // The newest toast always survives.
+        WINTOAST_CHECK_EQUAL(delivered.back(), next - 1);
+        // Counters start over with each open; added up, every toast is accounted for.
+        WINTOAST_CHECK_EQUAL(delivered.size() + dropped, static_cast<std::uint64_t>(next));
+        spool.close();
+        WINTOAST_CHECK(removeFile(path));
+    });
+
+    add("spool.overflow.reject-new", [] {
+        const std::wstring path = scratchPath(L"reject.spool");
+        removeFile(path);
+        WinToastSpool::Options options;
+        options.capacityBytes = 4096;
+        options.durableAppend = false;
+        WinToastSpool spool(options);
+        WINTOAST_CHECK(spool.open(path));
+        int appended = 0;
+        while (spool.append(numberedToast(appended)) == WinToastSpool::Appended) {
+            appended++;
+        }
+        WINTOAST_CHECK(appended > 0);
+        WINTOAST_CHECK_EQUAL(spool.counters().rejected, std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(spool.counters().pending, static_cast<std::size_t>(appended));
+        // Room made by deliveries is used again (wrapping around may pad out the end of the ring).
+        WINTOAST_CHECK_EQUAL(spool.deliver([](const WinToastFrozenToast&, const WinToastSpool::Entry&) { return true; }, 2), std::size_t(2));
+        WINTOAST_CHECK(spool.append(numberedToast(appended)) == WinToastSpool::Appended);
+        spool.close();
+        WINTOAST_CHECK(removeFile(path));
+    });
+
+    add("spool.overflow.block", [] {
+        // Eight producers fill a small ring faster than the sender drains it;
+        // Block makes them wait instead of losing anything.
+        const std::wstring path = scratchPath(L"block.spool");
+        removeFile(path);
+        WinToastSpool::Options options;
+        options.capacityBytes = 16384;
+        options.overflow = WinToastSpool::Block;
+        options.blockTimeoutMilliseconds = 10000;
+        WinToastSpool spool(options);
+        WINTOAST_CHECK(spool.open(path));
+        std::mutex mutex;
+        std::set<int> delivered;
+        std::atomic<int> duplicates{ 0 };
+        spool.start([&](const WinToastFrozenToast& toast, const WinToastSpool::Entry&) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!delivered.insert(numberOf(toast)).second) {
+                duplicates++;
+            }
+            return true;
+        });
+        std::atomic<int> failures{ 0 };
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 8; t++) {
+            producers.emplace_back([&, t] {
+                for (int i = 0; i < 250; i++) {
+                    if (spool.append(numberedToast(t * 1000 + i)) != WinToastSpool::Appended) {
+                        failures++;
+                    }
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (spool.counters().pending > 0 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        spool.close();
+        const WinToastSpool::Counters counters = spool.counters();
+        WINTOAST_CHECK_EQUAL(failures.load(), 0);
+        WINTOAST_CHECK_EQUAL(duplicates.load(), 0);
+        WINTOAST_CHECK_EQUAL(delivered.size(), std::size_t(2000));
+        WINTOAST_CHECK_EQUAL(counters.delivered, std::uint64_t(2000));
+        // Group commit: concurrent appenders share flushes.
+        WINTOAST_CHECK(counters.flushes < counters.appended);
+        WINTOAST_CHECK(removeFile(path));
+    });
+
+    add("spool.torn", [] {
+        // A record whose marker never made it to disk, or whose bytes do not
+        // match their checksum, ends recovery there: everything before it is
+        // replayed, nothing after it.
+        const std::wstring path = scratchPath(L"torn.spool");
+        const std::size_t recordBytes = numberedRecordBytes();
+        auto fill = [&path] {
+            removeFile(path);
+            WinToastSpool spool;
+            WINTOAST_CHECK(spool.open(path));
+            for (int i = 0; i < 10; i++) {
+                WINTOAST_CHECK(spool.append(numberedToast(i)) == WinToastSpool::Appended);
+            }
+        };
+        auto replayed = [&path] {
+            WinToastSpool spool;
+            WINTOAST_CHECK(spool.open(path));
+            std::vector<int> numbers;
+            spool.deliver([&numbers](const WinToastFrozenToast& toast, const WinToastSpool::Entry&) {
+                numbers.push_back(numberOf(toast));
+                return true;
+            });
+            return numbers;
+        };
+
+        fill();
+        const std::uint32_t unwritten = 0;
+        overwrite(path, SpoolDataOffset + recordBytes * 9, &unwritten, sizeof(unwritten));
+        std::vector<int> numbers = replayed();
+        WINTOAST_CHECK_EQUAL(numbers.size(), std::size_t(9));
+        WINTOAST_CHECK_EQUAL(numbers.back(), 8);
+
+        fill();
+        const char flipped = 0x55;
+        overwrite(path, SpoolDataOffset + recordBytes * 5 + SpoolRecordHeader, &flipped, 1);
+        numbers = replayed();
+        WINTOAST_CHECK((numbers == std::vector<int>{ 0, 1, 2, 3, 4 }));
+
+        // Appends after recovery go where the torn record was, and survive the next restart.
+        {
+            WinToastSpool spool;
+            WINTOAST_CHECK(spool.open(path));
+            WINTOAST_CHECK(spool.append(numberedToast(42)) == WinToastSpool::Appended);
+        }
+        numbers = replayed();
+        WINTOAST_CHECK((numbers == std::vector<int>{ 42 }));
+        WINTOAST_CHECK(removeFile(path));
+    });
+
+#ifndef _WIN32
+    add("spool.kill-restart", [] {
+        // A child process appends and delivers flat out until it is killed with
+        // SIGKILL at some point. After the restart every toast it managed to
+        // append is delivered: before the kill, or now from the replay.
+        const std::wstring path = scratchPath(L"kill.spool");
+        const std::string appendedLog = narrowPath(scratchPath(L"kill.appended"));
+        const std::string deliveredLog = narrowPath(scratchPath(L"kill.delivered"));
+        for (int trial = 0; trial < 3; trial++) {
+            removeFile(path);
+            std::remove(appendedLog.c_str());
+            std::remove(deliveredLog.c_str());
+            const pid_t child = fork();
+            WINTOAST_CHECK(child >= 0);
+            if (child == 0) {
+                WinToastSpool::Options options;
+                options.capacityBytes = 65536;
+                options.overflow = WinToastSpool::Block;
+                options.durableAppend = false;
+                options.blockTimeoutMilliseconds = 100000;
+                WinToastSpool spool(options);
+                if (!spool.open(path)) {
+                    _exit(3);
+                }
+                std::FILE* delivered = std::fopen(deliveredLog.c_str(), "w");
+                std::FILE* appended = std::fopen(appendedLog.c_str(), "w");
+                if (!delivered || !appended) {
+                    _exit(4);
+                }
+                std::setvbuf(delivered, nullptr, _IONBF, 0);
+                std::setvbuf(appended, nullptr, _IONBF, 0);
+                spool.start([delivered](const WinToastFrozenToast&, const WinToastSpool::Entry& entry) {
+                    std::fprintf(delivered, "%llu\n", static_cast<unsigned long long>(entry.sequence));
+                    usleep(50);
+                    return true;
+                });
+                for (int i = 0; ; i++) {
+                    std::uint64_t sequence = 0;
+                    if (spool.append(numberedToast(i), static_cast<std::uint64_t>(i), &sequence) == WinToastSpool::Appended) {
+                        std::fprintf(appended, "%llu\n", static_cast<unsigned long long>(sequence));
+                    }
+                }
+            }
+            usleep(150000 + trial * 37000);
+            kill(child, SIGKILL);
+            int status = 0;
+            waitpid(child, &status, 0);
+            WINTOAST_CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+
+            std::set<unsigned long long> appended;
+            std::map<unsigned long long, int> delivered;
+            {
+                std::ifstream log(appendedLog);
+                unsigned long long sequence;
+                while (log >> sequence) {
+                    appended.insert(sequence);
+                }
+            }
+            {
+                std::ifstream log(deliveredLog);
+                unsigned long long sequence;
+                while (log >> sequence) {
+                    delivered[sequence]++;
+                }
+            }
+            WINTOAST_CHECK(!appended.empty());
+
+            WinToastSpool spool;
+            WINTOAST_CHECK(spool.open(path));
+            std::uint64_t previous = 0;
+            bool first = true;
+            spool.deliver([&](const WinToastFrozenToast& toast, const WinToastSpool::Entry& entry) {
+                WINTOAST_CHECK(entry.replayed);
+                WINTOAST_CHECK_EQUAL(entry.sequence, static_cast<std::uint64_t>(numberOf(toast)));
+                WINTOAST_CHECK_EQUAL(entry.tag, entry.sequence);
+                WINTOAST_CHECK(first || entry.sequence == previous + 1);
+                first = false;
+                previous = entry.sequence;
+                delivered[entry.sequence]++;
+                return true;
+            });
+            for (unsigned long long sequence : appended) {
+                WINTOAST_CHECK(delivered.count(sequence) > 0);
+            }
+        }
+        removeFile(path);
+        std::remove(appendedLog.c_str());
+        std::remove(deliveredLog.c_str());
+    });
+#endif
+}
@@ -0,0 +1,120 @@
+#include "wintoasttest.h"
+#include "wintoastpool.h"
+#include <sstream>
+
+using namespace WinToastLib;
+
+namespace {
+    // E_FAIL, negative where long is 64-bit too.
+    const long Failed = static_cast<long>(static_cast<std::int32_t>(0x80004005u));
+
+    class SilentHandler : public IWinToastHandler {
+    public:
+        void toastActivated() const override {}
+        void toastActivated(int) const override {}
+        void toastDismissed(WinToastDismissalReason) const override {}
+        void toastFailed() const override {}
+    };
+}
+
+void WinToastTestSuite::addStatsCases() {
+    add("stats.histogram", [] {
+        WinToastStats stats;
+        for (int i = 0; i < 99; i++) {
+            stats.record(WinToastStats::Show, 1000);
+        }
+        stats.record(WinToastStats::Show, 1000000);
+        stats.record(WinToastStats::Send, 0);
+
+        WinToastStats::Snapshot snapshot = stats.snapshot();
+        const WinToastStats::StageSnapshot& show = snapshot.stages[WinToastStats::Show];
+        WINTOAST_CHECK_EQUAL(show.count, std::uint64_t(100));
+        WINTOAST_CHECK_EQUAL(show.totalNanoseconds, std::uint64_t(99 * 1000 + 1000000));
+        WINTOAST_CHECK_EQUAL(show.maxNanoseconds, std::uint64_t(1000000));
+        // 1000 ns lands in [512, 1024); percentiles report the bucket's upper
+        // bound, but never more than the largest sample.
+        WINTOAST_CHECK_EQUAL(show.buckets[9], std::uint64_t(99));
+        WINTOAST_CHECK_EQUAL(show.percentile(0.50), std::uint64_t(1024));
+        WINTOAST_CHECK_EQUAL(show.percentile(0.99), std::uint64_t(1024));
+        WINTOAST_CHECK_EQUAL(show.percentile(1.0), std::uint64_t(1000000));
+        WINTOAST_CHECK_EQUAL(snapshot.stages[WinToastStats::Send].buckets[0], std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(snapshot.stages[WinToastStats::Send].percentile(0.5), std::uint64_t(0));
+        WINTOAST_CHECK_EQUAL(snapshot.stages[WinToastStats::PayloadLoad].percentile(0.5), std::uint64_t(0));
+
+        // Each distinct failure code keeps a slot while there are any; the rest
+        // are counted together.
+        for (int code = 1; code <= WinToastStats::ResultSlots + 2; code++) {
+            stats.countFailure(Failed + code);
+        }
+        stats.countFailure(Failed + 1);
+        snapshot = stats.snapshot();
+        WINTOAST_CHECK_EQUAL(snapshot.failures, std::uint64_t(WinToastStats::ResultSlots + 3));
+        WINTOAST_CHECK_EQUAL(snapshot.failuresByResult.size(), std::size_t(WinToastStats::ResultSlots));
+        WINTOAST_CHECK_EQUAL(snapshot.failuresByResult[0].first, Failed + 1);
+        WINTOAST_CHECK_EQUAL(snapshot.failuresByResult[0].second, std::uint64_t(2));
+        WINTOAST_CHECK_EQUAL(snapshot.otherFailures, std::uint64_t(2));
+
+        stats.reset();
+        snapshot = stats.snapshot();
+        WINTOAST_CHECK_EQUAL(snapshot.stages[WinToastStats::Show].count, std::uint64_t(0));
+        WINTOAST_CHECK_EQUAL(snapshot.failures, std::uint64_t(0));
+        WINTOAST_CHECK(snapshot.failuresByResult.empty());
+    });
+
+    add("stats.backend", [] {
+        // Sends through a tenant on the in-memory notifier: the backend times its
+        // stages, the tenant counts sends, failures and outcomes.
+        auto backend = std::make_shared<WinToastMemoryBackend>();
+        WinToastBackendTenant tenant(L"WinToast.App", backend);
+        WinToastTemplate toast(WinToastTemplate::Text01);
+        toast.setTextField(L"Build finished", WinToastTemplate::FirstLine);
+        const WinToastFrozenToast frozen(toast);
+        auto handler = std::make_shared<SilentHandler>();
+
+        for (int i = 0; i < 10; i++) {
+            WINTOAST_CHECK(tenant.show(frozen, handler) >= 0);
+        }
+        backend->failNext(Failed);
+        WINTOAST_CHECK(tenant.show(frozen, handler) < 0);
+        WINTOAST_CHECK(tenant.show(frozen, handler) >= 0);
+        const WinToastNotificationHandle last = backend->lastShown();
+        WINTOAST_CHECK(backend->activate(last));
+        WINTOAST_CHECK(backend->activate(last, 1));
+        WINTOAST_CHECK(backend->dismiss(last, IWinToastHandler::TimedOut));
+        WINTOAST_CHECK(backend->fail(last));
+
+#ifndef WINTOAST_NO_STATS
+        const WinToastStats::Snapshot snapshot = tenant.stats()->snapshot();
+        WINTOAST_CHECK_EQUAL(snapshot.sends, std::uint64_t(12));
+        WINTOAST_CHECK_EQUAL(snapshot.shown, std::uint64_t(11));
+        WINTOAST_CHECK_EQUAL(snapshot.failures, std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(snapshot.failuresByResult.size(), std::size_t(1));
+        WINTOAST_CHECK_EQUAL(snapshot.failuresByResult[0].first, Failed);
+
+        // One session per failure: opened, dropped, opened again.
+        WINTOAST_CHECK_EQUAL(snapshot.stages[WinToastStats::FactoryLookup].count, std::uint64_t(2));
+        WINTOAST_CHECK_EQUAL(snapshot.stages[WinToastStats::NotifierCreation].count, std::uint64_t(2));
+        // The failing call built its notification before Show failed.
+        WINTOAST_CHECK_EQUAL(snapshot.stages[WinToastStats::NotificationCreation].count, std::uint64_t(12));
+        WINTOAST_CHECK_EQUAL(snapshot.stages[WinToastStats::HandlerWiring].count, std::uint64_t(12));
+        WINTOAST_CHECK_EQUAL(snapshot.stages[WinToastStats::Show].count, std::uint64_t(11));
+
+        WINTOAST_CHECK_EQUAL(snapshot.outcomes[WinToastStats::Activated], std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(snapshot.outcomes[WinToastStats::ActionActivated], std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(snapshot.outcomes[WinToastStats::DismissedTimedOut], std::uint64_t(1));
+        WINTOAST_CHECK_EQUAL(snapshot.outcomes[WinToastStats::DismissedUserCanceled], std::uint64_t(0));
+        WINTOAST_CHECK_EQUAL(snapshot.outcomes[WinToastStats::Failed], std::uint64_t(1));
+
+        std::wostringstream text;
+        snapshot.write(text);
+        WINTOAST_CHECK(text.str().find(L"sends 12, shown 11, failed 1") != std::wstring::npos);
+        WINTOAST_CHECK(text.str().find(L"hr 0x80004005: 1") != std::wstring::npos);
+        WINTOAST_CHECK(text.str().find(L"dismissed-timed-out=1") != std::wstring::npos);
+        WINTOAST_CHECK(text.str().find(L"\nshow ") != std::wstring::npos);
+#else
+        // Compiled out: nothing is recorded anywhere.
+        WINTOAST_CHECK(tenant.stats() == nullptr);
+        WINTOAST_CHECK_EQUAL(backend->counters().shows, std::size_t(11));
+#endif
+    });
+}
@@ -0,0 +1,187 @@
+#include "wintoasttest.h"
+#include "wintoastbackend.h"
+#include "wintoastdispatch.h"
+#include "wintoastpayload.h"
+#include "wintoastregistry.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace WinToastLib;
+
+namespace {
+    class CountingHandler : public IWinToastHandler {
+    public:
+        void toastActivated() const override { _outcomes++; }
+        void toastActivated(int) const override { _outcomes++; }
+        void toastDismissed(WinToastDismissalReason) const override { _outcomes++; }
+        void toastFailed() const override { _outcomes++; }
+        inline std::uint64_t outcomes() const { return _outcomes.load(); }
+
+    private:
+        mutable std::atomic<std::uint64_t> _outcomes{ 0 };
+    };
+
+    // Shown toasts waiting for the platform to report an outcome.
+    class PendingOutcomes {
+    public:
+        void push(_In_ WinToastNotificationHandle notification) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _notifications.push_back(std::move(notification));
+        }
+
+        bool pop(_Out_ WinToastNotificationHandle& notification) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_notifications.empty()) {
+                return false;
+            }
+            notification = std::move(_notifications.front());
+            _notifications.pop_front();
+            return true;
+        }
+
+    private:
+        std::mutex                              _mutex;
+        std::deque<WinToastNotificationHandle>  _notifications;
+    };
+}
+
+void WinToastTestSuite::addStressCases() {
+    add("stress.send", [] {
+        // The shared send path from many threads at once, the way WinToast runs
+        // it: one prototype cache, registry, notifier and dispatcher for every
+        // sender. Outcomes arrive on other threads while toasts are still going
+        // out, tagged toasts replace each other, and an expirer sweeps the
+        // registry. Meant to be run under ThreadSanitizer as well.
+        const int Senders = 8;
+        const int ToastsPerSender = 4000;
+        const int Tags = 16;
+        WinToastPrototypeCache prototypes;
+        auto registry = std::make_shared<WinToastRegistry>();
+        auto backend = std::make_shared<WinToastMemoryBackend>();
+        WinToastDispatcher::Options options;
+        options.mode = WinToastDispatcher::ThreadPool;
+        options.threads = 3;
+        options.capacity = std::size_t(1) << 17;
+        auto dispatcher = std::make_shared<WinToastDispatcher>(options);
+        auto handler = std::make_shared<CountingHandler>();
+        std::weak_ptr<WinToastRegistry> weak = registry;
+        WINTOAST_CHECK(backend->openSession(L"WinToast.Test") >= 0);
+
+        PendingOutcomes pending;
+        std::atomic<int> sendersLeft{ Senders };
+        std::atomic<std::uint64_t> reported{ 0 };
+        std::atomic<std::uint64_t> superseded{ 0 };
+        std::atomic<std::uint64_t> failedSends{ 0 };
+        std::vector<std::vector<std::int64_t>> ids(Senders);
+        std::vector<std::thread> threads;
+        for (int s = 0; s < Senders; s++) {
+            threads.emplace_back([&, s] {
+                std::wstring xml;
+                for (int i = 0; i < ToastsPerSender; i++) {
+                    WinToastTemplate toast(WinToastTemplate::Text02);
+                    toast.setTextField(L"Sender " + std::to_wstring(s), WinToastTemplate::FirstLine)
+                         .setTextField(L"Toast " + std::to_wstring(i), WinToastTemplate::SecondLine);
+                    const bool tagged = i % 3 == 0;
+                    if (tagged) {
+                        toast.setTag(std::to_wstring((s + i) % Tags)).setGroup(L"stress");
+                    }
+                    WinToastPayload::compile(*prototypes.get(toast.type(), true), toast, xml);
+
+                    const std::int64_t id = registry->nextId();
+                    ids[s].push_back(id);
+                    registry->reserve(id, i % 5 == 0 ? id : WinToastRegistry::NoExpiration);
+                    std::shared_ptr<IWinToastHandler> forwarder = std::make_shared<WinToastDispatchingHandler>(dispatcher, handler, id,
+                        [weak](const WinToastOutcome& outcome) {
+                            if (auto live = weak.lock()) {
+                                live->erase(outcome.toastId);
+                            }
+                        });
+                    WinToastNotificationHandle notification;
+                    const long hr = tagged
+                        ? backend->showTagged(xml, 0, toast.tag(), toast.group(), WinToastNotificationData(), forwarder, notification)
+                        : backend->show(xml, 0, forwarder, notification);
+                    if (hr < 0) {
+                        registry->erase(id);
+                        failedSends++;
+                        continue;
+                    }
+                    if (tagged) {
+                        WinToastRegistry::Superseded older;
+                        if (registry->bindTag(id, IWinToastBackend::tagKey(toast.tag(), toast.group()), forwarder, older)) {
+                            older.handler->toastDismissed(IWinToastHandler::ApplicationHidden);
+                            superseded++;
+                        }
+                    }
+                    registry->attach(id, notification);
+                    pending.push(std::move(notification));
+                }
+                sendersLeft--;
+            });
+        }
+        for (int p = 0; p < 2; p++) {
+            threads.emplace_back([&, p] {
+                std::uint64_t n = p;
+                for (;;) {
+                    WinToastNotificationHandle notification;
+                    if (!pending.pop(notification)) {
+                        if (sendersLeft.load() == 0 && !pending.pop(notification)) {
+                            return;
+                        }
+                        if (!notification) {
+                            std::this_thread::yield();
+                            continue;
+                        }
+                    }
+                    switch (n++ % 3) {
+                    case 0:  backend->dismiss(notification, IWinToastHandler::UserCanceled); break;
+                    case 1:  backend->activate(notification, 0);                             break;
+                    default: backend->fail(notification);                                    break;
+                    }
+                    reported++;
+                }
+            });
+        }
+        std::atomic<bool> expiring{ true };
+        std::thread expirer([&] {
+            while (expiring.load()) {
+                registry->expire(registry->nextId());
+                std::this_thread::yield();
+            }
+        });
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        expiring = false;
+        expirer.join();
+
+        // Every toast reached an outcome, so nothing is left behind.
+        WINTOAST_CHECK_EQUAL(failedSends.load(), std::uint64_t(0));
+        WINTOAST_CHECK_EQUAL(reported.load(), std::uint64_t(Senders * ToastsPerSender));
+        WINTOAST_CHECK_EQUAL(registry->size(), std::size_t(0));
+        WINTOAST_CHECK_EQUAL(registry->tagged(), std::size_t(0));
+        WINTOAST_CHECK(registry->highWaterMark() > 0);
+
+        // Ids are unique across all senders.
+        std::vector<std::int64_t> all;
+        for (const auto& own : ids) {
+            WINTOAST_CHECK(std::is_sorted(own.begin(), own.end()));
+            all.insert(all.end(), own.begin(), own.end());
+        }
+        std::sort(all.begin(), all.end());
+        WINTOAST_CHECK(std::adjacent_find(all.begin(), all.end()) == all.end());
+
+        // Each outcome reached the handler once, through the dispatcher's workers.
+        const std::uint64_t expected = reported.load() + superseded.load();
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (handler->outcomes() < expected && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const WinToastDispatcher::Counters counters = dispatcher->counters();
+        WINTOAST_CHECK_EQUAL(counters.dropped, std::uint64_t(0));
+        WINTOAST_CHECK_EQUAL(counters.posted, expected);
+        WINTOAST_CHECK_EQUAL(handler->outcomes(), expected);
+    });
+}
@@ -0,0 +1,396 @@
+#include "wintoasttest.h"
+#include "wintoastbackend.h"
+#include "wintoastclock.h"
+#include "wintoaststats.h"
+#include "wintoasttrace.h"
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <thread>
+
+using namespace WinToastLib;
+
+namespace {
+    // Just enough of a strict JSON reader to check what the tracer writes: any
+    // syntax error, trailing garbage or unknown escape fails the parse.
+    struct JsonValue {
+        enum Type { Null, Bool, Number, String, Array, Object };
+
+        Type                                            type = Null;
+        bool                                            boolean = false;
+        double                                          number = 0;
+        std::string                                     text;
+        std::vector<JsonValue>                          items;
+        std::vector<std::pair<std::string, JsonValue>>  members;
+
+        const JsonValue* member(_In_ const std::string& name) const {
+            for (const auto& entry : members) {
+                if (entry.first == name) {
+                    return &entry.second;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    class JsonParser {
+    public:
+        explicit JsonParser(_In_ const std::string& text) : _text(text) {}
+
+        bool parse(_Out_ JsonValue& value) {
+            _pos = 0;
+            if (!parseValue(value, 0)) {
+                return false;
+            }
+            skipSpace();
+            return _pos == _text.size();
+        }
+
+    private:
+        static const int MaxDepth = 64;
+
+        void skipSpace() {
+            while (_pos < _text.size() && (_text[_pos] == ' ' || _text[_pos] == '\t' || _text[_pos] == '\n' || _text[_pos] == '\r')) {
+                _pos++;
+            }
+        }
+
+        bool consume(_In_ const char* literal) {
+            const std::size_t length = std::char_traits<char>::length(literal);
+            if (_text.compare(_pos, length, literal) != 0) {
+                return false;
+            }
+            _pos += length;
+            return true;
+        }
+
+        bool parseValue(_Out_ JsonValue& value, _In_ int depth) {
+            skipSpace();
+            if (_pos >= _text.size() || depth > MaxDepth) {
+                return false;
+            }
+            switch (_text[_pos]) {
+            case '{':
+                return parseObject(value, depth);
+            case '[':
+                return parseArray(value, depth);
+            case '"':
+                value.type = JsonValue::String;
+                return parseString(value.text);
+            case 't':
+                value.type = JsonValue::Bool;
+                value.boolean = true;
+                return consume("true");
+            case 'f':
+                value.type = JsonValue::Bool;
+                return consume("false");
+            case 'n':
+                value.type = JsonValue::Null;
+                return consume("null");
+            default:
+                return parseNumber(value);
+            }
+        }
+
+        bool parseObject(_Out_ JsonValue& value, _In_ int depth) {
+            value.type = JsonValue::Object;
+            _pos++;
+            skipSpace();
+            if (consume("}")) {
+                return true;
+            }
+            for (;;) {
+                skipSpace();
+                std::string name;
+                if (_pos >= _text.size() || _text[_pos] != '"' || !parseString(name)) {
+                    return false;
+                }
+                skipSpace();
+                if (!consume(":")) {
+                    return false;
+                }
+                value.members.emplace_back(std::move(name), JsonValue());
+                if (!parseValue(value.members.back().second, depth + 1)) {
+                    return false;
+                }
+                skipSpace();
+                if (consume("}")) {
+                    return true;
+                }
+                if (!consume(",")) {
+                    return false;
+                }
+            }
+        }
+
+        bool parseArray(_Out_ JsonValue& value, _In_ int depth) {
+            value.type = JsonValue::Array;
+            _pos++;
+            skipSpace();
+            if (consume("]")) {
+                return true;
+            }
+            for (;;) {
+                value.items.emplace_back();
+                if (!parseValue(value.items.back(), depth + 1)) {
+                    return false;
+                }
+                skipSpace();
+                if (consume("]")) {
+                    return true;
+                }
+                if (!consume(",")) {
+                    return false;
+                }
+            }
+        }
+
+        bool parseString(_Out_ std::string& text) {
+            _pos++;
+            while (_pos < _text.size()) {
+                const char c = _text[_pos++];
+                if (c == '"') {
+                    return true;
+                }
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    return false;
+                }
+                if (c != '\\') {
+                    text.push_back(c);
+                    continue;
+                }
+                if (_pos >= _text.size()) {
+                    return false;
+                }
+                const char escaped = _text[_pos++];
+                switch (escaped) {
+                case '"':  text.push_back('"');  break;
+                case '\\': text.push_back('\\'); break;
+                case '/':  text.push_back('/');  break;
+                case 'b':  text.push_back('\b'); break;
+                case 'f':  text.push_back('\f'); break;
+                case 'n':  text.push_back('\n'); break;
+                case 'r':  text.push_back('\r'); break;
+                case 't':  text.push_back('\t'); break;
+                case 'u': {
+                    // Only ASCII comes back from the tracer; keep the low byte.
+                    if (_pos + 4 > _text.size()) {
+                        return false;
+                    }
+                    char* end = nullptr;
+                    const std::string digits = _text.substr(_pos, 4);
+                    const long code = std::strtol(digits.c_str(), &end, 16);
+                    if (end != digits.c_str() + 4) {
+                        return false;
+                    }
+                    text.push_back(static_cast<char>(code & 0x7f));
+                    _pos += 4;
+                    break;
+                }
+                default:
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        bool parseNumber(_Out_ JsonValue& value) {
+            // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+            const std::size_t start = _pos;
+            auto digits = [this] {
+                const std::size_t from = _pos;
+                while (_pos < _text.size() && _text[_pos] >= '0' && _text[_pos] <= '9') {
+                    _pos++;
+                }
+                return _pos - from;
+            };
+            if (_pos < _text.size() && _text[_pos] == '-') {
+                _pos++;
+            }
+            const std::size_t integer = _pos;
+            const std::size_t integerDigits = digits();
+            if (integerDigits == 0 || (integerDigits > 1 && _text[integer] == '0')) {
+                return false;
+            }
+            if (_pos < _text.size() && _text[_pos] == '.') {
+                _pos++;
+                if (digits() == 0) {
+                    return false;
+                }
+            }
+            if (_pos < _text.size() && (_text[_pos] == 'e' || _text[_pos] == 'E')) {
+                _pos++;
+                if (_pos < _text.size() && (_text[_pos] == '+' || _text[_pos] == '-')) {
+                    _pos++;
+                }
+                if (digits() == 0) {
+                    return false;
+                }
+            }
+            value.type = JsonValue::Number;
+            value.number = std::strtod(_text.substr(start, _pos - start).c_str(), nullptr);
+            return true;
+        }
+
+        const std::string&  _text;
+        std::size_t         _pos = 0;
+    };
+
+    // The events of a closed tracer's document, after checking the envelope.
+    std::vector<JsonValue> traceEvents(_In_ const std::string& document) {
+        JsonValue root;
+        WINTOAST_CHECK(JsonParser(document).parse(root));
+        WINTOAST_CHECK(root.type == JsonValue::Object);
+        const JsonValue* unit = root.member("displayTimeUnit");
+        WINTOAST_CHECK(unit && unit->type == JsonValue::String && unit->text == "ms");
+        const JsonValue* events = root.member("traceEvents");
+        WINTOAST_CHECK(events && events->type == JsonValue::Array);
+        return events->items;
+    }
+
+    bool isNumber(_In_opt_ const JsonValue* value) {
+        return value && value->type == JsonValue::Number;
+    }
+
+    bool isString(_In_opt_ const JsonValue* value, _In_ const char* text) {
+        return value && value->type == JsonValue::String && value->text == text;
+    }
+}
+
+void WinToastTestSuite::addTraceCases() {
+    add("trace.json.parser", [] {
+        // The checker has to reject what a viewer would, or the cases below prove nothing.
+        JsonValue value;
+        WINTOAST_CHECK(JsonParser("{\"a\":[1,-2.5e3,\"x\\\"y\",true,null,{}]}").parse(value));
+        const char* const Broken[] = {
+            "", "{", "{\"a\":1,}", "[1,]", "[1 2]", "{\"a\" 1}", "\"a\nb\"", "\"\\q\"", "01", "1.", "[1]]", "{\"a\":1}x"
+        };
+        for (const char* text : Broken) {
+            WINTOAST_CHECK(!JsonParser(text).parse(value));
+        }
+    });
+
+    add("trace.json.empty", [] {
+        std::ostringstream out;
+        {
+            WinToastTracer tracer(out);
+        }
+        WINTOAST_CHECK(traceEvents(out.str()).empty());
+    });
+
+    add("trace.json.events", [] {
+        // Names and details are written as JSON strings; control characters are dropped.
+        std::ostringstream out;
+        auto clock = std::make_shared<WinToastManualClock>(1000);
+        WinToastTracer tracer(out, WinToastTracer::Options(), clock);
+        clock->advance(5);
+        tracer.instant("say \"hi\"", 7, "C:\\path\nnext");
+        tracer.complete("span", 1, 3);
+        tracer.flowStart(7);
+        tracer.flowEnd(7);
+        tracer.close();
+        tracer.instant("late");
+
+        const std::vector<JsonValue> events = traceEvents(out.str());
+        WINTOAST_CHECK_EQUAL(events.size(), std::size_t(4));
+        WINTOAST_CHECK(isString(events[0].member("name"), "say \"hi\""));
+        WINTOAST_CHECK(isString(events[0].member("ph"), "i"));
+        WINTOAST_CHECK_EQUAL(events[0].member("ts")->number, 5.0);
+        const JsonValue* args = events[0].member("args");
+        WINTOAST_CHECK(args && isNumber(args->member("id")) && args->member("id")->number == 7);
+        WINTOAST_CHECK(isString(args->member("detail"), "C:\\pathnext"));
+        WINTOAST_CHECK(isString(events[1].member("ph"), "X"));
+        WINTOAST_CHECK_EQUAL(events[1].member("dur")->number, 3.0);
+        WINTOAST_CHECK(events[1].member("args") == nullptr);
+        WINTOAST_CHECK(isString(events[3].member("bp"), "e"));
+        WINTOAST_CHECK_EQUAL(tracer.counters().recorded, std::uint64_t(4));
+    });
+
+    add("trace.json.threads", [] {
+        // Senders on several threads, outcomes on others, small buffers so the
+        // flusher runs while they record. The document must still parse, every
+        // event must be complete, and every flow must end after it starts.
+        const int Senders = 4;
+        const int ToastsPerSender = 200;
+        std::ostringstream out;
+        WinToastTracer::Options options;
+        options.flushIntervalMilliseconds = 5;
+        options.bufferEvents = 16;
+        auto tracer = std::make_shared<WinToastTracer>(out, options);
+        auto backend = std::make_shared<WinToastMemoryBackend>();
+        backend->setTracer(tracer);
+        backend->openSession(L"WinToast.Test");
+        std::vector<std::thread> threads;
+        for (int t = 0; t < Senders; t++) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < ToastsPerSender; i++) {
+                    const std::int64_t id = t * 1000 + i;
+                    WinToastStageTimer timer(nullptr, tracer.get(), id);
+                    WinToastNotificationHandle notification;
+                    backend->show(L"<toast/>", 0, nullptr, notification);
+                    tracer->flowStart(id);
+                    timer.lap(WinToastStats::Send);
+                    std::thread([&tracer, id] {
+                        const std::int64_t start = tracer->now();
+                        tracer->flowEnd(id);
+                        tracer->complete("activated", start, tracer->now() - start, id);
+                    }).join();
+                }
+                tracer->instant("rate-dropped", 5);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        tracer->close();
+        const WinToastTracer::Counters counters = tracer->counters();
+        WINTOAST_CHECK_EQUAL(counters.written, counters.recorded);
+
+        const std::vector<JsonValue> events = traceEvents(out.str());
+        WINTOAST_CHECK_EQUAL(static_cast<std::uint64_t>(events.size()), counters.recorded);
+        std::map<double, double> flowStarts;
+        std::map<double, double> flowEnds;
+        std::set<double> threadIds;
+        for (const JsonValue& event : events) {
+            WINTOAST_CHECK(event.type == JsonValue::Object);
+            const JsonValue* name = event.member("name");
+            const JsonValue* phase = event.member("ph");
+            WINTOAST_CHECK(name && name->type == JsonValue::String && !name->text.empty());
+            WINTOAST_CHECK(isString(event.member("cat"), "wintoast"));
+            WINTOAST_CHECK(phase && phase->type == JsonValue::String && phase->text.size() == 1);
+            WINTOAST_CHECK(isNumber(event.member("ts")) && event.member("ts")->number >= 0);
+            WINTOAST_CHECK(isNumber(event.member("pid")));
+            WINTOAST_CHECK(isNumber(event.member("tid")));
+            threadIds.insert(event.member("tid")->number);
+            switch (phase->text[0]) {
+            case 'X':
+                WINTOAST_CHECK(isNumber(event.member("dur")) && event.member("dur")->number >= 0);
+                break;
+            case 'i':
+                WINTOAST_CHECK(isString(event.member("s"), "t"));
+                break;
+            case 's':
+            case 'f': {
+                WINTOAST_CHECK(isString(name, "toast"));
+                WINTOAST_CHECK(isNumber(event.member("id")));
+                auto& flows = phase->text[0] == 's' ? flowStarts : flowEnds;
+                WINTOAST_CHECK(flows.emplace(event.member("id")->number, event.member("ts")->number).second);
+                if (phase->text[0] == 'f') {
+                    WINTOAST_CHECK(isString(event.member("bp"), "e"));
+                }
+                break;
+            }
+            default:
+                WINTOAST_CHECK(!"unexpected phase");
+            }
+        }
+        WINTOAST_CHECK_EQUAL(flowStarts.size(), std::size_t(Senders * ToastsPerSender));
+        WINTOAST_CHECK_EQUAL(flowEnds.size(), flowStarts.size());
+        for (const auto& start : flowStarts) {
+            auto end = flowEnds.find(start.first);
+            WINTOAST_CHECK(end != flowEnds.end() && end->second >= start.second);
+        }
+        // Each sender and each outcome thread got its own tid.
+        WINTOAST_CHECK(threadIds.size() > static_cast<std::size_t>(Senders));
+    });
+}
@@ -0,0 +1,210 @@
+#include "wintoasttrace.h"
+#include <algorithm>
+
+using namespace WinToastLib;
+
+namespace {
+    const char* const TraceCategory = "wintoast";
+    const char* const FlowName = "toast";
+
+    // Distinguishes tracers in the per-thread buffer cache, even when one is
+    // allocated where a destroyed one used to be.
+    std::atomic<std::uint64_t> nextTracerSerial{ 1 };
+
+    void writeString(_Inout_ std::ostream& out, _In_ const char* value) {
+        out << '"';
+        for (const char* c = value; *c; c++) {
+            if (*c == '"' || *c == '\\') {
+                out << '\\' << *c;
+            } else if (static_cast<unsigned char>(*c) >= 0x20) {
+                out << *c;
+            }
+        }
+        out << '"';
+    }
+}
+
+WinToastTracer::WinToastTracer(_Inout_ std::ostream& out) : WinToastTracer(out, Options()) {}
+
+WinToastTracer::WinToastTracer(_Inout_ std::ostream& out, _In_ const Options& options, _In_opt_ std::shared_ptr<IWinToastClock> clock) :
+    _options(options),
+    _clock(clock ? std::move(clock) : WinToastSteadyClock::instance()),
+    _origin(_clock->nowMicroseconds()),
+    _serial(nextTracerSerial.fetch_add(1)),
+    _out(out)
+{
+    _options.bufferEvents = std::max<std::size_t>(_options.bufferEvents, 1);
+    _out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    _flusher = std::thread(&WinToastTracer::flushLoop, this);
+}
+
+WinToastTracer::~WinToastTracer() {
+    close();
+}
+
+void WinToastTracer::complete(_In_ const char* name, _In_ std::int64_t startMicroseconds, _In_ std::int64_t durationMicroseconds,
+                              _In_ std::int64_t toastId, _In_opt_ const char* detail) {
+    record('X', name, detail, startMicroseconds, durationMicroseconds, toastId);
+}
+
+void WinToastTracer::instant(_In_ const char* name, _In_ std::int64_t toastId, _In_opt_ const char* detail) {
+    record('i', name, detail, now(), 0, toastId);
+}
+
+void WinToastTracer::flowStart(_In_ std::int64_t toastId) {
+    record('s', FlowName, nullptr, now(), 0, toastId);
+}
+
+void WinToastTracer::flowEnd(_In_ std::int64_t toastId) {
+    record('f', FlowName, nullptr, now(), 0, toastId);
+}
+
+void WinToastTracer::record(_In_ char phase, _In_ const char* name, _In_opt_ const char* detail,
+                            _In_ std::int64_t timestamp, _In_ std::int64_t duration, _In_ std::int64_t toastId) {
+    if (_closed.load(std::memory_order_acquire)) {
+        return;
+    }
+    ThreadBuffer& buffer = threadBuffer();
+    bool full = false;
+    {
+        // Only ever contended by the flusher swapping the vector out.
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.events.push_back(Event{ phase, name, detail, timestamp, duration, toastId, buffer.thread });
+        full = buffer.events.size() >= _options.bufferEvents;
+    }
+    _recorded.fetch_add(1, std::memory_order_relaxed);
+    if (full) {
+        {
+            std::lock_guard<std::mutex> lock(_wakeMutex);
+            _wakeRequested = true;
+        }
+        _wakeup.notify_one();
+    }
+}
+
+WinToastTracer::ThreadBuffer& WinToastTracer::threadBuffer() {
+    // Buffers are owned by the tracer, so the cached pointers stay valid for as
+    // long as a tracer with that serial exists.
+    static thread_local std::vector<std::pair<std::uint64_t, ThreadBuffer*>> cache;
+    for (const auto& entry : cache) {
+        if (entry.first == _serial) {
+            return *entry.second;
+        }
+    }
+    auto buffer = std::make_shared<ThreadBuffer>();
+    buffer->events.reserve(_options.bufferEvents);
+    buffer->spare.reserve(_options.bufferEvents);
+    {
+        std::lock_guard<std::mutex> lock(_buffersMutex);
+        buffer->thread = static_cast<std::uint32_t>(_buffers.size() + 1);
+        _buffers.push_back(buffer);
+    }
+    if (cache.size() >= 8) {
+        cache.erase(cache.begin());
+    }
+    cache.emplace_back(_serial, buffer.get());
+    return *buffer;
+}
+
+void WinToastTracer::flushLoop() {
+    std::unique_lock<std::mutex> lock(_wakeMutex);
+    while (!_closed.load(std::memory_order_acquire)) {
+        _wakeup.wait_for(lock, std::chrono::milliseconds(_options.flushIntervalMilliseconds), [this] {
+            return _wakeRequested || _closed.load(std::memory_order_acquire);
+        });
+        _wakeRequested = false;
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+void WinToastTracer::flush() {
+    if (!_closed.load(std::memory_order_acquire)) {
+        drain();
+    }
+}
+
+void WinToastTracer::drain() {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(_buffersMutex);
+        buffers = _buffers;
+    }
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    for (const auto& buffer : buffers) {
+        {
+            // The spare keeps its capacity, so after the first round neither side
+            // allocates.
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            buffer->events.swap(buffer->spare);
+        }
+        for (const Event& event : buffer->spare) {
+            write(event);
+        }
+        _written.fetch_add(buffer->spare.size(), std::memory_order_relaxed);
+        buffer->spare.clear();
+    }
+    _out.flush();
+}
+
+void WinToastTracer::write(_In_ const Event& event) {
+    _out << (_firstEvent ? "\n" : ",\n");
+    _firstEvent = false;
+    _out << "{\"name\":";
+    writeString(_out, event.name);
+    _out << ",\"cat\":\"" << TraceCategory << "\",\"ph\":\"" << event.phase << "\",\"ts\":" << event.timestamp
+         << ",\"pid\":1,\"tid\":" << event.thread;
+    switch (event.phase) {
+    case 'X':
+        _out << ",\"dur\":" << event.duration;
+        break;
+    case 'i':
+        _out << ",\"s\":\"t\"";
+        break;
+    case 'f':
+        // Bind to the enclosing span (the outcome callback), not the next one.
+        _out << ",\"bp\":\"e\"";
+        break;
+    }
+    if (event.phase == 's' || event.phase == 'f') {
+        _out << ",\"id\":" << event.toastId;
+    } else if (event.toastId >= 0 || event.detail) {
+        _out << ",\"args\":{";
+        if (event.toastId >= 0) {
+            _out << "\"id\":" << event.toastId << (event.detail ? "," : "");
+        }
+        if (event.detail) {
+            _out << "\"detail\":";
+            writeString(_out, event.detail);
+        }
+        _out << "}";
+    }
+    _out << "}";
+}
+
+void WinToastTracer::close() {
+    {
+        std::lock_guard<std::mutex> lock(_wakeMutex);
+        if (_closed.exchange(true)) {
+            return;
+        }
+    }
+    _wakeup.notify_one();
+    if (_flusher.joinable()) {
+        _flusher.join();
+    }
+    drain();
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    _out << "\n]}\n";
+    _out.flush();
+}
+
+WinToastTracer::Counters WinToastTracer::counters() const {
+    Counters counters = {};
+    counters.recorded = _recorded.load(std::memory_order_relaxed);
+    counters.written = _written.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(_buffersMutex);
+    counters.threads = _buffers.size();
+    return counters;
+}
@@ -0,0 +1,103 @@
+#ifndef WINTOASTTRACE_H
+#define WINTOASTTRACE_H
+#include "wintoastclock.h"
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace WinToastLib {
+
+    // Writes the toast lifecycle as trace-event JSON (the chrome://tracing and
+    // Perfetto "JSON Array/Object" format): a span per send stage, and a flow
+    // arrow from each toast's send to the callback that reported its outcome, on
+    // whichever thread that arrived.
+    //
+    // Every thread appends to its own buffer, so tracing adds no lock shared
+    // between senders; a background thread drains the buffers into the stream
+    // every flushIntervalMilliseconds, or sooner when a buffer fills up. Buffers
+    // are kept until the tracer goes away, so a thread keeps its tid. Event names
+    // must be string literals (or otherwise outlive the tracer).
+    class WinToastTracer {
+    public:
+        struct Options {
+            std::int64_t        flushIntervalMilliseconds = 100;
+            std::size_t         bufferEvents = 4096;    // per thread; a full buffer wakes the flusher
+        };
+
+        struct Counters {
+            std::uint64_t       recorded;
+            std::uint64_t       written;
+            std::size_t         threads;
+        };
+
+        // Starts the JSON document on out. out must outlive the tracer.
+        WinToastTracer(_Inout_ std::ostream& out);
+        WinToastTracer(_Inout_ std::ostream& out, _In_ const Options& options, _In_opt_ std::shared_ptr<IWinToastClock> clock = nullptr);
+        // Same as close().
+        ~WinToastTracer();
+
+        // A finished span ("X" event).
+        void                    complete(_In_ const char* name, _In_ std::int64_t startMicroseconds, _In_ std::int64_t durationMicroseconds,
+                                         _In_ std::int64_t toastId = -1, _In_opt_ const char* detail = nullptr);
+        // A point in time ("i" event) on the calling thread.
+        void                    instant(_In_ const char* name, _In_ std::int64_t toastId = -1, _In_opt_ const char* detail = nullptr);
+        // Flow arrow for toastId: begin inside the sending span, end inside the
+        // span of the outcome callback.
+        void                    flowStart(_In_ std::int64_t toastId);
+        void                    flowEnd(_In_ std::int64_t toastId);
+
+        inline std::int64_t     now() const { return _clock->nowMicroseconds() - _origin; }
+        // Writes everything recorded so far.
+        void                    flush();
+        // Stops the flusher, writes the rest and closes the JSON document. Later
+        // events are dropped.
+        void                    close();
+        Counters                counters() const;
+
+    private:
+        struct Event {
+            char                phase;
+            const char*         name;
+            const char*         detail;
+            std::int64_t        timestamp;
+            std::int64_t        duration;
+            std::int64_t        toastId;
+            std::uint32_t       thread;
+        };
+
+        struct ThreadBuffer {
+            std::mutex          mutex;
+            std::vector<Event>  events;
+            std::vector<Event>  spare;              // being written out; guarded by _writeMutex
+            std::uint32_t       thread;
+        };
+
+        void                    record(_In_ char phase, _In_ const char* name, _In_opt_ const char* detail,
+                                       _In_ std::int64_t timestamp, _In_ std::int64_t duration, _In_ std::int64_t toastId);
+        ThreadBuffer&           threadBuffer();
+        void                    flushLoop();
+        void                    drain();
+        void                    write(_In_ const Event& event);
+
+        Options                             _options;
+        std::shared_ptr<IWinToastClock>     _clock;
+        std::int64_t                        _origin;
+        std::uint64_t                       _serial;
+        std::ostream&                       _out;
+        bool                                _firstEvent = true;
+
+        mutable std::mutex                  _buffersMutex;
+        std::vector<std::shared_ptr<ThreadBuffer>> _buffers;
+        std::mutex                          _writeMutex;            // the stream and _firstEvent
+        std::mutex                          _wakeMutex;
+        std::condition_variable             _wakeup;
+        bool                                _wakeRequested = false;
+        std::atomic<bool>                   _closed{ false };
+        std::atomic<std::uint64_t>          _recorded{ 0 };
+        std::atomic<std::uint64_t>          _written{ 0 };
+        std::thread                         _flusher;
+    };
+}
+#endif // WINTOASTTRACE_H